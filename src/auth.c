@@ -0,0 +1,190 @@
+/*
+** auth.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "auth.h"
+#include "epoch.h"
+
+/* Changes to the directory of the authfile that may have changed the file */
+#define AUTH_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+/* Size of the buffer inotify events are read into, enough for many events
+ * with the longest names */
+#define AUTH_EVENT_BUFFER_SIZE 4096
+
+char* auth_read_line(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, file);
+    fclose(file);
+    if (length <= 0) {
+        free(line);
+	return NULL;
+    }
+    if (line[length - 1] == '\n') {
+        line[length - 1] = '\0';
+    }
+    return line;
+}
+
+/* Reads the authfile into a new version of the authentication string.
+ * Returns NULL if the file cannot be read or its first line is empty */
+static AuthSecret* read_secret(const char* path) {
+    char* line = auth_read_line(path);
+    if (line == NULL || line[0] == '\0') {
+        free(line);
+	return NULL;
+    }
+    size_t length = strlen(line);
+    AuthSecret* secret = malloc(sizeof(AuthSecret) + length + 1);
+    if (secret != NULL) {
+        secret->length = length;
+	secret->retired = 0;
+	secret->nextRetired = NULL;
+	memcpy(secret->value, line, length + 1);
+    }
+    free(line);
+    return secret;
+}
+
+Authenticator* auth_load(const char* path) {
+    AuthSecret* secret = read_secret(path);
+    if (secret == NULL) {
+        return NULL;
+    }
+    Authenticator* auth = calloc(1, sizeof(Authenticator));
+    auth->path = strdup(path);
+    auth->current = secret;
+    pthread_mutex_init(&(auth->reloadLock), NULL);
+    auth->watchFd = -1;
+    return auth;
+}
+
+bool auth_check(Authenticator* auth, const char* given) {
+    epoch_enter();
+    AuthSecret* secret = __atomic_load_n(&(auth->current), __ATOMIC_ACQUIRE);
+
+    // Every character given is compared, wrapping round the secret if it is
+    // longer, and the differences are only looked at once all are found
+    size_t givenLength = strlen(given);
+    unsigned int difference = givenLength != secret->length;
+    for (size_t i = 0; i < givenLength; i++) {
+        difference |= (unsigned char)given[i]
+		^ (unsigned char)secret->value[i % secret->length];
+    }
+    epoch_exit();
+    return difference == 0;
+}
+
+/* Frees the retired versions of the string no reader can still be using.
+ * The reload lock must be held */
+static void reclaim_secrets(Authenticator* auth) {
+    epoch_advance();
+    AuthSecret** link = &(auth->retired);
+    while (*link != NULL) {
+        AuthSecret* secret = *link;
+	if (epoch_reclaimable(secret->retired)) {
+	    *link = secret->nextRetired;
+	    free(secret);
+	} else {
+	    link = &(secret->nextRetired);
+	}
+    }
+}
+
+bool auth_reload(Authenticator* auth) {
+    AuthSecret* secret = read_secret(auth->path);
+    pthread_mutex_lock(&(auth->reloadLock));
+    reclaim_secrets(auth);
+    AuthSecret* old = auth->current;
+    if (secret == NULL || (secret->length == old->length
+	    && memcmp(secret->value, old->value, old->length) == 0)) {
+	pthread_mutex_unlock(&(auth->reloadLock));
+	free(secret);
+	return false;
+    }
+
+    // Readers that loaded the old version may still be comparing against it
+    __atomic_store_n(&(auth->current), secret, __ATOMIC_RELEASE);
+    old->retired = epoch_current();
+    old->nextRetired = auth->retired;
+    auth->retired = old;
+    auth->numReloads++;
+    pthread_mutex_unlock(&(auth->reloadLock));
+    return true;
+}
+
+bool auth_watch(Authenticator* auth) {
+    auth->watchFd = inotify_init1(IN_CLOEXEC);
+    if (auth->watchFd < 0) {
+        return false;
+    }
+
+    // Editors often replace the file rather than write to it, so it is the
+    // directory that is watched
+    char* slash = strrchr(auth->path, '/');
+    char* directory = slash == NULL ? strdup(".")
+	    : strndup(auth->path, slash == auth->path ? 1 : slash - auth->path);
+    int watch = inotify_add_watch(auth->watchFd, directory,
+	    AUTH_WATCH_EVENTS);
+    free(directory);
+    if (watch < 0) {
+        close(auth->watchFd);
+	auth->watchFd = -1;
+	return false;
+    }
+
+    // The thread never handles signals, whatever the caller has blocked
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, auth_watch_thread, auth);
+    pthread_detach(threadId);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return true;
+}
+
+void* auth_watch_thread(void* arg) {
+    Authenticator* auth = (Authenticator*)arg;
+    const char* slash = strrchr(auth->path, '/');
+    const char* name = slash == NULL ? auth->path : slash + 1;
+    char buffer[AUTH_EVENT_BUFFER_SIZE]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t length = read(auth->watchFd, buffer, sizeof(buffer));
+	if (length <= 0) {
+	    continue;
+	}
+
+	// Only reload once for all the events read at once
+	bool changed = false;
+	for (char* next = buffer; next < buffer + length;) {
+	    struct inotify_event* event = (struct inotify_event*)next;
+	    if (event->len > 0 && strcmp(event->name, name) == 0) {
+	        changed = true;
+	    }
+	    next += sizeof(struct inotify_event) + event->len;
+	}
+	if (changed) {
+	    auth_reload(auth);
+	}
+    }
+    return NULL;
+}
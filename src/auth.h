@@ -0,0 +1,118 @@
+/*
+** auth.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* One version of the authentication string, the first line of the authfile
+ * without its newline. A version replaced by a reload is kept on the
+ * retired list, noting the epoch it was retired in, until no reader can
+ * still be comparing against it */
+typedef struct AuthSecret {
+    size_t length;
+    unsigned long long retired;
+    struct AuthSecret* nextRetired;
+    char value[];
+} AuthSecret;
+
+/* The authentication string of a server, read once from path and kept in
+ * memory. current is read without a lock and swapped atomically when the
+ * file is reloaded. reloadLock guards the retired list and serialises
+ * reloads, and numReloads counts the reloads that replaced the string.
+ * watchFd is the inotify instance watching the directory of the file, -1 if
+ * it is not watched */
+typedef struct {
+    char* path;
+    AuthSecret* current;
+    AuthSecret* retired;
+    pthread_mutex_t reloadLock;
+    unsigned long numReloads;
+    int watchFd;
+} Authenticator;
+
+/* auth_read_line()
+* −−−−−−−−−−−−−−−
+* Reads the first line of a file.
+*
+* path: the name of the file to read. Not NULL
+*
+* Returns: the line without its newline, allocated with malloc. NULL if the
+* file cannot be read or is empty
+*/
+char* auth_read_line(const char* path);
+
+/* auth_load()
+* −−−−−−−−−−−−−−−
+* Reads the authentication string from the first line of an authfile.
+*
+* path: the name of the authfile, which is kept to reload it from. Not NULL
+*
+* Returns: the authenticator created with malloc, NULL if the file cannot be
+* read or its first line is empty
+*/
+Authenticator* auth_load(const char* path);
+
+/* auth_check()
+* −−−−−−−−−−−−−−−
+* Checks a string given by a client against the authentication string,
+* without taking a lock.
+*
+* The comparison takes the same time whichever characters differ, so the
+* time taken reveals nothing about the string, only the length of the one
+* given.
+*
+* auth: the authenticator to check against. Not NULL
+* given: the string given by the client. Not NULL
+*
+* Returns: true if the strings match exactly, false otherwise
+*/
+bool auth_check(Authenticator* auth, const char* given);
+
+/* auth_reload()
+* −−−−−−−−−−−−−−−
+* Reads the authfile again and swaps in its first line as the authentication
+* string if it has changed. Requests checked during the swap see either the
+* old or the new string. The old string is kept until no request can still
+* be checking against it.
+*
+* auth: the authenticator to reload. Not NULL
+*
+* Returns: true if the string was replaced, false if it was unchanged or the
+* file could not be read or had an empty first line, leaving the old string
+* in use
+*/
+bool auth_reload(Authenticator* auth);
+
+/* auth_watch()
+* −−−−−−−−−−−−−−−
+* Starts a thread reloading the authentication string whenever the authfile
+* is written, or replaced by another file moved over it. The thread waits
+* with inotify on the directory holding the file, and runs with every signal
+* blocked.
+*
+* auth: the authenticator to keep up to date. Not NULL
+*
+* Returns: true if the file is being watched, false if inotify could not be
+* set up, in which case the string is only reloaded by auth_reload()
+*/
+bool auth_watch(Authenticator* auth);
+
+/* auth_watch_thread()
+* −−−−−−−−−−−−−−−
+* Thread function reading the inotify events of the directory holding an
+* authfile and reloading it when the file changes. Never returns.
+*
+* arg: the Authenticator cast to a void*. Not NULL
+*/
+void* auth_watch_thread(void* arg);
+
+#endif
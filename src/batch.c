@@ -0,0 +1,161 @@
+/*
+** batch.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "batch.h"
+
+/* Number of bytes needed to write the largest item length in decimal */
+#define MAX_LENGTH_DIGITS 20
+
+bool is_batch_request(HttpRequest* httpRequest) {
+    return httpRequest->method[0] == 'M';
+}
+
+/* Counts the keys in a batch body. Returns -1 if the body is malformed,
+ * contains a missing item, is a put without a value for every key, or has
+ * a key no single key request could name: one that is empty or holds a null
+ * byte */
+static long count_keys(HttpRequest* httpRequest,
+	EngineBatchOperation operation) {
+    size_t offset = 0;
+    long numItems = 0;
+    const char* item;
+    size_t itemLength;
+    int result;
+    while ((result = http_next_batch_item(httpRequest->body,
+	    httpRequest->bodyLength, &offset, &item, &itemLength)) == 1) {
+        bool isKey = operation != ENGINE_BATCH_PUT || numItems % 2 == 0;
+	if (item == NULL || (isKey && (itemLength == 0
+		|| memchr(item, '\0', itemLength) != NULL))) {
+	    return -1;
+	}
+	numItems++;
+    }
+    if (result < 0 || (operation == ENGINE_BATCH_PUT && numItems % 2 != 0)) {
+        return -1;
+    }
+    return operation == ENGINE_BATCH_PUT ? numItems / 2 : numItems;
+}
+
+/* Reads the keys (and values) of a request into items, copying each key
+ * null terminated into keys. Values are left in the body of the request */
+static void read_items(HttpRequest* httpRequest,
+	EngineBatchOperation operation, unsigned int expiry, EngineItem* items,
+	size_t numKeys, char* keys) {
+    size_t offset = 0;
+    for (size_t i = 0; i < numKeys; i++) {
+        const char* item;
+	size_t itemLength;
+	http_next_batch_item(httpRequest->body, httpRequest->bodyLength,
+		&offset, &item, &itemLength);
+	memcpy(keys, item, itemLength);
+	keys[itemLength] = '\0';
+	memset(&(items[i]), 0, sizeof(EngineItem));
+	items[i].key = keys;
+	items[i].expiry = expiry;
+	keys += itemLength + 1;
+	if (operation == ENGINE_BATCH_PUT) {
+	    http_next_batch_item(httpRequest->body, httpRequest->bodyLength,
+		    &offset, &(items[i].value), &(items[i].valueLength));
+	}
+    }
+}
+
+/* Sets the response body to the values found by a batch get. Returns false
+ * if memory cannot be allocated */
+static bool get_response_body(EngineItem* items, size_t numKeys,
+	HttpResponse* httpResponse) {
+    size_t bodyLength = 0;
+    for (size_t i = 0; i < numKeys; i++) {
+	bodyLength += items[i].value == NULL ? strlen(HTTP_BATCH_MISSING)
+		: MAX_LENGTH_DIGITS + 1 + items[i].valueLength;
+    }
+    char* body = malloc(bodyLength + 1);
+    if (body == NULL) {
+        return false;
+    }
+    char* end = body;
+    for (size_t i = 0; i < numKeys; i++) {
+	if (items[i].value == NULL) {
+	    end += sprintf(end, HTTP_BATCH_MISSING);
+	} else {
+	    end += sprintf(end, "%zu:", items[i].valueLength);
+	    memcpy(end, items[i].value, items[i].valueLength);
+	    end += items[i].valueLength;
+	}
+    }
+    httpResponse->body = body;
+    httpResponse->bodyLength = end - body;
+    return true;
+}
+
+/* Sets the response body to the result of each key of a batch put or
+ * delete. Returns false if memory cannot be allocated */
+static bool result_response_body(EngineItem* items, size_t numKeys,
+	HttpResponse* httpResponse) {
+    char* body = malloc(numKeys + 1);
+    if (body == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < numKeys; i++) {
+        body[i] = items[i].done ? HTTP_BATCH_DONE : HTTP_BATCH_NOT_DONE;
+    }
+    httpResponse->body = body;
+    httpResponse->bodyLength = numKeys;
+    return true;
+}
+
+size_t handle_batch_request(StorageEngine* engine, HttpRequest* httpRequest,
+	HttpResponse* httpResponse) {
+    EngineBatchOperation operation = ENGINE_BATCH_DELETE;
+    if (strcmp(httpRequest->method, "MGET") == 0) {
+        operation = ENGINE_BATCH_GET;
+    } else if (strcmp(httpRequest->method, "MPUT") == 0) {
+        operation = ENGINE_BATCH_PUT;
+    }
+
+    long numKeys = count_keys(httpRequest, operation);
+    unsigned int expiry = 0;
+    if (numKeys < 0 || (operation == ENGINE_BATCH_PUT && !http_get_expiry(
+	    httpRequest, (unsigned int)time(NULL), &expiry))) {
+	httpResponse->status = STATUS_BAD_REQUEST;
+	return 0;
+    }
+    httpResponse->status = STATUS_OK;
+    if (numKeys == 0) {
+        return 0;
+    }
+    EngineItem* items = malloc(numKeys * sizeof(EngineItem));
+    char* keys = malloc(httpRequest->bodyLength + numKeys);
+    if (items == NULL || keys == NULL) {
+        free(items);
+	free(keys);
+	httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+	return 0;
+    }
+    read_items(httpRequest, operation, expiry, items, numKeys, keys);
+
+    bool built = engine_batch(engine, operation, items, numKeys) == ENGINE_OK;
+    if (built && operation == ENGINE_BATCH_GET) {
+        built = get_response_body(items, numKeys, httpResponse);
+	for (long i = 0; i < numKeys; i++) {
+	    free((char*)items[i].value);
+	}
+    } else if (built) {
+        built = result_response_body(items, numKeys, httpResponse);
+    }
+    if (!built) {
+        httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+    }
+    free(items);
+    free(keys);
+    return numKeys;
+}
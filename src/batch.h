@@ -0,0 +1,54 @@
+/*
+** batch.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include "http.h"
+#include "engine.h"
+
+/* is_batch_request()
+* −−−−−−−−−−−−−−−
+* Checks if a valid http request is one of the batch methods "MGET", "MPUT"
+* or "MDELETE".
+*
+* httpRequest: a request accepted by valid_http_method_and_address(). Not NULL
+*
+* Returns: true if the request is a batch request. False otherwise
+*/
+bool is_batch_request(HttpRequest* httpRequest);
+
+/* handle_batch_request()
+* −−−−−−−−−−−−−−−
+* Carries out every key in a batch request on a store with engine_batch(),
+* so the whole batch is applied at once.
+*
+* The body of the request is a sequence of items in the format read by
+* http_next_batch_item(). MGET and MDELETE take one key per item, and MPUT
+* takes a key item followed by a value item for each key. As in the address
+* of a single key request, a key may not be empty or hold a null byte, and
+* a batch with such a key is a bad request. An MPUT with an HTTP_TTL_HEADER
+* header gives every key it puts that time to live, and is a bad request if
+* the header is invalid.
+*
+* The response body for MGET is the value of each key in the same format,
+* with HTTP_BATCH_MISSING for keys not found. For MPUT and MDELETE it holds
+* one HTTP_BATCH_DONE or HTTP_BATCH_NOT_DONE character per key. Results
+* are in the order the keys were given.
+*
+* engine: the store the request is for. Not NULL
+* httpRequest: a valid batch request. Not NULL
+* httpResponse: the status, body and bodyLength are set. Not NULL
+*
+* Returns: the number of keys in the batch
+*/
+size_t handle_batch_request(StorageEngine* engine, HttpRequest* httpRequest,
+	HttpResponse* httpResponse);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+** checkpoint.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include "checkpoint.h"
+#include "snapshot.h"
+
+/* Reported when a snapshot turns out to be damaged after startup */
+#define SNAPSHOT_DAMAGED_ERROR "dbserver: snapshot of %s store is damaged, " \
+	"keys after the damage are dropped\n"
+
+/* Reported when a round of snapshots cannot be written */
+#define SNAPSHOT_WRITE_ERROR "dbserver: unable to write snapshot\n"
+
+/* Saves every store to a new snapshot after rotating the log, then deletes
+ * the log generations the snapshots replace. Returns false if the log could
+ * not be rotated or a snapshot could not be written */
+static bool write_snapshots(Checkpointer* checkpointer) {
+    // Records appended before the rotation are all included in the
+    // snapshots, later ones may or may not be and are replayed on top
+    unsigned long long appended = wal_appended(checkpointer->log);
+    unsigned long long generation = wal_rotate(checkpointer->log);
+    if (generation == 0) {
+        return false;
+    }
+
+    // Every keyspace with changes in the earlier generations already exists
+    size_t numKeyspaces = 0;
+    Keyspace** keyspaces = keyspaces_list(checkpointer->keyspaces,
+	    &numKeyspaces);
+    bool written = keyspaces != NULL;
+    for (size_t i = 0; written && i < numKeyspaces; i++) {
+        char* path = snapshot_path(checkpointer->dir, keyspaces[i]->name);
+	written = path != NULL
+		&& engine_snapshot(keyspaces[i]->engine, path, generation);
+	free(path);
+    }
+    free(keyspaces);
+    if (!written) {
+        return false;
+    }
+    wal_remove_before(checkpointer->log, generation);
+    checkpointer->checkpointed = appended;
+    checkpointer->pending = false;
+    return true;
+}
+
+/* Body of the checkpoint thread. See checkpoint_start() */
+static void* checkpoint_thread(void* arg) {
+    Checkpointer* checkpointer = (Checkpointer*)arg;
+
+    // Lookups are served from the mapped snapshots until they are copied
+    // in. Only keyspaces restored on startup have a snapshot. A damaged one
+    // is detached like the rest, leaving the keys copied before the damage
+    // with the log replayed on top, and replaced by the next round
+    size_t numKeyspaces = 0;
+    Keyspace** keyspaces = keyspaces_list(checkpointer->keyspaces,
+	    &numKeyspaces);
+    for (size_t i = 0; keyspaces != NULL && i < numKeyspaces; i++) {
+        if (!engine_warm(keyspaces[i]->engine)) {
+	    fprintf(stderr, SNAPSHOT_DAMAGED_ERROR, keyspaces[i]->name);
+	    checkpointer->pending = true;
+	}
+    }
+    for (size_t i = 0; keyspaces != NULL && i < numKeyspaces; i++) {
+        engine_detach_snapshot(keyspaces[i]->engine);
+    }
+    free(keyspaces);
+
+    while (checkpointer->interval > 0) {
+        sleep(checkpointer->interval);
+	if (!checkpointer->pending && wal_appended(checkpointer->log)
+		== checkpointer->checkpointed) {
+	    continue;
+	}
+	if (!write_snapshots(checkpointer)) {
+	    fprintf(stderr, SNAPSHOT_WRITE_ERROR);
+	}
+    }
+    return NULL;
+}
+
+Checkpointer* checkpoint_start(const char* dir, WriteAheadLog* log,
+	Keyspaces* keyspaces, unsigned int interval, bool pending) {
+    Checkpointer* checkpointer = malloc(sizeof(Checkpointer));
+    char* dirCopy = strdup(dir);
+    pthread_t threadId;
+    if (checkpointer == NULL || dirCopy == NULL) {
+        free(checkpointer);
+	free(dirCopy);
+	return NULL;
+    }
+    checkpointer->dir = dirCopy;
+    checkpointer->log = log;
+    checkpointer->keyspaces = keyspaces;
+    checkpointer->interval = interval;
+    checkpointer->checkpointed = wal_appended(log);
+    checkpointer->pending = pending;
+
+    // The thread is started before dbserver sets up its signal handling, so
+    // it blocks every signal to leave them to the threads meant to take them
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    int created = 
+	    pthread_create(&threadId, NULL, checkpoint_thread, checkpointer);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (created != 0) {
+        free(checkpointer);
+	free(dirCopy);
+	return NULL;
+    }
+    pthread_detach(threadId);
+    return checkpointer;
+}
@@ -0,0 +1,57 @@
+/*
+** checkpoint.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "keyspace.h"
+#include "wal.h"
+
+/* The state of the background thread keeping the snapshots in a data
+ * directory up to date. checkpointed is the number of the last log record
+ * included in the snapshots, and pending is set while changes replayed on
+ * startup have not yet been saved to a snapshot */
+typedef struct {
+    char* dir;
+    WriteAheadLog* log;
+    Keyspaces* keyspaces;
+    unsigned int interval;
+    unsigned long long checkpointed;
+    bool pending;
+} Checkpointer;
+
+/* checkpoint_start()
+* −−−−−−−−−−−−−−−
+* Starts a thread that first copies the snapshot of the store of each
+* keyspace into memory and detaches it, then every interval seconds saves
+* the store of every keyspace to a new snapshot if any have changed. Each
+* round takes in the keyspaces created since the last.
+*
+* Before each round of snapshots the log is rotated, so the snapshots hold
+* every change in earlier generations, which are then deleted. If a snapshot
+* entry turns out to be damaged the thread reports it and drops the entries
+* after it: the store keeps the keys copied before the damage and the
+* changes replayed from the log, and its next snapshot replaces the damaged
+* one.
+*
+* dir: the data directory holding the snapshots and log. Not NULL
+* log: the log the stores' changes are recorded in. Not NULL
+* keyspaces: the keyspaces whose stores to keep snapshots of, named after
+* each keyspace. Not NULL
+* interval: seconds between rounds of snapshots, 0 to never write any
+* pending: whether the stores hold changes replayed from the log that are not
+* yet in their snapshots
+*
+* Returns: the checkpointer, NULL if the thread could not be started
+*/
+Checkpointer* checkpoint_start(const char* dir, WriteAheadLog* log,
+	Keyspaces* keyspaces, unsigned int interval, bool pending);
+
+#endif
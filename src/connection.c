@@ -0,0 +1,180 @@
+/*
+** connection.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "connection.h"
+
+/* Initial size of the receive and send buffers */
+#define CONNECTION_BUFFER_SIZE 4096
+
+/* Initial number of entries in the send queue */
+#define CONNECTION_SEGMENTS 16
+
+/* Most segments gathered into one call to sendmsg (the Linux IOV_MAX) */
+#define MAX_SEGMENTS_PER_WRITE 1024
+
+/* Grows buffer so it can hold at least required bytes */
+static void reserve(char** buffer, size_t* capacity, size_t required) {
+    if (*capacity >= required) {
+        return;
+    }
+    size_t newCapacity = *capacity ? *capacity : CONNECTION_BUFFER_SIZE;
+    while (newCapacity < required) {
+        newCapacity *= 2;
+    }
+    *buffer = realloc(*buffer, newCapacity);
+    *capacity = newCapacity;
+}
+
+Connection* connection_init(int fd) {
+    Connection* connection = malloc(sizeof(Connection));
+    memset(connection, 0, sizeof(Connection));
+    connection->fd = fd;
+    reserve(&(connection->in), &(connection->inCapacity), 
+	    CONNECTION_BUFFER_SIZE);
+    return connection;
+}
+
+/* Adds a segment to the end of the send queue */
+static void add_segment(Connection* connection, OutputSegment segment) {
+    if (connection->numSegments == connection->segmentCapacity) {
+        connection->segmentCapacity = connection->segmentCapacity 
+		? connection->segmentCapacity * 2 : CONNECTION_SEGMENTS;
+	connection->segments = realloc(connection->segments, 
+		connection->segmentCapacity * sizeof(OutputSegment));
+    }
+    connection->segments[connection->numSegments++] = segment;
+}
+
+/* Hands the bytes of a segment back to their owner */
+static void release_segment(OutputSegment* segment) {
+    if (segment->release != NULL) {
+        segment->release(segment->releaseArg);
+    }
+}
+
+void connection_free(Connection* connection) {
+    close(connection->fd);
+    for (int i = connection->segmentsSent; i < connection->numSegments; i++) {
+        release_segment(&(connection->segments[i]));
+    }
+    free(connection->segments);
+    free(connection->in);
+    free(connection->out);
+    free(connection);
+}
+
+int connection_read(Connection* connection) {
+    // Always leave room for a full buffer's worth of new bytes
+    reserve(&(connection->in), &(connection->inCapacity), 
+	    connection->inLength + CONNECTION_BUFFER_SIZE);
+    ssize_t received;
+    do {
+        received = recv(connection->fd, connection->in + connection->inLength,
+		connection->inCapacity - connection->inLength, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received > 0) {
+        connection->inLength += received;
+	return 1;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 1;
+    }
+    return 0;
+}
+
+void connection_consume(Connection* connection, size_t length) {
+    connection->inLength -= length;
+    memmove(connection->in, connection->in + length, connection->inLength);
+}
+
+void connection_queue(Connection* connection, const char* data, 
+	size_t length) {
+    reserve(&(connection->out), &(connection->outCapacity), 
+	    connection->outLength + length);
+    memcpy(connection->out + connection->outLength, data, length);
+
+    // Grow the last segment if it ends where these bytes were copied to
+    OutputSegment* last = connection->numSegments > connection->segmentsSent
+	    ? &(connection->segments[connection->numSegments - 1]) : NULL;
+    if (last != NULL && last->data == NULL 
+	    && last->offset + last->length == connection->outLength) {
+        last->length += length;
+    } else {
+        OutputSegment segment = {NULL, connection->outLength, length, NULL, 
+		NULL};
+	add_segment(connection, segment);
+    }
+    connection->outLength += length;
+}
+
+void connection_queue_external(Connection* connection, const char* data, 
+	size_t length, SegmentRelease release, void* releaseArg) {
+    OutputSegment segment = {data, 0, length, release, releaseArg};
+    add_segment(connection, segment);
+}
+
+int connection_write(Connection* connection) {
+    while (connection->segmentsSent < connection->numSegments) {
+        // Gather the unsent segments, skipping what was already sent of the
+	// first one
+        struct iovec iov[MAX_SEGMENTS_PER_WRITE];
+	int numIov = 0;
+	for (int i = connection->segmentsSent; i < connection->numSegments 
+		&& numIov < MAX_SEGMENTS_PER_WRITE; i++, numIov++) {
+	    OutputSegment* segment = &(connection->segments[i]);
+	    const char* data = segment->data != NULL ? segment->data 
+		    : connection->out + segment->offset;
+	    iov[numIov].iov_base = (void*)data;
+	    iov[numIov].iov_len = segment->length;
+	}
+	iov[0].iov_base = (char*)iov[0].iov_base + connection->segmentOffset;
+	iov[0].iov_len -= connection->segmentOffset;
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(struct msghdr));
+	message.msg_iov = iov;
+	message.msg_iovlen = numIov;
+        ssize_t sent = sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+	if (sent < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	    return 0;
+	}
+	if (sent < 0) {
+	    return -1;
+	}
+
+	// Release the segments that were sent in full
+	size_t remaining = sent;
+	while (connection->segmentsSent < connection->numSegments) {
+	    OutputSegment* segment = 
+		    &(connection->segments[connection->segmentsSent]);
+	    size_t unsent = segment->length - connection->segmentOffset;
+	    if (remaining < unsent) {
+	        connection->segmentOffset += remaining;
+		break;
+	    }
+	    remaining -= unsent;
+	    release_segment(segment);
+	    connection->segmentsSent++;
+	    connection->segmentOffset = 0;
+	}
+    }
+    connection->numSegments = 0;
+    connection->segmentsSent = 0;
+    connection->outLength = 0;
+    return 1;
+}
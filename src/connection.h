@@ -0,0 +1,141 @@
+/*
+** connection.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "http.h"
+
+/* Called with releaseArg once the bytes of a segment have been sent */
+typedef void (*SegmentRelease)(void* releaseArg);
+
+/* A run of bytes waiting to be sent. Bytes copied into the connection's out
+ * buffer have data set to NULL and start at offset in the buffer. Otherwise
+ * data points to bytes owned by someone else, which are handed back through
+ * release (if not NULL) once sent */
+typedef struct {
+    const char* data;
+    size_t offset;
+    size_t length;
+    SegmentRelease release;
+    void* releaseArg;
+} OutputSegment;
+
+/* A client socket with the bytes received from it that have not been parsed
+ * yet, the progress parsing the request at the front of them, and the queue 
+ * of response segments that have not been sent yet. segmentsSent of the
+ * segments and segmentOffset bytes of the next one have been sent. closing
+ * is set once no more requests will be read, waitingToWrite while the socket
+ * is being watched for room to send the rest of the queue. When served by a
+ * worker pool, readyEvents holds the epoll events the connection was last
+ * handed to the pool with, and worker the pool worker that last served it */
+typedef struct {
+    int fd;
+    char* in;
+    size_t inLength;
+    size_t inCapacity;
+    HttpParser parser;
+    char* out;
+    size_t outLength;
+    size_t outCapacity;
+    OutputSegment* segments;
+    int numSegments;
+    int segmentCapacity;
+    int segmentsSent;
+    size_t segmentOffset;
+    bool closing;
+    bool waitingToWrite;
+    uint32_t readyEvents;
+    unsigned int worker;
+} Connection;
+
+/* connection_init()
+* −−−−−−−−−−−−−−−
+* Creates a connection for the given client socket with empty buffers.
+*
+* fd: file descriptor of the client socket
+*
+* Returns: pointer to the Connection created with malloc
+*/
+Connection* connection_init(int fd);
+
+/* connection_free()
+* −−−−−−−−−−−−−−−
+* Closes the client socket and frees the connection and its buffers. Segments
+* that were never sent are released.
+*
+* connection: the connection to free. Not NULL
+*/
+void connection_free(Connection* connection);
+
+/* connection_read()
+* −−−−−−−−−−−−−−−
+* Reads the bytes available on the socket onto the end of the receive buffer.
+*
+* A single read is made, so a blocking socket waits for the client to send
+* something and a non-blocking socket may return with nothing read.
+*
+* connection: the connection to read from. Not NULL
+*
+* Returns: 1 if the socket is still open, 0 if the client has closed its end
+* of the connection or an error occurred
+*/
+int connection_read(Connection* connection);
+
+/* connection_consume()
+* −−−−−−−−−−−−−−−
+* Removes bytes that have been handled from the front of the receive buffer.
+*
+* connection: the connection to update. Not NULL
+* length: the number of bytes to remove, at most connection->inLength
+*/
+void connection_consume(Connection* connection, size_t length);
+
+/* connection_queue()
+* −−−−−−−−−−−−−−−
+* Copies bytes onto the end of the connection's send queue.
+*
+* connection: the connection to send on. Not NULL
+* data: the bytes to send. Not NULL
+* length: the number of bytes in data
+*/
+void connection_queue(Connection* connection, const char* data, 
+	size_t length);
+
+/* connection_queue_external()
+* −−−−−−−−−−−−−−−
+* Adds bytes to the end of the connection's send queue without copying them.
+*
+* connection: the connection to send on. Not NULL
+* data: the bytes to send, which must stay valid until released. Not NULL
+* length: the number of bytes in data
+* release: called with releaseArg once the bytes are sent or the connection 
+* is freed, may be NULL
+* releaseArg: argument passed to release
+*/
+void connection_queue_external(Connection* connection, const char* data, 
+	size_t length, SegmentRelease release, void* releaseArg);
+
+/* connection_write()
+* −−−−−−−−−−−−−−−
+* Sends as much of the send queue as the socket will accept.
+*
+* Every queued segment is gathered into one sendmsg call (a writev that can
+* also suppress SIGPIPE), so a batch of responses costs a single system call.
+*
+* connection: the connection to send on. Not NULL
+*
+* Returns: 1 if the send queue is now empty, 0 if bytes remain to be sent
+* once the socket is writable again, -1 if the socket has failed
+*/
+int connection_write(Connection* connection);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+** crc32.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <pthread.h>
+#include "crc32.h"
+
+/* CRC-32 (IEEE 802.3) polynomial, reflected */
+#define CRC32_POLYNOMIAL 0xEDB88320u
+
+static uint32_t crcTable[256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+/* Fills in the lookup table used by crc32() */
+static void init_crc_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+	for (int bit = 0; bit < 8; bit++) {
+	    crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+	}
+	crcTable[i] = crc;
+    }
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t length) {
+    pthread_once(&crcTableOnce, init_crc_table);
+    const unsigned char* bytes = data;
+    crc ^= 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = crcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
@@ -0,0 +1,28 @@
+/*
+** crc32.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* crc32()
+* −−−−−−−−−−−−−−−
+* Computes the CRC-32 (IEEE 802.3) checksum used by the files dbserver 
+* writes.
+*
+* crc: the checksum of the data before this part, 0 to start a new checksum
+* data: the bytes to add to the checksum. Not NULL unless length is 0
+* length: the number of bytes in data
+*
+* Returns: the checksum of everything up to and including data
+*/
+uint32_t crc32(uint32_t crc, const void* data, size_t length);
+
+#endif
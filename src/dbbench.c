@@ -0,0 +1,649 @@
+/*
+** dbbench.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+**
+** Usage:
+**      dbbench [--threads n] [--connections n] [--duration sec]
+**              [--requests n] [--keys n] [--distribution uniform|zipf]
+**              [--theta t] [--mix get:put:delete] [--value-size bytes]
+**              [--pipeline depth] [--private percent] [--authfile file]
+**              [--preload] [--json file] portnum
+** Drives load against the dbserver listening on portnum and reports the
+** throughput and latency it sees.
+** --threads threads (4 by default) share --connections persistent
+** connections (32 by default) between them. Each thread sends a batch of
+** --pipeline requests (1 by default) on every one of its connections before
+** reading their responses. The benchmark runs for --duration seconds (10 by
+** default), or until --requests requests have been sent if that is given.
+** Each request is a GET, PUT or DELETE, picked at random with the weights
+** given by --mix (90:10:0 by default), of one of --keys keys (100000 by
+** default). Keys are picked with a Zipfian distribution of skew --theta
+** (0.99 by default) unless --distribution is uniform. PUT requests store
+** --value-size bytes (100 by default). --private sends that percentage of
+** the requests to the private store, authenticated with the first line of
+** --authfile. --preload stores every key before the benchmark starts, so GET
+** requests find them.
+** The results are printed as a table, and also written as JSON to the file
+** given by --json, or to standard output if it is "-".
+*/
+
+#include <math.h>
+#include <getopt.h>
+#include "dbbench.h"
+#include "auth.h"
+
+/* Host the benchmark connects to */
+#define SERVER_HOST "localhost"
+
+/* Error messages */
+#define USAGE_ERROR_MSG "Usage: dbbench [--threads n] [--connections n] " \
+	"[--duration sec] [--requests n] [--keys n] " \
+	"[--distribution uniform|zipf] [--theta t] [--mix get:put:delete] " \
+	"[--value-size bytes] [--pipeline depth] [--private percent] " \
+	"[--authfile file] [--preload] [--json file] portnum\n"
+#define PORT_CONNECT_ERROR "dbbench: unable to connect to port %s\n"
+#define AUTH_STRING_ERROR "dbbench: unable to read authentication string\n"
+#define REQUEST_FAILED_ERROR "dbbench: a connection failed during the " \
+	"benchmark\n"
+#define JSON_OPEN_ERROR "dbbench: unable to write to \"%s\"\n"
+
+/* Base 10 used for calls to strtol */
+#define BASE_10 10
+
+/* Default and maximum values of the options */
+#define DEFAULT_THREADS 4
+#define MAX_THREADS 1024
+#define DEFAULT_CONNECTIONS 32
+#define MAX_CONNECTIONS 65536
+#define DEFAULT_DURATION 10
+#define MAX_DURATION 86400
+#define MAX_REQUESTS 1000000000000L
+#define DEFAULT_KEYS 100000
+#define MAX_KEYS 100000000
+#define DEFAULT_THETA 0.99
+#define DEFAULT_GET_WEIGHT 90
+#define DEFAULT_PUT_WEIGHT 10
+#define MAX_WEIGHT 1000000
+#define DEFAULT_VALUE_SIZE 100
+#define MAX_VALUE_SIZE (1024 * 1024)
+#define DEFAULT_PIPELINE 1
+#define MAX_PIPELINE 4096
+#define MAX_PERCENT 100
+
+/* Name of the key of each rank */
+#define KEY_FORMAT "bench%lu"
+#define KEY_BUFFER_SIZE 32
+
+/* Byte every value is filled with */
+#define VALUE_FILL 'x'
+
+/* Number of PUT requests --preload keeps in flight on a connection */
+#define PRELOAD_DEPTH 64
+
+/* Number of nanoseconds in a second, and in a microsecond */
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define NANOSECONDS_PER_MICROSECOND 1000.0
+
+/* Scales the top 53 bits of a random number to a double below 1 */
+#define RANDOM_DOUBLE_SCALE (1.0 / (1ULL << 53))
+
+/* Odd constant spreading the seeds of the threads apart */
+#define SEED_INCREMENT 0x9E3779B97F4A7C15ULL
+
+/* Results table */
+#define TABLE_HEADER "%-9s %10s %8s %8s %10s %10s %10s %10s %10s %10s\n"
+#define TABLE_ROW "%-9s %10lu %8lu %8lu %10.1f %10.1f %10.1f %10.1f " \
+	"%10.1f %10.1f\n"
+#define THROUGHPUT_LINE "Throughput: %.0f requests/s over %.2f s\n"
+
+/* The options dbbench accepts, as returned by getopt_long() */
+enum {
+    OPTION_THREADS = 1,
+    OPTION_CONNECTIONS,
+    OPTION_DURATION,
+    OPTION_REQUESTS,
+    OPTION_KEYS,
+    OPTION_DISTRIBUTION,
+    OPTION_THETA,
+    OPTION_MIX,
+    OPTION_VALUE_SIZE,
+    OPTION_PIPELINE,
+    OPTION_PRIVATE,
+    OPTION_AUTHFILE,
+    OPTION_PRELOAD,
+    OPTION_JSON
+};
+
+/* Options accepted before or after portnum */
+static const struct option longOptions[] = {
+    {"threads", required_argument, NULL, OPTION_THREADS},
+    {"connections", required_argument, NULL, OPTION_CONNECTIONS},
+    {"duration", required_argument, NULL, OPTION_DURATION},
+    {"requests", required_argument, NULL, OPTION_REQUESTS},
+    {"keys", required_argument, NULL, OPTION_KEYS},
+    {"distribution", required_argument, NULL, OPTION_DISTRIBUTION},
+    {"theta", required_argument, NULL, OPTION_THETA},
+    {"mix", required_argument, NULL, OPTION_MIX},
+    {"value-size", required_argument, NULL, OPTION_VALUE_SIZE},
+    {"pipeline", required_argument, NULL, OPTION_PIPELINE},
+    {"private", required_argument, NULL, OPTION_PRIVATE},
+    {"authfile", required_argument, NULL, OPTION_AUTHFILE},
+    {"preload", no_argument, NULL, OPTION_PRELOAD},
+    {"json", required_argument, NULL, OPTION_JSON},
+    {NULL, 0, NULL, 0}
+};
+
+/* Values accepted by --distribution, indexed by KeyDistribution */
+static const char* const distributionNames[] = {"uniform", "zipf"};
+
+/* Names the operations are given in the table and in the JSON, indexed by
+ * BenchOperation */
+static const char* const operationNames[] = {"GET", "PUT", "DELETE", "all"};
+static const char* const operationKeys[] = {"get", "put", "delete", "all"};
+
+/* Adds the requests, errors, misses and latencies of one result to
+ * another */
+static void add_result(BenchResult* to, const BenchResult* from) {
+    to->requests += from->requests;
+    to->errors += from->errors;
+    to->misses += from->misses;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        to->latency.counts[i] += from->latency.counts[i];
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchArguments benchArgs = process_command_line(argc, argv);
+
+    char* authorization = NULL;
+    if (benchArgs.authfile != NULL) {
+        authorization = auth_read_line(benchArgs.authfile);
+	if (authorization == NULL) {
+	    fprintf(stderr, AUTH_STRING_ERROR);
+	    exit(AUTHENTICATION_ERROR);
+	}
+    }
+    Zipf zipf;
+    if (benchArgs.distribution == KEYS_ZIPF) {
+        zipf_init(&zipf, benchArgs.keys, benchArgs.theta);
+    }
+    char* value = malloc(benchArgs.valueSize + 1);
+    memset(value, VALUE_FILL, benchArgs.valueSize);
+    value[benchArgs.valueSize] = '\0';
+
+    // Open every connection before starting, spreading them and the
+    // requests as evenly as possible between the threads
+    BenchThread* threads = calloc(benchArgs.threads, sizeof(BenchThread));
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, benchArgs.threads + 1);
+    unsigned long long seed = latency_now();
+    for (unsigned int i = 0; i < benchArgs.threads; i++) {
+        BenchThread* thread = &threads[i];
+	thread->index = i;
+	thread->benchArgs = &benchArgs;
+	thread->zipf = &zipf;
+	thread->value = value;
+	thread->start = &start;
+	thread->numClients = benchArgs.connections / benchArgs.threads
+		+ (i < benchArgs.connections % benchArgs.threads);
+	thread->requests = benchArgs.requests / benchArgs.threads
+		+ (i < benchArgs.requests % benchArgs.threads);
+	thread->rng = (seed + (i + 1) * SEED_INCREMENT) | 1;
+	thread->clients = malloc(thread->numClients * sizeof(DbClient*));
+	for (unsigned int j = 0; j < thread->numClients; j++) {
+	    thread->clients[j] = dbclient_connect(SERVER_HOST, benchArgs.port,
+		    authorization);
+	    if (thread->clients[j] == NULL) {
+	        fprintf(stderr, PORT_CONNECT_ERROR, benchArgs.port);
+		exit(CONNECTION_ERROR);
+	    }
+	}
+    }
+
+    // The clock starts once every thread has preloaded its keys
+    pthread_t* threadIds = malloc(benchArgs.threads * sizeof(pthread_t));
+    for (unsigned int i = 0; i < benchArgs.threads; i++) {
+        pthread_create(&threadIds[i], NULL, bench_thread, &threads[i]);
+    }
+    pthread_barrier_wait(&start);
+    unsigned long long startTime = latency_now();
+    for (unsigned int i = 0; i < benchArgs.threads; i++) {
+        pthread_join(threadIds[i], NULL);
+    }
+    double seconds = (double)(latency_now() - startTime)
+	    / NANOSECONDS_PER_SECOND;
+
+    // Add up the results of the threads, and of the operations for BENCH_ALL
+    BenchResult results[BENCH_OPERATIONS + 1];
+    memset(results, 0, sizeof(results));
+    bool failed = false;
+    for (unsigned int i = 0; i < benchArgs.threads; i++) {
+        failed |= threads[i].failed;
+	for (int op = 0; op < BENCH_OPERATIONS; op++) {
+	    add_result(&results[op], &threads[i].results[op]);
+	    add_result(&results[BENCH_ALL], &threads[i].results[op]);
+	}
+	for (unsigned int j = 0; j < threads[i].numClients; j++) {
+	    dbclient_close(threads[i].clients[j]);
+	}
+	free(threads[i].clients);
+    }
+    print_results(stdout, &benchArgs, results, seconds);
+
+    int status = OK;
+    if (benchArgs.json != NULL) {
+        bool toStdout = strcmp(benchArgs.json, "-") == 0;
+	FILE* json = toStdout ? stdout : fopen(benchArgs.json, "w");
+	if (json == NULL) {
+	    fprintf(stderr, JSON_OPEN_ERROR, benchArgs.json);
+	    status = OUTPUT_ERROR;
+	} else {
+	    write_json_results(json, &benchArgs, results, seconds);
+	    if (!toStdout && fclose(json) != 0) {
+	        fprintf(stderr, JSON_OPEN_ERROR, benchArgs.json);
+		status = OUTPUT_ERROR;
+	    }
+	}
+    }
+    if (failed) {
+        fprintf(stderr, REQUEST_FAILED_ERROR);
+	status = REQUEST_ERROR;
+    }
+
+    pthread_barrier_destroy(&start);
+    free(threadIds);
+    free(threads);
+    free(value);
+    free(authorization);
+    return status;
+}
+
+/* Parses an integer option value between min and max inclusive. Exits with
+ * a usage error if the value is invalid */
+static long parse_option_count(const char* value, long min, long max) {
+    char* endOfInt;
+    long count = strtol(value, &endOfInt, BASE_10);
+    if (*value == '\0' || *endOfInt != '\0' || count < min || count > max) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    return count;
+}
+
+/* Returns the distribution named by a --distribution value. Exits with a
+ * usage error if it names no distribution */
+static KeyDistribution parse_distribution(const char* value) {
+    for (int i = KEYS_UNIFORM; i <= KEYS_ZIPF; i++) {
+        if (strcmp(value, distributionNames[i]) == 0) {
+	    return i;
+	}
+    }
+    fprintf(stderr, USAGE_ERROR_MSG);
+    exit(USAGE_ERROR);
+}
+
+/* Parses a --theta value, which must be between 0 and 1 exclusive. Exits
+ * with a usage error if it is not */
+static double parse_theta(const char* value) {
+    char* end;
+    double theta = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || !(theta > 0 && theta < 1)) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    return theta;
+}
+
+/* Parses a --mix value of the form get:put:delete into the weight of each
+ * operation. Exits with a usage error if it is not of that form or every
+ * weight is 0 */
+static void parse_mix(const char* value, unsigned int* mix) {
+    char* copy = strdup(value);
+    char* rest = copy;
+    unsigned long total = 0;
+    for (int op = 0; op < BENCH_OPERATIONS; op++) {
+        char* weight = strsep(&rest, ":");
+	if (weight == NULL || (op == BENCH_OPERATIONS - 1) != (rest == NULL)) {
+	    fprintf(stderr, USAGE_ERROR_MSG);
+	    exit(USAGE_ERROR);
+	}
+	mix[op] = parse_option_count(weight, 0, MAX_WEIGHT);
+	total += mix[op];
+    }
+    free(copy);
+    if (total == 0) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+}
+
+BenchArguments process_command_line(int argc, char** argv) {
+    BenchArguments benchArgs;
+    memset(&benchArgs, 0, sizeof(BenchArguments));
+    benchArgs.threads = DEFAULT_THREADS;
+    benchArgs.connections = DEFAULT_CONNECTIONS;
+    benchArgs.duration = DEFAULT_DURATION;
+    benchArgs.keys = DEFAULT_KEYS;
+    benchArgs.distribution = KEYS_ZIPF;
+    benchArgs.theta = DEFAULT_THETA;
+    benchArgs.mix[BENCH_GET] = DEFAULT_GET_WEIGHT;
+    benchArgs.mix[BENCH_PUT] = DEFAULT_PUT_WEIGHT;
+    benchArgs.valueSize = DEFAULT_VALUE_SIZE;
+    benchArgs.pipeline = DEFAULT_PIPELINE;
+
+    // Handle the options, leaving portnum at the end of argv
+    int option;
+    while ((option = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (option) {
+	    case OPTION_THREADS:
+	        benchArgs.threads = parse_option_count(optarg, 1, MAX_THREADS);
+		break;
+	    case OPTION_CONNECTIONS:
+	        benchArgs.connections =
+			parse_option_count(optarg, 1, MAX_CONNECTIONS);
+		break;
+	    case OPTION_DURATION:
+	        benchArgs.duration =
+			parse_option_count(optarg, 1, MAX_DURATION);
+		break;
+	    case OPTION_REQUESTS:
+	        benchArgs.requests =
+			parse_option_count(optarg, 1, MAX_REQUESTS);
+		break;
+	    case OPTION_KEYS:
+	        benchArgs.keys = parse_option_count(optarg, 1, MAX_KEYS);
+		break;
+	    case OPTION_DISTRIBUTION:
+	        benchArgs.distribution = parse_distribution(optarg);
+		break;
+	    case OPTION_THETA:
+	        benchArgs.theta = parse_theta(optarg);
+		break;
+	    case OPTION_MIX:
+	        parse_mix(optarg, benchArgs.mix);
+		break;
+	    case OPTION_VALUE_SIZE:
+	        benchArgs.valueSize =
+			parse_option_count(optarg, 0, MAX_VALUE_SIZE);
+		break;
+	    case OPTION_PIPELINE:
+	        benchArgs.pipeline =
+			parse_option_count(optarg, 1, MAX_PIPELINE);
+		break;
+	    case OPTION_PRIVATE:
+	        benchArgs.privatePercent =
+			parse_option_count(optarg, 0, MAX_PERCENT);
+		break;
+	    case OPTION_AUTHFILE:
+	        benchArgs.authfile = optarg;
+		break;
+	    case OPTION_PRELOAD:
+	        benchArgs.preload = true;
+		break;
+	    case OPTION_JSON:
+	        benchArgs.json = optarg;
+		break;
+	    default:
+	        fprintf(stderr, USAGE_ERROR_MSG);
+		exit(USAGE_ERROR);
+	}
+    }
+
+    // Every thread needs a connection, and the private store needs the
+    // authentication string
+    if (optind != argc - 1 || benchArgs.connections < benchArgs.threads
+	    || (benchArgs.privatePercent > 0 && benchArgs.authfile == NULL)) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    benchArgs.port = argv[optind];
+    return benchArgs;
+}
+
+void zipf_init(Zipf* zipf, unsigned long n, double theta) {
+    double zetaN = 0;
+    for (unsigned long i = 1; i <= n; i++) {
+        zetaN += 1.0 / pow(i, theta);
+    }
+    double zeta2 = 1 + pow(0.5, theta);
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1 / (1 - theta);
+    zipf->zetaN = zetaN;
+    zipf->eta = n < 2 ? 0
+	    : (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetaN);
+    zipf->half = zeta2;
+}
+
+unsigned long zipf_next(Zipf* zipf, double uniform) {
+    // The two most popular ranks are picked out exactly, and the rest come
+    // from an approximation of the inverse of the distribution
+    double scaled = uniform * zipf->zetaN;
+    if (scaled < 1) {
+        return 0;
+    }
+    if (scaled < zipf->half) {
+        return 1;
+    }
+    unsigned long rank = (unsigned long)(zipf->n
+	    * pow(zipf->eta * uniform - zipf->eta + 1, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/* Returns the next number from the xorshift64* generator of a thread */
+static unsigned long long next_random(BenchThread* thread) {
+    thread->rng ^= thread->rng >> 12;
+    thread->rng ^= thread->rng << 25;
+    thread->rng ^= thread->rng >> 27;
+    return thread->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* Buffers a random request on a connection, with the operation, store and
+ * key picked as the arguments ask. Returns the operation sent, or -1 if the
+ * request could not be sent */
+static int send_random_request(BenchThread* thread, DbClient* client) {
+    BenchArguments* benchArgs = thread->benchArgs;
+    unsigned int total = benchArgs->mix[BENCH_GET] + benchArgs->mix[BENCH_PUT]
+	    + benchArgs->mix[BENCH_DELETE];
+    unsigned int pick = next_random(thread) % total;
+    int op = BENCH_GET;
+    while (pick >= benchArgs->mix[op]) {
+        pick -= benchArgs->mix[op++];
+    }
+    const char* dbType = next_random(thread) % MAX_PERCENT
+	    < benchArgs->privatePercent ? "private" : "public";
+    unsigned long rank = benchArgs->distribution == KEYS_ZIPF
+	    ? zipf_next(thread->zipf,
+	    (next_random(thread) >> 11) * RANDOM_DOUBLE_SCALE)
+	    : next_random(thread) % benchArgs->keys;
+    char key[KEY_BUFFER_SIZE];
+    sprintf(key, KEY_FORMAT, rank);
+
+    int sent;
+    switch (op) {
+        case BENCH_GET:
+	    sent = dbclient_send_get(client, dbType, key);
+	    break;
+	case BENCH_PUT:
+	    sent = dbclient_send_put(client, dbType, key, thread->value,
+		    benchArgs->valueSize);
+	    break;
+	default:
+	    sent = dbclient_send_delete(client, dbType, key);
+	    break;
+    }
+    return sent ? op : -1;
+}
+
+/* Receives the responses to a batch of numOps requests sent at sentAt,
+ * counting each against its operation in ops. Returns false if the
+ * connection failed, counting the requests left as errors */
+static bool receive_batch(BenchThread* thread, DbClient* client,
+	const int* ops, unsigned int numOps, unsigned long long sentAt) {
+    for (unsigned int i = 0; i < numOps; i++) {
+        BenchResult* result = &thread->results[ops[i]];
+	result->requests++;
+	HttpResponse response;
+	if (!dbclient_receive(client, &response)) {
+	    result->errors++;
+	    for (unsigned int j = i + 1; j < numOps; j++) {
+	        thread->results[ops[j]].requests++;
+		thread->results[ops[j]].errors++;
+	    }
+	    return false;
+	}
+	latency_record(&result->latency, latency_now() - sentAt);
+	if (response.status == STATUS_NOT_FOUND) {
+	    result->misses++;
+	} else if (response.status != STATUS_OK) {
+	    result->errors++;
+	}
+	free_http_response(&response);
+    }
+    return true;
+}
+
+/* Stores this thread's share of the keys in the public store, and in the
+ * private store if any requests go to it. Returns false if a request
+ * failed */
+static bool preload_keys(BenchThread* thread) {
+    BenchArguments* benchArgs = thread->benchArgs;
+    DbClient* client = thread->clients[0];
+    int numStores = benchArgs->privatePercent > 0 ? 2 : 1;
+    const char* const dbTypes[] = {"public", "private"};
+    char key[KEY_BUFFER_SIZE];
+    for (unsigned long rank = thread->index; rank < benchArgs->keys;
+	    rank += benchArgs->threads) {
+        sprintf(key, KEY_FORMAT, rank);
+	for (int i = 0; i < numStores; i++) {
+	    if (!dbclient_send_put(client, dbTypes[i], key, thread->value,
+		    benchArgs->valueSize)) {
+	        return false;
+	    }
+	}
+
+	// Read the responses whenever enough are in flight, and at the end
+	while (client->pending >= PRELOAD_DEPTH || (client->pending > 0
+		&& rank + benchArgs->threads >= benchArgs->keys)) {
+	    HttpResponse response;
+	    if (!dbclient_receive(client, &response)) {
+	        return false;
+	    }
+	    int status = response.status;
+	    free_http_response(&response);
+	    if (status != STATUS_OK) {
+	        return false;
+	    }
+	}
+    }
+    return true;
+}
+
+void* bench_thread(void* arg) {
+    BenchThread* thread = (BenchThread*)arg;
+    BenchArguments* benchArgs = thread->benchArgs;
+    if (benchArgs->preload && !preload_keys(thread)) {
+        thread->failed = true;
+    }
+    pthread_barrier_wait(thread->start);
+    unsigned long long deadline =
+	    latency_now() + benchArgs->duration * NANOSECONDS_PER_SECOND;
+
+    unsigned int depth = benchArgs->pipeline;
+    int* ops = malloc(thread->numClients * depth * sizeof(int));
+    unsigned int* batchSizes =
+	    malloc(thread->numClients * sizeof(unsigned int));
+    unsigned long long* sentAt =
+	    malloc(thread->numClients * sizeof(unsigned long long));
+    unsigned long remaining = thread->requests;
+    while (!thread->failed && (benchArgs->requests > 0 ? remaining > 0
+	    : latency_now() < deadline)) {
+        // Every connection is sent its batch before any response is read,
+	// so the server works on all of them at once
+        for (unsigned int c = 0; c < thread->numClients; c++) {
+	    unsigned int batchSize = depth;
+	    if (benchArgs->requests > 0) {
+	        batchSize = remaining < depth ? remaining : depth;
+		remaining -= batchSize;
+	    }
+	    batchSizes[c] = 0;
+	    for (unsigned int i = 0; i < batchSize; i++) {
+	        int op = send_random_request(thread, thread->clients[c]);
+		if (op < 0) {
+		    thread->failed = true;
+		    break;
+		}
+		ops[c * depth + batchSizes[c]++] = op;
+	    }
+	    sentAt[c] = latency_now();
+	    dbclient_flush(thread->clients[c]);
+	}
+	for (unsigned int c = 0; c < thread->numClients; c++) {
+	    if (!receive_batch(thread, thread->clients[c], &ops[c * depth],
+		    batchSizes[c], sentAt[c])) {
+	        thread->failed = true;
+	    }
+	}
+    }
+    free(ops);
+    free(batchSizes);
+    free(sentAt);
+    return NULL;
+}
+
+/* Returns a duration in nanoseconds as microseconds */
+static double microseconds(unsigned long long nanoseconds) {
+    return nanoseconds / NANOSECONDS_PER_MICROSECOND;
+}
+
+void print_results(FILE* out, BenchArguments* benchArgs,
+	BenchResult* results, double seconds) {
+    fprintf(out, TABLE_HEADER, "Operation", "Requests", "Errors", "Misses",
+	    "Mean(us)", "p50", "p90", "p99", "p99.9", "Max");
+    for (int op = 0; op <= BENCH_ALL; op++) {
+        // Operations the mix never sends are left out
+        if (op != BENCH_ALL && benchArgs->mix[op] == 0) {
+	    continue;
+	}
+	LatencySummary summary;
+	latency_summarise(&results[op].latency, &summary);
+	fprintf(out, TABLE_ROW, operationNames[op], results[op].requests,
+		results[op].errors, results[op].misses,
+		microseconds(summary.mean), microseconds(summary.p50),
+		microseconds(summary.p90), microseconds(summary.p99),
+		microseconds(summary.p999), microseconds(summary.max));
+    }
+    fprintf(out, THROUGHPUT_LINE,
+	    seconds > 0 ? results[BENCH_ALL].requests / seconds : 0, seconds);
+}
+
+void write_json_results(FILE* out, BenchArguments* benchArgs,
+	BenchResult* results, double seconds) {
+    fprintf(out, "{\"config\":{\"threads\":%u,\"connections\":%u,"
+	    "\"duration_s\":%u,\"requests\":%lu,\"keys\":%lu,"
+	    "\"distribution\":\"%s\",\"theta\":%g,"
+	    "\"mix\":{\"get\":%u,\"put\":%u,\"delete\":%u},"
+	    "\"value_size\":%u,\"pipeline\":%u,\"private_percent\":%u,"
+	    "\"preload\":%s},", benchArgs->threads, benchArgs->connections,
+	    benchArgs->duration, benchArgs->requests, benchArgs->keys,
+	    distributionNames[benchArgs->distribution], benchArgs->theta,
+	    benchArgs->mix[BENCH_GET], benchArgs->mix[BENCH_PUT],
+	    benchArgs->mix[BENCH_DELETE], benchArgs->valueSize,
+	    benchArgs->pipeline, benchArgs->privatePercent,
+	    benchArgs->preload ? "true" : "false");
+    fprintf(out, "\"elapsed_s\":%.6f,\"throughput_rps\":%.1f,"
+	    "\"operations\":{", seconds,
+	    seconds > 0 ? results[BENCH_ALL].requests / seconds : 0);
+    for (int op = 0; op <= BENCH_ALL; op++) {
+        fprintf(out, "%s\"%s\":{\"requests\":%lu,\"errors\":%lu,"
+		"\"misses\":%lu,\"latency\":", op > 0 ? "," : "",
+		operationKeys[op], results[op].requests, results[op].errors,
+		results[op].misses);
+	latency_write_json(out, &results[op].latency);
+	fprintf(out, "}");
+    }
+    fprintf(out, "}}\n");
+}
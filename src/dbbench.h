@@ -0,0 +1,199 @@
+/*
+** dbbench.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef DBBENCH_H
+#define DBBENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "dbclientlib.h"
+#include "latency.h"
+
+/* The kinds of request the benchmark sends, with BENCH_ALL counting them all
+ * together in the results */
+typedef enum {
+    BENCH_GET = 0,
+    BENCH_PUT = 1,
+    BENCH_DELETE = 2,
+    BENCH_OPERATIONS = 3,
+    BENCH_ALL = 3
+} BenchOperation;
+
+/* How the key of each request is picked from the keyspace */
+typedef enum {
+    KEYS_UNIFORM = 0,
+    KEYS_ZIPF = 1
+} KeyDistribution;
+
+/* Arguments passed into dbbench. mix holds the relative weight of each
+ * operation, and requests is the total number to send, 0 to send them for
+ * duration seconds instead */
+typedef struct {
+    char* port;
+    unsigned int threads;
+    unsigned int connections;
+    unsigned int duration;
+    unsigned long requests;
+    unsigned long keys;
+    KeyDistribution distribution;
+    double theta;
+    unsigned int mix[BENCH_OPERATIONS];
+    unsigned int valueSize;
+    unsigned int pipeline;
+    unsigned int privatePercent;
+    char* authfile;
+    bool preload;
+    char* json;
+} BenchArguments;
+
+/* The constants of a Zipfian distribution over n keys with skew theta, from
+ * which key ranks are drawn with zipf_next(). Rank 0 is the most popular */
+typedef struct {
+    unsigned long n;
+    double theta;
+    double alpha;
+    double zetaN;
+    double eta;
+    double half;
+} Zipf;
+
+/* The results of requests of one kind: the number sent, how many failed or
+ * got a response other than 200 or 404, how many found no key, and the time
+ * each took from being sent to its response arriving */
+typedef struct {
+    unsigned long requests;
+    unsigned long errors;
+    unsigned long misses;
+    LatencyHistogram latency;
+} BenchResult;
+
+/* Arguments passed to each thread driving the benchmark, with the results it
+ * gathered. The thread owns numClients connections and sends up to requests
+ * requests over them, or runs until the time is up if that is 0. rng is the
+ * state of its random number generator */
+typedef struct {
+    unsigned int index;
+    BenchArguments* benchArgs;
+    Zipf* zipf;
+    const char* value;
+    pthread_barrier_t* start;
+    DbClient** clients;
+    unsigned int numClients;
+    unsigned long requests;
+    unsigned long long rng;
+    bool failed;
+    BenchResult results[BENCH_OPERATIONS];
+} BenchThread;
+
+/* Different types of exit statuses */
+typedef enum {
+    OK = 0,
+    USAGE_ERROR = 1,
+    CONNECTION_ERROR = 2,
+    AUTHENTICATION_ERROR = 3,
+    REQUEST_ERROR = 4,
+    OUTPUT_ERROR = 5
+} ErrorType;
+
+/* process_command_line()
+* −−−−−−−−−−−−−−−
+* Validates the command line arguments given to dbbench.
+*
+* The expected structure of the command line arguments is:
+*
+*     ./dbbench [--threads n] [--connections n] [--duration sec]
+*             [--requests n] [--keys n] [--distribution uniform|zipf]
+*             [--theta t] [--mix get:put:delete] [--value-size bytes]
+*             [--pipeline depth] [--private percent] [--authfile file]
+*             [--preload] [--json file] portnum
+*
+* argc: the number of command line arguments given.
+* argv: array containing the command line arguments.
+*
+* Returns: BenchArguments struct containing the values extracted from the
+* command line arguments, with defaults for the options not given.
+* Errors: if an option or portnum is missing or invalid, there are fewer
+* connections than threads, or --private is given without --authfile,
+* USAGE_ERROR_MSG is printed and the program exits with status 1.
+*/
+BenchArguments process_command_line(int argc, char** argv);
+
+/* zipf_init()
+* −−−−−−−−−−−−−−−
+* Works out the constants of a Zipfian distribution, as described by Gray et
+* al. in "Quickly Generating Billion-Record Synthetic Databases". Takes time
+* in proportion to n.
+*
+* zipf: set to the distribution. Not NULL
+* n: the number of keys to draw from, at least 1
+* theta: the skew, between 0 and 1 exclusive. Larger values make the most
+* popular keys more popular
+*/
+void zipf_init(Zipf* zipf, unsigned long n, double theta);
+
+/* zipf_next()
+* −−−−−−−−−−−−−−−
+* Draws a key rank from a Zipfian distribution.
+*
+* zipf: the distribution. Not NULL
+* uniform: a random number uniform between 0 inclusive and 1 exclusive
+*
+* Returns: the rank, below the number of keys of the distribution
+*/
+unsigned long zipf_next(Zipf* zipf, double uniform);
+
+/* bench_thread()
+* −−−−−−−−−−−−−−−
+* Thread function driving a share of the benchmark over its connections.
+*
+* The thread first stores its share of the keys if --preload was given, then
+* waits at the start barrier for every other thread. It then sends a batch of
+* up to --pipeline requests on each of its connections before waiting for
+* their responses, over and over until it has sent its share of the requests
+* or the duration is up. Stops early if a connection fails.
+*
+* arg: the BenchThread cast to a void*, which is filled in with the results.
+* Not NULL
+*
+* Returns: NULL
+*/
+void* bench_thread(void* arg);
+
+/* print_results()
+* −−−−−−−−−−−−−−−
+* Prints a table of the requests sent, errors, misses and latency
+* percentiles of each operation and of all of them together, followed by the
+* throughput.
+*
+* out: the stream to print the table to. Not NULL
+* benchArgs: the arguments the benchmark was run with. Not NULL
+* results: the results indexed by BenchOperation, including BENCH_ALL. Not
+* NULL
+* seconds: the time the benchmark took
+*/
+void print_results(FILE* out, BenchArguments* benchArgs,
+	BenchResult* results, double seconds);
+
+/* write_json_results()
+* −−−−−−−−−−−−−−−
+* Writes the arguments and results of the benchmark as a JSON object, for
+* comparing runs by script.
+*
+* out: the stream to write to. Not NULL
+* benchArgs: the arguments the benchmark was run with. Not NULL
+* results: the results indexed by BenchOperation, including BENCH_ALL. Not
+* NULL
+* seconds: the time the benchmark took
+*/
+void write_json_results(FILE* out, BenchArguments* benchArgs,
+	BenchResult* results, double seconds);
+
+#endif
@@ -13,9 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <unistd.h>
-#include <netdb.h>
-#include "http.h"
+#include "dbclientlib.h"
 
 /* Arguments passed into dbclient */
 typedef struct {
@@ -57,34 +55,6 @@ typedef enum {
 */
 ClientArguments process_command_line(int argc, char** argv);
 
-/* create_connection()
-* −−−−−−−−−−−−−−−
-* Creates a TCP connection on localhost using the port number provided.
-*
-* clientArgs: the command line arguments provided to dbclient. Not NULL
-*
-* Returns: file descriptor of the open connection
-* Errors: if the program is unable to get the address information or if the 
-* connection fails PORT_CONNECTION_ERROR is printed and the program exits with
-* status 2
-* Reference: CSSE2310 Semester 1 2022 Week 9 net2.c
-*/
-int create_connection(ClientArguments clientArgs);
-
-/* construct_http_request()
-* −−−−−−−−−−−−−−−
-* Constructs and sends a GET or PUT http request to the given file stream 
-* depending on the given parameters.
-*
-* If a key and value is provided a PUT request is created. If only a key is 
-* provided then a GET request is created.
-*
-* key: key to include in the http request
-* value: value to include in the http request
-* toServer: file stream used to write to the server
-*/
-void construct_http_request(char* key, char* value, FILE* toServer);
-
 /* is_get_request()
 * −−−−−−−−−−−−−−−
 * Checks if the command line arguments are for a get request.
@@ -103,15 +73,16 @@ bool is_get_request(char* value);
 * Exits the client with the exit status corresponding to the http response 
 * received.
 *
-* If the http response status == 200 then the program exits with status 0.
+* If the http response status == 200 then the program exits with status 0,
+* printing the value received if the request was a GET.
 * Otherwise if the request was a GET the program exits with status 3.
 * Otherwise if the request was PUT the program exits with status 4.
 *
-* httpResponse: HttpResponse struct holding the http response information. Not 
+* status: the http response status, or -1 if no response was received
+* value: the value received for a GET request, freed before exiting. May be 
 * NULL
 * requestIsGet: indicates if the original request sent was a GET request or not
-* Not NULL.
 */
-void exit_client(HttpResponse* httpResponse, bool requestIsGet);
+void exit_client(int status, char* value, bool requestIsGet);
 
 #endif
@@ -0,0 +1,369 @@
+/*
+** dbclientlib.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "dbclientlib.h"
+
+/* Carriage-return line-feed */
+#define CRLF "\r\n"
+
+/* Request line, and the headers that may follow it */
+#define REQUEST_LINE "%s /%s/%s HTTP/1.1" CRLF
+#define AUTHORIZATION_HEADER "Authorization: %s" CRLF
+#define CONTENT_LENGTH_HEADER "Content-Length: %zu" CRLF
+
+/* Length written before each item of a batch body */
+#define BATCH_ITEM_LENGTH "%zu:"
+
+/* Returns true if key can be sent in a request address */
+static bool valid_key(const char* key) {
+    return key[0] != '\0' && strpbrk(key, " \r\n") == NULL;
+}
+
+/* Makes room for length more bytes in the request buffer. Returns false if
+ * memory cannot be allocated */
+static bool reserve_output(DbClient* client, size_t length) {
+    if (client->outLength + length <= client->outCapacity) {
+        return true;
+    }
+    size_t capacity = client->outCapacity == 0
+	    ? DBCLIENT_FLUSH_SIZE : client->outCapacity;
+    while (capacity < client->outLength + length) {
+        capacity *= 2;
+    }
+    char* out = realloc(client->out, capacity);
+    if (out == NULL) {
+        return false;
+    }
+    client->out = out;
+    client->outCapacity = capacity;
+    return true;
+}
+
+/* Buffers the head of a request and makes room for its body, which has
+ * bodyLength bytes if hasBody is true. Returns false if memory cannot be
+ * allocated */
+static bool append_head(DbClient* client, const char* method,
+	const char* dbType, const char* key, bool hasBody, size_t bodyLength) {
+    // Format the head straight into the buffer once its length is known
+    const char* authorization =
+	    client->authorization != NULL ? client->authorization : "";
+    int headLength = snprintf(NULL, 0, REQUEST_LINE, method, dbType, key)
+	    + (client->authorization != NULL ? snprintf(NULL, 0,
+	    AUTHORIZATION_HEADER, authorization) : 0)
+	    + (hasBody ? snprintf(NULL, 0, CONTENT_LENGTH_HEADER,
+	    bodyLength) : 0)
+	    + strlen(CRLF);
+    if (!reserve_output(client, headLength + 1 + bodyLength)) {
+        return false;
+    }
+    char* head = client->out + client->outLength;
+    head += sprintf(head, REQUEST_LINE, method, dbType, key);
+    if (client->authorization != NULL) {
+        head += sprintf(head, AUTHORIZATION_HEADER, authorization);
+    }
+    if (hasBody) {
+        head += sprintf(head, CONTENT_LENGTH_HEADER, bodyLength);
+    }
+    sprintf(head, CRLF);
+    client->outLength += headLength;
+    return true;
+}
+
+/* Counts a request as sent once it is completely buffered, flushing once
+ * enough has been buffered. Returns 1 on success, 0 otherwise */
+static int finish_send(DbClient* client) {
+    client->pending++;
+    if (client->outLength >= DBCLIENT_FLUSH_SIZE) {
+        return dbclient_flush(client);
+    }
+    return 1;
+}
+
+/* Buffers a request. body may be NULL for requests without one. Returns 1 on
+ * success, 0 otherwise */
+static int send_request(DbClient* client, const char* method,
+	const char* dbType, const char* key, const char* body,
+	size_t bodyLength) {
+    if (!valid_key(key) || !valid_key(dbType)
+	    || !append_head(client, method, dbType, key, body != NULL,
+	    bodyLength)) {
+        return 0;
+    }
+    if (body != NULL) {
+        memcpy(client->out + client->outLength, body, bodyLength);
+	client->outLength += bodyLength;
+    }
+    return finish_send(client);
+}
+
+/* Returns the number of bytes an item takes up in a batch body */
+static size_t batch_item_size(size_t length) {
+    return snprintf(NULL, 0, BATCH_ITEM_LENGTH, length) + length;
+}
+
+/* Appends an item to a batch body the buffer already has room for */
+static void append_batch_item(DbClient* client, const char* item,
+	size_t length) {
+    client->outLength += sprintf(client->out + client->outLength,
+	    BATCH_ITEM_LENGTH, length);
+    memcpy(client->out + client->outLength, item, length);
+    client->outLength += length;
+}
+
+/* Buffers a batch request for numKeys keys. values and valueLengths give the
+ * value of each key for MPUT and are NULL otherwise. Returns 1 on success, 0
+ * otherwise */
+static int send_batch(DbClient* client, const char* method,
+	const char* dbType, const char** keys, const char** values,
+	const size_t* valueLengths, size_t numKeys) {
+    size_t bodyLength = 0;
+    for (size_t i = 0; i < numKeys; i++) {
+        bodyLength += batch_item_size(strlen(keys[i]));
+	if (values != NULL) {
+	    bodyLength += batch_item_size(valueLengths[i]);
+	}
+    }
+    if (!valid_key(dbType)
+	    || !append_head(client, method, dbType, "", true, bodyLength)) {
+        return 0;
+    }
+    for (size_t i = 0; i < numKeys; i++) {
+        append_batch_item(client, keys[i], strlen(keys[i]));
+	if (values != NULL) {
+	    append_batch_item(client, values[i], valueLengths[i]);
+	}
+    }
+    return finish_send(client);
+}
+
+/* Waits for the response to a batch put or delete just sent, copying the
+ * result of each key into results if it is not NULL. Returns the status or
+ * -1 */
+static int finish_batch(DbClient* client, int sent, size_t numKeys,
+	char* results) {
+    HttpResponse httpResponse;
+    if (!sent || !dbclient_receive(client, &httpResponse)) {
+        return -1;
+    }
+    int status = httpResponse.status;
+    if (status == STATUS_OK && httpResponse.bodyLength != numKeys) {
+        status = -1;
+    } else if (status == STATUS_OK && results != NULL) {
+        memcpy(results, httpResponse.body, numKeys);
+    }
+    free_http_response(&httpResponse);
+    return status;
+}
+
+DbClient* dbclient_connect(const char* host, const char* port,
+	const char* authorization) {
+    struct addrinfo* ai = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET; // IPv4
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &ai) != 0) {
+        return NULL;
+    }
+
+    // Try each address until one connects
+    int fd = -1;
+    for (struct addrinfo* address = ai; address != NULL && fd < 0;
+	    address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype,
+		address->ai_protocol);
+	if (fd >= 0
+		&& connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+	    close(fd);
+	    fd = -1;
+	}
+    }
+    freeaddrinfo(ai);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // Requests are batched here, so the kernel should send each flush at once
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    DbClient* client = malloc(sizeof(DbClient));
+    int fdFrom = dup(fd);
+    FILE* from = fdFrom < 0 ? NULL : fdopen(fdFrom, "r");
+    char* authorizationCopy =
+	    authorization != NULL ? strdup(authorization) : NULL;
+    if (client == NULL || from == NULL
+	    || (authorization != NULL && authorizationCopy == NULL)) {
+        free(client);
+	free(authorizationCopy);
+	if (from != NULL) {
+	    fclose(from);
+	} else if (fdFrom >= 0) {
+	    close(fdFrom);
+	}
+	close(fd);
+	return NULL;
+    }
+    memset(client, 0, sizeof(DbClient));
+    client->fd = fd;
+    client->from = from;
+    client->authorization = authorizationCopy;
+    return client;
+}
+
+void dbclient_close(DbClient* client) {
+    fclose(client->from);
+    close(client->fd);
+    free(client->authorization);
+    free(client->out);
+    free(client);
+}
+
+int dbclient_send_get(DbClient* client, const char* dbType, const char* key) {
+    return send_request(client, "GET", dbType, key, NULL, 0);
+}
+
+int dbclient_send_put(DbClient* client, const char* dbType, const char* key,
+	const char* value, size_t valueLength) {
+    return send_request(client, "PUT", dbType, key, value != NULL ? value : "",
+	    valueLength);
+}
+
+int dbclient_send_delete(DbClient* client, const char* dbType,
+	const char* key) {
+    return send_request(client, "DELETE", dbType, key, NULL, 0);
+}
+
+int dbclient_flush(DbClient* client) {
+    size_t sent = 0;
+    while (sent < client->outLength) {
+        // MSG_NOSIGNAL reports a closed connection as an error, not SIGPIPE
+        ssize_t numSent = send(client->fd, client->out + sent,
+		client->outLength - sent, MSG_NOSIGNAL);
+	if (numSent < 0) {
+	    client->outLength = 0;
+	    return 0;
+	}
+	sent += numSent;
+    }
+    client->outLength = 0;
+    return 1;
+}
+
+int dbclient_receive(DbClient* client, HttpResponse* httpResponse) {
+    memset(httpResponse, 0, sizeof(HttpResponse));
+    if (client->pending == 0 || !dbclient_flush(client)
+	    || !get_http_response(client->from, httpResponse)) {
+        return 0;
+    }
+    client->pending--;
+    return 1;
+}
+
+/* Waits for the response to the request just sent, returning its status or
+ * -1. The response body is freed unless body is not NULL, in which case it
+ * is handed to the caller */
+static int finish_request(DbClient* client, int sent, char** body,
+	size_t* bodyLength) {
+    HttpResponse httpResponse;
+    if (!sent || !dbclient_receive(client, &httpResponse)) {
+        return -1;
+    }
+    if (body != NULL && httpResponse.status == STATUS_OK) {
+        *body = httpResponse.body;
+	if (bodyLength != NULL) {
+	    *bodyLength = httpResponse.bodyLength;
+	}
+	httpResponse.body = NULL;
+    }
+    free_http_response(&httpResponse);
+    return httpResponse.status;
+}
+
+int dbclient_get(DbClient* client, const char* dbType, const char* key,
+	char** value, size_t* valueLength) {
+    *value = NULL;
+    return finish_request(client, dbclient_send_get(client, dbType, key),
+	    value, valueLength);
+}
+
+int dbclient_put(DbClient* client, const char* dbType, const char* key,
+	const char* value, size_t valueLength) {
+    return finish_request(client,
+	    dbclient_send_put(client, dbType, key, value, valueLength),
+	    NULL, NULL);
+}
+
+int dbclient_delete(DbClient* client, const char* dbType, const char* key) {
+    return finish_request(client,
+	    dbclient_send_delete(client, dbType, key), NULL, NULL);
+}
+
+int dbclient_mget(DbClient* client, const char* dbType, const char** keys,
+	size_t numKeys, char** values, size_t* valueLengths) {
+    memset(values, 0, numKeys * sizeof(char*));
+    HttpResponse httpResponse;
+    if (!send_batch(client, "MGET", dbType, keys, NULL, NULL, numKeys)
+	    || !dbclient_receive(client, &httpResponse)) {
+        return -1;
+    }
+
+    // Copy out each value, giving up if the body does not hold one per key
+    int status = httpResponse.status;
+    size_t offset = 0;
+    for (size_t i = 0; status == STATUS_OK && i < numKeys; i++) {
+        const char* item;
+	size_t itemLength;
+	if (http_next_batch_item(httpResponse.body, httpResponse.bodyLength,
+		&offset, &item, &itemLength) != 1) {
+	    status = -1;
+	    break;
+	}
+	if (valueLengths != NULL) {
+	    valueLengths[i] = itemLength;
+	}
+	if (item != NULL) {
+	    values[i] = malloc(itemLength + 1);
+	    if (values[i] == NULL) {
+	        status = -1;
+		break;
+	    }
+	    memcpy(values[i], item, itemLength);
+	    values[i][itemLength] = '\0';
+	}
+    }
+    if (status == -1) {
+        for (size_t i = 0; i < numKeys; i++) {
+	    free(values[i]);
+	    values[i] = NULL;
+	}
+    }
+    free_http_response(&httpResponse);
+    return status;
+}
+
+int dbclient_mput(DbClient* client, const char* dbType, const char** keys,
+	const char** values, const size_t* valueLengths, size_t numKeys,
+	char* results) {
+    return finish_batch(client, send_batch(client, "MPUT", dbType, keys,
+	    values, valueLengths, numKeys), numKeys, results);
+}
+
+int dbclient_mdelete(DbClient* client, const char* dbType, const char** keys,
+	size_t numKeys, char* results) {
+    return finish_batch(client, send_batch(client, "MDELETE", dbType, keys,
+	    NULL, NULL, numKeys), numKeys, results);
+}
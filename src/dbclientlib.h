@@ -0,0 +1,236 @@
+/*
+** dbclientlib.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef DBCLIENTLIB_H
+#define DBCLIENTLIB_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "http.h"
+
+/* Requests are sent once this many bytes of them have been buffered */
+#define DBCLIENT_FLUSH_SIZE (64 * 1024)
+
+/* A connection to a dbserver which is kept open across many requests.
+ * Requests are buffered in out until they are flushed, and pending counts the
+ * requests sent whose responses have not been received yet */
+typedef struct {
+    int fd;
+    FILE* from;
+    char* authorization;
+    char* out;
+    size_t outLength;
+    size_t outCapacity;
+    unsigned long pending;
+} DbClient;
+
+/* dbclient_connect()
+* −−−−−−−−−−−−−−−
+* Opens a TCP connection to a dbserver.
+*
+* host: the name or address of the server. Not NULL
+* port: the port number or service name the server listens on. Not NULL
+* authorization: sent in an Authorization header with every request, needed
+* for requests to the private store. NULL to send no such header
+*
+* Returns: the connection, freed by dbclient_close(). NULL if the server
+* cannot be connected to
+*/
+DbClient* dbclient_connect(const char* host, const char* port,
+	const char* authorization);
+
+/* dbclient_close()
+* −−−−−−−−−−−−−−−
+* Closes a connection and frees all memory associated with it. Requests still
+* buffered are discarded.
+*
+* client: the connection to close. Not NULL
+*/
+void dbclient_close(DbClient* client);
+
+/* dbclient_send_get()
+* −−−−−−−−−−−−−−−
+* Buffers a GET request for a key without waiting for its response.
+*
+* Any number of requests can be sent before their responses are received with
+* dbclient_receive(), and the responses arrive in the order the requests were
+* sent. Callers should receive responses regularly rather than sending an
+* unbounded number first, as the server stops reading while the client is not
+* reading its responses.
+*
+* client: the connection to send on. Not NULL
+* dbType: the store the key is in, "public" or "private". Not NULL
+* key: the key to get, which must not be empty or contain spaces or line
+* breaks. Not NULL
+*
+* Returns: 1 if the request was buffered, 0 if the key is invalid or the
+* request could not be sent
+*/
+int dbclient_send_get(DbClient* client, const char* dbType, const char* key);
+
+/* dbclient_send_put()
+* −−−−−−−−−−−−−−−
+* Buffers a PUT request storing a value under a key without waiting for its
+* response. See dbclient_send_get().
+*
+* client: the connection to send on. Not NULL
+* dbType: the store to put the key in, "public" or "private". Not NULL
+* key: the key to store, which must not be empty or contain spaces or line
+* breaks. Not NULL
+* value: the valueLength bytes to store
+* valueLength: the number of bytes in value
+*
+* Returns: 1 if the request was buffered, 0 if the key is invalid or the
+* request could not be sent
+*/
+int dbclient_send_put(DbClient* client, const char* dbType, const char* key,
+	const char* value, size_t valueLength);
+
+/* dbclient_send_delete()
+* −−−−−−−−−−−−−−−
+* Buffers a DELETE request for a key without waiting for its response. See
+* dbclient_send_get().
+*
+* client: the connection to send on. Not NULL
+* dbType: the store the key is in, "public" or "private". Not NULL
+* key: the key to delete, which must not be empty or contain spaces or line
+* breaks. Not NULL
+*
+* Returns: 1 if the request was buffered, 0 if the key is invalid or the
+* request could not be sent
+*/
+int dbclient_send_delete(DbClient* client, const char* dbType,
+	const char* key);
+
+/* dbclient_flush()
+* −−−−−−−−−−−−−−−
+* Sends every buffered request to the server.
+*
+* client: the connection to flush. Not NULL
+*
+* Returns: 1 on success, 0 if the connection failed
+*/
+int dbclient_flush(DbClient* client);
+
+/* dbclient_receive()
+* −−−−−−−−−−−−−−−
+* Waits for the response to the oldest request sent that has not been
+* received yet, flushing buffered requests first.
+*
+* client: the connection to receive on. Not NULL
+* httpResponse: set to the response, freed with free_http_response(). Not
+* NULL
+*
+* Returns: 1 if a response was received, 0 if there are no requests waiting
+* for a response or the connection failed
+*/
+int dbclient_receive(DbClient* client, HttpResponse* httpResponse);
+
+/* dbclient_get()
+* −−−−−−−−−−−−−−−
+* Gets the value of a key, waiting for the response. Responses to requests
+* sent earlier must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store the key is in, "public" or "private". Not NULL
+* key: the key to get. Not NULL
+* value: set to the value when the status is 200, allocated with malloc and
+* null terminated. Set to NULL otherwise. Not NULL
+* valueLength: set to the length of the value. May be NULL
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_get(DbClient* client, const char* dbType, const char* key,
+	char** value, size_t* valueLength);
+
+/* dbclient_put()
+* −−−−−−−−−−−−−−−
+* Stores a value under a key, waiting for the response. Responses to requests
+* sent earlier must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store to put the key in, "public" or "private". Not NULL
+* key: the key to store. Not NULL
+* value: the valueLength bytes to store
+* valueLength: the number of bytes in value
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_put(DbClient* client, const char* dbType, const char* key,
+	const char* value, size_t valueLength);
+
+/* dbclient_delete()
+* −−−−−−−−−−−−−−−
+* Deletes a key, waiting for the response. Responses to requests sent earlier
+* must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store the key is in, "public" or "private". Not NULL
+* key: the key to delete. Not NULL
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_delete(DbClient* client, const char* dbType, const char* key);
+
+/* dbclient_mget()
+* −−−−−−−−−−−−−−−
+* Gets the values of many keys with one MGET request, waiting for the 
+* response. Responses to requests sent earlier must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store the keys are in, "public" or "private". Not NULL
+* keys: the numKeys keys to get. Not NULL
+* numKeys: the number of keys
+* values: set to the value of each key, allocated with malloc and null
+* terminated, or NULL for keys that were not found. Not NULL
+* valueLengths: set to the length of each value. May be NULL
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_mget(DbClient* client, const char* dbType, const char** keys,
+	size_t numKeys, char** values, size_t* valueLengths);
+
+/* dbclient_mput()
+* −−−−−−−−−−−−−−−
+* Stores many values with one MPUT request, waiting for the response. 
+* Responses to requests sent earlier must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store to put the keys in, "public" or "private". Not NULL
+* keys: the numKeys keys to store. Not NULL
+* values: the value to store under each key. Not NULL
+* valueLengths: the number of bytes in each value. Not NULL
+* numKeys: the number of keys
+* results: set to HTTP_BATCH_DONE or HTTP_BATCH_NOT_DONE for each key
+* when the status is 200. May be NULL
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_mput(DbClient* client, const char* dbType, const char** keys,
+	const char** values, const size_t* valueLengths, size_t numKeys,
+	char* results);
+
+/* dbclient_mdelete()
+* −−−−−−−−−−−−−−−
+* Deletes many keys with one MDELETE request, waiting for the response.
+* Responses to requests sent earlier must have been received first.
+*
+* client: the connection to use. Not NULL
+* dbType: the store the keys are in, "public" or "private". Not NULL
+* keys: the numKeys keys to delete. Not NULL
+* numKeys: the number of keys
+* results: set to HTTP_BATCH_DONE for each key deleted and 
+* HTTP_BATCH_NOT_DONE for each key not found when the status is 200. May be
+* NULL
+*
+* Returns: the http status of the response, -1 if the request failed
+*/
+int dbclient_mdelete(DbClient* client, const char* dbType, const char** keys,
+	size_t numKeys, char* results);
+
+#endif
@@ -6,24 +6,96 @@
 **      s4674720
 **
 ** Usage:
-**      ./dbserver authfile connections [portnum]
+**      ./dbserver [--shards n] [--epoll n] [--pool n] [--pool-queue depth]
+**              [--listeners n] [--data-dir dir] [--sync none|batch|op]
+**              [--sync-interval usec] [--snapshot-interval sec] 
+**              [--max-memory mb] [--ordered] [--engine name]
+**              [--keyspace name[:shards[:mb[:authfile]]]]...
+**              [--max-keyspaces n] authfile connections [portnum]
 ** The authfile argument is the name of a text file, the first line of which 
-** is to be used as an authentication.
+** is to be used as an authentication. It is read once at startup, and again
+** whenever the file changes or dbserver receives SIGUSR1.
 ** The connections argument indicates the maximum number of simultaneous client
 ** connections to be permitted. If this is zero, then there is no limit to how 
 ** many clients may connect.
 ** The portnum argument, if specified, indicates which localhost port dbserver 
 ** is to listen on. If the port number is absent, then dbserver is to use an 
 ** ephemeral port.
-** Any additional arguments are to be silently ignored.
+** The --shards option sets how many independently locked partitions each
+** store is split into. The --epoll option serves clients from that many event
+** loop threads instead of creating a thread for every connection. The --pool
+** option instead serves them from a fixed pool of that many threads, each 
+** with a queue of up to --pool-queue ready connections (256 by default). A 
+** worker keeps serving the connections it served before, and steals from the
+** queues of the others once its own is empty.
+** The --listeners option accepts clients on that many threads, each with its
+** own socket bound to the port with SO_REUSEPORT so the kernel spreads new
+** connections between them. Each listener is pinned to a CPU of its own.
+** The --data-dir option keeps a write-ahead log of every change in the given
+** directory, which is replayed into the stores on startup. --sync sets how 
+** far a change must reach before it is acknowledged: written to the log 
+** (none), synced together with the changes made alongside it (batch, the 
+** default), or synced at once without waiting for others (op).
+** --sync-interval makes each batch wait that many microseconds for more
+** changes to join it.
+** Each store is also saved to a snapshot in the data directory every 
+** --snapshot-interval seconds (60 by default, 0 for never), after which the
+** log it replaces is deleted. On startup the snapshots are mapped into memory
+** and served from directly while they are copied into the stores in the 
+** background, so only the log written since needs to be replayed.
+** The --max-memory option bounds the memory held by the keys of the public
+** store to that many megabytes, evicting the least recently used keys to make
+** room for new ones.
+** The --ordered option keeps the keys of every store in order as well, so a
+** "SCAN /<store>/<prefix>" request can return them in ascending order a page
+** at a time.
+** The --engine option selects the storage engine that runs every store by
+** name. The only engine is "linear", the default: each store is split into
+** shards, each a hash table with linear probing behind its own lock.
+** Each store is a keyspace, addressed by its name as "/<name>/<key>". The
+** public keyspace needs no authentication and the private keyspace needs
+** the string in the authfile. Each --keyspace option creates another, with
+** its own store split into the given number of shards, its own memory limit
+** in megabytes and its own authfile, whose first line its requests must
+** carry. Empty fields take the --shards default, no limit and no
+** authentication. The public and private keyspaces may be configured the
+** same way. With --max-keyspaces, a PUT or MPUT to a keyspace that does not
+** exist creates it, with the defaults and the --max-memory limit, until that
+** many have been. Keyspaces found in the data directory are restored on
+** startup. Unless they are configured again they are set up as they were,
+** reading their authfile again, and those created on demand count toward
+** --max-keyspaces. No keyspace may be named "stats".
+** A PUT or MPUT with a "TTL: seconds" header makes the keys it puts expire 
+** after that many seconds. Expired keys are never returned, and are removed
+** in the background within a second.
+** A "GET /stats" request carrying the private keyspace's secret returns 
+** every statistic as a JSON object, including the latencies of parsing, 
+** waiting for locks and running each kind of request on each store. The 
+** statistics are also printed to stderr on SIGHUP.
 */
 
+#include <getopt.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "dbserver.h"
+#include "eventloop.h"
+#include "listener.h"
+#include "batch.h"
+#include "scan.h"
+#include "checkpoint.h"
 
 /* Error messages */
-#define USAGE_ERROR_MSG "Usage: dbserver authfile connections [portnum]\n"
+#define USAGE_ERROR_MSG "Usage: dbserver [--shards n] [--epoll n] " \
+	"[--pool n] [--pool-queue depth] [--listeners n] " \
+	"[--data-dir dir] [--sync none|batch|op] [--sync-interval usec] " \
+	"[--snapshot-interval sec] [--max-memory mb] [--ordered] " \
+	"[--engine name] [--keyspace name[:shards[:mb[:authfile]]]]... " \
+	"[--max-keyspaces n] authfile connections [portnum]\n"
 #define PORT_BIND_ERROR "dbserver: unable to open socket for listening\n"
 #define AUTH_STRING_ERROR "dbserver: unable to read authentication string\n"
+#define DATA_DIR_ERROR "dbserver: unable to open data directory\n"
 
 /* Base 10 used for calls to strtol */
 #define BASE_10 10
@@ -43,26 +115,305 @@
 
 /* Statistics for dbserver */
 #define STATS_CONNECTED_CLIENTS "Connected clients:%d\n"
-#define STATS_COMPLETED_CLIENTS "Completed clients:%d\n"
-#define STATS_AUTH_FAILURES "Auth failures:%d\n"
-#define STATS_GET_OPERATIONS "GET operations:%d\n"
-#define STATS_PUT_OPERATIONS "PUT operations:%d\n"
-#define STATS_DELETE_OPERATIONS "DELETE operations:%d\n"
+#define STATS_COMPLETED_CLIENTS "Completed clients:%lu\n"
+#define STATS_AUTH_FAILURES "Auth failures:%lu\n"
+#define STATS_GET_OPERATIONS "GET operations:%lu\n"
+#define STATS_PUT_OPERATIONS "PUT operations:%lu\n"
+#define STATS_DELETE_OPERATIONS "DELETE operations:%lu\n"
+#define STATS_EXPIRED_KEYS "Expired keys:%lu\n"
+#define STATS_EVICTED_KEYS "Evicted keys:%lu\n"
+#define STATS_KEY_BYTES "Store key bytes:%zu\n"
+#define STATS_MEMORY_RESERVED "Store memory reserved:%zu\n"
+#define STATS_MEMORY_USED "Store memory used:%zu\n"
+#define STATS_SLAB_PAGES "Slab pages:%zu\n"
+#define STATS_SLAB_OCCUPANCY "Slab occupancy:%.1f%%\n"
+#define STATS_FRAGMENTATION "Store fragmentation:%.1f%%\n"
+#define STATS_POOL_WORKERS "Pool workers:%u\n"
+#define STATS_POOL_TASKS "Pool tasks:%lu\n"
+#define STATS_POOL_STEALS "Pool steals:%lu\n"
+#define STATS_POOL_QUEUE_FULL "Pool queue full:%lu\n"
+#define STATS_POOL_QUEUED "Pool queued:%zu\n"
+#define STATS_LISTENER_ACCEPTED "Listener %u accepted:%lu\n"
+#define STATS_LISTENER_REJECTED "Listener %u rejected:%lu\n"
+
 
 /* Minimum and maximum number of arguments required for dbserver */
 #define MIN_NUM_ARGS 3
 #define MAX_NUM_ARGS 4
 
+/* Default and maximum number of shards each store is split into */
+#define DEFAULT_SHARDS 16
+#define MAX_SHARDS 4096
+
+/* Maximum number of event loop threads */
+#define MAX_EPOLL_WORKERS 1024
+
+/* Maximum number of worker pool threads, and the default and maximum number
+ * of ready connections each of their queues holds */
+#define MAX_POOL_WORKERS 1024
+#define DEFAULT_POOL_QUEUE_DEPTH 256
+#define MAX_POOL_QUEUE_DEPTH 65536
+
+/* Maximum number of listener threads */
+#define MAX_LISTENERS 256
+
+/* Number of bytes needed to write a port number as a string */
+#define PORT_STRING_SIZE 8
+
+/* Maximum number of microseconds a batch of changes waits before syncing */
+#define MAX_SYNC_INTERVAL 1000000
+
+/* Default and maximum number of seconds between snapshots */
+#define DEFAULT_SNAPSHOT_INTERVAL 60
+#define MAX_SNAPSHOT_INTERVAL 86400
+
+/* Maximum memory limit in megabytes, and the bytes in a megabyte */
+#define MAX_MEMORY_LIMIT (1024 * 1024)
+#define BYTES_PER_MB (1024 * 1024)
+
+/* Maximum number of keyspaces that may be created on demand */
+#define MAX_KEYSPACES 65536
+
+/* Number of fields of a --keyspace value: name, shards, megabytes and
+ * authfile, separated by colons */
+#define KEYSPACE_FIELDS 4
+#define KEYSPACE_FIELD_SEPARATOR ':'
+
+/* Number of seconds between passes removing expired keys */
+#define EXPIRY_INTERVAL 1
+
+/* Permissions of a data directory created by dbserver */
+#define DATA_DIR_MODE 0700
+
+/* Names of the keyspaces that always exist, as recorded in the write-ahead
+ * log */
+#define PUBLIC_STORE_NAME "public"
+#define PRIVATE_STORE_NAME "private"
+
+/* Values returned by getopt_long for the long only options */
+enum {
+    OPTION_SHARDS = 256,
+    OPTION_EPOLL,
+    OPTION_POOL,
+    OPTION_POOL_QUEUE,
+    OPTION_LISTENERS,
+    OPTION_DATA_DIR,
+    OPTION_SYNC,
+    OPTION_SYNC_INTERVAL,
+    OPTION_SNAPSHOT_INTERVAL,
+    OPTION_MAX_MEMORY,
+    OPTION_ORDERED,
+    OPTION_ENGINE,
+    OPTION_KEYSPACE,
+    OPTION_MAX_KEYSPACES
+};
+
+/* Options accepted before or after the positional arguments */
+static const struct option longOptions[] = {
+    {"shards", required_argument, NULL, OPTION_SHARDS},
+    {"epoll", required_argument, NULL, OPTION_EPOLL},
+    {"pool", required_argument, NULL, OPTION_POOL},
+    {"pool-queue", required_argument, NULL, OPTION_POOL_QUEUE},
+    {"listeners", required_argument, NULL, OPTION_LISTENERS},
+    {"data-dir", required_argument, NULL, OPTION_DATA_DIR},
+    {"sync", required_argument, NULL, OPTION_SYNC},
+    {"sync-interval", required_argument, NULL, OPTION_SYNC_INTERVAL},
+    {"snapshot-interval", required_argument, NULL, OPTION_SNAPSHOT_INTERVAL},
+    {"max-memory", required_argument, NULL, OPTION_MAX_MEMORY},
+    {"ordered", no_argument, NULL, OPTION_ORDERED},
+    {"engine", required_argument, NULL, OPTION_ENGINE},
+    {"keyspace", required_argument, NULL, OPTION_KEYSPACE},
+    {"max-keyspaces", required_argument, NULL, OPTION_MAX_KEYSPACES},
+    {NULL, 0, NULL, 0}
+};
+
+/* Values accepted by --sync, indexed by WalSyncMode */
+static const char* const syncModeNames[] = {"none", "batch", "op"};
+
+/* Names the metrics are given in the statistics, indexed by MetricsMethod,
+ * MetricsStore and LatencyStage */
+static const char* const metricsMethodNames[] = {"GET", "PUT", "DELETE", 
+	"MGET", "MPUT", "MDELETE", "SCAN", "other"};
+static const char* const metricsStoreNames[] = {"public", "private", 
+	"named", "none"};
+static const char* const latencyStageNames[] = {"parse", "lock_wait", 
+	"store", "total"};
+
 int main(int argc, char** argv) {
     ServerArguments serverArgs = process_command_line(argc, argv);
-   
-    int fdServer = initialise_server(serverArgs.port);
-    process_connections(fdServer, serverArgs);
+
+    // Restore the stores from the snapshots and log before accepting any 
+    // connections
+    Keyspaces* keyspaces = initialise_keyspaces(&serverArgs);
+    open_data_directory(keyspaces, serverArgs);
+
+    int fdServer = initialise_server(serverArgs.port, 
+	    serverArgs.listeners > 0);
+    process_connections(fdServer, serverArgs, keyspaces);
     
     return 0;
 }
 
+/* Parses an integer option value between min and max inclusive. Exits with
+ * a usage error if the value is invalid */
+static unsigned int parse_option_count(const char* value, unsigned int min,
+	unsigned int max) {
+    char* endOfInt;
+    long count = strtol(value, &endOfInt, BASE_10);
+    if (*value == '\0' || *endOfInt != '\0' || count < (long)min 
+	    || count > max) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    return count;
+}
+
+/* Returns the sync mode named by a --sync value. Exits with a usage error if
+ * it names no mode */
+static WalSyncMode parse_sync_mode(const char* value) {
+    for (int mode = WAL_SYNC_NONE; mode <= WAL_SYNC_OP; mode++) {
+        if (strcmp(value, syncModeNames[mode]) == 0) {
+	    return mode;
+	}
+    }
+    fprintf(stderr, USAGE_ERROR_MSG);
+    exit(USAGE_ERROR);
+}
+
+/* Parses a --keyspace value "name[:shards[:mb[:authfile]]]" in place, where
+ * empty fields take the defaults. Exits with a usage error if it is 
+ * invalid */
+static KeyspaceOption parse_keyspace_option(char* value) {
+    char* fields[KEYSPACE_FIELDS] = {NULL};
+    char* field = value;
+    for (int i = 0; i < KEYSPACE_FIELDS && field != NULL; i++) {
+        fields[i] = field;
+	// The authfile is the rest of the value, colons and all
+	char* separator = i < KEYSPACE_FIELDS - 1 
+		? strchr(field, KEYSPACE_FIELD_SEPARATOR) : NULL;
+	if (separator != NULL) {
+	    *separator++ = '\0';
+	}
+	field = separator;
+    }
+    if (!http_valid_store_name(fields[0])) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+
+    KeyspaceOption option;
+    memset(&option, 0, sizeof(KeyspaceOption));
+    option.name = fields[0];
+    if (fields[1] != NULL && fields[1][0] != '\0') {
+        option.config.numShards = 
+		parse_option_count(fields[1], 1, MAX_SHARDS);
+    }
+    if (fields[2] != NULL && fields[2][0] != '\0') {
+        option.config.memoryLimit = (size_t)parse_option_count(fields[2], 1,
+		MAX_MEMORY_LIMIT) * BYTES_PER_MB;
+    }
+    if (fields[3] != NULL && fields[3][0] != '\0') {
+        option.authfile = fields[3];
+    }
+    return option;
+}
+
+/* Adds a keyspace given with --keyspace to the server arguments. Exits with
+ * a usage error if it is invalid or the keyspace was already given */
+static void add_keyspace_option(ServerArguments* serverArgs, char* value) {
+    KeyspaceOption option = parse_keyspace_option(value);
+    for (unsigned int i = 0; i < serverArgs->numKeyspaces; i++) {
+        if (strcmp(serverArgs->keyspaces[i].name, option.name) == 0) {
+	    fprintf(stderr, USAGE_ERROR_MSG);
+	    exit(USAGE_ERROR);
+	}
+    }
+    serverArgs->keyspaces = realloc(serverArgs->keyspaces, 
+	    (serverArgs->numKeyspaces + 1) * sizeof(KeyspaceOption));
+    serverArgs->keyspaces[serverArgs->numKeyspaces++] = option;
+}
+
 ServerArguments process_command_line(int argc, char** argv) {
+    ServerArguments serverArgs;
+    memset(&serverArgs, 0, sizeof(ServerArguments));
+    serverArgs.shards = DEFAULT_SHARDS;
+    serverArgs.syncMode = WAL_SYNC_BATCH;
+    serverArgs.snapshotInterval = DEFAULT_SNAPSHOT_INTERVAL;
+    serverArgs.poolQueueDepth = DEFAULT_POOL_QUEUE_DEPTH;
+    serverArgs.engine = engine_default();
+
+    // Handle the options, leaving the positional arguments at the end of argv
+    int option;
+    while ((option = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (option) {
+	    case OPTION_SHARDS:
+	        serverArgs.shards = parse_option_count(optarg, 1, MAX_SHARDS);
+		break;
+	    case OPTION_EPOLL:
+	        serverArgs.epollWorkers = 
+			parse_option_count(optarg, 1, MAX_EPOLL_WORKERS);
+		break;
+	    case OPTION_POOL:
+	        serverArgs.poolWorkers = 
+			parse_option_count(optarg, 1, MAX_POOL_WORKERS);
+		break;
+	    case OPTION_POOL_QUEUE:
+	        serverArgs.poolQueueDepth = 
+			parse_option_count(optarg, 1, MAX_POOL_QUEUE_DEPTH);
+		break;
+	    case OPTION_LISTENERS:
+	        serverArgs.listeners = 
+			parse_option_count(optarg, 1, MAX_LISTENERS);
+		break;
+	    case OPTION_DATA_DIR:
+	        serverArgs.dataDir = optarg;
+		break;
+	    case OPTION_SYNC:
+	        serverArgs.syncMode = parse_sync_mode(optarg);
+		break;
+	    case OPTION_SYNC_INTERVAL:
+	        serverArgs.syncInterval = 
+			parse_option_count(optarg, 0, MAX_SYNC_INTERVAL);
+		break;
+	    case OPTION_SNAPSHOT_INTERVAL:
+	        serverArgs.snapshotInterval = 
+			parse_option_count(optarg, 0, MAX_SNAPSHOT_INTERVAL);
+		break;
+	    case OPTION_MAX_MEMORY:
+		serverArgs.maxMemory = 
+			parse_option_count(optarg, 1, MAX_MEMORY_LIMIT);
+		break;
+	    case OPTION_ORDERED:
+		serverArgs.ordered = true;
+		break;
+	    case OPTION_ENGINE:
+	        serverArgs.engine = engine_find(optarg);
+		if (serverArgs.engine == NULL) {
+		    fprintf(stderr, USAGE_ERROR_MSG);
+		    exit(USAGE_ERROR);
+		}
+		break;
+	    case OPTION_KEYSPACE:
+	        add_keyspace_option(&serverArgs, optarg);
+		break;
+	    case OPTION_MAX_KEYSPACES:
+	        serverArgs.maxKeyspaces = 
+			parse_option_count(optarg, 0, MAX_KEYSPACES);
+		break;
+	    default:
+	        fprintf(stderr, USAGE_ERROR_MSG);
+		exit(USAGE_ERROR);
+	}
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    // Connections are served by the event loop or the pool, not both
+    if (serverArgs.epollWorkers > 0 && serverArgs.poolWorkers > 0) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+
     // Check min args are provided
     if (argc < MIN_NUM_ARGS || argc > MAX_NUM_ARGS) {
 	fprintf(stderr, USAGE_ERROR_MSG);
@@ -88,15 +439,29 @@ ServerArguments process_command_line(int argc, char** argv) {
 	}
     }
 
-    // Check authentication file valid
-    if (!valid_authfile(argv[1])) {
+    // Check authentication file valid, keeping the string it holds
+    Authenticator* auth = auth_load(argv[1]);
+    if (auth == NULL) {
         fprintf(stderr, AUTH_STRING_ERROR);
 	exit(AUTHENTICATION_ERROR);
     }
 
+    // Likewise the authfile of each keyspace configured with one
+    for (unsigned int i = 0; i < serverArgs.numKeyspaces; i++) {
+        KeyspaceOption* option = &(serverArgs.keyspaces[i]);
+	if (option->authfile == NULL) {
+	    continue;
+	}
+	option->config.auth = auth_load(option->authfile);
+	if (option->config.auth == NULL) {
+	    fprintf(stderr, AUTH_STRING_ERROR);
+	    exit(AUTHENTICATION_ERROR);
+	}
+    }
+
     // Set up ServerArguments with valid arguments provided
-    ServerArguments serverArgs;
     serverArgs.authfile = argv[1];
+    serverArgs.auth = auth;
     serverArgs.connections = connections;
     serverArgs.port = DEFAULT_PORT;
     if (argc > MIN_NUM_ARGS_WITHOUT_PORTNUM) {
@@ -105,7 +470,10 @@ ServerArguments process_command_line(int argc, char** argv) {
     return serverArgs;
 }
 
-int initialise_server(const char* port) {
+/* Creates a socket listening on the given port of localhost, shared with 
+ * other sockets bound with reusePort set if it is. Returns 1 if the address
+ * cannot be found, and exits with a listen error if it cannot be bound */
+static int open_listening_socket(const char* port, bool reusePort) {
     struct addrinfo* ai = 0;
     struct addrinfo hints;
     memset(&hints, 0, sizeof(struct addrinfo));
@@ -124,6 +492,9 @@ int initialise_server(const char* port) {
     // Allow address (port number) to be reused immediately
     int optVal = 1;
     setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optVal, sizeof(int));
+    if (reusePort) {
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &optVal, sizeof(int));
+    }
 
     // Bind and listen on the port specified
     if (bind(listenfd, (struct sockaddr*)ai->ai_addr, sizeof(struct sockaddr)) 
@@ -134,228 +505,464 @@ int initialise_server(const char* port) {
     }
 
     listen(listenfd, LISTEN_QUEUE_LENGTH);
-    print_port(listenfd);
     freeaddrinfo(ai);
     return listenfd;
 }
 
-void process_connections(int fdServer, ServerArguments serverArgs) {
-    int fdClient;
-    struct sockaddr_in fromAddr;
-    socklen_t fromAddrSize = sizeof(struct sockaddr_in);
+int initialise_server(const char* port, bool reusePort) {
+    int listenfd = open_listening_socket(port, reusePort);
+    print_port(listenfd);
+    return listenfd;
+}
 
-    // Create Initial semaphore lock, stores and statistics structs
-    Locks locks;
-    memset(&locks, 0, sizeof(Locks));
-    init_lock(&(locks.databaseLock));
-    init_lock(&(locks.statisticsLock));
-    StringStores* stringStores = initialise_stringstores();
+int add_listening_socket(int fdServer) {
+    struct sockaddr_in ad;
+    memset(&ad, 0, sizeof(struct sockaddr_in));
+    socklen_t len = sizeof(struct sockaddr_in);
+    getsockname(fdServer, (struct sockaddr*)&ad, &len);
+    char port[PORT_STRING_SIZE];
+    snprintf(port, sizeof(port), "%u", ntohs(ad.sin_port));
+    return open_listening_socket(port, true);
+}
+
+void process_connections(int fdServer, ServerArguments serverArgs, 
+	Keyspaces* keyspaces) {
+    // Create initial statistics struct
     Statistics stats;
     memset(&stats, 0, sizeof(Statistics));
-    create_signal_thread(&stats, &locks);
+    stats.metrics = calloc(1, sizeof(ServerMetrics));
+    create_signal_thread(&stats, keyspaces, serverArgs.auth);
+    create_expiry_thread(keyspaces);
+    auth_watch(serverArgs.auth);
+    for (unsigned int i = 0; i < serverArgs.numKeyspaces; i++) {
+        if (serverArgs.keyspaces[i].config.auth != NULL) {
+	    auth_watch(serverArgs.keyspaces[i].config.auth);
+	}
+    }
+
+    // Clients get a thread each unless the event loop or pool threads were
+    // asked for
+    ThreadArguments sharedArgs;
+    memset(&sharedArgs, 0, sizeof(ThreadArguments));
+    sharedArgs.stats = &stats;
+    sharedArgs.keyspaces = keyspaces;
+    sharedArgs.serverArgs = &serverArgs;
+    ClientHandler handler = start_client_thread;
+    void* handlerArg = &sharedArgs;
+    if (serverArgs.epollWorkers > 0) {
+        handler = event_loop_add_client;
+	handlerArg = start_event_loop(&sharedArgs, serverArgs.epollWorkers);
+    } else if (serverArgs.poolWorkers > 0) {
+        handler = worker_pool_add_client;
+	handlerArg = start_worker_pool(&sharedArgs, serverArgs.poolWorkers, 
+		serverArgs.poolQueueDepth);
+    }
 
-    // Keep accepting new connections and creating threads to handle the 
-    // connection
-    while(true) {
-        fdClient = 
-	        accept(fdServer, (struct sockaddr*)&fromAddr, &fromAddrSize);
+    // Without --listeners this thread accepts every client itself
+    unsigned int numListeners = serverArgs.listeners > 0 
+	    ? serverArgs.listeners : 1;
+    Listener* listeners = calloc(numListeners, sizeof(Listener));
+    void* memory = NULL;
+    if (listeners == NULL || posix_memalign(&memory, CACHE_LINE_SIZE, 
+	    numListeners * sizeof(ListenerStatistics)) != 0) {
+        fprintf(stderr, PORT_BIND_ERROR);
+	exit(LISTEN_ERROR);
+    }
+    ListenerStatistics* counters = (ListenerStatistics*)memory;
+    memset(counters, 0, numListeners * sizeof(ListenerStatistics));
+    for (unsigned int i = 0; i < numListeners; i++) {
+        listeners[i].fdServer = i == 0 ? fdServer 
+		: add_listening_socket(fdServer);
+	listeners[i].cpu = serverArgs.listeners > 0 ? listener_cpu(i) : -1;
+	listeners[i].counters = &(counters[i]);
+	listeners[i].stats = &stats;
+	listeners[i].serverArgs = &serverArgs;
+	listeners[i].handler = handler;
+	listeners[i].handlerArg = handlerArg;
+    }
+    if (serverArgs.listeners > 0) {
+        stats.numListeners = numListeners;
+	__atomic_store_n(&(stats.listeners), counters, __ATOMIC_RELEASE);
+    }
 
-	if (!check_connection_limit(fdClient, &locks, &stats, serverArgs)) {
-	    continue;
-	}
+    // Every socket is listening before any is accepted on, and this thread
+    // becomes the first listener
+    for (unsigned int i = 1; i < numListeners; i++) {
+        pthread_t threadId;
+	pthread_create(&threadId, NULL, listener_thread, &(listeners[i]));
+	pthread_detach(threadId);
+    }
+    listener_thread(&(listeners[0]));
+}
+
+void start_client_thread(void* arg, int fdClient) {
+    ThreadArguments* sharedArgs = (ThreadArguments*)arg;
     ThreadArguments* threadArgs = initialise_thread_arguments();
+    *threadArgs = *sharedArgs;
     threadArgs->fdClient = fdClient;
-	threadArgs->locks = &locks;
-	threadArgs->stats = &stats;
-	threadArgs->stringStores = stringStores;
-	threadArgs->serverArgs = &serverArgs;
-	
-	pthread_t threadId;
-	pthread_create(&threadId, NULL, client_thread, threadArgs);
-        pthread_detach(threadId);
-    }
+
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, client_thread, threadArgs);
+    pthread_detach(threadId);
 }
 
-bool check_connection_limit(int fdClient, Locks* locks, Statistics* stats, 
+bool check_connection_limit(int fdClient, Statistics* stats, 
 	ServerArguments serverArgs) {
-    take_lock(&(locks->statisticsLock));
-    
     // Reject connection if the number of connections == connection limit
-    if (serverArgs.connections != 0
-	    && stats->connectedClients >= serverArgs.connections) {
-        FILE* to = fdopen(fdClient, "w");
-	
-	// create response
-	char* response = construct_HTTP_response(
-		STATUS_SERVICE_UNAVAILABLE, 
-		STATUS_EXPLANATION_SERVICE_UNAVAILABLE, NULL, NULL);
-	
-	// Send response
-	fprintf(to, "%s", response);
-	fflush(to);
-	fclose(to);
-	release_lock(&(locks->statisticsLock));
+    if (!admit_client(stats, serverArgs.connections)) {
+	char response[HTTP_RESPONSE_HEAD_SIZE];
+	int length = http_format_response_head(response, sizeof(response),
+		STATUS_SERVICE_UNAVAILABLE, 0);
+	send(fdClient, response, length, MSG_NOSIGNAL);
+	close(fdClient);
 	return false;
     }
-    stats->connectedClients++;
-    release_lock(&(locks->statisticsLock));
     return true;
 }
 
+bool admit_client(Statistics* stats, int connectionLimit) {
+    int connected = __atomic_load_n(&(stats->connectedClients), 
+	    __ATOMIC_RELAXED);
+    do {
+        if (connectionLimit != 0 && connected >= connectionLimit) {
+	    return false;
+	}
+    } while (!__atomic_compare_exchange_n(&(stats->connectedClients), 
+	    &connected, connected + 1, false, __ATOMIC_RELAXED, 
+	    __ATOMIC_RELAXED));
+    return true;
+}
+
+void release_client(Statistics* stats) {
+    __atomic_fetch_sub(&(stats->connectedClients), 1, __ATOMIC_RELAXED);
+    increment_statistic(&(local_statistics(stats)->completedClients));
+}
+
+StatisticsSlot* local_statistics(Statistics* stats) {
+    static unsigned int nextSlot = 0;
+    static __thread int slot = -1;
+    if (slot < 0) {
+        slot = __atomic_fetch_add(&nextSlot, 1, __ATOMIC_RELAXED) 
+		% STATISTICS_SLOTS;
+    }
+    return &(stats->slots[slot]);
+}
+
+void increment_statistic(unsigned long* counter) {
+    add_statistic(counter, 1);
+}
+
+void add_statistic(unsigned long* counter, unsigned long amount) {
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
 void* client_thread(void* arg) {
     ThreadArguments* threadArgs = (ThreadArguments*)arg;
+    Connection* connection = connection_init(threadArgs->fdClient);
 
-    // Convert fd to FILE*
-    int fd2 = dup(threadArgs->fdClient);
-    FILE* to = fdopen(threadArgs->fdClient, "w");
-    FILE* from = fdopen(fd2, "r");
-
-    // Keep processing multiple requests from the client
-    while (1) {
-        if (!process_client_request(to, from, threadArgs)) {
-	        break;
-	    }
+    // Keep processing multiple requests from the client, sending the
+    // responses to each batch of requests received
+    while (connection_read(connection) 
+	    && process_buffered_requests(connection, threadArgs)) {
+        if (write_responses(connection, threadArgs->stats) < 0) {
+	    break;
+	}
     }
-    take_lock(&(threadArgs->locks->statisticsLock));
-    threadArgs->stats->connectedClients--;
-    threadArgs->stats->completedClients++;
-    release_lock(&(threadArgs->locks->statisticsLock));
+    write_responses(connection, threadArgs->stats);
+    release_client(threadArgs->stats);
     
     // Free resources and exit
-    fclose(to);
-    fclose(from);
+    connection_free(connection);
     free(arg);
     pthread_exit(NULL);
 }
 
-int process_client_request(FILE* to, FILE* from, ThreadArguments* threadArgs) {
-    HttpRequest httpRequest;
-    memset(&httpRequest, 0, sizeof(HttpRequest));
+int process_buffered_requests(Connection* connection, 
+	ThreadArguments* threadArgs) {
+    size_t processed = 0;
+    int result = 1;
+    while (processed < connection->inLength) {
+        HttpRequest httpRequest;
+	unsigned long long start = latency_now();
+	long length = http_parse_request(connection->in + processed, 
+		connection->inLength - processed, &(connection->parser), 
+		&httpRequest);
+	if (length == 0) {
+	    break;
+	}
+	// If a badly formed request is received stop reading requests
+	if (length < 0) {
+	    result = 0;
+	    break;
+	}
+	unsigned long long parsed = latency_now();
+	process_client_request(connection, &httpRequest, threadArgs);
+	processed += length;
+
+	RequestMetrics* metrics = 
+		request_metrics(threadArgs->stats, &httpRequest);
+	latency_record(&(metrics->stages[LATENCY_PARSE]), parsed - start);
+	latency_record(&(metrics->stages[LATENCY_TOTAL]), 
+		latency_now() - start);
+	add_statistic(&(metrics->requestBytes), length);
+    }
+    connection_consume(connection, processed);
+    return result;
+}
+
+void process_client_request(Connection* connection, HttpRequest* httpRequest,
+	ThreadArguments* threadArgs) {
     HttpResponse httpResponse;
     memset(&httpResponse, 0, sizeof(HttpResponse));
-    httpRequest.messageAuthenticated = true;
-
-    // If EOF or a badly formed request is received return early
-    char* address;
-    if (!get_HTTP_request(
-            from, 
-            &(httpRequest.method), 
-            &address, 
-            &(httpRequest.headers), 
-            &(httpRequest.body)
-        )
-    ) {
-	return 0;
-    }
-    deconstruct_address(&httpRequest, address);
+    httpRequest->messageAuthenticated = true;
 
     // If authentication fails mark http request as not authenticated. To be
-    // handled in handle_http_request
-    if (strcmp(httpRequest.dbType, "private") == 0 
-	    && !check_valid_authentication(&httpRequest, threadArgs)) {
-	take_lock(&(threadArgs->locks->statisticsLock));
-	threadArgs->stats->authFailures++;	    
-	release_lock(&(threadArgs->locks->statisticsLock));
-	httpRequest.messageAuthenticated = false;
-    }
-
-    // Handle http request and update statistics
-    take_lock(&(threadArgs->locks->databaseLock));
-    handle_http_request(&httpRequest, &httpResponse, threadArgs);
-    release_lock(&(threadArgs->locks->databaseLock));
-    update_statistics(&httpRequest, &httpResponse, threadArgs);
+    // handled in handle_http_request. Keyspaces created after this lookup
+    // are created on demand, so never have a secret. The statistics cover
+    // every keyspace, so need the private keyspace's secret
+    Keyspace* keyspace = 
+	    keyspace_find(threadArgs->keyspaces, httpRequest->dbType);
+    Authenticator* auth = keyspace != NULL ? keyspace->config.auth : NULL;
+    if (is_stats_request(httpRequest)) {
+        auth = keyspace_find(threadArgs->keyspaces, 
+		PRIVATE_STORE_NAME)->config.auth;
+    }
+    if (auth != NULL && !check_valid_authentication(httpRequest, auth)) {
+	increment_statistic(
+		&(local_statistics(threadArgs->stats)->authFailures));
+	httpRequest->messageAuthenticated = false;
+    }
+
+    // Handle http request and update statistics. Lock waits left over from
+    // outside a request are not counted
+    shardstore_take_lock_wait();
+    unsigned long long start = latency_now();
+    handle_http_request(httpRequest, &httpResponse, keyspace, threadArgs);
+    unsigned long long handled = latency_now() - start;
+    unsigned long long lockWait = shardstore_take_lock_wait();
+    RequestMetrics* metrics = request_metrics(threadArgs->stats, httpRequest);
+    latency_record(&(metrics->stages[LATENCY_LOCK_WAIT]), lockWait);
+    latency_record(&(metrics->stages[LATENCY_STORE]), 
+	    handled > lockWait ? handled - lockWait : 0);
+    update_statistics(httpRequest, &httpResponse, threadArgs);
     
-    // Create response and send to client
-    httpResponse.statusExplanation = 
-	    get_status_explanation(httpResponse.status);
-    char* response = construct_HTTP_response(httpResponse.status, 
-	        httpResponse.statusExplanation, NULL, httpResponse.body);
-    fprintf(to, "%s", response);
-    fflush(to);
+    // Queue the response head, followed by the body without copying it. The
+    // connection frees or hands back the body once it has been sent
+    char head[HTTP_RESPONSE_HEAD_SIZE];
+    size_t bodyLength = 
+	    httpResponse.body != NULL ? httpResponse.bodyLength : 0;
+    int headLength = http_format_response_head(head, sizeof(head), 
+	    httpResponse.status, bodyLength);
+    connection_queue(connection, head, headLength);
+    add_statistic(&(metrics->responseBytes), headLength + bodyLength);
+    if (httpResponse.body != NULL && httpResponse.releaseBody != NULL) {
+        connection_queue_external(connection, httpResponse.body, bodyLength,
+		httpResponse.releaseBody, httpResponse.releaseArg);
+	httpResponse.body = NULL;
+	httpResponse.releaseBody = NULL;
+    } else if (httpResponse.body != NULL) {
+        connection_queue_external(connection, httpResponse.body, bodyLength, 
+		free, httpResponse.body);
+	httpResponse.body = NULL;
+    }
 
     // Free resources
-    free(response);
-    free_http_request(&httpRequest);
     free_http_response(&httpResponse); 
-    return 1;
 }
 
 void update_statistics(HttpRequest* httpRequest, HttpResponse* httpResponse, 
 	ThreadArguments* threadArgs) {
-    // Only update statistics if the http response status = STATUS_OK
-    if (httpResponse->status != STATUS_OK) {
+    // Only update statistics if the http response status = STATUS_OK. 
+    // Reading the statistics is not an operation on a store
+    if (httpResponse->status != STATUS_OK || is_stats_request(httpRequest)) {
         return;
     }
-    take_lock(&(threadArgs->locks->statisticsLock));
+    StatisticsSlot* slot = local_statistics(threadArgs->stats);
     if (strcmp(httpRequest->method, "GET") == 0) {
-	threadArgs->stats->getOperations++;
+	increment_statistic(&(slot->getOperations));
     } else if (strcmp(httpRequest->method, "PUT") == 0) {
-	threadArgs->stats->putOperations++;
+	increment_statistic(&(slot->putOperations));
     } else if (strcmp(httpRequest->method, "DELETE") == 0) {
-	threadArgs->stats->deleteOperations++;
+	increment_statistic(&(slot->deleteOperations));
     }
-    release_lock(&(threadArgs->locks->statisticsLock));
 }
 
-void create_signal_thread(Statistics* stats, Locks* locks) {
+void create_signal_thread(Statistics* stats, Keyspaces* keyspaces,
+	Authenticator* auth) {
     SignalThreadArguments* sigThreadArgs = 
 	    malloc(sizeof(SignalThreadArguments));
     memset(sigThreadArgs, 0, sizeof(SignalThreadArguments));
     sigset_t set;
 
-    // Block SIGHUP
+    // Block SIGHUP and SIGUSR1
     sigemptyset(&set);
     sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGUSR1);
     pthread_sigmask(SIG_BLOCK, &set, NULL);
 
     // Create client connection handling thread
     pthread_t threadId;
     sigThreadArgs->set = set;
     sigThreadArgs->stats = stats;
-    sigThreadArgs->locks = locks;
+    sigThreadArgs->keyspaces = keyspaces;
+    sigThreadArgs->auth = auth;
     pthread_create(&threadId, NULL, &signal_thread, (void*)sigThreadArgs);
     pthread_detach(threadId);
 }
 
+void create_expiry_thread(Keyspaces* keyspaces) {
+    // The thread never handles signals, whatever the caller has blocked
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, expiry_thread, keyspaces);
+    pthread_detach(threadId);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+void* expiry_thread(void* arg) {
+    Keyspaces* keyspaces = (Keyspaces*)arg;
+    for (;;) {
+        sleep(EXPIRY_INTERVAL);
+	unsigned int now = (unsigned int)time(NULL);
+	size_t numKeyspaces = 0;
+	Keyspace** list = keyspaces_list(keyspaces, &numKeyspaces);
+	for (size_t i = 0; list != NULL && i < numKeyspaces; i++) {
+	    engine_expire(list[i]->engine, now);
+	}
+	free(list);
+    }
+    return NULL;
+}
+
+/* Returns part as a percentage of whole, 0 if whole is 0 */
+static double percentage(size_t part, size_t whole) {
+    return whole == 0 ? 0 : 100.0 * part / whole;
+}
+
+/* Sums the counters of the store of every keyspace into stats */
+static void sum_keyspace_statistics(Keyspaces* keyspaces, 
+	EngineStats* stats) {
+    memset(stats, 0, sizeof(EngineStats));
+    size_t numKeyspaces = 0;
+    Keyspace** list = keyspaces_list(keyspaces, &numKeyspaces);
+    for (size_t i = 0; list != NULL && i < numKeyspaces; i++) {
+        engine_stats(list[i]->engine, stats);
+    }
+    free(list);
+}
+
+void print_memory_statistics(Keyspaces* keyspaces) {
+    EngineStats storeStats;
+    sum_keyspace_statistics(keyspaces, &storeStats);
+    SlabStats memory = storeStats.memory;
+
+    // Occupancy is the share of slab pages in allocated chunks, and 
+    // fragmentation the share of all memory reserved that holds no entry
+    size_t pageBytes = memory.numPages * SLAB_PAGE_SIZE;
+    size_t largeBytes = memory.reservedBytes - pageBytes;
+    fprintf(stderr, STATS_KEY_BYTES, storeStats.keyBytes);
+    fprintf(stderr, STATS_MEMORY_RESERVED, memory.reservedBytes);
+    fprintf(stderr, STATS_MEMORY_USED, memory.requestedBytes);
+    fprintf(stderr, STATS_SLAB_PAGES, memory.numPages);
+    fprintf(stderr, STATS_SLAB_OCCUPANCY, 
+	    percentage(memory.usedBytes - largeBytes, pageBytes));
+    fprintf(stderr, STATS_FRAGMENTATION, percentage(memory.reservedBytes
+	    - memory.requestedBytes, memory.reservedBytes));
+}
+
+void print_pool_statistics(ThreadPool* pool) {
+    ThreadPoolStats poolStats;
+    threadpool_stats(pool, &poolStats);
+    fprintf(stderr, STATS_POOL_WORKERS, poolStats.workers);
+    fprintf(stderr, STATS_POOL_TASKS, poolStats.executed);
+    fprintf(stderr, STATS_POOL_STEALS, poolStats.stolen);
+    fprintf(stderr, STATS_POOL_QUEUE_FULL, poolStats.full);
+    fprintf(stderr, STATS_POOL_QUEUED, poolStats.queued);
+}
+
+void print_listener_statistics(Statistics* stats) {
+    ListenerStatistics* counters = 
+	    __atomic_load_n(&(stats->listeners), __ATOMIC_ACQUIRE);
+    for (unsigned int i = 0; counters != NULL && i < stats->numListeners;
+	    i++) {
+	fprintf(stderr, STATS_LISTENER_ACCEPTED, i, __atomic_load_n(
+		&(counters[i].accepted), __ATOMIC_RELAXED));
+	fprintf(stderr, STATS_LISTENER_REJECTED, i, __atomic_load_n(
+		&(counters[i].rejected), __ATOMIC_RELAXED));
+    }
+}
+
+void sum_statistics(Statistics* stats, StatisticsSlot* total) {
+    memset(total, 0, sizeof(StatisticsSlot));
+    for (int i = 0; i < STATISTICS_SLOTS; i++) {
+        StatisticsSlot* slot = &(stats->slots[i]);
+	total->completedClients += __atomic_load_n(
+		&(slot->completedClients), __ATOMIC_RELAXED);
+	total->authFailures += __atomic_load_n(
+		&(slot->authFailures), __ATOMIC_RELAXED);
+	total->getOperations += __atomic_load_n(
+		&(slot->getOperations), __ATOMIC_RELAXED);
+	total->putOperations += __atomic_load_n(
+		&(slot->putOperations), __ATOMIC_RELAXED);
+	total->deleteOperations += __atomic_load_n(
+		&(slot->deleteOperations), __ATOMIC_RELAXED);
+    }
+}
+
+/* Reloads the authentication string, and the secret of every keyspace with
+ * one of its own */
+static void reload_secrets(SignalThreadArguments* sigThreadArgs) {
+    auth_reload(sigThreadArgs->auth);
+    size_t numKeyspaces = 0;
+    Keyspace** list = keyspaces_list(sigThreadArgs->keyspaces, 
+	    &numKeyspaces);
+    for (size_t i = 0; list != NULL && i < numKeyspaces; i++) {
+        Authenticator* auth = list[i]->config.auth;
+	if (auth != NULL && auth != sigThreadArgs->auth) {
+	    auth_reload(auth);
+	}
+    }
+    free(list);
+}
+
 void* signal_thread(void* arg) {
     SignalThreadArguments* sigThreadArgs = (SignalThreadArguments*)arg;
     int sig;
 
     for (;;) {
         sigwait(&(sigThreadArgs->set), &sig);
-	take_lock(&(sigThreadArgs->locks->statisticsLock));
-	fprintf(stderr, STATS_CONNECTED_CLIENTS, 
-		sigThreadArgs->stats->connectedClients);
-	fprintf(stderr, STATS_COMPLETED_CLIENTS, 
-		sigThreadArgs->stats->completedClients);
-	fprintf(stderr, STATS_AUTH_FAILURES, 
-		sigThreadArgs->stats->authFailures);
-	fprintf(stderr, STATS_GET_OPERATIONS, 
-		sigThreadArgs->stats->getOperations);
-	fprintf(stderr, STATS_PUT_OPERATIONS, 
-		sigThreadArgs->stats->putOperations);
-	fprintf(stderr, STATS_DELETE_OPERATIONS, 
-		sigThreadArgs->stats->deleteOperations);
-	fflush(stderr);
-	release_lock(&(sigThreadArgs->locks->statisticsLock));
-    }
-}
+	if (sig == SIGUSR1) {
+	    reload_secrets(sigThreadArgs);
+	    continue;
+	}
 
-bool valid_authfile(char* authCommand) {
-    FILE* auth = fopen(authCommand, "r");
-    if (auth == NULL) {
-        return false;
-    }
+	// Sum the counters of every slot
+	Statistics* stats = sigThreadArgs->stats;
+	StatisticsSlot total;
+	sum_statistics(stats, &total);
 
-    char* line = read_line(auth);
-    if (line == NULL || line[0] == '\0') {
-        free(line);
-	fclose(auth);
-        return false;
+	fprintf(stderr, STATS_CONNECTED_CLIENTS, __atomic_load_n(
+		&(stats->connectedClients), __ATOMIC_RELAXED));
+	fprintf(stderr, STATS_COMPLETED_CLIENTS, total.completedClients);
+	fprintf(stderr, STATS_AUTH_FAILURES, total.authFailures);
+	fprintf(stderr, STATS_GET_OPERATIONS, total.getOperations);
+	fprintf(stderr, STATS_PUT_OPERATIONS, total.putOperations);
+	fprintf(stderr, STATS_DELETE_OPERATIONS, total.deleteOperations);
+	EngineStats storeStats;
+	sum_keyspace_statistics(sigThreadArgs->keyspaces, &storeStats);
+	fprintf(stderr, STATS_EXPIRED_KEYS, storeStats.expired);
+	fprintf(stderr, STATS_EVICTED_KEYS, storeStats.evicted);
+	print_memory_statistics(sigThreadArgs->keyspaces);
+	ThreadPool* pool = __atomic_load_n(&(stats->pool), __ATOMIC_ACQUIRE);
+	if (pool != NULL) {
+	    print_pool_statistics(pool);
+	}
+	print_listener_statistics(stats);
+	fflush(stderr);
     }
-    free(line);
-    fclose(auth);
-    return true;
 }
 
 void print_port(int serverFd) {
@@ -369,52 +976,137 @@ void print_port(int serverFd) {
     fflush(stderr);
 }
 
-void init_lock(sem_t* lock) {
-    sem_init(lock, 0, 1);
+Keyspaces* initialise_keyspaces(ServerArguments* serverArgs) {
+    KeyspaceConfig defaults;
+    memset(&defaults, 0, sizeof(KeyspaceConfig));
+    defaults.numShards = serverArgs->shards;
+    defaults.memoryLimit = (size_t)serverArgs->maxMemory * BYTES_PER_MB;
+    Keyspaces* keyspaces = keyspaces_init(serverArgs->engine, &defaults,
+	    serverArgs->maxKeyspaces, serverArgs->ordered,
+	    serverArgs->dataDir);
+
+    // The private keyspace keeps the server's secret unless given another
+    for (unsigned int i = 0; i < serverArgs->numKeyspaces; i++) {
+        KeyspaceOption* option = &(serverArgs->keyspaces[i]);
+	KeyspaceConfig config = option->config;
+	if (config.auth == NULL 
+		&& strcmp(option->name, PRIVATE_STORE_NAME) == 0) {
+	    config.auth = serverArgs->auth;
+	}
+	keyspace_add(keyspaces, option->name, &config, false);
+    }
+    KeyspaceConfig privateConfig = defaults;
+    privateConfig.memoryLimit = 0;
+    privateConfig.auth = serverArgs->auth;
+    keyspace_add(keyspaces, PUBLIC_STORE_NAME, &defaults, false);
+    keyspace_add(keyspaces, PRIVATE_STORE_NAME, &privateConfig, false);
+    return keyspaces;
 }
 
-void take_lock(sem_t* lock) {
-    sem_wait(lock);
+Keyspace* restore_keyspace(Keyspaces* keyspaces, const char* name) {
+    if (!http_valid_store_name(name)) {
+        return NULL;
+    }
+    KeyspaceConfig unsaved = keyspaces->defaults;
+    unsaved.auth = keyspace_find(keyspaces, PRIVATE_STORE_NAME)->config.auth;
+    return keyspace_restore(keyspaces, name, &unsaved);
 }
 
-void release_lock(sem_t* lock) {
-    sem_post(lock);
+/* Restores a keyspace for each snapshot in the data directory of a keyspace
+ * that does not exist yet. Returns false if the directory cannot be read */
+static bool restore_keyspaces(Keyspaces* keyspaces, const char* dataDir) {
+    DIR* dir = opendir(dataDir);
+    if (dir == NULL) {
+        return false;
+    }
+    size_t suffixLength = strlen(SNAPSHOT_FILE_EXTENSION);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+	if (length <= suffixLength || strcmp(entry->d_name 
+		+ length - suffixLength, SNAPSHOT_FILE_EXTENSION) != 0) {
+	    continue;
+	}
+	entry->d_name[length - suffixLength] = '\0';
+	restore_keyspace(keyspaces, entry->d_name);
+    }
+    closedir(dir);
+    return true;
 }
 
-StringStores* initialise_stringstores(void) {
-    StringStores* stringStores = (StringStores*)malloc(sizeof(StringStores));
-    memset(stringStores, 0, sizeof(StringStores));
-    stringStores->publicStore = stringstore_init();
-    stringStores->privateStore = stringstore_init();
-    return stringStores;
+void open_data_directory(Keyspaces* keyspaces, ServerArguments serverArgs) {
+    if (serverArgs.dataDir == NULL) {
+        return;
+    }
+    bool opened = (mkdir(serverArgs.dataDir, DATA_DIR_MODE) == 0 
+	    || errno == EEXIST) 
+	    && restore_keyspaces(keyspaces, serverArgs.dataDir);
+
+    // Map in each keyspace's snapshot. Only the header is read, so this 
+    // takes the same time however many keys were saved
+    size_t numKeyspaces = 0;
+    Keyspace** list = opened ? keyspaces_list(keyspaces, &numKeyspaces) 
+	    : NULL;
+    opened = list != NULL;
+    for (size_t i = 0; opened && i < numKeyspaces; i++) {
+        char* path = snapshot_path(serverArgs.dataDir, list[i]->name);
+	opened = path != NULL && engine_open_snapshot(list[i]->engine, path);
+	free(path);
+    }
+    free(list);
+
+    // Replay the changes logged since the snapshots, then carry on appending
+    WriteAheadLog* log = NULL;
+    long numReplayed = opened 
+	    ? wal_replay(serverArgs.dataDir, replay_change, keyspaces) : -1;
+    if (numReplayed >= 0) {
+	log = wal_open(serverArgs.dataDir, serverArgs.syncMode, 
+		serverArgs.syncInterval);
+    }
+    if (log == NULL) {
+        fprintf(stderr, DATA_DIR_ERROR);
+	exit(DATA_ERROR);
+    }
+    if (!keyspaces_attach_log(keyspaces, log)
+	    || checkpoint_start(serverArgs.dataDir, log, keyspaces,
+	    serverArgs.snapshotInterval, numReplayed > 0) == NULL) {
+        fprintf(stderr, DATA_DIR_ERROR);
+	exit(DATA_ERROR);
+    }
+}
+
+void replay_change(void* arg, unsigned long long generation, 
+	WalRecordType type, const char* store, const char* key, 
+	const char* value, size_t valueLength, unsigned int expiry) {
+    Keyspaces* keyspaces = (Keyspaces*)arg;
+    Keyspace* keyspace = restore_keyspace(keyspaces, store);
+    if (keyspace == NULL) {
+        return;
+    }
+    engine_replay(keyspace->engine, generation, type, key, value, 
+	    valueLength, expiry);
 }
 
 bool check_valid_authentication(HttpRequest* httpRequest, 
-	ThreadArguments* threadArgs) {
+	Authenticator* auth) {
     char* authWord = get_auth_string(httpRequest);
     if (authWord == NULL) {
         return false;
     }
-
-    // Open authfile and read in the auth string stored
-    FILE* authFile = fopen(threadArgs->serverArgs->authfile, "r");
-    char* storedAuthWord = read_line(authFile);
-
-    // Check if the database requires authentication and if its valid
-    if (strcmp(httpRequest->dbType, "private") == 0 
-	    && strcmp(authWord, storedAuthWord) == 0) {
-        free(storedAuthWord);
-	fclose(authFile);
-	return true;
-    }
-    free(storedAuthWord);
-    fclose(authFile);
-    return false;
+    return auth_check(auth, authWord);
 }
 
 void handle_http_request(HttpRequest* httpRequest, HttpResponse* httpResponse, 
-	ThreadArguments* threadArgs) {
+	Keyspace* keyspace, ThreadArguments* threadArgs) {
     httpResponse->body = NULL;
+    if (is_stats_request(httpRequest)) {
+        if (httpRequest->messageAuthenticated) {
+	    handle_stats(httpResponse, threadArgs);
+	} else {
+	    httpResponse->status = STATUS_UNAUTHORIZED;
+	}
+	return;
+    }
     if (!valid_http_method_and_address(httpRequest)) {
         httpResponse->status = STATUS_BAD_REQUEST;
         return;
@@ -426,36 +1118,249 @@ void handle_http_request(HttpRequest* httpRequest, HttpResponse* httpResponse,
         return;
     }
 
-    // Set stringstore to either public or private
-    StringStore* stringStore = threadArgs->stringStores->publicStore;
-    if (strcmp(httpRequest->dbType, "private") == 0) {
-        stringStore = threadArgs->stringStores->privateStore;
+    // Only a request storing keys may create the keyspace it is addressed to
+    if (keyspace == NULL && (strcmp(httpRequest->method, "PUT") == 0 
+	    || strcmp(httpRequest->method, "MPUT") == 0)) {
+        keyspace = keyspace_add(threadArgs->keyspaces, httpRequest->dbType,
+		NULL, true);
+    }
+    if (keyspace == NULL) {
+        httpResponse->status = STATUS_NOT_FOUND;
+	return;
+    }
+    StorageEngine* store = keyspace->engine;
+    if (is_batch_request(httpRequest)) {
+        handle_batch(store, httpRequest, httpResponse, threadArgs);
+	return;
+    }
+    if (is_scan_request(httpRequest)) {
+        handle_scan(store, httpRequest, httpResponse, threadArgs);
+	return;
     }
 
     // Handle different scenarios for GET, PUT and DELETE requests
     httpResponse->status = STATUS_OK;
     if (strcmp(httpRequest->method, "GET") == 0) {
-	// GET request response either 200 (OK) | 404 (Not Found)
-        char* valueRetrieved = 
-	        (char*)stringstore_retrieve(stringStore, httpRequest->key);
-
-	if (valueRetrieved == NULL) {
+	// GET request response either 200 (OK) | 404 (Not Found). A value
+	// borrowed from the store is sent straight from it, then handed back
+	EngineValue value;
+	if (engine_get(store, httpRequest->key, &value) != ENGINE_OK) {
             httpResponse->status = STATUS_NOT_FOUND;
-        } else {
-	    httpResponse->body = strdup(valueRetrieved);
+	} else {
+	    httpResponse->bodyLength = value.length;
+	    httpResponse->body = value.value;
+	    httpResponse->releaseBody = value.release;
+	    httpResponse->releaseArg = value.releaseArg;
 	}
     } else if (strcmp(httpRequest->method, "PUT") == 0) {
-	// PUT request response either 200 (OK) | 500 (Internal Server Error)
-	if (!stringstore_add(stringStore, httpRequest->key, 
-		httpRequest->body)) {
+        // PUT request response either 200 (OK) | 400 (Bad Request) for an
+	// invalid time to live | 500 (Internal Server Error)
+	unsigned int expiry;
+	if (!http_get_expiry(httpRequest, (unsigned int)time(NULL), 
+		&expiry)) {
+	    httpResponse->status = STATUS_BAD_REQUEST;
+	    return;
+	}
+	if (engine_put(store, httpRequest->key, httpRequest->body, 
+		httpRequest->bodyLength, expiry) != ENGINE_OK) {
 	    httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
 	}
     } else if (strcmp(httpRequest->method, "DELETE") == 0) {
-	// DELETE request response either 200 (OK) | 404 (Not Found)
-	if (!stringstore_delete(stringStore, httpRequest->key)) {
+	// DELETE request response either 200 (OK) | 404 (Not Found) | 
+	// 500 (Internal Server Error)
+	EngineStatus deleted = engine_delete(store, httpRequest->key);
+	if (deleted == ENGINE_NOT_FOUND) {
 	    httpResponse->status = STATUS_NOT_FOUND;
+	} else if (deleted != ENGINE_OK) {
+	    httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+	}
+    }
+}
+
+void handle_batch(StorageEngine* store, HttpRequest* httpRequest, 
+	HttpResponse* httpResponse, ThreadArguments* threadArgs) {
+    size_t numKeys = handle_batch_request(store, httpRequest, httpResponse);
+    if (httpResponse->status != STATUS_OK) {
+        return;
+    }
+
+    // Each key counts as one operation of the method's single key form
+    StatisticsSlot* slot = local_statistics(threadArgs->stats);
+    if (strcmp(httpRequest->method, "MGET") == 0) {
+	add_statistic(&(slot->getOperations), numKeys);
+    } else if (strcmp(httpRequest->method, "MPUT") == 0) {
+	add_statistic(&(slot->putOperations), numKeys);
+    } else {
+	add_statistic(&(slot->deleteOperations), numKeys);
+    }
+}
+
+void handle_scan(StorageEngine* store, HttpRequest* httpRequest, 
+	HttpResponse* httpResponse, ThreadArguments* threadArgs) {
+    size_t numKeys = handle_scan_request(store, httpRequest, httpResponse);
+    if (httpResponse->status == STATUS_OK) {
+        add_statistic(&(local_statistics(threadArgs->stats)->getOperations),
+		numKeys);
+    }
+}
+
+RequestMetrics* request_metrics(Statistics* stats, HttpRequest* httpRequest) {
+    MetricsMethod method = METRICS_OTHER;
+    for (int i = 0; i < METRICS_OTHER; i++) {
+        if (strcmp(httpRequest->method, metricsMethodNames[i]) == 0) {
+	    method = i;
+	    break;
 	}
     }
+    MetricsStore store = METRICS_NO_STORE;
+    if (strcmp(httpRequest->dbType, PUBLIC_STORE_NAME) == 0) {
+        store = METRICS_PUBLIC;
+    } else if (strcmp(httpRequest->dbType, PRIVATE_STORE_NAME) == 0) {
+        store = METRICS_PRIVATE;
+    } else if (!is_stats_request(httpRequest) 
+	    && http_valid_store_name(httpRequest->dbType)) {
+        store = METRICS_NAMED;
+    }
+    return &(stats->metrics->requests[method][store]);
+}
+
+int write_responses(Connection* connection, Statistics* stats) {
+    unsigned long long start = latency_now();
+    int written = connection_write(connection);
+    latency_record(&(stats->metrics->writes), latency_now() - start);
+    return written;
+}
+
+bool is_stats_request(HttpRequest* httpRequest) {
+    return strcmp(httpRequest->method, "GET") == 0 
+	    && strcmp(httpRequest->dbType, HTTP_STATS_ADDRESS) == 0
+	    && httpRequest->key[0] == '\0';
+}
+
+/* Writes the latencies and sizes of every kind of request received to each
+ * store as members of a JSON object, leaving out the ones never received */
+static void write_request_metrics(FILE* out, ServerMetrics* metrics) {
+    bool firstMethod = true;
+    for (int method = 0; method < METRICS_METHODS; method++) {
+        bool firstStore = true;
+	for (int store = 0; store < METRICS_STORES; store++) {
+	    RequestMetrics* request = &(metrics->requests[method][store]);
+	    LatencySummary total;
+	    latency_summarise(&(request->stages[LATENCY_TOTAL]), &total);
+	    if (total.count == 0) {
+	        continue;
+	    }
+	    if (firstStore) {
+	        fprintf(out, "%s\"%s\":{", firstMethod ? "" : ",", 
+			metricsMethodNames[method]);
+		firstMethod = false;
+	    }
+	    fprintf(out, "%s\"%s\":{\"requests\":%lu,\"request_bytes\":%lu,"
+		    "\"response_bytes\":%lu", firstStore ? "" : ",", 
+		    metricsStoreNames[store], total.count, __atomic_load_n(
+		    &(request->requestBytes), __ATOMIC_RELAXED), 
+		    __atomic_load_n(&(request->responseBytes), 
+		    __ATOMIC_RELAXED));
+	    firstStore = false;
+	    for (int stage = 0; stage < LATENCY_STAGES; stage++) {
+	        fprintf(out, ",\"%s\":", latencyStageNames[stage]);
+		latency_write_json(out, &(request->stages[stage]));
+	    }
+	    fprintf(out, "}");
+	}
+	if (!firstStore) {
+	    fprintf(out, "}");
+	}
+    }
+}
+
+/* Writes the setup, keys and memory of every keyspace as the member 
+ * "keyspaces" of a JSON object */
+static void write_keyspace_statistics(FILE* out, Keyspaces* keyspaces) {
+    size_t numKeyspaces = 0;
+    Keyspace** list = keyspaces_list(keyspaces, &numKeyspaces);
+    fprintf(out, ",\"keyspaces\":{");
+    for (size_t i = 0; list != NULL && i < numKeyspaces; i++) {
+        EngineStats keyspaceStats;
+	memset(&keyspaceStats, 0, sizeof(EngineStats));
+	engine_stats(list[i]->engine, &keyspaceStats);
+	fprintf(out, "%s\"%s\":{\"shards\":%u,\"memory_limit\":%zu,"
+		"\"authenticated\":%s,\"on_demand\":%s,\"key_bytes\":%zu,"
+		"\"used_bytes\":%zu,\"expired_keys\":%lu,"
+		"\"evicted_keys\":%lu}", i == 0 ? "" : ",", list[i]->name,
+		list[i]->config.numShards, list[i]->config.memoryLimit,
+		list[i]->config.auth != NULL ? "true" : "false",
+		list[i]->onDemand ? "true" : "false", keyspaceStats.keyBytes,
+		keyspaceStats.memory.requestedBytes, keyspaceStats.expired,
+		keyspaceStats.evicted);
+    }
+    fprintf(out, "}");
+    free(list);
+}
+
+void handle_stats(HttpResponse* httpResponse, ThreadArguments* threadArgs) {
+    char* body = NULL;
+    size_t bodyLength = 0;
+    FILE* out = open_memstream(&body, &bodyLength);
+    if (out == NULL) {
+        httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+	return;
+    }
+    Statistics* stats = threadArgs->stats;
+    StatisticsSlot total;
+    sum_statistics(stats, &total);
+    EngineStats storeStats;
+    sum_keyspace_statistics(threadArgs->keyspaces, &storeStats);
+    fprintf(out, "{\"connected_clients\":%d,\"completed_clients\":%lu,"
+	    "\"auth_failures\":%lu,\"get_operations\":%lu,"
+	    "\"put_operations\":%lu,\"delete_operations\":%lu,"
+	    "\"expired_keys\":%lu,\"evicted_keys\":%lu", 
+	    __atomic_load_n(&(stats->connectedClients), __ATOMIC_RELAXED),
+	    total.completedClients, total.authFailures, total.getOperations,
+	    total.putOperations, total.deleteOperations, storeStats.expired,
+	    storeStats.evicted);
+    fprintf(out, ",\"memory\":{\"key_bytes\":%zu,\"reserved_bytes\":%zu,"
+	    "\"used_bytes\":%zu,\"slab_pages\":%zu}", 
+	    storeStats.keyBytes, storeStats.memory.reservedBytes,
+	    storeStats.memory.requestedBytes, storeStats.memory.numPages);
+    write_keyspace_statistics(out, threadArgs->keyspaces);
+
+    ThreadPool* pool = __atomic_load_n(&(stats->pool), __ATOMIC_ACQUIRE);
+    if (pool != NULL) {
+        ThreadPoolStats poolStats;
+	threadpool_stats(pool, &poolStats);
+	fprintf(out, ",\"pool\":{\"workers\":%u,\"tasks\":%lu,"
+		"\"steals\":%lu,\"queue_full\":%lu,\"queued\":%zu}", 
+		poolStats.workers, poolStats.executed, poolStats.stolen, 
+		poolStats.full, poolStats.queued);
+    }
+    ListenerStatistics* counters = 
+	    __atomic_load_n(&(stats->listeners), __ATOMIC_ACQUIRE);
+    if (counters != NULL) {
+        fprintf(out, ",\"listeners\":[");
+	for (unsigned int i = 0; i < stats->numListeners; i++) {
+	    fprintf(out, "%s{\"accepted\":%lu,\"rejected\":%lu}", 
+		    i == 0 ? "" : ",", __atomic_load_n(
+		    &(counters[i].accepted), __ATOMIC_RELAXED), 
+		    __atomic_load_n(&(counters[i].rejected), 
+		    __ATOMIC_RELAXED));
+	}
+	fprintf(out, "]");
+    }
+
+    fprintf(out, ",\"requests\":{");
+    write_request_metrics(out, stats->metrics);
+    fprintf(out, "},\"writes\":");
+    latency_write_json(out, &(stats->metrics->writes));
+    fprintf(out, "}\n");
+    if (fclose(out) != 0) {
+        free(body);
+	httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+	return;
+    }
+    httpResponse->status = STATUS_OK;
+    httpResponse->body = body;
+    httpResponse->bodyLength = bodyLength;
 }
 
 ThreadArguments* initialise_thread_arguments(void) {
@@ -21,50 +21,147 @@
 // #include <csse2310a4.h>
 #include <semaphore.h>
 #include "http.h"
+#include "shardstore.h"
+#include "engine.h"
+#include "connection.h"
+#include "threadpool.h"
+#include "latency.h"
+#include "auth.h"
+#include "keyspace.h"
 
-/* Public and Private instances of string stores */
+/* A keyspace configured with --keyspace. authfile is the file its secret is
+ * read from, NULL if its requests need none */
 typedef struct {
-    StringStore* publicStore;
-    StringStore* privateStore;
-} StringStores;
+    char* name;
+    char* authfile;
+    KeyspaceConfig config;
+} KeyspaceOption;
 
 /* The arguments passed to dbserver */
 typedef struct {
     char* authfile;
     int connections;
     char* port;
+    unsigned int shards;
+    unsigned int epollWorkers;
+    unsigned int poolWorkers;
+    unsigned int poolQueueDepth;
+    unsigned int listeners;
+    char* dataDir;
+    WalSyncMode syncMode;
+    unsigned int syncInterval;
+    unsigned int snapshotInterval;
+    unsigned int maxMemory;
+    bool ordered;
+    const StorageEngineOps* engine;
+    KeyspaceOption* keyspaces;
+    unsigned int numKeyspaces;
+    unsigned int maxKeyspaces;
+    Authenticator* auth;
 } ServerArguments;
 
-/* The dbserver statistics */
+/* Number of counter slots the threads of dbserver are spread over */
+#define STATISTICS_SLOTS 16
+
+/* Counters updated by one group of threads. Every slot sits on its own cache
+ * line, so threads using different slots never contend. The counters are
+ * only ever updated atomically */
 typedef struct {
-    int connectedClients;
-    int completedClients;
-    int authFailures;
-    int getOperations;
-    int putOperations;
-    int deleteOperations;
-} Statistics;
+    unsigned long completedClients;
+    unsigned long authFailures;
+    unsigned long getOperations;
+    unsigned long putOperations;
+    unsigned long deleteOperations;
+} __attribute__((aligned(CACHE_LINE_SIZE))) StatisticsSlot;
 
-/* Locks for the database and statistics to enforce mutual exclusion */
+/* Counters of the clients one listener thread has admitted and turned away,
+ * on a cache line of their own as only that listener updates them */
 typedef struct {
-    sem_t databaseLock;
-    sem_t statisticsLock;
-} Locks;
+    unsigned long accepted;
+    unsigned long rejected;
+} __attribute__((aligned(CACHE_LINE_SIZE))) ListenerStatistics;
+
+/* The kinds of request whose latencies and sizes are recorded apart */
+typedef enum {
+    METRICS_GET = 0,
+    METRICS_PUT = 1,
+    METRICS_DELETE = 2,
+    METRICS_MGET = 3,
+    METRICS_MPUT = 4,
+    METRICS_MDELETE = 5,
+    METRICS_SCAN = 6,
+    METRICS_OTHER = 7,
+    METRICS_METHODS = 8
+} MetricsMethod;
+
+/* The stores requests are recorded apart for. Requests to every other
+ * keyspace are recorded together as METRICS_NAMED, and METRICS_NO_STORE is
+ * for the requests addressed to no keyspace */
+typedef enum {
+    METRICS_PUBLIC = 0,
+    METRICS_PRIVATE = 1,
+    METRICS_NAMED = 2,
+    METRICS_NO_STORE = 3,
+    METRICS_STORES = 4
+} MetricsStore;
+
+/* The stages of serving a request that are timed. The store stage runs from
+ * when the request has been authenticated until its response is ready, less
+ * the time waiting for shard locks. The total runs from when parsing starts
+ * until the response is queued to be sent */
+typedef enum {
+    LATENCY_PARSE = 0,
+    LATENCY_LOCK_WAIT = 1,
+    LATENCY_STORE = 2,
+    LATENCY_TOTAL = 3,
+    LATENCY_STAGES = 4
+} LatencyStage;
+
+/* Latencies of each stage of one kind of request to one store, and the 
+ * bytes of the requests received and responses sent */
+typedef struct {
+    LatencyHistogram stages[LATENCY_STAGES];
+    unsigned long requestBytes;
+    unsigned long responseBytes;
+} RequestMetrics;
+
+/* The latencies recorded by dbserver. writes holds the time taken by each
+ * send of the queued responses of a connection, which may hold the 
+ * responses to several kinds of request at once */
+typedef struct {
+    RequestMetrics requests[METRICS_METHODS][METRICS_STORES];
+    LatencyHistogram writes;
+} ServerMetrics;
+
+/* The dbserver statistics. connectedClients is shared as every thread checks
+ * it against the connection limit, the other counters are summed over the
+ * slots when they are printed. pool is the worker pool serving connections,
+ * NULL unless dbserver was started with --pool. listeners holds the counters
+ * of each of the numListeners listener threads, NULL unless dbserver was 
+* started with --listeners. metrics holds the latencies of every request */
+typedef struct {
+    int connectedClients __attribute__((aligned(CACHE_LINE_SIZE)));
+    StatisticsSlot slots[STATISTICS_SLOTS];
+    ThreadPool* pool;
+    ListenerStatistics* listeners;
+    unsigned int numListeners;
+    ServerMetrics* metrics;
+} Statistics;
 
 /* Arguments passed to the thread handling client connections */
 typedef struct ThreadArguments {
     int fdClient;
-    Locks* locks;
     Statistics* stats;
-    StringStores* stringStores;
+    Keyspaces* keyspaces;
     ServerArguments* serverArgs;
 } ThreadArguments;
 
-/* Arguments passed to the thread handling the signal SIGHUP */
+/* Arguments passed to the thread handling the signals SIGHUP and SIGUSR1 */
 typedef struct {
     Statistics* stats;
+    Keyspaces* keyspaces;
+    Authenticator* auth;
     sigset_t set;
-    Locks* locks;
 } SignalThreadArguments;
 
 /* The different types of exit statuses */
@@ -72,7 +169,8 @@ typedef enum {
     OK = 0,
     USAGE_ERROR = 1,
     AUTHENTICATION_ERROR = 2,
-    LISTEN_ERROR = 3
+    LISTEN_ERROR = 3,
+    DATA_ERROR = 4
 } ErrorType;
 
 /* process_command_line()
@@ -81,12 +179,30 @@ typedef enum {
 *
 * The expected structure of the command line arguments is:
 *
-*     ./dbserver authfile connections [portnum]
+*     ./dbserver [--shards n] [--epoll n] [--pool n] [--pool-queue depth]
+*             [--listeners n] [--data-dir dir] [--sync none|batch|op]
+*             [--sync-interval usec] [--engine name]
+*             [--keyspace name[:shards[:mb[:authfile]]]]...
+*             [--max-keyspaces n] authfile connections [portnum]
 *
 * "authfile" is the name of a text file containing the authentication string. 
 * "connections" is a positive integer limiting the number of allowed active 
 * connections. "portnum" is the portnumber the server is to bind to that must 
-* be a positive integer between 1024 and 65535 inclusive.
+* be a positive integer between 1024 and 65535 inclusive. "--shards" sets the
+* number of independently locked partitions each store is split into.
+* "--epoll" serves clients from the given number of event loop threads rather
+* than a thread per connection. "--pool" serves them from a work stealing pool
+* of that many threads instead, each queueing up to "--pool-queue" ready
+* connections, and may not be given with "--epoll". "--listeners" accepts 
+* clients on that many threads, each with its own socket on the port. 
+* "--data-dir" keeps a write-ahead log in the given directory, "--sync" sets
+* how far each change must reach in the log before it is acknowledged and 
+* "--sync-interval" how many microseconds each group of changes waits for 
+* more to join it before syncing. "--engine" selects the storage engine that
+* runs every keyspace by name. Each "--keyspace" creates a keyspace with its
+* own number of shards, memory limit in megabytes and authfile, any of which
+* may be left empty for the defaults. "--max-keyspaces" lets that many more
+* keyspaces be created by requests.
 *
 * argc: the number of command line arguments passed.
 * argv: an array containing the command line arguments
@@ -106,6 +222,8 @@ ServerArguments process_command_line(int argc, char** argv);
 * port
 *
 * port: the port the server will try to bind to and listen on.
+* reusePort: set SO_REUSEPORT, so more sockets can be bound to the same port
+* with add_listening_socket()
 *
 * Returns: the file descriptor the server is listening on
 * Errors: if there is an issue getting the address info this function will exit
@@ -114,7 +232,20 @@ ServerArguments process_command_line(int argc, char** argv);
 * exit with status 3
 * Reference: CSSE2310 Week 10 server-multithreaded.c
 */
-int initialise_server(const char* port);
+int initialise_server(const char* port, bool reusePort);
+
+/* add_listening_socket()
+* −−−−−−−−−−−−−−−
+* Creates another socket listening on the same port as the server, so the 
+* kernel spreads new connections between them.
+*
+* fdServer: a socket returned by initialise_server() with reusePort set
+*
+* Returns: the file descriptor of the new socket
+* Errors: failure to bind to the port will print out PORT_BIND_ERROR and 
+* exit with status 3
+*/
+int add_listening_socket(int fdServer);
 
 /* process_connections()
 * −−−−−−−−−−−−−−−
@@ -122,20 +253,38 @@ int initialise_server(const char* port);
 * connections.
 *
 * If the connection limit is reached the client connection handling thread will
-* not be created.
+* not be created. If dbserver was started with --epoll or --pool the 
+* connections are handed to the event loop or worker pool instead. With
+* --listeners the clients are accepted by that many listener threads, each 
+* on its own socket and CPU, otherwise by the calling thread.
 *
 * fdServer: file descriptor the server listens on for incomming connections. 
 * Not NULL
 * serverArgs: ServerArguments struct containing the command line arguments used
 * when calling dbserver. Not NULL
+* keyspaces: the keyspaces served. Not NULL
 * 
+* Errors: if memory for the listeners cannot be allocated, PORT_BIND_ERROR is
+* printed and the program exits with status 3
 * Reference: CSSE2310 Week 10 server-multithreaded.c
 */
-void process_connections(int fdServer, ServerArguments serverArgs);
+void process_connections(int fdServer, ServerArguments serverArgs, 
+	Keyspaces* keyspaces);
+
+/* start_client_thread()
+* −−−−−−−−−−−−−−−
+* Creates a thread to serve an admitted client for as long as it stays 
+* connected.
+*
+* arg: ThreadArguments holding the stores, statistics and server arguments,
+* copied for the new thread. Not NULL
+* fdClient: the socket of the client
+*/
+void start_client_thread(void* arg, int fdClient);
 
 /* client_thread()
 * −−−−−−−−−−−−−−−
-* Thread function opens file streams to the client and processes requests.
+* Thread function reading requests from the client and sending responses.
 *
 * This function will handle multiple requests coming from one client. If the 
 * incoming http request is valid the dbserver statistics will update 
@@ -147,37 +296,43 @@ void process_connections(int fdServer, ServerArguments serverArgs);
 */
 void* client_thread(void* arg);
 
-/* process_client_request()
+/* process_buffered_requests()
 * −−−−−−−−−−−−−−−
-* Processes an individual client http request.
+* Processes every complete request in a connection's receive buffer, queueing
+* the responses in its send buffer.
 *
-* The http request is read and authentication is checked for validity if 
-* required. If the request is valid a http response is formed and sent to the 
-* client.
+* Pipelined requests are all answered before anything is written, so their
+* responses go out together in one write. The requests are parsed in place,
+* and the bytes of the requests processed are then removed from the receive
+* buffer. A partly received request is left in the buffer to be finished by
+* a later call.
 *
-* to: file stream used to write to the client. Not NULL
-* from: File stream used to receive data from the client. Not NULL
-* threadArgs: ThreadArguments struct containing data passed into the 
-* thread function. Not NULL
+* connection: the connection holding the received requests. Not NULL
+* threadArgs: ThreadArguments holding the stores, statistics and server
+* arguments. Not NULL
 *
-* Returns: 0 if the http request recieved is malformed. 1 if the http request
-* is succesfully received, processed and sent to the client.
+* Returns: 0 if a malformed request was received and the connection should be
+* closed, 1 otherwise
 */
-int process_client_request(FILE* to, FILE* from, ThreadArguments* threadArgs);
+int process_buffered_requests(Connection* connection, 
+	ThreadArguments* threadArgs);
 
-/* valid_authfile()
+/* process_client_request()
 * −−−−−−−−−−−−−−−
-* Checks if the authfile provided is valid.
-*
-* A valid auth file is one that can be opened for reading and does not have an
-* empty first line.
+* Processes an individual client http request.
 *
-* authCommand: the name of the authfile that was passed as a command line 
-* argument on call to dbserver
+* The keyspace addressed is looked up, its authentication checked for 
+* validity if it has a secret, the request is carried out and the http
+* response is queued to be sent to the client. The response
+* body is queued without being copied.
 *
-* Returns: true if the authentication file is valid, false otherwise. 
+* connection: the connection the request was received on. Not NULL
+* httpRequest: HttpRequest struct holding the parsed request. Not NULL
+* threadArgs: ThreadArguments struct containing data passed into the 
+* thread function. Not NULL
 */
-bool valid_authfile(char* authCommand);
+void process_client_request(Connection* connection, HttpRequest* httpRequest,
+	ThreadArguments* threadArgs);
 
 /* print_port()
 * −−−−−−−−−−−−−−−
@@ -189,63 +344,103 @@ bool valid_authfile(char* authCommand);
 */
 void print_port(int serverFd);
 
-/* inti_lock()
+/* initialise_keyspaces()
 * −−−−−−−−−−−−−−−
-* Initialises a semaphore lock with a value of 1.
+* Creates the keyspaces given with --keyspace, followed by the public and
+* private keyspaces unless they were among them.
 *
-* lock: the semaphore to initialise as a lock
+* The public keyspace is bounded by --max-memory, as is every keyspace 
+* created on demand, and the private keyspace takes the server's secret
+* unless it was given an authfile of its own.
 *
-* Reference: CSSE2310 Week 7 race3.c
+* serverArgs: ServerArguments struct containing the command line arguments
+* used when calling dbserver. Not NULL
+*
+* Returns: the keyspaces created with malloc
 */
-void init_lock(sem_t* lock);
+Keyspaces* initialise_keyspaces(ServerArguments* serverArgs);
 
-/* take_lock()
+/* open_data_directory()
 * −−−−−−−−−−−−−−−
-* Takes a lock of the given semaphore.
+* Restores the stores from the snapshots and write-ahead log in the data 
+* directory and attaches the log to them, so every later change is recorded.
+*
+* A keyspace is restored for every snapshot found of a keyspace not
+* configured, as for restore_keyspace(). Each snapshot is mapped into memory
+* and attached to its keyspace's store, then the log written since is
+* replayed on top. A background thread copies the snapshots into the stores
+* and saves new ones every snapshotInterval seconds.
 *
-* lock: the semaphore to wait on
+* Does nothing unless dbserver was started with --data-dir. The directory is
+* created if it does not exist.
 *
-* Reference: CSSE2310 Week 7 race3.c
+* keyspaces: the keyspaces configured on the command line. Not NULL
+* serverArgs: ServerArguments struct containing the command line arguments 
+* used when calling dbserver
+*
+* Errors: if the directory, a snapshot or the log cannot be opened or read,
+* a snapshot is damaged or the setup of a keyspace cannot be saved,
+* DATA_DIR_ERROR is printed and the program exits with status 4
 */
-void take_lock(sem_t* lock);
+void open_data_directory(Keyspaces* keyspaces, ServerArguments serverArgs);
 
-/* release_lock()
+/* restore_keyspace()
 * −−−−−−−−−−−−−−−
-* Release a lock of the given semaphore.
+* Adds a keyspace found in the data directory that is not configured on the
+* command line, set up as it was saved there, with keyspace_restore(). One
+* saved without its setup by an older server is given the defaults, and its
+* requests must carry the secret of the private keyspace, as must those of
+* one whose authfile can no longer be read.
 *
-* lock: the semaphore to post with
+* keyspaces: the keyspaces being restored, holding the private keyspace. Not
+* NULL
+* name: the name of the keyspace. Not NULL
 *
-* Reference: CSSE2310 Week 7 race3.c
+* Returns: the keyspace with the name, NULL if the name is not valid or the
+* keyspace could not be created
 */
-void release_lock(sem_t* lock);
+Keyspace* restore_keyspace(Keyspaces* keyspaces, const char* name);
 
-/* initialise_stringstores()
+/* replay_change()
 * −−−−−−−−−−−−−−−
-* Initialises the public and private string stores.
-*
-* Returns: pointer to StringStores containing public and private stringstore 
-* created with malloc.
+* Applies a change read back from the write-ahead log to the keyspace it was
+* made to, restoring the keyspace with restore_keyspace() if it does not
+* exist. 
+* Records from log generations older than the keyspace's snapshot are 
+* skipped.
+*
+* arg: the Keyspaces being restored, cast to a void*. Not NULL
+* generation: the log generation the record is from
+* type: the type of change
+* store: the name of the store changed. Not NULL
+* key: the key changed. Not NULL
+* value: the valueLength bytes stored by a WAL_PUT
+* valueLength: the number of bytes in value
+* expiry: when a key put expires, 0 if it never does. A key that has already
+* expired is deleted instead
 */
-StringStores* initialise_stringstores(void);
+void replay_change(void* arg, unsigned long long generation, 
+	WalRecordType type, const char* store, const char* key, 
+	const char* value, size_t valueLength, unsigned int expiry);
 
 /* check_valid_authentication()
 * −−−−−−−−−−−−−−−
 * Checks if the authentication string provided in the http request header 
-* matches with the authentication file used by the server.
+* matches with the authentication file of the keyspace addressed.
 * 
 * The first line in the authentication file is used as the authentication 
-* string for the database server, that must match up with the authentication
-* http header provided
+* string for the keyspace, that must match up with the authentication
+* http header provided. The string is read once at startup and compared in
+* constant time, so no file is opened for the request.
 *
 * httpRequest: HttpRequest struct containing the http request information Not 
 * NULL
-* threadArgs: ThreadArguments struct containing the arguments passed into the 
-* client thread function. Not NULL
+* auth: the secret of the keyspace addressed. Not NULL
 *
 * Returns: true if the authenitcation string is valid, false otherwise
 */
 bool check_valid_authentication(HttpRequest* httpRequest, 
-	ThreadArguments* threadArgs);
+	Authenticator* auth);
 
 /* check_connection_limit()
 * −−−−−−−−−−−−−−−
@@ -255,8 +450,10 @@ bool check_valid_authentication(HttpRequest* httpRequest,
 * restricts the number of active clients that can be connected to the server 
 * at once.
 *
+* The client is admitted with a single atomic update of the connected client
+* count, so no lock is taken.
+*
 * fdClient: file descriptor used to communicate with client
-* locks: Locks struct containing the statistics lock. Not NULL
 * stats: Statistics struct containing the statistics for the server. Not NULL
 * serverArgs: ServerArguments struct containing the arguments passed into 
 * dbserver. Not NULL
@@ -264,27 +461,101 @@ bool check_valid_authentication(HttpRequest* httpRequest,
 * Returns: true if the client is able to connect. false if the connection
 * limit has been reached, and client is unable to connect.
 */
-bool check_connection_limit(int fdClient, Locks* locks, Statistics* stats, 
+bool check_connection_limit(int fdClient, Statistics* stats, 
 	ServerArguments serverArgs);
 
+/* admit_client()
+* −−−−−−−−−−−−−−−
+* Atomically counts a new connected client if the connection limit allows it.
+*
+* stats: Statistics struct containing the statistics for the server. Not NULL
+* connectionLimit: the maximum number of connected clients, 0 for no limit
+*
+* Returns: true if the client was counted as connected, false if the limit
+* has been reached
+*/
+bool admit_client(Statistics* stats, int connectionLimit);
+
+/* release_client()
+* −−−−−−−−−−−−−−−
+* Counts a connected client as completed once its connection has closed.
+*
+* stats: Statistics struct containing the statistics for the server. Not NULL
+*/
+void release_client(Statistics* stats);
+
+/* local_statistics()
+* −−−−−−−−−−−−−−−
+* Gets the statistics slot the calling thread updates.
+*
+* Threads are given slots in turn the first time they call this function.
+*
+* stats: Statistics struct containing the statistics for the server. Not NULL
+*
+* Returns: the calling thread's statistics slot
+*/
+StatisticsSlot* local_statistics(Statistics* stats);
+
+/* increment_statistic()
+* −−−−−−−−−−−−−−−
+* Atomically adds one to a counter in a statistics slot.
+*
+* counter: the counter to increment. Not NULL
+*/
+void increment_statistic(unsigned long* counter);
+
+/* add_statistic()
+* −−−−−−−−−−−−−−−
+* Atomically adds an amount to a counter in a statistics slot.
+*
+* counter: the counter to add to. Not NULL
+* amount: the amount to add
+*/
+void add_statistic(unsigned long* counter, unsigned long amount);
+
 /* create_signal_thread()
 * −−−−−−−−−−−−−−−
-* Creates a thread that handles incoming SIGHUP signals.
+* Creates a thread that handles incoming SIGHUP and SIGUSR1 signals.
 *
-* SIGHUP is blocked on the main thread and a new thread is created to handle
-* SIGHUP.
+* SIGHUP and SIGUSR1 are blocked on the main thread and a new thread is 
+* created to handle them.
 *
 * stats: Statistics struct that holds the statistics for dbserver. Not NULL
-* locks: Locks struct holding the locks for the database and statistics. Not 
-* NULL
+* keyspaces: the keyspaces whose memory use is reported and whose secrets
+* are reloaded on SIGUSR1. Not NULL
+* auth: the authentication string reloaded on SIGUSR1. Not NULL
 *
 * Reference: pthread_sigmask(3) man page example
 */
-void create_signal_thread(Statistics* stats, Locks* locks);
+void create_signal_thread(Statistics* stats, Keyspaces* keyspaces,
+	Authenticator* auth);
+
+/* create_expiry_thread()
+* −−−−−−−−−−−−−−−
+* Creates a thread that removes expired keys from every keyspace in the 
+* background, with every signal blocked.
+*
+* keyspaces: the keyspaces to remove keys from. Not NULL
+*/
+void create_expiry_thread(Keyspaces* keyspaces);
+
+/* expiry_thread()
+* −−−−−−−−−−−−−−−
+* Asks the store of every keyspace to remove the keys whose time to live has
+* passed every EXPIRY_INTERVAL seconds. Never returns.
+*
+* arg: the Keyspaces to remove keys from, cast to a void*. Not NULL
+*/
+void* expiry_thread(void* arg);
 
 /* signal_thread()
 * −−−−−−−−−−−−−−−
-* Catches SIGHUP and prints out the statistics.
+* Catches SIGHUP and prints out the statistics, summed over every slot, and
+* the number of keys that have expired or been evicted, followed by the 
+* memory used by the entries of every keyspace and the counters of the 
+* worker pool and listeners if there are any. Catches SIGUSR1 and reloads the
+* authentication string from the authfile, and the secret of every keyspace
+* with one of its own.
 *
 * arg: SignalThread struct holding the parameters passed into signal_thread 
 * cast as a void*. Not NULL.
@@ -293,6 +564,96 @@ void create_signal_thread(Statistics* stats, Locks* locks);
 */
 void* signal_thread(void* arg);
 
+/* print_memory_statistics()
+* −−−−−−−−−−−−−−−
+* Prints the memory held by the keys of every keyspace to stderr, then the 
+* memory reserved for and used by their entries, along with the occupancy of
+* the slab pages and the fragmentation.
+*
+* keyspaces: the keyspaces to report on. Not NULL
+*/
+void print_memory_statistics(Keyspaces* keyspaces);
+
+/* print_pool_statistics()
+* −−−−−−−−−−−−−−−
+* Prints the number of workers in a pool to stderr, then the tasks it has 
+* run, the tasks stolen from one worker by another, the times a task waited
+* for room in every queue and the tasks queued now.
+*
+* pool: the pool to report on. Not NULL
+*/
+void print_pool_statistics(ThreadPool* pool);
+
+/* print_listener_statistics()
+* −−−−−−−−−−−−−−−
+* Prints the number of clients each listener thread has accepted and turned
+* away to stderr, if dbserver was started with --listeners.
+*
+* stats: Statistics struct that holds the statistics for dbserver. Not NULL
+*/
+void print_listener_statistics(Statistics* stats);
+
+/* sum_statistics()
+* −−−−−−−−−−−−−−−
+* Sums the counters of every statistics slot.
+*
+* stats: Statistics struct that holds the statistics for dbserver. Not NULL
+* total: set to the sum of the slots. Not NULL
+*/
+void sum_statistics(Statistics* stats, StatisticsSlot* total);
+
+/* request_metrics()
+* −−−−−−−−−−−−−−−
+* Finds where the latencies and sizes of a request are recorded, by its
+* method and the store it is addressed to.
+*
+* stats: Statistics struct that holds the statistics for dbserver. Not NULL
+* httpRequest: a request that has been parsed. Not NULL
+*
+* Returns: the metrics of the request's kind and store
+*/
+RequestMetrics* request_metrics(Statistics* stats, HttpRequest* httpRequest);
+
+/* write_responses()
+* −−−−−−−−−−−−−−−
+* Sends as much of a connection's queued responses as the socket will 
+* accept with connection_write(), recording how long it took.
+*
+* connection: the connection to send on. Not NULL
+* stats: Statistics struct that holds the statistics for dbserver. Not NULL
+*
+* Returns: the result of connection_write()
+*/
+int write_responses(Connection* connection, Statistics* stats);
+
+/* is_stats_request()
+* −−−−−−−−−−−−−−−
+* Checks if a request is a "GET /stats".
+*
+* httpRequest: a request that has been parsed. Not NULL
+*
+* Returns: true if the request asks for the statistics. False otherwise
+*/
+bool is_stats_request(HttpRequest* httpRequest);
+
+/* handle_stats()
+* −−−−−−−−−−−−−−−
+* Responds with every statistic of dbserver as a JSON object. Only called
+* once the request has carried the private keyspace's secret, as the object
+* names every keyspace.
+*
+* The object holds the counters printed on SIGHUP, the memory held by the
+* stores, the setup and memory of each keyspace, the counters of the worker
+* pool and listeners if there are any, and the latencies of each stage of 
+* serving every kind of request to each store that has been received. The
+* count, mean and percentiles of each latency are given in nanoseconds, with
+* the bytes received and sent for each kind of request.
+*
+* httpResponse: the status, body and bodyLength are set. Not NULL
+* threadArgs: ThreadArguments holding the stores and statistics. Not NULL
+*/
+void handle_stats(HttpResponse* httpResponse, ThreadArguments* threadArgs);
+
 /* update_statistics()
 * −−−−−−−−−−−−−−−
 * Updates the statistics stuct according to the httpRequest that is passed in.
@@ -301,6 +662,7 @@ void* signal_thread(void* arg);
 * httpResponse->status value of STATUS_OK. The statistics are updated according
 * to the type of request passed in (GET, PUT, DELETE), a successfull GET, PUT 
 * or DELETE request results in the corresponding statistic to increase by 1.
+* A "GET /stats" request is not counted.
 *
 * httpRequest: HttpRequest struct holding the information of the http request, 
 * Not NULL
@@ -320,17 +682,60 @@ void update_statistics(HttpRequest* httpRequest, HttpResponse* httpResponse,
 * request provided. This function will handle GET, PUT and DELETE http 
 * requests. If the http request provided has an invalid method or address or if
 * the message is unauthorized then the function will return before executing 
-* any stringstore functions.
+* any stringstore functions. A PUT or MPUT to a keyspace that does not exist
+* creates it if --max-keyspaces allows, any other request to one gets a 404
+* (Not Found) response.
+*
+* Only the shard holding the key is locked: GET requests take its lock for
+* reading so they run alongside each other, PUT and DELETE take it for
+* writing. Batch requests are passed to handle_batch(), and SCAN requests to
+* handle_scan(). A GET of a value 
+* held in its own entry pins it and borrows it as the response body instead
+* of copying it, so the lock is only held for the lookup.
 *
 * httpRequest: HttpRequest struct holding the http request information. Not 
 * NULL.
 * httpResponse: HttpResponse struct holding the http response information. Not 
 * NULL.
+* keyspace: the keyspace addressed, NULL if it did not exist when the request
+* was authenticated
 * threadArgs: ThreadArguments struct holding the arguments passed to the 
 * client thread
 */
 void handle_http_request(HttpRequest* httpRequest, HttpResponse* httpResponse, 
-	ThreadArguments* threadArgs);
+	Keyspace* keyspace, ThreadArguments* threadArgs);
+
+/* handle_batch()
+* −−−−−−−−−−−−−−−
+* Handles an authorized MGET, MPUT or MDELETE request with
+* handle_batch_request(), counting every key of a successful batch in the
+* statistics for GET, PUT or DELETE operations.
+*
+* store: the store the request is for. Not NULL
+* httpRequest: HttpRequest struct holding the batch request. Not NULL
+* httpResponse: HttpResponse struct holding the http response information. Not
+* NULL
+* threadArgs: ThreadArguments struct holding the arguments passed to the 
+* client thread
+*/
+void handle_batch(StorageEngine* store, HttpRequest* httpRequest, 
+	HttpResponse* httpResponse, ThreadArguments* threadArgs);
+
+/* handle_scan()
+* −−−−−−−−−−−−−−−
+* Handles an authorized SCAN request with handle_scan_request(), counting 
+* every key returned by a successful scan in the statistics for GET 
+* operations.
+*
+* store: the store the request is for. Not NULL
+* httpRequest: HttpRequest struct holding the scan request. Not NULL
+* httpResponse: HttpResponse struct holding the http response information. Not
+* NULL
+* threadArgs: ThreadArguments struct holding the arguments passed to the 
+* client thread
+*/
+void handle_scan(StorageEngine* store, HttpRequest* httpRequest, 
+	HttpResponse* httpResponse, ThreadArguments* threadArgs);
 
 /* initialise_thread_arguments()
 * −−−−−−−−−−−−−−−
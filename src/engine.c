@@ -0,0 +1,128 @@
+/*
+** engine.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "linearengine.h"
+
+/* Every engine that can be selected, the first being the default */
+static const StorageEngineOps* const engines[] = {&linearEngine};
+
+const StorageEngineOps* engine_find(const char* name) {
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i]->name, name) == 0) {
+	    return engines[i];
+	}
+    }
+    return NULL;
+}
+
+const StorageEngineOps* engine_default(void) {
+    return engines[0];
+}
+
+StorageEngine* engine_create(const StorageEngineOps* ops, const char* name,
+	unsigned int numShards) {
+    StorageEngine* engine = malloc(sizeof(StorageEngine));
+    if (engine == NULL) {
+        return NULL;
+    }
+    engine->ops = ops;
+    engine->store = ops->create(name, numShards);
+    engine->name = name;
+    if (engine->store == NULL) {
+        free(engine);
+	return NULL;
+    }
+    return engine;
+}
+
+void engine_free(StorageEngine* engine) {
+    engine->ops->destroy(engine->store);
+    free(engine);
+}
+
+EngineStatus engine_get(StorageEngine* engine, const char* key,
+	EngineValue* value) {
+    return engine->ops->get(engine->store, key, value);
+}
+
+EngineStatus engine_put(StorageEngine* engine, const char* key,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    return engine->ops->put(engine->store, key, value, valueLength, expiry);
+}
+
+EngineStatus engine_delete(StorageEngine* engine, const char* key) {
+    return engine->ops->delete(engine->store, key);
+}
+
+EngineStatus engine_batch(StorageEngine* engine,
+	EngineBatchOperation operation, EngineItem* items, size_t count) {
+    return engine->ops->batch(engine->store, operation, items, count);
+}
+
+EngineStatus engine_scan_begin(StorageEngine* engine, EngineScan* scan,
+	const char* from) {
+    EngineStatus status = ENGINE_OK;
+    scan->engine = engine;
+    scan->scan = engine->ops->scan_begin(engine->store, from, &status);
+    return status;
+}
+
+EngineItem* engine_scan_next(EngineScan* scan) {
+    return scan->engine->ops->scan_next(scan->scan);
+}
+
+void engine_scan_end(EngineScan* scan) {
+    scan->engine->ops->scan_end(scan->scan);
+}
+
+size_t engine_expire(StorageEngine* engine, unsigned int now) {
+    return engine->ops->expire(engine->store, now);
+}
+
+void engine_stats(StorageEngine* engine, EngineStats* stats) {
+    engine->ops->stats(engine->store, stats);
+}
+
+void engine_set_memory_limit(StorageEngine* engine, size_t memoryLimit) {
+    engine->ops->set_memory_limit(engine->store, memoryLimit);
+}
+
+bool engine_set_ordered(StorageEngine* engine) {
+    return engine->ops->set_ordered(engine->store);
+}
+
+bool engine_open_snapshot(StorageEngine* engine, const char* path) {
+    return engine->ops->open_snapshot(engine->store, path);
+}
+
+void engine_attach_log(StorageEngine* engine, WriteAheadLog* log) {
+    engine->ops->attach_log(engine->store, log);
+}
+
+void engine_replay(StorageEngine* engine, unsigned long long generation,
+	WalRecordType type, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry) {
+    engine->ops->replay(engine->store, generation, type, key, value,
+	    valueLength, expiry);
+}
+
+bool engine_warm(StorageEngine* engine) {
+    return engine->ops->warm(engine->store);
+}
+
+void engine_detach_snapshot(StorageEngine* engine) {
+    engine->ops->detach_snapshot(engine->store);
+}
+
+bool engine_snapshot(StorageEngine* engine, const char* path,
+	unsigned long long walGeneration) {
+    return engine->ops->snapshot(engine->store, path, walGeneration);
+}
@@ -0,0 +1,364 @@
+/*
+** engine.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "slab.h"
+#include "wal.h"
+
+/* Outcomes of the operations of a storage engine */
+typedef enum {
+    ENGINE_OK = 0,
+    ENGINE_NOT_FOUND = 1,       // the key is not in the store
+    ENGINE_INVALID = 2,         // the store cannot do this, e.g. not ordered
+    ENGINE_FAILED = 3,          // out of memory, or the log failed
+    ENGINE_UNAVAILABLE = 4      // cannot be done yet, e.g. still warming up
+} EngineStatus;
+
+/* Hands a value borrowed from a store back to it */
+typedef void (*EngineRelease)(void* releaseArg);
+
+/* A value found by an engine. If release is set the value is borrowed from
+ * the store, and must be handed back by calling release with releaseArg
+ * once it is no longer needed. Otherwise it was allocated with malloc and
+ * belongs to the caller. Either way it is null terminated */
+typedef struct {
+    char* value;
+    size_t length;
+    EngineRelease release;
+    void* releaseArg;
+} EngineValue;
+
+/* The operation a batch applies to each of its keys */
+typedef enum {
+    ENGINE_BATCH_GET,
+    ENGINE_BATCH_PUT,
+    ENGINE_BATCH_DELETE
+} EngineBatchOperation;
+
+/* A key of a batch or of a walk through a store, with its value of
+ * valueLength bytes and when it expires (0 for never). In a batch, done is
+ * set if the key was found, put or deleted */
+typedef struct {
+    const char* key;
+    const char* value;
+    size_t valueLength;
+    unsigned int expiry;
+    bool done;
+} EngineItem;
+
+/* Counters of a store reported in the statistics. memory is the slab memory
+ * of the store, or as near to it as the engine can tell */
+typedef struct {
+    size_t keyBytes;
+    unsigned long expired;
+    unsigned long evicted;
+    SlabStats memory;
+} EngineStats;
+
+/* The operations of a storage engine, each given the store created by
+ * create(). Every operation may be called by many threads at once, apart
+ * from those a store is set up with before the server starts, namely
+ * set_memory_limit(), set_ordered(), open_snapshot(), attach_log() and
+ * replay().
+ *
+ * Changes are made durable before put(), delete() and batch() return if a
+ * log has been attached. batch() applies an operation to many keys at once,
+ * as engine_batch() describes. scan_begin() returns a walk of the keys in order
+ * that scan_next() moves through, and that must be finished by scan_end().
+ * The snapshot operations keep the store in the snapshot file at path: a
+ * store opened from a snapshot serves keys from it until warm() has copied
+ * them in and detach_snapshot() has been called */
+typedef struct {
+    const char* name;
+    void* (*create)(const char* storeName, unsigned int numShards);
+    void (*destroy)(void* store);
+    EngineStatus (*get)(void* store, const char* key, EngineValue* value);
+    EngineStatus (*put)(void* store, const char* key, const char* value,
+	    size_t valueLength, unsigned int expiry);
+    EngineStatus (*delete)(void* store, const char* key);
+    EngineStatus (*batch)(void* store, EngineBatchOperation operation,
+	    EngineItem* items, size_t count);
+    void* (*scan_begin)(void* store, const char* from, EngineStatus* status);
+    EngineItem* (*scan_next)(void* scan);
+    void (*scan_end)(void* scan);
+    size_t (*expire)(void* store, unsigned int now);
+    void (*stats)(void* store, EngineStats* stats);
+    void (*set_memory_limit)(void* store, size_t memoryLimit);
+    bool (*set_ordered)(void* store);
+    bool (*open_snapshot)(void* store, const char* path);
+    void (*attach_log)(void* store, WriteAheadLog* log);
+    void (*replay)(void* store, unsigned long long generation,
+	    WalRecordType type, const char* key, const char* value,
+	    size_t valueLength, unsigned int expiry);
+    bool (*warm)(void* store);
+    void (*detach_snapshot)(void* store);
+    bool (*snapshot)(void* store, const char* path,
+	    unsigned long long walGeneration);
+} StorageEngineOps;
+
+/* A store run by a storage engine. name is the name its changes are logged
+ * and its snapshot saved under */
+typedef struct {
+    const StorageEngineOps* ops;
+    void* store;
+    const char* name;
+} StorageEngine;
+
+/* A walk through the keys of a store started by engine_scan_begin() */
+typedef struct {
+    StorageEngine* engine;
+    void* scan;
+} EngineScan;
+
+/* engine_find()
+* −−−−−−−−−−−−−−−
+* Looks up a storage engine by the name it is selected with.
+*
+* name: the name of the engine. Not NULL
+*
+* Returns: the operations of the engine, NULL if no engine has that name
+*/
+const StorageEngineOps* engine_find(const char* name);
+
+/* engine_default()
+* −−−−−−−−−−−−−−−
+* Returns: the operations of the engine used when none is selected
+*/
+const StorageEngineOps* engine_default(void);
+
+/* engine_create()
+* −−−−−−−−−−−−−−−
+* Creates an empty store run by a storage engine.
+*
+* ops: the operations of the engine. Not NULL
+* name: the name the store's changes are logged under. Not NULL
+* numShards: the number of independently locked partitions to split the
+* store into, which engines that have none may ignore
+*
+* Returns: the store created with malloc, NULL if memory cannot be allocated
+*/
+StorageEngine* engine_create(const StorageEngineOps* ops, const char* name,
+	unsigned int numShards);
+
+/* engine_free()
+* −−−−−−−−−−−−−−−
+* Frees a store and every key in it.
+*
+* engine: the store to free. Not NULL
+*/
+void engine_free(StorageEngine* engine);
+
+/* engine_get()
+* −−−−−−−−−−−−−−−
+* Finds the value of a key.
+*
+* engine: the store to look in. Not NULL
+* key: the key to find. Not NULL
+* value: set to the value when the key is found. Not NULL
+*
+* Returns: ENGINE_OK if the key was found, ENGINE_NOT_FOUND otherwise
+*/
+EngineStatus engine_get(StorageEngine* engine, const char* key,
+	EngineValue* value);
+
+/* engine_put()
+* −−−−−−−−−−−−−−−
+* Stores a value under a key, replacing any value it had.
+*
+* engine: the store to change. Not NULL
+* key: the key to store. Not NULL
+* value: the valueLength bytes to store
+* valueLength: the number of bytes in value
+* expiry: when the key expires in seconds since the Epoch, 0 for never
+*
+* Returns: ENGINE_OK if the value was stored, ENGINE_FAILED if it could not
+* be stored or logged
+*/
+EngineStatus engine_put(StorageEngine* engine, const char* key,
+	const char* value, size_t valueLength, unsigned int expiry);
+
+/* engine_delete()
+* −−−−−−−−−−−−−−−
+* Removes a key.
+*
+* engine: the store to change. Not NULL
+* key: the key to remove. Not NULL
+*
+* Returns: ENGINE_OK if the key was removed, ENGINE_NOT_FOUND if it was not
+* in the store, ENGINE_FAILED if the change could not be logged
+*/
+EngineStatus engine_delete(StorageEngine* engine, const char* key);
+
+/* engine_batch()
+* −−−−−−−−−−−−−−−
+* Gets, puts or deletes many keys at once, so no other request sees the
+* batch half applied. Each item's done is set if its key was found, put or
+* deleted. A get sets the value and valueLength of each key found to a copy
+* allocated with malloc, which the caller frees, and the value of a key not
+* found to NULL.
+*
+* engine: the store to apply the batch to. Not NULL
+* operation: what to do with each key
+* items: the keys, with the value and expiry of each for a put. Not NULL
+* count: the number of items
+*
+* Returns: ENGINE_OK if the batch was applied, ENGINE_FAILED if memory
+* cannot be allocated or the changes could not be logged. A get that fails
+* leaves no copies to free
+*/
+EngineStatus engine_batch(StorageEngine* engine,
+	EngineBatchOperation operation, EngineItem* items, size_t count);
+
+/* engine_scan_begin()
+* −−−−−−−−−−−−−−−
+* Starts walking the keys of an ordered store in ascending order. The store
+* is seen as it was at one moment until engine_scan_end() is called.
+*
+* engine: the store to walk. Not NULL
+* scan: set up for engine_scan_next(). Not NULL
+* from: the first key to walk from, NULL to start at the first key
+*
+* Returns: ENGINE_OK if the walk started, ENGINE_INVALID if the store keeps
+* no order, ENGINE_UNAVAILABLE if it cannot be walked yet or memory cannot
+* be allocated
+*/
+EngineStatus engine_scan_begin(StorageEngine* engine, EngineScan* scan,
+	const char* from);
+
+/* engine_scan_next()
+* −−−−−−−−−−−−−−−
+* Moves on to the next key of a walk started by engine_scan_begin().
+*
+* scan: the walk to continue. Not NULL
+*
+* Returns: the next key, with its value, valueLength and expiry set. Only
+* valid until the next call. NULL once every key has been walked
+*/
+EngineItem* engine_scan_next(EngineScan* scan);
+
+/* engine_scan_end()
+* −−−−−−−−−−−−−−−
+* Finishes a walk started by engine_scan_begin(). Keys and values walked
+* must be copied before this is called.
+*
+* scan: the walk to finish. Not NULL
+*/
+void engine_scan_end(EngineScan* scan);
+
+/* engine_expire()
+* −−−−−−−−−−−−−−−
+* Removes the keys of a store whose expiry has passed.
+*
+* engine: the store to expire keys from. Not NULL
+* now: the current time in seconds since the Epoch
+*
+* Returns: the number of keys removed
+*/
+size_t engine_expire(StorageEngine* engine, unsigned int now);
+
+/* engine_stats()
+* −−−−−−−−−−−−−−−
+* Adds the counters of a store to stats, so those of several stores can be
+* summed. Parts of the store may be locked for reading in turn while its
+* memory is measured.
+*
+* engine: the store to count. Not NULL
+* stats: the counters to add to. Not NULL
+*/
+void engine_stats(StorageEngine* engine, EngineStats* stats);
+
+/* engine_set_memory_limit()
+* −−−−−−−−−−−−−−−
+* Bounds the memory held by the keys of a store, evicting cold keys to make
+* room for new ones.
+*
+* engine: the store to bound. Not NULL
+* memoryLimit: the most memory in bytes, 0 for no limit
+*/
+void engine_set_memory_limit(StorageEngine* engine, size_t memoryLimit);
+
+/* engine_set_ordered()
+* −−−−−−−−−−−−−−−
+* Keeps the keys of a store in order so it can be walked.
+*
+* engine: the store to order. Not NULL
+*
+* Returns: false if memory cannot be allocated, true otherwise
+*/
+bool engine_set_ordered(StorageEngine* engine);
+
+/* engine_open_snapshot()
+* −−−−−−−−−−−−−−−
+* Serves the keys of a store from its snapshot file until it is warmed up.
+* A missing file leaves the store empty.
+*
+* engine: the store to open the snapshot of. Not NULL
+* path: the snapshot file. Not NULL
+*
+* Returns: false if the file exists but cannot be read, true otherwise
+*/
+bool engine_open_snapshot(StorageEngine* engine, const char* path);
+
+/* engine_attach_log()
+* −−−−−−−−−−−−−−−
+* Records every later change to a store in a write-ahead log.
+*
+* engine: the store to log the changes of. Not NULL
+* log: the log, shared by every store of the server. Not NULL
+*/
+void engine_attach_log(StorageEngine* engine, WriteAheadLog* log);
+
+/* engine_replay()
+* −−−−−−−−−−−−−−−
+* Applies a change read back from the write-ahead log to a store, unless it
+* is already in the store's snapshot or put a key that has since expired.
+* Called before the server accepts connections. See WalReplayFunction.
+*/
+void engine_replay(StorageEngine* engine, unsigned long long generation,
+	WalRecordType type, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry);
+
+/* engine_warm()
+* −−−−−−−−−−−−−−−
+* Copies the keys of the snapshot of a store into memory while requests
+* carry on being served.
+*
+* engine: the store to warm up. Not NULL
+*
+* Returns: false if the snapshot turned out to be damaged, true otherwise
+*/
+bool engine_warm(StorageEngine* engine);
+
+/* engine_detach_snapshot()
+* −−−−−−−−−−−−−−−
+* Stops serving keys from the snapshot of a store once engine_warm() has
+* copied it. Does nothing if the store has no snapshot.
+*
+* engine: the store to detach the snapshot from. Not NULL
+*/
+void engine_detach_snapshot(StorageEngine* engine);
+
+/* engine_snapshot()
+* −−−−−−−−−−−−−−−
+* Writes every key of a store to a new snapshot file.
+*
+* engine: the store to save. Not NULL
+* path: the snapshot file to write. Not NULL
+* walGeneration: the first write-ahead log generation whose changes may be
+* missing from the snapshot
+*
+* Returns: true if the snapshot was written, false otherwise
+*/
+bool engine_snapshot(StorageEngine* engine, const char* path,
+	unsigned long long walGeneration);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+** epoch.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "epoch.h"
+
+/* The global epoch. Records hold 0 while their thread is not reading, so
+ * epochs start at 1 */
+static unsigned long long globalEpoch = 1;
+
+/* The blocks of thread records, newest first */
+static EpochBlock* blocks = NULL;
+
+/* Guards giving out records */
+static pthread_mutex_t registerLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Hands a thread's record back when the thread exits */
+static pthread_key_t recordKey;
+static pthread_once_t recordKeyOnce = PTHREAD_ONCE_INIT;
+
+/* The record of the calling thread, NULL until it first enters */
+static __thread EpochRecord* threadRecord = NULL;
+
+/* Marks the record of an exiting thread free for reuse */
+static void release_record(void* record) {
+    EpochRecord* epochRecord = (EpochRecord*)record;
+    __atomic_store_n(&(epochRecord->epoch), 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&(epochRecord->owned), 0, __ATOMIC_RELEASE);
+}
+
+/* Creates the key used to release records */
+static void create_record_key(void) {
+    pthread_key_create(&recordKey, release_record);
+}
+
+/* Gives the calling thread a record, reusing one left by an exited thread
+ * where possible. Returns NULL if memory cannot be allocated */
+static EpochRecord* register_thread(void) {
+    pthread_once(&recordKeyOnce, create_record_key);
+    pthread_mutex_lock(&registerLock);
+    EpochRecord* record = NULL;
+    for (EpochBlock* block = blocks; block != NULL && record == NULL;
+	    block = block->next) {
+        for (int i = 0; i < EPOCH_RECORDS_PER_BLOCK; i++) {
+	    if (!__atomic_load_n(&(block->records[i].owned),
+		    __ATOMIC_ACQUIRE)) {
+	        record = &(block->records[i]);
+		break;
+	    }
+	}
+    }
+    if (record == NULL) {
+        void* memory;
+	if (posix_memalign(&memory, EPOCH_CACHE_LINE_SIZE,
+		sizeof(EpochBlock)) != 0) {
+	    pthread_mutex_unlock(&registerLock);
+	    return NULL;
+	}
+	EpochBlock* block = memory;
+	memset(block, 0, sizeof(EpochBlock));
+	block->next = blocks;
+	__atomic_store_n(&blocks, block, __ATOMIC_RELEASE);
+	record = &(block->records[0]);
+    }
+    __atomic_store_n(&(record->owned), 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registerLock);
+    pthread_setspecific(recordKey, record);
+    return record;
+}
+
+void epoch_enter(void) {
+    if (threadRecord == NULL) {
+        threadRecord = register_thread();
+	if (threadRecord == NULL) {
+	    abort();
+	}
+    }
+
+    // The announcement must be visible before anything is read under it
+    unsigned long long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&(threadRecord->epoch), epoch, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(void) {
+    __atomic_store_n(&(threadRecord->epoch), 0, __ATOMIC_RELEASE);
+}
+
+unsigned long long epoch_current(void) {
+    return __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+}
+
+void epoch_advance(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+    for (EpochBlock* block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE);
+	    block != NULL; block = block->next) {
+        for (int i = 0; i < EPOCH_RECORDS_PER_BLOCK; i++) {
+	    unsigned long long seen = __atomic_load_n(
+		    &(block->records[i].epoch), __ATOMIC_ACQUIRE);
+	    if (seen != 0 && seen != epoch) {
+	        return;
+	    }
+	}
+    }
+    __atomic_compare_exchange_n(&globalEpoch, &epoch, epoch + 1, false,
+	    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+bool epoch_reclaimable(unsigned long long retired) {
+    return __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE) >= retired + 2;
+}
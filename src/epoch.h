@@ -0,0 +1,84 @@
+/*
+** epoch.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+
+/* Epoch based reclamation, letting threads read shared structures without
+ * locks while writers free the memory they remove from them.
+ *
+ * A reader brackets its accesses with epoch_enter() and epoch_exit(). A
+ * writer that unlinks a block notes epoch_current() as the block is
+ * retired, and may free it once epoch_reclaimable() says every reader that
+ * could still see it has left. The global epoch only advances once every
+ * reader inside an epoch has seen the current one, so two advances after a
+ * block is retired no reader can hold it. Readers only ever write to a
+ * record of their own, so they never contend with each other */
+
+/* Size of a cache line, so each thread's record sits on its own */
+#define EPOCH_CACHE_LINE_SIZE 64
+
+/* Number of thread records allocated at a time */
+#define EPOCH_RECORDS_PER_BLOCK 64
+
+/* The epoch a thread is reading in, 0 while it is not reading. owned is set
+ * while a thread is using the record */
+typedef struct {
+    unsigned long long epoch;
+    int owned;
+} __attribute__((aligned(EPOCH_CACHE_LINE_SIZE))) EpochRecord;
+
+/* A block of thread records. Blocks are never freed, records are reused
+ * once their thread exits */
+typedef struct EpochBlock {
+    EpochRecord records[EPOCH_RECORDS_PER_BLOCK];
+    struct EpochBlock* next;
+} EpochBlock;
+
+/* epoch_enter()
+* −−−−−−−−−−−−−−−
+* Starts a read of structures protected by epochs. Nothing retired after
+* this point is freed until the matching epoch_exit(). Calls do not nest.
+*
+* The calling thread is given a record the first time it enters.
+*/
+void epoch_enter(void);
+
+/* epoch_exit()
+* −−−−−−−−−−−−−−−
+* Ends a read started by epoch_enter(). Pointers read since must no longer be
+* used.
+*/
+void epoch_exit(void);
+
+/* epoch_current()
+* −−−−−−−−−−−−−−−
+* Returns: the current global epoch, to be noted when a block is retired
+*/
+unsigned long long epoch_current(void);
+
+/* epoch_advance()
+* −−−−−−−−−−−−−−−
+* Moves the global epoch on if every thread reading has seen the current
+* one. Cheap enough to call on each pass over retired blocks.
+*/
+void epoch_advance(void);
+
+/* epoch_reclaimable()
+* −−−−−−−−−−−−−−−
+* Checks if a block retired in the given epoch can be freed.
+*
+* retired: the epoch_current() noted when the block was retired
+*
+* Returns: true if no reader can still be using the block
+*/
+bool epoch_reclaimable(unsigned long long retired);
+
+#endif
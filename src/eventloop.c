@@ -0,0 +1,170 @@
+/*
+** eventloop.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include "eventloop.h"
+
+/* Maximum number of events handled for each call to epoll_wait */
+#define MAX_EVENTS 64
+
+EventLoop* start_event_loop(ThreadArguments* sharedArgs, 
+	unsigned int numWorkers) {
+    EventLoop* eventLoop = malloc(sizeof(EventLoop));
+    eventLoop->workers = calloc(numWorkers, sizeof(EventLoopWorker));
+    eventLoop->numWorkers = numWorkers;
+    eventLoop->nextWorker = 0;
+
+    // Start the workers, each waiting on its own epoll instance
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        EventLoopWorker* worker = &(eventLoop->workers[i]);
+	worker->epollFd = epoll_create1(0);
+	worker->threadArgs = *sharedArgs;
+	worker->threadArgs.fdClient = -1;
+	worker->oneShot = false;
+
+	pthread_t threadId;
+	pthread_create(&threadId, NULL, event_loop_worker, worker);
+	pthread_detach(threadId);
+    }
+    return eventLoop;
+}
+
+void event_loop_add_client(void* arg, int fdClient) {
+    EventLoop* eventLoop = (EventLoop*)arg;
+    fcntl(fdClient, F_SETFL, fcntl(fdClient, F_GETFL) | O_NONBLOCK);
+    Connection* connection = connection_init(fdClient);
+    unsigned int worker = __atomic_fetch_add(&(eventLoop->nextWorker), 1, 
+	    __ATOMIC_RELAXED) % eventLoop->numWorkers;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.ptr = connection;
+    epoll_ctl(eventLoop->workers[worker].epollFd, EPOLL_CTL_ADD, fdClient, 
+	    &event);
+}
+
+/* Serves a connection handed to a worker of the pool with the events it was
+ * reported ready with */
+static void run_pool_task(void* arg, unsigned int worker, void* task) {
+    EventLoopWorker* dispatcher = (EventLoopWorker*)arg;
+    Connection* connection = (Connection*)task;
+    connection->worker = worker;
+    handle_connection_event(dispatcher, connection, connection->readyEvents);
+}
+
+WorkerPool* start_worker_pool(ThreadArguments* sharedArgs,
+	unsigned int numWorkers, size_t queueDepth) {
+    WorkerPool* workerPool = malloc(sizeof(WorkerPool));
+    workerPool->dispatcher.epollFd = epoll_create1(0);
+    workerPool->dispatcher.threadArgs = *sharedArgs;
+    workerPool->dispatcher.threadArgs.fdClient = -1;
+    workerPool->dispatcher.oneShot = true;
+    workerPool->nextWorker = 0;
+    workerPool->pool = threadpool_create(numWorkers, queueDepth, 
+	    run_pool_task, &(workerPool->dispatcher));
+    if (workerPool->pool == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    __atomic_store_n(&(sharedArgs->stats->pool), workerPool->pool, 
+	    __ATOMIC_RELEASE);
+
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, worker_pool_dispatcher, workerPool);
+    pthread_detach(threadId);
+    return workerPool;
+}
+
+void worker_pool_add_client(void* arg, int fdClient) {
+    WorkerPool* workerPool = (WorkerPool*)arg;
+    fcntl(fdClient, F_SETFL, fcntl(fdClient, F_GETFL) | O_NONBLOCK);
+    Connection* connection = connection_init(fdClient);
+    connection->worker = __atomic_fetch_add(&(workerPool->nextWorker), 1, 
+	    __ATOMIC_RELAXED);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = connection;
+    epoll_ctl(workerPool->dispatcher.epollFd, EPOLL_CTL_ADD, fdClient, 
+	    &event);
+}
+
+void* worker_pool_dispatcher(void* arg) {
+    WorkerPool* workerPool = (WorkerPool*)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int numEvents = epoll_wait(workerPool->dispatcher.epollFd, events,
+		MAX_EVENTS, -1);
+	for (int i = 0; i < numEvents; i++) {
+	    Connection* connection = (Connection*)events[i].data.ptr;
+	    connection->readyEvents = events[i].events;
+	    threadpool_submit(workerPool->pool, connection, 
+		    connection->worker);
+	}
+    }
+    return NULL;
+}
+
+void* event_loop_worker(void* arg) {
+    EventLoopWorker* worker = (EventLoopWorker*)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int numEvents = epoll_wait(worker->epollFd, events, MAX_EVENTS, -1);
+	for (int i = 0; i < numEvents; i++) {
+	    handle_connection_event(worker, (Connection*)events[i].data.ptr, 
+		    events[i].events);
+	}
+    }
+    return NULL;
+}
+
+void handle_connection_event(EventLoopWorker* worker, Connection* connection,
+	uint32_t events) {
+    // Read and process whatever the client has sent
+    if (!connection->closing 
+	    && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        if (!connection_read(connection)) {
+	    connection->closing = true;
+	}
+	if (!process_buffered_requests(connection, &(worker->threadArgs))) {
+	    connection->closing = true;
+	}
+    }
+
+    // Send the responses, then close the connection once nothing is left to
+    // send to a client that is going away
+    int written = write_responses(connection, worker->threadArgs.stats);
+    if (written < 0 || (written == 1 && connection->closing)) {
+        epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+	connection_free(connection);
+	release_client(worker->threadArgs.stats);
+	return;
+    }
+
+    // While responses are waiting to be sent only watch for room to write,
+    // so a client that does not read its responses cannot make the server
+    // queue more of them. Input is watched for again once they have all
+    // been sent. A pool connection reported once must be re-armed every time
+    bool waitingToWrite = (written == 0);
+    if (worker->oneShot || waitingToWrite != connection->waitingToWrite 
+	    || connection->closing) {
+        struct epoll_event event;
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = waitingToWrite ? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+	if (worker->oneShot) {
+	    event.events |= EPOLLONESHOT;
+	}
+	event.data.ptr = connection;
+	connection->waitingToWrite = waitingToWrite;
+	epoll_ctl(worker->epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+}
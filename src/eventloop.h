@@ -0,0 +1,137 @@
+/*
+** eventloop.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdint.h>
+#include "dbserver.h"
+#include "connection.h"
+#include "threadpool.h"
+
+/* A thread of the event loop serving the connections assigned to it from
+ * its own epoll instance. oneShot is set when the epoll instance is instead
+ * shared by the threads of a worker pool, so each connection is only ever
+ * reported to one of them at a time */
+typedef struct {
+    int epollFd;
+    ThreadArguments threadArgs;
+    bool oneShot;
+} EventLoopWorker;
+
+/* The threads of the event loop and the worker the next connection handed
+ * to it is assigned to */
+typedef struct {
+    EventLoopWorker* workers;
+    unsigned int numWorkers;
+    unsigned int nextWorker;
+} EventLoop;
+
+/* A pool of worker threads serving the connections watched by a single epoll
+ * instance, which a dispatcher thread waits on. nextWorker is the worker the
+ * next connection handed to the pool is first queued on */
+typedef struct {
+    EventLoopWorker dispatcher;
+    ThreadPool* pool;
+    unsigned int nextWorker;
+} WorkerPool;
+
+/* start_event_loop()
+* −−−−−−−−−−−−−−−
+* Starts a fixed set of event loop threads to serve connections.
+*
+* A worker waits on the sockets of all of its connections at once with
+* epoll, so idle clients cost no thread of their own.
+*
+* sharedArgs: ThreadArguments holding the stores, statistics and server
+* arguments shared by every worker. Not NULL
+* numWorkers: the number of worker threads to run. Greater than 0
+*
+* Returns: the event loop created with malloc
+*/
+EventLoop* start_event_loop(ThreadArguments* sharedArgs, 
+	unsigned int numWorkers);
+
+/* event_loop_add_client()
+* −−−−−−−−−−−−−−−
+* Hands an admitted client to an event loop. The socket is made non-blocking
+* and assigned to the workers in turn. Safe to call from several listener
+* threads at once.
+*
+* arg: the EventLoop cast to a void*. Not NULL
+* fdClient: the socket of a client that has been admitted
+*/
+void event_loop_add_client(void* arg, int fdClient);
+
+/* start_worker_pool()
+* −−−−−−−−−−−−−−−
+* Starts a pool of worker threads to serve connections.
+*
+* Every connection handed to the pool is watched by a single epoll instance.
+* Each connection found ready to read or write is queued as a task on the
+* worker that last served it, so it keeps running on the same thread while
+* that thread keeps up, and idle workers steal the tasks queued on busy ones.
+* A connection is only re-armed once its task has finished, so no two 
+* workers ever serve it at once. The pool is recorded in the statistics so
+* its counters can be printed.
+*
+* sharedArgs: ThreadArguments holding the stores, statistics and server
+* arguments shared by every worker. Not NULL
+* numWorkers: the number of worker threads to run. Greater than 0
+* queueDepth: the most tasks each worker's queue holds. Greater than 0
+*
+* Returns: the worker pool created with malloc
+* Errors: exits if the pool cannot be started
+*/
+WorkerPool* start_worker_pool(ThreadArguments* sharedArgs,
+	unsigned int numWorkers, size_t queueDepth);
+
+/* worker_pool_add_client()
+* −−−−−−−−−−−−−−−
+* Hands an admitted client to a worker pool. The socket is made non-blocking
+* and its first task is queued on the workers in turn. Safe to call from 
+* several listener threads at once.
+*
+* arg: the WorkerPool cast to a void*. Not NULL
+* fdClient: the socket of a client that has been admitted
+*/
+void worker_pool_add_client(void* arg, int fdClient);
+
+/* worker_pool_dispatcher()
+* −−−−−−−−−−−−−−−
+* Thread function waiting for events on the connections of a worker pool and
+* queueing each connection reported ready as a task.
+*
+* arg: the WorkerPool cast to a void*. Not NULL
+*/
+void* worker_pool_dispatcher(void* arg);
+
+/* event_loop_worker()
+* −−−−−−−−−−−−−−−
+* Thread function waiting for and handling events on a worker's connections.
+*
+* arg: EventLoopWorker struct of the worker cast to a void*. Not NULL
+*/
+void* event_loop_worker(void* arg);
+
+/* handle_connection_event()
+* −−−−−−−−−−−−−−−
+* Reads, processes and answers the requests on a connection that epoll has
+* reported as ready, then closes it or updates the events it is watched for.
+* If the worker's epoll instance is shared by a pool the connection is always
+* re-armed, after which it must not be touched as another thread may be
+* serving it.
+*
+* worker: the worker the connection is assigned to. Not NULL
+* connection: the connection the event occurred on. Not NULL
+* events: the epoll events reported for the connection
+*/
+void handle_connection_event(EventLoopWorker* worker, Connection* connection,
+	uint32_t events);
+
+#endif
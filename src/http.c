@@ -9,110 +9,492 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
 #include "http.h"
 
+/* Carriage-return line-feed and the blank line ending a request head */
+#define CRLF "\r\n"
+#define END_OF_HEAD "\r\n\r\n"
+
+/* Header giving the length of a request or response body */
+#define CONTENT_LENGTH_NAME "Content-Length"
+#define CONTENT_LENGTH_HEADER CONTENT_LENGTH_NAME ":"
+
+/* Prefix of the version at the end of a request line and the start of a 
+ * status line */
+#define HTTP_VERSION_PREFIX "HTTP/1."
+
+/* Number of digits in a response status */
+#define STATUS_DIGITS 3
+
 bool valid_http_method_and_address(HttpRequest* httpRequest) {
     char* method = httpRequest->method;
-    // HTTP request method must be either "GET", "PUT". or "DELETE"
-    if (strcmp(method, "GET") != 0 && strcmp(method, "PUT") != 0 
+    // HTTP request method must be either "GET", "PUT". or "DELETE", or one of
+    // their batch forms, or "SCAN"
+    bool scan = strcmp(method, "SCAN") == 0;
+    bool batch = method[0] == 'M';
+    if (batch) {
+        method++;
+    }
+    if (!scan && strcmp(method, "GET") != 0 && strcmp(method, "PUT") != 0 
 	    && strcmp(method, "DELETE") != 0) {
         return false;
     }
-    char* dbType = httpRequest->dbType;
-    // Type of string store is either "public" or "private"
-    if (strcmp(dbType, "public") != 0 && strcmp(dbType, "private") != 0) {
+    // The store is named, and need not exist yet
+    if (!http_valid_store_name(httpRequest->dbType)) {
         return false;
     }
+    // A scan takes an optional key prefix in place of the key
+    return scan || batch == (httpRequest->key[0] == '\0');
+}
+
+bool http_valid_store_name(const char* name) {
+    size_t length = 0;
+    for (; name[length] != '\0'; length++) {
+        char c = name[length];
+	if (length == HTTP_MAX_STORE_NAME
+		|| !(isalnum((unsigned char)c) || c == '-' || c == '_')) {
+	    return false;
+	}
+    }
+    return length > 0 && strcmp(name, HTTP_STATS_ADDRESS) != 0;
+}
+
+int http_next_batch_item(const char* body, size_t bodyLength, size_t* offset,
+	const char** item, size_t* itemLength) {
+    size_t i = *offset;
+    if (i == bodyLength) {
+        return 0;
+    }
+    if (bodyLength - i >= strlen(HTTP_BATCH_MISSING) && memcmp(body + i, 
+	    HTTP_BATCH_MISSING, strlen(HTTP_BATCH_MISSING)) == 0) {
+        *offset = i + strlen(HTTP_BATCH_MISSING);
+	*item = NULL;
+	*itemLength = 0;
+	return 1;
+    }
+
+    // Read the length by hand, the body is not null terminated
+    size_t length = 0;
+    size_t start = i;
+    for (; i < bodyLength && isdigit((unsigned char)body[i]); i++) {
+        length = length * 10 + (body[i] - '0');
+	if (length > bodyLength) {
+	    return -1;
+	}
+    }
+    if (i == start || i == bodyLength || body[i] != ':' 
+	    || bodyLength - (i + 1) < length) {
+        return -1;
+    }
+    *item = body + i + 1;
+    *itemLength = length;
+    *offset = i + 1 + length;
+    return 1;
+}
+
+/* Returns a pointer to the first occurrence of needle in the length bytes
+ * starting at haystack, or NULL if it does not occur */
+static const char* find_bytes(const char* haystack, size_t length, 
+	const char* needle) {
+    size_t needleLength = strlen(needle);
+    const char* end = haystack + length;
+    const char* candidate = haystack;
+    while ((candidate = memchr(candidate, needle[0], end - candidate)) 
+	    != NULL) {
+        if (candidate + needleLength > end) {
+	    return NULL;
+	}
+	if (memcmp(candidate, needle, needleLength) == 0) {
+	    return candidate;
+	}
+	candidate++;
+    }
+    return NULL;
+}
+
+/* Returns the body length given by the Content-Length header of a complete 
+ * request head, 0 if there is no such header, or -1 if the length is 
+ * invalid or several such headers give different lengths */
+static long find_content_length(const char* head, size_t headLength) {
+    const char* endOfHead = head + headLength - strlen(END_OF_HEAD);
+    long bodyLength = -1;
+    const char* line = find_bytes(head, headLength, CRLF);
+    while (line != NULL && line < endOfHead) {
+        line += strlen(CRLF);
+	if (strncasecmp(line, CONTENT_LENGTH_HEADER, 
+		strlen(CONTENT_LENGTH_HEADER)) == 0) {
+	    // Read the digits by hand, every line of the head ends in '\r'
+	    const char* digit = line + strlen(CONTENT_LENGTH_HEADER);
+	    while (*digit == ' ' || *digit == '\t') {
+	        digit++;
+	    }
+	    if (!isdigit((unsigned char)*digit)) {
+	        return -1;
+	    }
+	    long length = 0;
+	    for (; isdigit((unsigned char)*digit); digit++) {
+	        length = length * 10 + (*digit - '0');
+		if (length > HTTP_MAX_BODY_SIZE) {
+		    return -1;
+		}
+	    }
+	    while (*digit == ' ' || *digit == '\t') {
+	        digit++;
+	    }
+
+	    // Headers disagreeing on where the body ends could smuggle a
+	    // request past anything in front of the server
+	    if (*digit != '\r' || (bodyLength >= 0 && length != bodyLength)) {
+	        return -1;
+	    }
+	    bodyLength = length;
+	}
+	line = find_bytes(line, endOfHead + strlen(CRLF) - line, CRLF);
+    }
+    return bodyLength < 0 ? 0 : bodyLength;
+}
+
+/* Splits the request line "<method> /<dbType>/<key> HTTP/1.x" ending at 
+ * lineEnd into null terminated strings in place. Returns false if the line is
+ * malformed */
+static bool parse_request_line(char* line, char* lineEnd, 
+	HttpRequest* httpRequest) {
+    char* endOfMethod = memchr(line, ' ', lineEnd - line);
+    if (endOfMethod == NULL || endOfMethod == line) {
+        return false;
+    }
+    char* address = endOfMethod + 1;
+    char* endOfAddress = memchr(address, ' ', lineEnd - address);
+    if (endOfAddress == NULL || *address != '/'
+	    || memchr(address, '\0', endOfAddress - address) != NULL) {
+        return false;
+    }
+    char* version = endOfAddress + 1;
+    if ((size_t)(lineEnd - version) < strlen(HTTP_VERSION_PREFIX) 
+	    || strncmp(version, HTTP_VERSION_PREFIX, 
+	    strlen(HTTP_VERSION_PREFIX)) != 0) {
+        return false;
+    }
+    *endOfMethod = '\0';
+    *endOfAddress = '\0';
+    *lineEnd = '\0';
+    httpRequest->method = line;
+
+    // The key is everything after the second '/', and is empty if there is 
+    // no second '/'
+    httpRequest->dbType = address + 1;
+    char* endOfDbType = memchr(httpRequest->dbType, '/', 
+	    endOfAddress - httpRequest->dbType);
+    if (endOfDbType == NULL) {
+        httpRequest->key = endOfAddress;
+    } else {
+        *endOfDbType = '\0';
+	httpRequest->key = endOfDbType + 1;
+    }
+    httpRequest->keyLength = endOfAddress - httpRequest->key;
     return true;
 }
 
-int get_http_response(FILE* from, HttpResponse* http_response) {
-    // Keep reading bytes from 'from' until double CRLF is received, inidcating end of response
-    // char buffer[1024] = {0};
-    // while(fgets(buffer, strlen(buffer)))
+/* Splits the header line "<name>: <value>" ending at lineEnd into null 
+ * terminated strings in place, trimming the spaces around the value. Returns
+ * false if the line is malformed */
+static bool parse_header_line(char* line, char* lineEnd, HttpHeader* header) {
+    char* colon = memchr(line, ':', lineEnd - line);
+    if (colon == NULL || colon == line) {
+        return false;
+    }
+    char* value = colon + 1;
+    while (value < lineEnd && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    char* endOfValue = lineEnd;
+    while (endOfValue > value 
+	    && (endOfValue[-1] == ' ' || endOfValue[-1] == '\t')) {
+        endOfValue--;
+    }
+    *colon = '\0';
+    *endOfValue = '\0';
+    header->name = line;
+    header->value = value;
+    return true;
+}
+
+/* Splits a complete request head into the fields of httpRequest in place.
+ * Returns false if the head is malformed */
+static bool parse_head(char* head, size_t headLength, 
+	HttpRequest* httpRequest) {
+    // The blank line ending the head starts after the last line's CRLF
+    char* endOfLines = head + headLength - strlen(CRLF);
+    char* lineEnd = (char*)find_bytes(head, endOfLines - head, CRLF);
+    if (!parse_request_line(head, lineEnd, httpRequest)) {
+        return false;
+    }
+
+    httpRequest->numHeaders = 0;
+    for (char* line = lineEnd + strlen(CRLF); line < endOfLines; 
+	    line = lineEnd + strlen(CRLF)) {
+        lineEnd = (char*)find_bytes(line, endOfLines - line, CRLF);
+	HttpHeader* header = &(httpRequest->headers[httpRequest->numHeaders]);
+	if (httpRequest->numHeaders == HTTP_MAX_HEADERS
+		|| !parse_header_line(line, lineEnd, header)) {
+	    return false;
+	}
+	httpRequest->numHeaders++;
+    }
+    return true;
+}
+
+long http_parse_request(char* buffer, size_t length, HttpParser* parser, 
+	HttpRequest* httpRequest) {
+    // Look for the end of the head in the bytes not searched yet, going back
+    // far enough to catch a blank line split over two reads
+    if (parser->headLength == 0) {
+        size_t start = 0;
+	if (parser->scanned > strlen(END_OF_HEAD)) {
+	    start = parser->scanned - strlen(END_OF_HEAD);
+	}
+	const char* endOfHead = find_bytes(buffer + start, length - start, 
+		END_OF_HEAD);
+	if (endOfHead == NULL) {
+	    parser->scanned = length;
+	    return length > HTTP_MAX_HEAD_SIZE ? -1 : 0;
+	}
+	size_t headLength = endOfHead - buffer + strlen(END_OF_HEAD);
+	long bodyLength = find_content_length(buffer, headLength);
+	if (headLength > HTTP_MAX_HEAD_SIZE || bodyLength < 0) {
+	    return -1;
+	}
+	parser->headLength = headLength;
+	parser->bodyLength = bodyLength;
+    }
+
+    // Wait for the whole body
+    size_t requestLength = parser->headLength + parser->bodyLength;
+    if (length < requestLength) {
+        return 0;
+    }
+    size_t headLength = parser->headLength;
+    memset(parser, 0, sizeof(HttpParser));
+    if (!parse_head(buffer, headLength, httpRequest)) {
+        return -1;
+    }
+    httpRequest->body = buffer + headLength;
+    httpRequest->bodyLength = requestLength - headLength;
+    return requestLength;
+}
+
+/* Reads a line ending in CRLF from a response stream into *line, which is 
+ * grown by getline as needed, and strips the CRLF. Returns the length of the
+ * line, or -1 at end of file or if the line does not end in CRLF */
+static long read_response_line(FILE* from, char** line, size_t* size) {
+    ssize_t length = getline(line, size, from);
+    if (length < (ssize_t)strlen(CRLF) 
+	    || strcmp(*line + length - strlen(CRLF), CRLF) != 0) {
+        return -1;
+    }
+    length -= strlen(CRLF);
+    (*line)[length] = '\0';
+    return length;
+}
+
+/* Sets the status and a copy of the explanation from the status line 
+ * "HTTP/1.x <status> <explanation>". Returns false if the line is malformed 
+ * or the copy cannot be allocated */
+static bool parse_status_line(const char* line, HttpResponse* httpResponse) {
+    const char* status = strchr(line, ' ');
+    if (strncmp(line, HTTP_VERSION_PREFIX, strlen(HTTP_VERSION_PREFIX)) != 0
+	    || status == NULL) {
+        return false;
+    }
+    status++;
+    httpResponse->status = 0;
+    for (int i = 0; i < STATUS_DIGITS; i++) {
+        if (!isdigit((unsigned char)status[i])) {
+	    return false;
+	}
+	httpResponse->status = httpResponse->status * 10 + (status[i] - '0');
+    }
+    const char* explanation = status + STATUS_DIGITS;
+    if (*explanation == ' ') {
+        explanation++;
+    } else if (*explanation != '\0') {
+        return false;
+    }
+    httpResponse->statusExplanation = strdup(explanation);
+    return httpResponse->statusExplanation != NULL;
+}
+
+/* Returns the value of a Content-Length header, or -1 if it is not a number 
+ * or is larger than HTTP_MAX_BODY_SIZE */
+static long parse_content_length(const char* value) {
+    long length = 0;
+    if (*value == '\0') {
+        return -1;
+    }
+    for (; *value != '\0'; value++) {
+        if (!isdigit((unsigned char)*value)) {
+	    return -1;
+	}
+	length = length * 10 + (*value - '0');
+	if (length > HTTP_MAX_BODY_SIZE) {
+	    return -1;
+	}
+    }
+    return length;
+}
 
-    // TEMPORARY SOLUTION: mock up a constant 200 response to get code working
-    http_response->body = "Mock body";
-    http_response->headers = '\0';
-    http_response->status = 200;
-    http_response->statusExplanation = "Mock status";
-    return 0;
+/* Appends a copy of header to the NULL terminated array of headers in 
+ * httpResponse, which holds numHeaders headers. Returns false if memory 
+ * cannot be allocated */
+static bool add_response_header(HttpResponse* httpResponse, int numHeaders, 
+	const HttpHeader* header) {
+    HttpHeader** headers = realloc(httpResponse->headers, 
+	    (numHeaders + 2) * sizeof(HttpHeader*));
+    if (headers == NULL) {
+        return false;
+    }
+    httpResponse->headers = headers;
+    headers[numHeaders + 1] = NULL;
+    headers[numHeaders] = malloc(sizeof(HttpHeader));
+    if (headers[numHeaders] == NULL) {
+        return false;
+    }
+    headers[numHeaders]->name = strdup(header->name);
+    headers[numHeaders]->value = strdup(header->value);
+    return headers[numHeaders]->name != NULL 
+	    && headers[numHeaders]->value != NULL;
 }
 
-char* get_status_explanation(int status) {
+int get_http_response(FILE* from, HttpResponse* httpResponse) {
+    memset(httpResponse, 0, sizeof(HttpResponse));
+    char* line = NULL;
+    size_t size = 0;
+    long lineLength = read_response_line(from, &line, &size);
+    bool valid = lineLength >= 0 && parse_status_line(line, httpResponse);
+
+    // Read headers until the blank line ending the head
+    long bodyLength = 0;
+    for (int numHeaders = 0; valid 
+	    && (lineLength = read_response_line(from, &line, &size)) > 0; 
+	    numHeaders++) {
+	HttpHeader header;
+	valid = numHeaders < HTTP_MAX_HEADERS 
+		&& parse_header_line(line, line + lineLength, &header)
+		&& add_response_header(httpResponse, numHeaders, &header);
+	if (valid && strcasecmp(header.name, CONTENT_LENGTH_NAME) == 0) {
+	    bodyLength = parse_content_length(header.value);
+	    valid = bodyLength >= 0;
+	}
+    }
+    valid = valid && lineLength == 0;
+    free(line);
+
+    // Read the body, null terminating it for callers treating it as a string
+    if (valid) {
+        httpResponse->body = malloc(bodyLength + 1);
+	valid = httpResponse->body != NULL && fread(httpResponse->body, 1, 
+		bodyLength, from) == (size_t)bodyLength;
+    }
+    if (!valid) {
+        free_http_response(httpResponse);
+	memset(httpResponse, 0, sizeof(HttpResponse));
+	return 0;
+    }
+    httpResponse->body[bodyLength] = '\0';
+    httpResponse->bodyLength = bodyLength;
+    return 1;
+}
+
+const char* get_status_explanation(int status) {
     if (status == STATUS_OK) {
-        return strdup(STATUS_EXPLANATION_OK);
+        return STATUS_EXPLANATION_OK;
     } else if (status == STATUS_BAD_REQUEST) {
-        return strdup(STATUS_EXPLANATION_BAD_REQUEST);
+        return STATUS_EXPLANATION_BAD_REQUEST;
     } else if (status == STATUS_NOT_FOUND) {
-        return strdup(STATUS_EXPLANATION_NOT_FOUND);
+        return STATUS_EXPLANATION_NOT_FOUND;
     } else if (status == STATUS_INTERNAL_SERVER_ERROR) {
-        return strdup(STATUS_EXPLANATION_INTERNAL_SERVER_ERROR);
+        return STATUS_EXPLANATION_INTERNAL_SERVER_ERROR;
     } else if (status == STATUS_UNAUTHORIZED) {
-	return strdup(STATUS_EXPLANATION_UNAUTHORIZED);
+	return STATUS_EXPLANATION_UNAUTHORIZED;
+    } else if (status == STATUS_SERVICE_UNAVAILABLE) {
+	return STATUS_EXPLANATION_SERVICE_UNAVAILABLE;
     } else {
         return NULL;
     }
 }
 
-// TEST THIS
-char** split_by_char(char* address, char* delimiter, unsigned int maxFields) {
-    char* address_copy = strdup(address);
-    char* buffer[maxFields];
-    char* token = strtok(address_copy, delimiter); // Get first token
-    
-    for (int i = 0; i < maxFields; i++) {
-        buffer[i] = strdup(token);
-        token = strtok(NULL, " "); // Successive calls with NULL process remaining tokens from original string
-    }
-    buffer[maxFields] = NULL;
-
-    free(address_copy);
-    
-    return buffer;
+int http_format_response_head(char* buffer, size_t size, int status, 
+	size_t bodyLength) {
+    const char* explanation = get_status_explanation(status);
+    return snprintf(buffer, size, 
+	    "HTTP/1.1 %d %s" CRLF "Content-Length: %zu" CRLF CRLF, status, 
+	    explanation != NULL ? explanation : "", bodyLength);
 }
 
-void deconstruct_address(HttpRequest* httpRequest, char* address) {
-    char delimiter[] = "/";
-    unsigned int maxFields = 3; // Number of strings to split string by
-    char** tokens = split_by_char(address, delimiter, maxFields);
-    httpRequest->dbType = strdup(tokens[1]);
-    httpRequest->key = strdup(tokens[2]);
-    free(address);
-    free(tokens);
+char* get_auth_string(HttpRequest* httpRequest) {
+    return http_get_header(httpRequest, "Authorization");
 }
 
-char* get_auth_string(HttpRequest* httpRequest) {
-    int i = 0;
-    while (httpRequest->headers[i]) {
-        if (strcmp(httpRequest->headers[i]->name, "Authorization") == 0) {
-	    return httpRequest->headers[i]->value;
+char* http_get_header(HttpRequest* httpRequest, const char* name) {
+    for (int i = 0; i < httpRequest->numHeaders; i++) {
+        if (strcasecmp(httpRequest->headers[i].name, name) == 0) {
+            return httpRequest->headers[i].value;
 	}
-	i++;
     }
     return NULL;
 }
 
-void free_http_request(HttpRequest* httpRequest) {
-    free(httpRequest->method);
-    free(httpRequest->dbType);
-    free(httpRequest->key);
-    free_array_of_headers(httpRequest->headers);
-    free(httpRequest->body);
+bool http_get_expiry(HttpRequest* httpRequest, unsigned int now,
+	unsigned int* expiry) {
+    *expiry = 0;
+    const char* value = http_get_header(httpRequest, HTTP_TTL_HEADER);
+    if (value == NULL) {
+        return true;
+    }
+
+    // Only plain digits are accepted, strtoul would skip spaces and signs
+    unsigned long long ttl = 0;
+    if (*value == '\0') {
+        return false;
+    }
+    for (; *value != '\0'; value++) {
+        if (!isdigit((unsigned char)*value)) {
+            return false;
+	}
+	ttl = ttl * 10 + (*value - '0');
+	if (ttl > UINT_MAX - now) {
+	    return false;
+	}
+    }
+    if (ttl == 0) {
+        return false;
+    }
+    *expiry = now + ttl;
+    return true;
 }
 
 void free_http_response(HttpResponse* httpResponse) {
     free(httpResponse->statusExplanation);
     free_array_of_headers(httpResponse->headers);
-    free(httpResponse->body);
+    if (httpResponse->releaseBody != NULL) {
+        httpResponse->releaseBody(httpResponse->releaseArg);
+    } else {
+        free(httpResponse->body);
+    }
 }
 
 void free_array_of_headers(HttpHeader** headers) {
-    for ( ; *headers != NULL; headers++) {
+    if (headers == NULL) {
+        return;
+    }
+    for (HttpHeader** header = headers; *header != NULL; header++) {
         // Free strings stored in header
-        free((*headers)->name);
-        free((*headers)->value);
-
-        free(headers);
+        free((*header)->name);
+        free((*header)->value);
+        free(*header);
     }
-}
\ No newline at end of file
+    free(headers);
+}
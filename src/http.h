@@ -21,28 +21,82 @@
 #define STATUS_EXPLANATION_INTERNAL_SERVER_ERROR "Internal Server Error"
 #define STATUS_EXPLANATION_SERVICE_UNAVAILABLE "Service Unavailable"
 
+/* Largest request head (request line and headers) and body accepted */
+#define HTTP_MAX_HEAD_SIZE (64 * 1024)
+#define HTTP_MAX_BODY_SIZE (64 * 1024 * 1024)
+
+/* Largest number of headers accepted in a request */
+#define HTTP_MAX_HEADERS 32
+
+/* Written in a batch response in place of the value of a missing key */
+#define HTTP_BATCH_MISSING "-1:"
+
+/* Result of each key of a batch put or delete response */
+#define HTTP_BATCH_DONE '1'
+#define HTTP_BATCH_NOT_DONE '0'
+
+/* Header of a PUT or MPUT request giving the number of seconds until the
+ * keys put expire */
+#define HTTP_TTL_HEADER "TTL"
+
+/* Header of a SCAN request giving the most keys to return */
+#define HTTP_LIMIT_HEADER "Limit"
+
+/* Size of a buffer large enough for any response head dbserver sends */
+#define HTTP_RESPONSE_HEAD_SIZE 128
+
+/* Longest name of a store in a request address */
+#define HTTP_MAX_STORE_NAME 64
+
+/* Address the statistics are served from, as in "GET /stats", which no
+ * store may be named */
+#define HTTP_STATS_ADDRESS "stats"
+
 typedef struct HttpHeader {
     char* name;
     char* value;
 } HttpHeader;
 
 
-/* Contains the information in a http request */
+/* Contains the information in a http request. Every string is a view into
+ * the buffer the request was parsed from. The method, dbType, key and header
+ * strings are null terminated in place, the body is not as the next request
+ * may follow straight after it */
 typedef struct HttpRequest {
     char* method;
     char* dbType;
     char* key;
-    HttpHeader** headers;
+    size_t keyLength;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int numHeaders;
     char* body;
+    size_t bodyLength;
     bool messageAuthenticated;
 } HttpRequest;
 
-/* The values of a http response */
+/* Progress through a request that has only been partly received. scanned is
+ * how much of the request has been searched for the end of its head, and 
+ * headLength and bodyLength are set once the end of the head is found */
+typedef struct {
+    size_t scanned;
+    size_t headLength;
+    size_t bodyLength;
+} HttpParser;
+
+/* Called to hand back a response body the response does not own */
+typedef void (*HttpBodyRelease)(void* releaseArg);
+
+/* The values of a http response. The body is bodyLength bytes long. If 
+ * releaseBody is set the body is borrowed, and instead of being freed it is
+ * handed back by calling releaseBody with releaseArg */
 typedef struct HttpResponse {
     int status;
     char* statusExplanation;
     HttpHeader** headers;
     char* body;
+    size_t bodyLength;
+    HttpBodyRelease releaseBody;
+    void* releaseArg;
 } HttpResponse;
 
 /* Different status values for a http response */
@@ -55,16 +109,48 @@ typedef enum {
     STATUS_SERVICE_UNAVAILABLE = 503
 } StatusValues;
 
-/**
- * Returns the HTTP response received on the file stream provided.
- * 
- * from: File stream http response is recieved on
- * http_response: pointer to HttpResponse struct of the received response.
- * 
- * The values of the HTTP response are set in the response pointer provided.
+/* get_http_response()
+* −−−−−−−−−−−−−−−
+* Reads the next http response from a stream.
+*
+* The status line and headers are read a line at a time, then the number of 
+* body bytes given by the Content-Length header, so further responses on the
+* same stream can be read by calling this again.
+*
+* from: the stream the response is received on. Not NULL
+* httpResponse: set to the response received, with every field allocated 
+* with malloc and freed by free_http_response(). The body is null terminated
+* after its bodyLength bytes. Not NULL
+*
+* Returns: 1 if a response was read, 0 at end of file or if the response was
+* malformed, in which case httpResponse holds nothing to free
 */
-int get_http_response(FILE* from, HttpResponse* http_response);
+int get_http_response(FILE* from, HttpResponse* httpResponse);
+
 
+/* http_parse_request()
+* −−−−−−−−−−−−−−−
+* Parses the first http request held in a buffer of received bytes.
+*
+* The request is complete once the blank line ending its headers has been
+* received, followed by the number of body bytes given in its Content-Length
+* header (if it has one). Until then the parser remembers how far it got, so
+* calling this again as more bytes arrive does not search the same bytes
+* twice. Once the request is complete its head is split up in place and
+* httpRequest is set to views into the buffer, no memory is allocated.
+*
+* buffer: bytes received from a client, starting at the request. Not NULL
+* length: the number of bytes in buffer
+* parser: the progress made on the request so far, zeroed before the first 
+* call for each request. Reset when a request is completed. Not NULL
+* httpRequest: set to the parsed request when it is complete. Not NULL
+*
+* Returns: the length of the request in bytes if it was complete, 0 if more 
+* bytes are needed, -1 if the request is malformed or larger than 
+* HTTP_MAX_HEAD_SIZE / HTTP_MAX_BODY_SIZE / HTTP_MAX_HEADERS allow
+*/
+long http_parse_request(char* buffer, size_t length, HttpParser* parser, 
+	HttpRequest* httpRequest);
 
 /* get_status_explanation()
 * −−−−−−−−−−−−−−−
@@ -73,25 +159,32 @@ int get_http_response(FILE* from, HttpResponse* http_response);
 *
 * status: The http response status
 *
-* Returns: copy of the status explanation on success created with malloc, 
-* NULL if the status does not match any of the status checks.
+* Returns: the status explanation, which must not be modified or freed. NULL
+* if the status does not match any of the status checks.
 */
-char* get_status_explanation(int status);
+const char* get_status_explanation(int status);
 
-/* deconstruct_address()
+/* http_format_response_head()
 * −−−−−−−−−−−−−−−
-* Splits the http request address into its database type and key, and saves
-* them in the httpRequest struct.
+* Writes the status line and headers of a http response into a buffer.
 *
-* httpRequest: HttpRequest struct holding the http request information. Not 
-* NULL
-* address: http request address in the form of "/<database type>/<key>"
+* The head ends with the blank line, so the body can be sent straight after
+* it.
+*
+* buffer: where to write the head. Not NULL
+* size: the size of buffer, HTTP_RESPONSE_HEAD_SIZE is always enough
+* status: the http response status
+* bodyLength: the number of bytes in the body that will follow the head
+*
+* Returns: the number of bytes written to buffer
 */
-void deconstruct_address(HttpRequest* httpRequest, char* address);
+int http_format_response_head(char* buffer, size_t size, int status, 
+	size_t bodyLength);
 
 /* get_auth_string()
 * −−−−−−−−−−−−−−−
-* Gets the authentication string from the http request header.
+* Gets the authentication string from the http request header. The header name
+* is matched without regard to case.
 *
 * httpRequest: HttpRequest struct holding the http request information. Not 
 * NULL
@@ -101,12 +194,64 @@ void deconstruct_address(HttpRequest* httpRequest, char* address);
 */
 char* get_auth_string(HttpRequest* httpRequest);
 
+/* http_get_header()
+* −−−−−−−−−−−−−−−
+* Finds the value of a header of a http request, matching the name without
+* regard to case.
+*
+* httpRequest: the request to look in. Not NULL
+* name: the name of the header. Not NULL
+*
+* Returns: the value of the first header with the name, NULL if there is none
+*/
+char* http_get_header(HttpRequest* httpRequest, const char* name);
+
+/* http_get_expiry()
+* −−−−−−−−−−−−−−−
+* Works out when the keys put by a request expire from its HTTP_TTL_HEADER
+* header, which holds a whole number of seconds greater than 0.
+*
+* httpRequest: the request to look in. Not NULL
+* now: the current time in seconds since the Epoch
+* expiry: set to now plus the time to live, or 0 if the request has no 
+* HTTP_TTL_HEADER header. Not NULL
+*
+* Returns: false if the header is present but not a valid time to live
+*/
+bool http_get_expiry(HttpRequest* httpRequest, unsigned int now,
+	unsigned int* expiry);
+
+/* http_next_batch_item()
+* −−−−−−−−−−−−−−−
+* Reads the next item from the body of a batch request or response.
+*
+* Batch bodies are a sequence of items, each written as its length in decimal,
+* a ':' and then the bytes of the item. A missing item is written as 
+* HTTP_BATCH_MISSING.
+*
+* body: the batch body. Not NULL
+* bodyLength: the number of bytes in body
+* offset: where the next item starts, advanced past it. Not NULL
+* item: set to the start of the item in body, NULL for a missing item. Not 
+* NULL
+* itemLength: set to the number of bytes in the item. Not NULL
+*
+* Returns: 1 if an item was read, 0 at the end of the body, -1 if the body is
+* malformed
+*/
+int http_next_batch_item(const char* body, size_t bodyLength, size_t* offset,
+	const char** item, size_t* itemLength);
+
 /* valid_http_method_and_address()
 * −−−−−−−−−−−−−−−
 * Checks if the method and address of the http request is valid.
 *
 * A valid http request method contains one of "GET", "PUT", or "DELETE".
-* A valid http request address is one that contains "public", or "private".
+* A valid http request address is one that contains a store name accepted by
+* http_valid_store_name(), followed by a key that is not empty. The batch
+* methods "MGET", "MPUT" and "MDELETE" carry their keys in the body instead,
+* so their address must have an empty key. "SCAN" takes a prefix in place
+* of the key, which may be empty.
 *
 * httpRequest: HttpRequest struct holding the http request information. Not 
 * NULL
@@ -116,18 +261,22 @@ char* get_auth_string(HttpRequest* httpRequest);
 */
 bool valid_http_method_and_address(HttpRequest* httpRequest);
 
-/* free_http_request()
+/* http_valid_store_name()
 * −−−−−−−−−−−−−−−
-* Frees all memory associated with the given HttpRequest.
+* Checks that a store name is made up of letters, digits, '-' and '_' only,
+* so it can be used in a file name, is no longer than HTTP_MAX_STORE_NAME
+* and is not HTTP_STATS_ADDRESS.
 *
-* httpRequest: HttpRequest struct holding the http request information. Not 
-* NULL 
+* name: the name to check. Not NULL
+*
+* Returns: true if the name is not empty and valid, false otherwise
 */
-void free_http_request(HttpRequest* httpRequest);
+bool http_valid_store_name(const char* name);
 
 /* free_http_response()
 * −−−−−−−−−−−−−−−
-* Frees all memory associated with the given HttpResponse.
+* Frees all memory associated with the given HttpResponse, handing back a 
+* borrowed body.
 *
 * httpResponse: HttpResponse struct holding the http response information. Not 
 * NULL 
@@ -135,7 +284,8 @@ void free_http_request(HttpRequest* httpRequest);
 void free_http_response(HttpResponse* httpResponse);
 
 /**
- * Frees the memory used by the array of headers
+ * Frees the memory used by a NULL terminated array of headers, which may 
+ * itself be NULL
 */
 void free_array_of_headers(HttpHeader** headers);
 
@@ -0,0 +1,360 @@
+/*
+** keyspace.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "keyspace.h"
+#include "epoch.h"
+
+/* Number of slots in the first version of the map */
+#define INITIAL_CAPACITY 8
+
+/* FNV-1a constants used to hash keyspace names */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* Suffix of the file a keyspace's setup is written to before it is moved
+ * into place */
+#define SETUP_TEMP_SUFFIX ".tmp"
+
+/* Permissions of a new setup file */
+#define SETUP_FILE_MODE 0600
+
+/* Hashes a keyspace name */
+static uint64_t hash_name(const char* name) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char)*name;
+	hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Allocates an empty version of the map with the given number of slots, a
+ * power of two. Both arrays follow the header in the same block */
+static KeyspaceTable* table_init(size_t capacity) {
+    KeyspaceTable* table = calloc(1,
+	    sizeof(KeyspaceTable) + 2 * capacity * sizeof(Keyspace*));
+    if (table != NULL) {
+        table->capacity = capacity;
+	table->slots = (Keyspace**)(table + 1);
+	table->entries = table->slots + capacity;
+    }
+    return table;
+}
+
+/* Puts a keyspace in the first free slot along its probe sequence. The
+ * table must have a free slot and not yet be published */
+static void table_insert(KeyspaceTable* table, Keyspace* keyspace) {
+    size_t mask = table->capacity - 1;
+    size_t i = hash_name(keyspace->name) & mask;
+    while (table->slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    table->slots[i] = keyspace;
+    table->entries[table->count++] = keyspace;
+}
+
+/* Looks up a keyspace in a version of the map */
+static Keyspace* table_find(KeyspaceTable* table, const char* name) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash_name(name) & mask; table->slots[i] != NULL;
+	    i = (i + 1) & mask) {
+        if (strcmp(table->slots[i]->name, name) == 0) {
+	    return table->slots[i];
+	}
+    }
+    return NULL;
+}
+
+/* Returns the path of the file the setup of the named keyspace is saved in
+ * with suffix appended, allocated with malloc */
+static char* setup_path(const char* dir, const char* name,
+	const char* suffix) {
+    char* path = malloc(strlen(dir) + strlen(name)
+	    + strlen(KEYSPACE_FILE_EXTENSION) + strlen(suffix) + 2);
+    if (path != NULL) {
+        sprintf(path, "%s/%s%s%s", dir, name, KEYSPACE_FILE_EXTENSION,
+		suffix);
+    }
+    return path;
+}
+
+/* Syncs a directory, so a file renamed into it survives a crash. Returns
+ * false on error */
+static bool sync_directory(const char* dir) {
+    int fd = open(dir, O_RDONLY);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return synced;
+}
+
+/* Saves the setup of a keyspace in the data directory, replacing any saved
+ * before. The first line holds whether it was created on demand, its number
+ * of shards and its memory limit, the second the absolute path of its
+ * authfile, empty if it needs no secret. Returns false on error */
+static bool save_setup(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* config, bool onDemand) {
+    char* path = setup_path(keyspaces->dataDir, name, "");
+    char* tempPath = setup_path(keyspaces->dataDir, name, SETUP_TEMP_SUFFIX);
+    char* authfile = config->auth == NULL ? NULL
+	    : realpath(config->auth->path, NULL);
+    int fd = path == NULL || tempPath == NULL ? -1
+	    : open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, SETUP_FILE_MODE);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (file == NULL && fd >= 0) {
+        close(fd);
+    }
+    bool saved = file != NULL && fprintf(file, "%d %u %zu\n%s\n", onDemand,
+	    config->numShards != 0 ? config->numShards
+	    : keyspaces->defaults.numShards, config->memoryLimit,
+	    config->auth == NULL ? "" 
+	    : authfile != NULL ? authfile : config->auth->path) >= 0
+	    && fflush(file) == 0 && fsync(fd) == 0;
+    if (file != NULL) {
+        saved = fclose(file) == 0 && saved;
+    }
+    saved = saved && rename(tempPath, path) == 0
+	    && sync_directory(keyspaces->dataDir);
+    if (!saved && tempPath != NULL) {
+        unlink(tempPath);
+    }
+    free(path);
+    free(tempPath);
+    free(authfile);
+    return saved;
+}
+
+/* Reads back the setup of a keyspace saved by save_setup(), with the path of
+ * its authfile allocated with malloc, or NULL if it needs no secret. Returns
+ * false if no setup was saved or it cannot be read */
+static bool load_setup(const char* dir, const char* name,
+	KeyspaceConfig* config, bool* onDemand, char** authfile) {
+    char* path = setup_path(dir, name, "");
+    FILE* file = path == NULL ? NULL : fopen(path, "r");
+    free(path);
+    if (file == NULL) {
+        return false;
+    }
+    char* line = NULL;
+    size_t size = 0;
+    int demanded;
+    bool loaded = getline(&line, &size, file) > 0 
+	    && sscanf(line, "%d %u %zu", &demanded, &(config->numShards),
+	    &(config->memoryLimit)) == 3
+	    && getline(&line, &size, file) > 0;
+    fclose(file);
+    if (!loaded) {
+        free(line);
+	return false;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == '\0') {
+        free(line);
+	line = NULL;
+    }
+    config->auth = NULL;
+    *onDemand = demanded != 0;
+    *authfile = line;
+    return true;
+}
+
+Keyspaces* keyspaces_init(const StorageEngineOps* ops,
+	const KeyspaceConfig* defaults, unsigned int maxOnDemand,
+	bool ordered, const char* dataDir) {
+    Keyspaces* keyspaces = calloc(1, sizeof(Keyspaces));
+    keyspaces->current = table_init(INITIAL_CAPACITY);
+    pthread_mutex_init(&(keyspaces->createLock), NULL);
+    keyspaces->ops = ops;
+    keyspaces->defaults = *defaults;
+    keyspaces->maxOnDemand = maxOnDemand;
+    keyspaces->ordered = ordered;
+    keyspaces->dataDir = dataDir == NULL ? NULL : strdup(dataDir);
+    return keyspaces;
+}
+
+Keyspace* keyspace_find(Keyspaces* keyspaces, const char* name) {
+    // The keyspace itself outlives the read, only the table may be retired
+    epoch_enter();
+    KeyspaceTable* table =
+	    __atomic_load_n(&(keyspaces->current), __ATOMIC_ACQUIRE);
+    Keyspace* keyspace = table_find(table, name);
+    epoch_exit();
+    return keyspace;
+}
+
+/* Frees the retired versions of the map no reader can still be using. The
+ * create lock must be held */
+static void reclaim_tables(Keyspaces* keyspaces) {
+    epoch_advance();
+    KeyspaceTable** link = &(keyspaces->retired);
+    while (*link != NULL) {
+        KeyspaceTable* table = *link;
+	if (epoch_reclaimable(table->retired)) {
+	    *link = table->nextRetired;
+	    free(table);
+	} else {
+	    link = &(table->nextRetired);
+	}
+    }
+}
+
+/* Creates a keyspace and its store, set up as the keyspaces require.
+ * Returns NULL if memory cannot be allocated */
+static Keyspace* create_keyspace(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* config, bool onDemand) {
+    Keyspace* keyspace = malloc(sizeof(Keyspace));
+    char* nameCopy = strdup(name);
+    if (keyspace == NULL || nameCopy == NULL) {
+        free(keyspace);
+	free(nameCopy);
+	return NULL;
+    }
+    keyspace->name = nameCopy;
+    keyspace->config = *config;
+    if (keyspace->config.numShards == 0) {
+        keyspace->config.numShards = keyspaces->defaults.numShards;
+    }
+    keyspace->onDemand = onDemand;
+    keyspace->engine = engine_create(keyspaces->ops, keyspace->name,
+	    keyspace->config.numShards);
+    if (keyspace->engine == NULL || (keyspaces->ordered
+	    && !engine_set_ordered(keyspace->engine))) {
+        if (keyspace->engine != NULL) {
+	    engine_free(keyspace->engine);
+	}
+	free(nameCopy);
+	free(keyspace);
+	return NULL;
+    }
+    if (keyspace->config.memoryLimit > 0) {
+        engine_set_memory_limit(keyspace->engine,
+		keyspace->config.memoryLimit);
+    }
+    if (keyspaces->log != NULL) {
+        engine_attach_log(keyspace->engine, keyspaces->log);
+    }
+    return keyspace;
+}
+
+/* Adds a keyspace as keyspace_add() does, only refusing one created on
+ * demand once maxOnDemand have been if limited is set */
+static Keyspace* add_keyspace(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* config, bool onDemand, bool limited) {
+    pthread_mutex_lock(&(keyspaces->createLock));
+    KeyspaceTable* old = keyspaces->current;
+    Keyspace* keyspace = table_find(old, name);
+    if (keyspace != NULL || (limited
+	    && keyspaces->numOnDemand >= keyspaces->maxOnDemand)) {
+        pthread_mutex_unlock(&(keyspaces->createLock));
+	return keyspace;
+    }
+    if (config == NULL) {
+        config = &(keyspaces->defaults);
+    }
+
+    // Once changes are logged a keyspace must be restorable as it is
+    if (keyspaces->log != NULL
+	    && !save_setup(keyspaces, name, config, onDemand)) {
+        pthread_mutex_unlock(&(keyspaces->createLock));
+	return NULL;
+    }
+
+    // Readers carry on with the old version while the new one is built,
+    // growing it so it stays at most half full
+    size_t capacity = old->capacity;
+    if (2 * (old->count + 1) > capacity) {
+        capacity *= 2;
+    }
+    KeyspaceTable* table = table_init(capacity);
+    keyspace = table == NULL ? NULL 
+	    : create_keyspace(keyspaces, name, config, onDemand);
+    if (keyspace == NULL) {
+        pthread_mutex_unlock(&(keyspaces->createLock));
+	free(table);
+	return NULL;
+    }
+    for (size_t i = 0; i < old->count; i++) {
+        table_insert(table, old->entries[i]);
+    }
+    table_insert(table, keyspace);
+    keyspaces->numOnDemand += onDemand;
+
+    // Readers that loaded the old version may still be probing it
+    reclaim_tables(keyspaces);
+    __atomic_store_n(&(keyspaces->current), table, __ATOMIC_RELEASE);
+    old->retired = epoch_current();
+    old->nextRetired = keyspaces->retired;
+    keyspaces->retired = old;
+    pthread_mutex_unlock(&(keyspaces->createLock));
+    return keyspace;
+}
+
+Keyspace* keyspace_add(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* config, bool onDemand) {
+    return add_keyspace(keyspaces, name, config, onDemand, onDemand);
+}
+
+Keyspace* keyspace_restore(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* unsaved) {
+    Keyspace* keyspace = keyspace_find(keyspaces, name);
+    if (keyspace != NULL) {
+        return keyspace;
+    }
+    KeyspaceConfig config;
+    bool onDemand = false;
+    char* authfile = NULL;
+    if (keyspaces->dataDir == NULL || !load_setup(keyspaces->dataDir, name,
+	    &config, &onDemand, &authfile)) {
+        config = *unsaved;
+    }
+    if (authfile != NULL) {
+        config.auth = auth_load(authfile);
+	if (config.auth == NULL) {
+	    config.auth = unsaved->auth;
+	} else {
+	    auth_watch(config.auth);
+	}
+	free(authfile);
+    }
+    return add_keyspace(keyspaces, name, &config, onDemand, false);
+}
+
+Keyspace** keyspaces_list(Keyspaces* keyspaces, size_t* count) {
+    epoch_enter();
+    KeyspaceTable* table =
+	    __atomic_load_n(&(keyspaces->current), __ATOMIC_ACQUIRE);
+    Keyspace** list = malloc(table->count * sizeof(Keyspace*));
+    if (list != NULL) {
+        memcpy(list, table->entries, table->count * sizeof(Keyspace*));
+	*count = table->count;
+    }
+    epoch_exit();
+    return list;
+}
+
+bool keyspaces_attach_log(Keyspaces* keyspaces, WriteAheadLog* log) {
+    pthread_mutex_lock(&(keyspaces->createLock));
+    KeyspaceTable* table = keyspaces->current;
+    bool saved = true;
+    for (size_t i = 0; i < table->count; i++) {
+        Keyspace* keyspace = table->entries[i];
+	engine_attach_log(keyspace->engine, log);
+	saved = saved && save_setup(keyspaces, keyspace->name,
+		&(keyspace->config), keyspace->onDemand);
+    }
+    keyspaces->log = log;
+    pthread_mutex_unlock(&(keyspaces->createLock));
+    return saved;
+}
@@ -0,0 +1,175 @@
+/*
+** keyspace.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef KEYSPACE_H
+#define KEYSPACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "engine.h"
+#include "auth.h"
+#include "wal.h"
+
+/* Suffix of the file in the data directory a keyspace's setup is saved in */
+#define KEYSPACE_FILE_EXTENSION ".keyspace"
+
+/* How a keyspace is set up: the number of shards its store is split into,
+ * the most memory its keys may hold (0 for no limit) and the secret its
+ * requests must carry (NULL if they need none) */
+typedef struct {
+    unsigned int numShards;
+    size_t memoryLimit;
+    Authenticator* auth;
+} KeyspaceConfig;
+
+/* A named store with a storage engine instance of its own, addressed as
+ * "/<name>/<key>". onDemand is set if it was created by a request rather than
+ * configured, including by a request before the server was restarted.
+ * Keyspaces are never freed once created */
+typedef struct {
+    char* name;
+    StorageEngine* engine;
+    KeyspaceConfig config;
+    bool onDemand;
+} Keyspace;
+
+/* One version of the map from names to keyspaces. slots is an open
+ * addressing table of capacity entries, at most half full, and entries holds
+ * the count keyspaces in the order they were created. A version is never
+ * changed once published, only replaced by a copy with a keyspace added, and
+ * retired until no reader can still be using it */
+typedef struct KeyspaceTable {
+    size_t capacity;
+    size_t count;
+    Keyspace** slots;
+    Keyspace** entries;
+    unsigned long long retired;
+    struct KeyspaceTable* nextRetired;
+} KeyspaceTable;
+
+/* The keyspaces of the server. Lookups load current without taking a lock;
+ * createLock is held while a keyspace is added. defaults is the setup of
+ * keyspaces created on demand, of which at most maxOnDemand may exist. Every
+ * keyspace is run by the engine ops, kept in order if ordered is set, and
+ * logs its changes to log once it is attached, when its setup is saved in
+ * dataDir */
+typedef struct {
+    KeyspaceTable* current;
+    KeyspaceTable* retired;
+    pthread_mutex_t createLock;
+    const StorageEngineOps* ops;
+    KeyspaceConfig defaults;
+    unsigned int maxOnDemand;
+    unsigned int numOnDemand;
+    bool ordered;
+    WriteAheadLog* log;
+    char* dataDir;
+} Keyspaces;
+
+/* keyspaces_init()
+* −−−−−−−−−−−−−−−
+* Creates an empty set of keyspaces.
+*
+* ops: the storage engine every keyspace is run by. Not NULL
+* defaults: the setup of keyspaces created on demand or restored without
+* being configured. Not NULL
+* maxOnDemand: the most keyspaces that may be created on demand, 0 for none
+* ordered: whether the keys of every keyspace are kept in order
+* dataDir: the data directory the keyspaces are restored from and their
+* setup saved in, NULL if there is none
+*
+* Returns: the keyspaces created with malloc
+*/
+Keyspaces* keyspaces_init(const StorageEngineOps* ops,
+	const KeyspaceConfig* defaults, unsigned int maxOnDemand, bool ordered,
+	const char* dataDir);
+
+/* keyspace_find()
+* −−−−−−−−−−−−−−−
+* Looks up a keyspace by name without taking any lock, so lookups never wait
+* for each other or for a keyspace being added.
+*
+* keyspaces: the keyspaces to look in. Not NULL
+* name: the name of the keyspace. Not NULL
+*
+* Returns: the keyspace, NULL if there is none with that name
+*/
+Keyspace* keyspace_find(Keyspaces* keyspaces, const char* name);
+
+/* keyspace_add()
+* −−−−−−−−−−−−−−−
+* Creates a keyspace with an empty store unless one with the name already
+* exists. The store is ordered if the keyspaces are, and has the log
+* attached once there is one. Once the log is attached the setup of the
+* keyspace is saved in the data directory before it is created.
+*
+* keyspaces: the keyspaces to add to. Not NULL
+* name: the name of the keyspace, accepted by http_valid_store_name(). Not
+* NULL
+* config: the setup of the keyspace, NULL for the defaults. A numShards of 0
+* takes that of the defaults
+* onDemand: whether it is being created by a request, which fails once
+* maxOnDemand keyspaces have been
+*
+* Returns: the keyspace with the name, NULL if it did not exist and could not
+* be created or its setup could not be saved
+*/
+Keyspace* keyspace_add(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* config, bool onDemand);
+
+/* keyspace_restore()
+* −−−−−−−−−−−−−−−
+* Adds a keyspace found in the data directory unless one with the name
+* already exists, set up as it was saved there.
+*
+* A keyspace created on demand is restored as one, counting toward
+* maxOnDemand even if that many already exist. A keyspace that needed a
+* secret reads it again from the authfile it was given, which is then
+* watched for changes.
+*
+* keyspaces: the keyspaces to add to. Not NULL
+* name: the name of the keyspace, accepted by http_valid_store_name(). Not
+* NULL
+* unsaved: the setup of the keyspace if none was saved. Its secret is also
+* needed if the saved authfile can no longer be read. Not NULL
+*
+* Returns: the keyspace with the name, NULL if it did not exist and could not
+* be created
+*/
+Keyspace* keyspace_restore(Keyspaces* keyspaces, const char* name,
+	const KeyspaceConfig* unsaved);
+
+/* keyspaces_list()
+* −−−−−−−−−−−−−−−
+* Takes a copy of the keyspaces that exist, in the order they were created.
+* Keyspaces added afterwards are not included.
+*
+* keyspaces: the keyspaces to list. Not NULL
+* count: set to the number of keyspaces listed. Not NULL
+*
+* Returns: the keyspaces in an array allocated with malloc, which the caller
+* frees. NULL if memory cannot be allocated
+*/
+Keyspace** keyspaces_list(Keyspaces* keyspaces, size_t* count);
+
+/* keyspaces_attach_log()
+* −−−−−−−−−−−−−−−
+* Records every later change to every keyspace in a write-ahead log,
+* including those added afterwards, and saves the setup of every keyspace in
+* the data directory so it can be restored as it is. Called before the server
+* accepts connections.
+*
+* keyspaces: the keyspaces to log the changes of. Not NULL
+* log: the log. Not NULL
+*
+* Returns: false if the setup of a keyspace could not be saved
+*/
+bool keyspaces_attach_log(Keyspaces* keyspaces, WriteAheadLog* log);
+
+#endif
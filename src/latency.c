@@ -0,0 +1,111 @@
+/*
+** latency.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <string.h>
+#include <time.h>
+#include "latency.h"
+
+/* Number of nanoseconds in a second */
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+/* Number of buckets each power of two is split into */
+#define SUB_BUCKETS (1u << LATENCY_SIGNIFICANT_BITS)
+
+/* Returns the bucket a duration is counted in */
+static unsigned int bucket_of(unsigned long long nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) {
+        return (unsigned int)nanoseconds;
+    }
+    unsigned int exponent = 63 - __builtin_clzll(nanoseconds);
+    if (exponent >= LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKETS - 1;
+    }
+
+    // The bits below the significant ones only pick the position within
+    // the bucket
+    unsigned int shift = exponent - LATENCY_SIGNIFICANT_BITS;
+    return (shift + 1) * SUB_BUCKETS
+	    + (unsigned int)((nanoseconds >> shift) - SUB_BUCKETS);
+}
+
+/* Returns the smallest duration counted in a bucket */
+static unsigned long long bucket_start(unsigned int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned int shift = bucket / SUB_BUCKETS - 1;
+    return (unsigned long long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+}
+
+/* Returns the largest duration counted in a bucket, or the smallest for the
+ * last bucket as it has no end */
+static unsigned long long bucket_end(unsigned int bucket) {
+    if (bucket == LATENCY_BUCKETS - 1) {
+        return bucket_start(bucket);
+    }
+    return bucket_start(bucket + 1) - 1;
+}
+
+unsigned long long latency_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND
+	    + now.tv_nsec;
+}
+
+void latency_record(LatencyHistogram* histogram,
+	unsigned long long nanoseconds) {
+    __atomic_fetch_add(&(histogram->counts[bucket_of(nanoseconds)]), 1,
+	    __ATOMIC_RELAXED);
+}
+
+void latency_summarise(LatencyHistogram* histogram, LatencySummary* summary) {
+    // Copy the counts first, so the percentiles agree with the total
+    unsigned long counts[LATENCY_BUCKETS];
+    memset(summary, 0, sizeof(LatencySummary));
+    double total = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = __atomic_load_n(&(histogram->counts[i]),
+		__ATOMIC_RELAXED);
+	summary->count += counts[i];
+	total += (double)counts[i]
+		* ((bucket_start(i) + bucket_end(i)) / 2.0);
+    }
+    if (summary->count == 0) {
+        return;
+    }
+    summary->mean = (unsigned long long)(total / summary->count);
+
+    // Each percentile is found at the first bucket whose running count
+    // reaches its rank
+    unsigned long long* percentiles[] = {&(summary->p50), &(summary->p90),
+	    &(summary->p99), &(summary->p999)};
+    const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+    unsigned int next = 0;
+    unsigned long seen = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (counts[i] == 0) {
+	    continue;
+	}
+	seen += counts[i];
+	while (next < sizeof(fractions) / sizeof(fractions[0])
+		&& seen >= fractions[next] * summary->count) {
+	    *percentiles[next++] = bucket_end(i);
+	}
+	summary->max = bucket_end(i);
+    }
+}
+
+void latency_write_json(FILE* out, LatencyHistogram* histogram) {
+    LatencySummary summary;
+    latency_summarise(histogram, &summary);
+    fprintf(out, "{\"count\":%lu,\"mean_ns\":%llu,\"p50_ns\":%llu,"
+	    "\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+	    "\"max_ns\":%llu}", summary.count, summary.mean, summary.p50,
+	    summary.p90, summary.p99, summary.p999, summary.max);
+}
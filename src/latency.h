@@ -0,0 +1,86 @@
+/*
+** latency.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+
+/* Number of leading bits of a duration each bucket of a histogram tells
+ * apart, so every bucket is at most 1/16 as wide as the durations in it */
+#define LATENCY_SIGNIFICANT_BITS 4
+
+/* Durations of 2^LATENCY_MAX_EXPONENT nanoseconds (about 18 minutes) and
+ * over are all counted in the last bucket */
+#define LATENCY_MAX_EXPONENT 40
+
+/* Number of buckets in a histogram: the durations below
+ * 2^LATENCY_SIGNIFICANT_BITS get one bucket each, and every power of two
+ * above that is split into 2^LATENCY_SIGNIFICANT_BITS buckets */
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SIGNIFICANT_BITS \
+	+ 1) << LATENCY_SIGNIFICANT_BITS)
+
+/* A histogram of durations in nanoseconds, with buckets whose widths grow
+ * with the durations they count. The counts are only ever updated
+ * atomically, so any number of threads can record into it without a lock */
+typedef struct {
+    unsigned long counts[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/* The count of a histogram with the mean and some of the percentiles of the
+ * durations in it, in nanoseconds. Each percentile is the upper end of the
+ * bucket it falls in */
+typedef struct {
+    unsigned long count;
+    unsigned long long mean;
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+} LatencySummary;
+
+/* latency_now()
+* −−−−−−−−−−−−−−−
+* Reads the monotonic clock.
+*
+* Returns: the current time in nanoseconds, from an arbitrary starting point
+*/
+unsigned long long latency_now(void);
+
+/* latency_record()
+* −−−−−−−−−−−−−−−
+* Counts a duration in a histogram with a single atomic add.
+*
+* histogram: the histogram to count the duration in. Not NULL
+* nanoseconds: the duration
+*/
+void latency_record(LatencyHistogram* histogram, 
+	unsigned long long nanoseconds);
+
+/* latency_summarise()
+* −−−−−−−−−−−−−−−
+* Summarises the durations counted in a histogram. Durations recorded while
+* it is read may or may not be included.
+*
+* histogram: the histogram to read. Not NULL
+* summary: set to the count, mean and percentiles of the histogram. Not NULL
+*/
+void latency_summarise(LatencyHistogram* histogram, LatencySummary* summary);
+
+/* latency_write_json()
+* −−−−−−−−−−−−−−−
+* Writes the summary of a histogram as a JSON object, with the count and
+* each duration in nanoseconds as a member.
+*
+* out: the stream to write to. Not NULL
+* histogram: the histogram to summarise. Not NULL
+*/
+void latency_write_json(FILE* out, LatencyHistogram* histogram);
+
+#endif
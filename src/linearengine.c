@@ -0,0 +1,405 @@
+/*
+** linearengine.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "linearengine.h"
+#include "shardstore.h"
+#include "snapshot.h"
+
+/* The keys of a batch grouped by shard. The keys of shard s are the items
+ * from shardStart[s] up to shardStart[s + 1], and position gives the index
+ * in items of each key in the order the batch gave them */
+typedef struct {
+    StringStoreItem* items;
+    size_t* position;
+    size_t* shardStart;
+} ShardBatch;
+
+/* A walk through the keys of the store, and the key it is at */
+typedef struct {
+    ShardScan shardScan;
+    EngineItem item;
+} LinearScan;
+
+static void* linear_create(const char* storeName, unsigned int numShards) {
+    return shardstore_init(storeName, numShards);
+}
+
+static void linear_destroy(void* store) {
+    shardstore_free((ShardedStore*)store);
+}
+
+/* Unpins a value handed out by linear_get() */
+static void linear_unpin(void* pin) {
+    stringstore_unpin((KeyValue*)pin);
+}
+
+static EngineStatus linear_get(void* store, const char* key,
+	EngineValue* value) {
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    StoreShard* shard = shardstore_shard(shardedStore, key);
+
+    // Only a store still reading from its snapshot needs the lock
+    char copy[STRINGSTORE_INLINE_SIZE];
+    size_t valueLength;
+    KeyValue* pin;
+    const char* valueRetrieved;
+    bool locked = !shardstore_retrieve_unlocked(shardedStore, shard, key,
+	    copy, &valueRetrieved, &valueLength, &pin);
+    if (locked) {
+        shardstore_rdlock(shard);
+	valueRetrieved = shardstore_retrieve_pinned(shardedStore, shard, key,
+		&valueLength, &pin);
+    }
+
+    // A pinned value is handed out straight from the store, short values
+    // held in the index are copied
+    EngineStatus status = ENGINE_OK;
+    memset(value, 0, sizeof(EngineValue));
+    if (valueRetrieved == NULL) {
+        status = ENGINE_NOT_FOUND;
+    } else if (pin != NULL) {
+	value->value = (char*)valueRetrieved;
+	value->length = valueLength;
+	value->release = linear_unpin;
+	value->releaseArg = pin;
+    } else {
+	value->value = malloc(valueLength + 1);
+	value->length = valueLength;
+	memcpy(value->value, valueRetrieved, valueLength + 1);
+    }
+    if (locked) {
+        pthread_rwlock_unlock(&(shard->lock));
+    }
+    return status;
+}
+
+static EngineStatus linear_put(void* store, const char* key,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    // The change is logged under the lock but committed after it
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    StoreShard* shard = shardstore_shard(shardedStore, key);
+    EngineStatus status = ENGINE_OK;
+    unsigned long long record = 0;
+    shardstore_wrlock(shard);
+    if (!shardstore_add(shardedStore, shard, key, value, valueLength,
+	    expiry)) {
+        status = ENGINE_FAILED;
+    } else {
+	record = shardstore_log(shardedStore, WAL_PUT, key, value,
+		valueLength, expiry);
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+    if (!shardstore_commit(shardedStore, record)) {
+        status = ENGINE_FAILED;
+    }
+    return status;
+}
+
+static EngineStatus linear_delete(void* store, const char* key) {
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    StoreShard* shard = shardstore_shard(shardedStore, key);
+    EngineStatus status = ENGINE_OK;
+    unsigned long long record = 0;
+    shardstore_wrlock(shard);
+    if (!shardstore_delete(shardedStore, shard, key)) {
+        status = ENGINE_NOT_FOUND;
+    } else {
+	record = shardstore_log(shardedStore, WAL_DELETE, key, NULL, 0, 0);
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+    if (!shardstore_commit(shardedStore, record)) {
+        status = ENGINE_FAILED;
+    }
+    return status;
+}
+
+/* Frees the memory used by a batch */
+static void free_shard_batch(ShardBatch* batch) {
+    free(batch->items);
+    free(batch->position);
+    free(batch->shardStart);
+}
+
+/* Groups the keys of a batch by shard, keeping their order within each
+ * shard. Returns false if memory cannot be allocated */
+static bool group_batch(ShardedStore* store, EngineItem* items, size_t count,
+	ShardBatch* batch) {
+    unsigned int* shardOf = malloc(count * sizeof(unsigned int));
+    size_t* next = malloc(store->numShards * sizeof(size_t));
+    batch->items = calloc(count, sizeof(StringStoreItem));
+    batch->position = malloc(count * sizeof(size_t));
+    batch->shardStart = calloc(store->numShards + 1, sizeof(size_t));
+    if (shardOf == NULL || next == NULL || batch->items == NULL
+	    || batch->position == NULL || batch->shardStart == NULL) {
+        free(shardOf);
+	free(next);
+	return false;
+    }
+
+    // Count the keys of each shard, then place them after those of the
+    // shards before it
+    for (size_t i = 0; i < count; i++) {
+        shardOf[i] = shardstore_index(store, stringstore_hash(items[i].key));
+	batch->shardStart[shardOf[i] + 1]++;
+    }
+    for (unsigned int s = 0; s < store->numShards; s++) {
+        batch->shardStart[s + 1] += batch->shardStart[s];
+    }
+    memcpy(next, batch->shardStart, store->numShards * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        batch->position[i] = next[shardOf[i]]++;
+	StringStoreItem* item = &(batch->items[batch->position[i]]);
+	item->key = items[i].key;
+	item->hash = stringstore_hash(items[i].key);
+	item->value = items[i].value;
+	item->valueLength = items[i].valueLength;
+	item->expiry = items[i].expiry;
+    }
+    free(next);
+    free(shardOf);
+    return true;
+}
+
+/* Logs the changes made to the given keys of a batch put or delete. Returns
+ * the number of the last record logged, or record if there were none */
+static unsigned long long log_changes(ShardedStore* store,
+	EngineBatchOperation operation, StringStoreItem* items, size_t count,
+	unsigned long long record) {
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i].result) {
+	    continue;
+	}
+	if (operation == ENGINE_BATCH_PUT) {
+	    record = shardstore_log(store, WAL_PUT, items[i].key,
+		    items[i].value, items[i].valueLength, items[i].expiry);
+	} else {
+	    record =
+		    shardstore_log(store, WAL_DELETE, items[i].key, NULL, 0, 0);
+	}
+    }
+    return record;
+}
+
+/* Hands the results of a batch back in the order its keys were given,
+ * copying the values found by a get. Returns false, leaving no copies, if
+ * memory cannot be allocated */
+static bool batch_results(ShardBatch* batch, EngineBatchOperation operation,
+	EngineItem* items, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        StringStoreItem* item = &(batch->items[batch->position[i]]);
+	items[i].done = item->result;
+	if (operation != ENGINE_BATCH_GET) {
+	    continue;
+	}
+	items[i].value = NULL;
+	if (item->value == NULL) {
+	    continue;
+	}
+	char* copy = malloc(item->valueLength + 1);
+	if (copy == NULL) {
+	    for (size_t j = 0; j < i; j++) {
+	        free((char*)items[j].value);
+		items[j].value = NULL;
+	    }
+	    return false;
+	}
+	memcpy(copy, item->value, item->valueLength);
+	copy[item->valueLength] = '\0';
+	items[i].value = copy;
+	items[i].valueLength = item->valueLength;
+    }
+    return true;
+}
+
+static EngineStatus linear_batch(void* store, EngineBatchOperation operation,
+	EngineItem* items, size_t count) {
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    ShardBatch batch;
+    memset(&batch, 0, sizeof(ShardBatch));
+    if (count == 0) {
+        return ENGINE_OK;
+    }
+    if (!group_batch(shardedStore, items, count, &batch)) {
+        free_shard_batch(&batch);
+	return ENGINE_FAILED;
+    }
+
+    // The lock of each shard involved is taken once, in ascending order, so
+    // the batch is applied at once and cannot deadlock with other batches
+    unsigned long long record = 0;
+    for (unsigned int s = 0; s < shardedStore->numShards; s++) {
+        if (batch.shardStart[s] == batch.shardStart[s + 1]) {
+	    continue;
+	}
+	if (operation == ENGINE_BATCH_GET) {
+	    shardstore_rdlock(&(shardedStore->shards[s]));
+	} else {
+	    shardstore_wrlock(&(shardedStore->shards[s]));
+	}
+    }
+    for (unsigned int s = 0; s < shardedStore->numShards; s++) {
+        StringStoreItem* shardItems = batch.items + batch.shardStart[s];
+	size_t shardCount = batch.shardStart[s + 1] - batch.shardStart[s];
+	if (shardCount == 0) {
+	    continue;
+	}
+	StoreShard* shard = &(shardedStore->shards[s]);
+	if (operation == ENGINE_BATCH_GET) {
+	    shardstore_retrieve_many(shardedStore, shard, shardItems,
+		    shardCount);
+	} else if (operation == ENGINE_BATCH_PUT) {
+	    shardstore_add_many(shardedStore, shard, shardItems, shardCount);
+	    record = log_changes(shardedStore, operation, shardItems,
+		    shardCount, record);
+	} else {
+	    shardstore_delete_many(shardedStore, shard, shardItems,
+		    shardCount);
+	    record = log_changes(shardedStore, operation, shardItems,
+		    shardCount, record);
+	}
+    }
+
+    // Values retrieved must be copied before the locks are released, and
+    // changes are committed after
+    bool done = batch_results(&batch, operation, items, count);
+    for (unsigned int s = shardedStore->numShards; s-- > 0;) {
+        if (batch.shardStart[s] != batch.shardStart[s + 1]) {
+	    pthread_rwlock_unlock(&(shardedStore->shards[s].lock));
+	}
+    }
+    if (operation != ENGINE_BATCH_GET) {
+        done = shardstore_commit(shardedStore, record) && done;
+    }
+    free_shard_batch(&batch);
+    return done ? ENGINE_OK : ENGINE_FAILED;
+}
+
+static void* linear_scan_begin(void* store, const char* from,
+	EngineStatus* status) {
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    if (!shardedStore->ordered) {
+        *status = ENGINE_INVALID;
+	return NULL;
+    }
+    LinearScan* scan = malloc(sizeof(LinearScan));
+    if (scan == NULL
+	    || !shardstore_scan_begin(shardedStore, &(scan->shardScan), from)) {
+        free(scan);
+	*status = ENGINE_UNAVAILABLE;
+	return NULL;
+    }
+    *status = ENGINE_OK;
+    return scan;
+}
+
+static EngineItem* linear_scan_next(void* scan) {
+    LinearScan* linearScan = (LinearScan*)scan;
+    StringStoreItem* next = shardstore_scan_next(&(linearScan->shardScan));
+    if (next == NULL) {
+        return NULL;
+    }
+    linearScan->item.key = next->key;
+    linearScan->item.value = next->value;
+    linearScan->item.valueLength = next->valueLength;
+    linearScan->item.expiry = next->expiry;
+    return &(linearScan->item);
+}
+
+static void linear_scan_end(void* scan) {
+    shardstore_scan_end(&(((LinearScan*)scan)->shardScan));
+    free(scan);
+}
+
+static size_t linear_expire(void* store, unsigned int now) {
+    return shardstore_expire((ShardedStore*)store, now);
+}
+
+static void linear_stats(void* store, EngineStats* stats) {
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    stats->keyBytes += shardstore_bytes(shardedStore);
+    stats->expired += shardstore_expired(shardedStore);
+    stats->evicted += shardstore_evicted(shardedStore);
+    shardstore_memory(shardedStore, &(stats->memory));
+}
+
+static void linear_set_memory_limit(void* store, size_t memoryLimit) {
+    shardstore_set_memory_limit((ShardedStore*)store, memoryLimit);
+}
+
+static bool linear_set_ordered(void* store) {
+    return shardstore_set_ordered((ShardedStore*)store);
+}
+
+static bool linear_open_snapshot(void* store, const char* path) {
+    return snapshot_open(path, &(((ShardedStore*)store)->snapshot));
+}
+
+static void linear_attach_log(void* store, WriteAheadLog* log) {
+    ((ShardedStore*)store)->log = log;
+}
+
+static void linear_replay(void* store, unsigned long long generation,
+	WalRecordType type, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry) {
+    // Changes logged before the snapshot was taken are already in it
+    ShardedStore* shardedStore = (ShardedStore*)store;
+    if (shardedStore->snapshot != NULL 
+	    && generation < snapshot_generation(shardedStore->snapshot)) {
+        return;
+    }
+
+    // Nothing else is running yet, so the shard does not need locking. A key
+    // that has expired since it was put is as good as deleted
+    StoreShard* shard = shardstore_shard(shardedStore, key);
+    if (type == WAL_PUT 
+	    && (expiry == 0 || expiry > (unsigned int)time(NULL))) {
+	shardstore_add(shardedStore, shard, key, value, valueLength, expiry);
+    } else {
+        shardstore_delete(shardedStore, shard, key);
+    }
+}
+
+static bool linear_warm(void* store) {
+    return shardstore_warm((ShardedStore*)store);
+}
+
+static void linear_detach_snapshot(void* store) {
+    shardstore_detach_snapshot((ShardedStore*)store);
+}
+
+static bool linear_snapshot(void* store, const char* path,
+	unsigned long long walGeneration) {
+    return shardstore_write_snapshot((ShardedStore*)store, path,
+	    walGeneration);
+}
+
+const StorageEngineOps linearEngine = {
+    .name = LINEAR_ENGINE_NAME,
+    .create = linear_create,
+    .destroy = linear_destroy,
+    .get = linear_get,
+    .put = linear_put,
+    .delete = linear_delete,
+    .batch = linear_batch,
+    .scan_begin = linear_scan_begin,
+    .scan_next = linear_scan_next,
+    .scan_end = linear_scan_end,
+    .expire = linear_expire,
+    .stats = linear_stats,
+    .set_memory_limit = linear_set_memory_limit,
+    .set_ordered = linear_set_ordered,
+    .open_snapshot = linear_open_snapshot,
+    .attach_log = linear_attach_log,
+    .replay = linear_replay,
+    .warm = linear_warm,
+    .detach_snapshot = linear_detach_snapshot,
+    .snapshot = linear_snapshot
+};
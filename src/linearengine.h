@@ -0,0 +1,23 @@
+/*
+** linearengine.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef LINEARENGINE_H
+#define LINEARENGINE_H
+
+#include "engine.h"
+
+/* Name the linear engine is selected with */
+#define LINEAR_ENGINE_NAME "linear"
+
+/* The reference storage engine: a ShardedStore of linear probing hash tables,
+ * each shard behind its own reader-writer lock. Lookups take no lock once
+ * the store has no snapshot attached, and changes are logged while the
+ * shard is locked and committed after it is released */
+extern const StorageEngineOps linearEngine;
+
+#endif
@@ -0,0 +1,59 @@
+/*
+** listener.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include "listener.h"
+
+int listener_cpu(unsigned int index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) {
+        return -1;
+    }
+    int numAllowed = CPU_COUNT(&allowed);
+    if (numAllowed == 0) {
+        return -1;
+    }
+
+    // Find the allowed CPU the index lands on, counting round them in turn
+    int wanted = index % numAllowed;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && wanted-- == 0) {
+	    return cpu;
+	}
+    }
+    return -1;
+}
+
+void* listener_thread(void* arg) {
+    Listener* listener = (Listener*)arg;
+    if (listener->cpu >= 0) {
+        cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(listener->cpu, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+    accept_clients(listener);
+    return NULL;
+}
+
+void accept_clients(Listener* listener) {
+    while (true) {
+        int fdClient = accept(listener->fdServer, NULL, NULL);
+	if (fdClient < 0) {
+	    continue;
+	}
+	if (!check_connection_limit(fdClient, listener->stats, 
+		*(listener->serverArgs))) {
+	    increment_statistic(&(listener->counters->rejected));
+	    continue;
+	}
+	increment_statistic(&(listener->counters->accepted));
+	listener->handler(listener->handlerArg, fdClient);
+    }
+}
@@ -0,0 +1,62 @@
+/*
+** listener.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include "dbserver.h"
+
+/* Called by a listener with each client it admits, to hand the connection
+ * to the threads that serve it */
+typedef void (*ClientHandler)(void* handlerArg, int fdClient);
+
+/* A thread accepting clients on a listening socket of its own. cpu is the 
+ * CPU the thread runs on, -1 to leave it to the scheduler. counters are the
+ * listener's own counts of the clients it has admitted and turned away */
+typedef struct {
+    int fdServer;
+    int cpu;
+    ListenerStatistics* counters;
+    Statistics* stats;
+    ServerArguments* serverArgs;
+    ClientHandler handler;
+    void* handlerArg;
+} Listener;
+
+/* listener_cpu()
+* −−−−−−−−−−−−−−−
+* Picks the CPU a listener runs on, spreading the listeners over the CPUs 
+* the process may run on in turn.
+*
+* index: the index of the listener
+*
+* Returns: the number of the CPU, -1 if the CPUs could not be found
+*/
+int listener_cpu(unsigned int index);
+
+/* listener_thread()
+* −−−−−−−−−−−−−−−
+* Thread function of a listener. Pins the thread to the listener's CPU, so 
+* the connections it accepts and any threads it starts to serve them stay 
+* on that CPU, then accepts clients on its socket. Never returns.
+*
+* arg: Listener struct of the listener cast to a void*. Not NULL
+*/
+void* listener_thread(void* arg);
+
+/* accept_clients()
+* −−−−−−−−−−−−−−−
+* Accepts clients on a listener's socket and hands those under the 
+* connection limit to its handler. Clients over the limit are turned away 
+* with a 503 response. Never returns.
+*
+* listener: the listener to accept clients for. Not NULL
+*/
+void accept_clients(Listener* listener);
+
+#endif
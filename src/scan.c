@@ -0,0 +1,225 @@
+/*
+** scan.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "scan.h"
+
+/* Number of bytes needed to write the largest item length in decimal */
+#define MAX_LENGTH_DIGITS 20
+
+/* Size a response body is first given */
+#define SCAN_INITIAL_BODY_SIZE 4096
+
+/* The keys a scan request asks for. start and end are null terminated
+ * copies of the bounds of the range, NULL where it is open. prefix is the key
+ * in the address of the request */
+typedef struct {
+    char* start;
+    char* end;
+    const char* prefix;
+    size_t prefixLength;
+    size_t limit;
+} ScanRange;
+
+/* Items written so far to a response body of the given capacity */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} ScanBody;
+
+bool is_scan_request(HttpRequest* httpRequest) {
+    return strcmp(httpRequest->method, "SCAN") == 0;
+}
+
+/* Reads the value of a limit header. Returns false unless it is a number
+ * between 1 and SCAN_MAX_LIMIT */
+static bool parse_limit(const char* value, size_t* limit) {
+    // Only plain digits are accepted, strtoul would skip spaces and signs
+    if (*value == '\0') {
+        return false;
+    }
+    *limit = 0;
+    for (; *value != '\0'; value++) {
+        if (!isdigit((unsigned char)*value)) {
+	    return false;
+	}
+	*limit = *limit * 10 + (*value - '0');
+	if (*limit > SCAN_MAX_LIMIT) {
+	    return false;
+	}
+    }
+    return *limit > 0;
+}
+
+/* Reads the range a scan request asks for, setting the status of the
+ * response if it cannot be read. Returns false if the request is malformed
+ * or memory cannot be allocated */
+static bool parse_range(HttpRequest* httpRequest, ScanRange* range,
+	HttpResponse* httpResponse) {
+    memset(range, 0, sizeof(ScanRange));
+    range->prefix = httpRequest->key;
+    range->prefixLength = httpRequest->keyLength;
+    range->limit = SCAN_DEFAULT_LIMIT;
+    const char* limit = http_get_header(httpRequest, HTTP_LIMIT_HEADER);
+    if (limit != NULL && !parse_limit(limit, &(range->limit))) {
+        httpResponse->status = STATUS_BAD_REQUEST;
+	return false;
+    }
+
+    // The start comes first, then the end
+    char** bounds[] = {&(range->start), &(range->end)};
+    size_t numBounds = 0;
+    size_t offset = 0;
+    const char* item;
+    size_t itemLength;
+    int result;
+    while ((result = http_next_batch_item(httpRequest->body,
+	    httpRequest->bodyLength, &offset, &item, &itemLength)) == 1) {
+	if (numBounds == 2) {
+	    httpResponse->status = STATUS_BAD_REQUEST;
+	    return false;
+	}
+	if (item != NULL) {
+	    *bounds[numBounds] = strndup(item, itemLength);
+	    if (*bounds[numBounds] == NULL) {
+	        httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+		return false;
+	    }
+	}
+	numBounds++;
+    }
+    if (result < 0) {
+        httpResponse->status = STATUS_BAD_REQUEST;
+	return false;
+    }
+    return true;
+}
+
+/* Checks if a key, found at or after the start of a range, is still in it.
+ * Keys are found in order, so the first key past the end or without the
+ * prefix ends the range */
+static bool in_range(ScanRange* range, const char* key) {
+    return (range->end == NULL || strcmp(key, range->end) < 0)
+	    && strncmp(key, range->prefix, range->prefixLength) == 0;
+}
+
+/* Appends an item to a response body, growing it as needed. Returns false if
+ * memory cannot be allocated */
+static bool append_item(ScanBody* body, const char* item, size_t itemLength) {
+    size_t needed = body->length + MAX_LENGTH_DIGITS + 1 + itemLength;
+    if (needed > body->capacity) {
+        size_t capacity = body->capacity == 0 ? SCAN_INITIAL_BODY_SIZE
+		: body->capacity;
+	while (capacity < needed) {
+	    capacity *= 2;
+	}
+	char* data = realloc(body->data, capacity);
+	if (data == NULL) {
+	    return false;
+	}
+	body->data = data;
+	body->capacity = capacity;
+    }
+    body->length += sprintf(body->data + body->length, "%zu:", itemLength);
+    memcpy(body->data + body->length, item, itemLength);
+    body->length += itemLength;
+    return true;
+}
+
+/* Sets the response body to the cursor followed by the keys and values
+ * found. Returns false if memory cannot be allocated */
+static bool scan_response_body(const char* cursor, ScanBody* results,
+	HttpResponse* httpResponse) {
+    size_t cursorLength = cursor != NULL ? strlen(cursor) : 0;
+    char* body = malloc(MAX_LENGTH_DIGITS + 1 + cursorLength 
+	    + results->length + 1);
+    if (body == NULL) {
+        return false;
+    }
+    char* end = body;
+    if (cursor == NULL) {
+        end += sprintf(end, HTTP_BATCH_MISSING);
+    } else {
+        end += sprintf(end, "%zu:", cursorLength);
+	memcpy(end, cursor, cursorLength);
+	end += cursorLength;
+    }
+    if (results->length > 0) {
+        memcpy(end, results->data, results->length);
+	end += results->length;
+    }
+    httpResponse->body = body;
+    httpResponse->bodyLength = end - body;
+    return true;
+}
+
+size_t handle_scan_request(StorageEngine* store, HttpRequest* httpRequest,
+	HttpResponse* httpResponse) {
+    ScanRange range;
+    if (!parse_range(httpRequest, &range, httpResponse)) {
+        free(range.start);
+	free(range.end);
+	return 0;
+    }
+
+    // Keys before the prefix can never be in the range
+    const char* from = range.start;
+    if (range.prefixLength > 0
+	    && (from == NULL || strcmp(from, range.prefix) < 0)) {
+	from = range.prefix;
+    }
+    EngineScan scan;
+    EngineStatus began = engine_scan_begin(store, &scan, from);
+    if (began != ENGINE_OK) {
+        httpResponse->status = began == ENGINE_INVALID
+		? STATUS_BAD_REQUEST : STATUS_SERVICE_UNAVAILABLE;
+	free(range.start);
+	free(range.end);
+	return 0;
+    }
+
+    // Values must be copied before the locks are released. The key after the
+    // last one returned is kept as the cursor
+    ScanBody results;
+    memset(&results, 0, sizeof(ScanBody));
+    char* cursor = NULL;
+    size_t numKeys = 0;
+    bool built = true;
+    EngineItem* item;
+    while (built && (item = engine_scan_next(&scan)) != NULL
+	    && in_range(&range, item->key)) {
+	size_t keyLength = strlen(item->key);
+	size_t itemSize = 2 * (MAX_LENGTH_DIGITS + 1) + keyLength
+		+ item->valueLength;
+	if (numKeys == range.limit || (numKeys > 0
+		&& results.length + itemSize > SCAN_MAX_BODY_SIZE)) {
+	    cursor = strdup(item->key);
+	    built = cursor != NULL;
+	    break;
+	}
+	built = append_item(&results, item->key, keyLength)
+		&& append_item(&results, item->value, item->valueLength);
+	numKeys++;
+    }
+    engine_scan_end(&scan);
+
+    httpResponse->status = STATUS_OK;
+    if (!built || !scan_response_body(cursor, &results, httpResponse)) {
+        httpResponse->status = STATUS_INTERNAL_SERVER_ERROR;
+	numKeys = 0;
+    }
+    free(cursor);
+    free(results.data);
+    free(range.start);
+    free(range.end);
+    return numKeys;
+}
@@ -0,0 +1,67 @@
+/*
+** scan.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include "http.h"
+#include "engine.h"
+
+/* Number of keys a scan returns when the request gives no limit, and the
+ * most it may ask for */
+#define SCAN_DEFAULT_LIMIT 100
+#define SCAN_MAX_LIMIT 10000
+
+/* Size a scan response body stops growing at. The key that would take it
+ * past this is returned as the cursor instead, unless it is the first */
+#define SCAN_MAX_BODY_SIZE (1024 * 1024)
+
+/* is_scan_request()
+* −−−−−−−−−−−−−−−
+* Checks if a valid http request is a "SCAN".
+*
+* httpRequest: a request accepted by valid_http_method_and_address(). Not NULL
+*
+* Returns: true if the request is a scan. False otherwise
+*/
+bool is_scan_request(HttpRequest* httpRequest);
+
+/* handle_scan_request()
+* −−−−−−−−−−−−−−−
+* Returns the keys of an ordered store in ascending order, along
+* with their values.
+*
+* The key in the address of the request is a prefix every key returned must
+* start with, and may be empty. The body holds up to two items in the format
+* read by http_next_batch_item(): the first key to return (or any after it),
+* then the key to stop before. Either may be HTTP_BATCH_MISSING or left out
+* to leave that end of the range open. An HTTP_LIMIT_HEADER header gives the
+* most keys to return, between 1 and SCAN_MAX_LIMIT, and SCAN_DEFAULT_LIMIT
+* if it is absent. Keys that have expired are skipped.
+*
+* The response body starts with a cursor item, the key to give as the first
+* key of the next request to carry on where this one stopped, or
+* HTTP_BATCH_MISSING if there are no more keys in the range. Each key found
+* follows as an item, with its value as another. The keys returned are as
+* they were at one moment.
+*
+* The response is a bad request if the body or limit is invalid or the store
+* keeps no order, and service unavailable if the store cannot be walked
+* yet, e.g. while it is still serving keys from its snapshot.
+*
+* store: the store the request is for. Not NULL
+* httpRequest: a valid scan request. Not NULL
+* httpResponse: the status, body and bodyLength are set. Not NULL
+*
+* Returns: the number of keys returned
+*/
+size_t handle_scan_request(StorageEngine* store, HttpRequest* httpRequest,
+	HttpResponse* httpResponse);
+
+#endif
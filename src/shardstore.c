@@ -0,0 +1,533 @@
+/*
+** shardstore.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "shardstore.h"
+#include "latency.h"
+
+ShardedStore* shardstore_init(const char* name, unsigned int numShards) {
+    ShardedStore* store = malloc(sizeof(ShardedStore));
+    if (store == NULL) {
+        return NULL;
+    }
+    store->name = name;
+    store->log = NULL;
+    store->snapshot = NULL;
+    store->memoryLimit = 0;
+    store->ordered = false;
+    void* shards;
+    if (posix_memalign(&shards, CACHE_LINE_SIZE,
+	    numShards * sizeof(StoreShard)) != 0) {
+        free(store);
+	return NULL;
+    }
+    memset(shards, 0, numShards * sizeof(StoreShard));
+    store->shards = shards;
+    store->numShards = numShards;
+
+    for (unsigned int i = 0; i < numShards; i++) {
+        pthread_rwlock_init(&(store->shards[i].lock), NULL);
+	timerwheel_init(&(store->shards[i].timers), (unsigned int)time(NULL));
+	store->shards[i].store = stringstore_init();
+	if (store->shards[i].store == NULL) {
+	    store->numShards = i;
+	    shardstore_free(store);
+	    return NULL;
+	}
+    }
+    return store;
+}
+
+void shardstore_free(ShardedStore* store) {
+    for (unsigned int i = 0; i < store->numShards; i++) {
+	pthread_rwlock_destroy(&(store->shards[i].lock));
+	timerwheel_destroy(&(store->shards[i].timers));
+	stringstore_free(store->shards[i].store);
+	if (store->shards[i].deleted != NULL) {
+	    stringstore_free(store->shards[i].deleted);
+	}
+    }
+    if (store->snapshot != NULL) {
+        snapshot_close(store->snapshot);
+    }
+    free(store->shards);
+    free(store);
+}
+
+unsigned int shardstore_index(ShardedStore* store, unsigned int hash) {
+    // The stringstore picks buckets with the low bits of the hash, so the
+    // shard is chosen from the high bits to keep the two independent
+    return ((unsigned long long)hash * store->numShards) >> 32;
+}
+
+StoreShard* shardstore_shard(ShardedStore* store, const char* key) {
+    return &(store->shards[shardstore_index(store, stringstore_hash(key))]);
+}
+
+/* Time the calling thread has spent waiting for shard locks, in 
+ * nanoseconds */
+static __thread unsigned long long lockWait = 0;
+
+void shardstore_rdlock(StoreShard* shard) {
+    // The clock is only read when the lock is contended
+    if (pthread_rwlock_tryrdlock(&(shard->lock)) == 0) {
+        return;
+    }
+    unsigned long long start = latency_now();
+    pthread_rwlock_rdlock(&(shard->lock));
+    lockWait += latency_now() - start;
+}
+
+void shardstore_wrlock(StoreShard* shard) {
+    if (pthread_rwlock_trywrlock(&(shard->lock)) == 0) {
+        return;
+    }
+    unsigned long long start = latency_now();
+    pthread_rwlock_wrlock(&(shard->lock));
+    lockWait += latency_now() - start;
+}
+
+unsigned long long shardstore_take_lock_wait(void) {
+    unsigned long long waited = lockWait;
+    lockWait = 0;
+    return waited;
+}
+
+/* Checks if a key has been deleted from a shard since the snapshot was
+ * taken */
+static bool is_deleted(StoreShard* shard, StringStoreItem* item) {
+    if (shard->deleted == NULL) {
+        return false;
+    }
+    StringStoreItem probe = *item;
+    stringstore_retrieve_many(shard->deleted, &probe, 1);
+    return probe.result;
+}
+
+/* Checks if a key has expired by the given time, 0 meaning it never does */
+static bool has_expired(unsigned int expiry, unsigned int now) {
+    return expiry != 0 && now >= expiry;
+}
+
+/* Looks up a key in the store's snapshot, setting the item's value as for 
+ * stringstore_retrieve_many(). Keys that have expired are treated as 
+ * missing. Returns true if the key was found */
+static bool snapshot_lookup(ShardedStore* store, StringStoreItem* item) {
+    if (!snapshot_find(store->snapshot, item->key, item->hash, &(item->value),
+	    &(item->valueLength), &(item->expiry))) {
+	return false;
+    }
+    return !has_expired(item->expiry, (unsigned int)time(NULL));
+}
+
+/* Remembers a key held by the store's snapshot as deleted, so its value
+ * there is no longer retrieved. Returns true if the key was in the snapshot 
+ * and is now hidden */
+static bool hide_snapshot_entry(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* item) {
+    StringStoreItem probe = *item;
+    if (is_deleted(shard, item) || !snapshot_lookup(store, &probe)) {
+        return false;
+    }
+    if (shard->deleted == NULL) {
+        shard->deleted = stringstore_init();
+    }
+    probe = *item;
+    probe.value = "";
+    probe.valueLength = 0;
+    probe.expiry = 0;
+    return shard->deleted != NULL 
+	    && stringstore_add_many(shard->deleted, &probe, 1) == 1;
+}
+
+/* Sets the timer of each key added with an expiry, and cancels that of each
+ * key added without one, so every key has at most one timer. A key whose
+ * timer cannot be allocated is still never retrieved once it expires */
+static void add_timers(StoreShard* shard, StringStoreItem* items, 
+	size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].result && items[i].expiry != 0) {
+            timerwheel_add(&(shard->timers), items[i].key, items[i].expiry);
+	} else if (items[i].result) {
+	    timerwheel_cancel(&(shard->timers), items[i].key);
+	}
+    }
+}
+
+void shardstore_retrieve_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count) {
+    stringstore_retrieve_many(shard->store, items, count);
+    if (store->snapshot == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i].result && !is_deleted(shard, &(items[i]))) {
+            items[i].result = snapshot_lookup(store, &(items[i]));
+	    if (!items[i].result) {
+	        items[i].value = NULL;
+		items[i].valueLength = 0;
+	    }
+	}
+    }
+}
+
+size_t shardstore_add_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count) {
+    size_t added = stringstore_add_many(shard->store, items, count);
+    add_timers(shard, items, count);
+    if (store->snapshot == NULL) {
+        return added;
+    }
+
+    // A key added again now hides its old value in the snapshot. Once a key
+    // that expires has gone, the old value must stay hidden
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].result && items[i].expiry != 0) {
+            hide_snapshot_entry(store, shard, &(items[i]));
+	} else if (items[i].result && shard->deleted != NULL) {
+	    StringStoreItem probe = items[i];
+	    stringstore_delete_many(shard->deleted, &probe, 1);
+	}
+    }
+    return added;
+}
+
+size_t shardstore_delete_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count) {
+    size_t deleted = stringstore_delete_many(shard->store, items, count);
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].result) {
+	    timerwheel_cancel(&(shard->timers), items[i].key);
+	}
+    }
+    if (store->snapshot == NULL) {
+        return deleted;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (hide_snapshot_entry(store, shard, &(items[i]))) {
+            deleted += !items[i].result;
+	    items[i].result = 1;
+	}
+    }
+    return deleted;
+}
+
+/* Fills in a single key item for the shard functions */
+static void single_item(StringStoreItem* item, const char* key,
+	const char* value, size_t valueLength) {
+    memset(item, 0, sizeof(StringStoreItem));
+    item->key = key;
+    item->hash = stringstore_hash(key);
+    item->value = value;
+    item->valueLength = valueLength;
+}
+
+const char* shardstore_retrieve(ShardedStore* store, StoreShard* shard,
+	const char* key, size_t* valueLength) {
+    StringStoreItem item;
+    single_item(&item, key, NULL, 0);
+    shardstore_retrieve_many(store, shard, &item, 1);
+    *valueLength = item.valueLength;
+    return item.value;
+}
+
+const char* shardstore_retrieve_pinned(ShardedStore* store, StoreShard* shard,
+	const char* key, size_t* valueLength, KeyValue** pin) {
+    const char* value = 
+	    stringstore_retrieve_pinned(shard->store, key, valueLength, pin);
+    if (value != NULL || store->snapshot == NULL) {
+        return value;
+    }
+
+    // A value in the snapshot is unmapped once it is detached, so it is 
+    // never pinned
+    return shardstore_retrieve(store, shard, key, valueLength);
+}
+
+bool shardstore_retrieve_unlocked(ShardedStore* store, StoreShard* shard,
+	const char* key, char* copy, const char** value, size_t* valueLength,
+	KeyValue** pin) {
+    if (__atomic_load_n(&(store->snapshot), __ATOMIC_ACQUIRE) != NULL) {
+        return false;
+    }
+    *value = stringstore_retrieve_unlocked(shard->store, key, copy, 
+	    valueLength, pin);
+    return true;
+}
+
+int shardstore_add(ShardedStore* store, StoreShard* shard, const char* key,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    StringStoreItem item;
+    single_item(&item, key, value, valueLength);
+    item.expiry = expiry;
+    return shardstore_add_many(store, shard, &item, 1);
+}
+
+int shardstore_delete(ShardedStore* store, StoreShard* shard, 
+	const char* key) {
+    StringStoreItem item;
+    single_item(&item, key, NULL, 0);
+    return shardstore_delete_many(store, shard, &item, 1);
+}
+
+size_t shardstore_expire(ShardedStore* store, unsigned int now) {
+    size_t numExpired = 0;
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        StoreShard* shard = &(store->shards[i]);
+	pthread_rwlock_wrlock(&(shard->lock));
+	Timer* due = timerwheel_advance(&(shard->timers), now);
+	pthread_rwlock_unlock(&(shard->lock));
+
+	// A timer may be left by a key since evicted, in which case the key
+	// is not removed
+	while (due != NULL) {
+	    pthread_rwlock_wrlock(&(shard->lock));
+	    for (int n = 0; n < SHARDSTORE_EXPIRE_CHUNK && due != NULL; n++) {
+	        Timer* timer = due;
+		due = timer->next;
+		numExpired += stringstore_expire(shard->store, timer->key,
+			stringstore_hash(timer->key), now);
+		free(timer);
+	    }
+	    pthread_rwlock_unlock(&(shard->lock));
+	}
+    }
+    return numExpired;
+}
+
+unsigned long shardstore_expired(ShardedStore* store) {
+    unsigned long numExpired = 0;
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        numExpired += stringstore_expired(store->shards[i].store);
+    }
+    return numExpired;
+}
+
+bool shardstore_warm(ShardedStore* store) {
+    if (store->snapshot == NULL) {
+        return true;
+    }
+    size_t offset = 0;
+    int result;
+    StringStoreItem item;
+    while ((result = snapshot_next(store->snapshot, &offset, &(item.key),
+	    &(item.value), &(item.valueLength), &(item.expiry))) == 1) {
+	if (has_expired(item.expiry, (unsigned int)time(NULL))) {
+	    continue;
+	}
+	item.hash = stringstore_hash(item.key);
+	StoreShard* shard = &(store->shards[shardstore_index(store, 
+		item.hash)]);
+
+	// Keys changed since the snapshot was taken keep their new state
+	StringStoreItem probe = item;
+	pthread_rwlock_wrlock(&(shard->lock));
+	stringstore_retrieve_many(shard->store, &probe, 1);
+	if (!probe.result && !is_deleted(shard, &item)) {
+	    stringstore_add_many(shard->store, &item, 1);
+	    add_timers(shard, &item, 1);
+	}
+	pthread_rwlock_unlock(&(shard->lock));
+    }
+    return result == 0;
+}
+
+/* Gives each shard its share of the store's memory limit. The caller holds
+ * every shard's lock for writing */
+static void apply_memory_limit(ShardedStore* store) {
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        stringstore_set_limit(store->shards[i].store, 
+		store->memoryLimit / store->numShards);
+    }
+}
+
+void shardstore_detach_snapshot(ShardedStore* store) {
+    if (store->snapshot == NULL) {
+        return;
+    }
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        pthread_rwlock_wrlock(&(store->shards[i].lock));
+    }
+    Snapshot* snapshot = store->snapshot;
+    __atomic_store_n(&(store->snapshot), NULL, __ATOMIC_RELEASE);
+    apply_memory_limit(store);
+    for (unsigned int i = store->numShards; i-- > 0;) {
+        if (store->shards[i].deleted != NULL) {
+            stringstore_free(store->shards[i].deleted);
+	    store->shards[i].deleted = NULL;
+	}
+	pthread_rwlock_unlock(&(store->shards[i].lock));
+    }
+    snapshot_close(snapshot);
+}
+
+void shardstore_set_memory_limit(ShardedStore* store, size_t memoryLimit) {
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        pthread_rwlock_wrlock(&(store->shards[i].lock));
+    }
+    store->memoryLimit = memoryLimit;
+    if (store->snapshot == NULL) {
+        apply_memory_limit(store);
+    }
+    for (unsigned int i = store->numShards; i-- > 0;) {
+        pthread_rwlock_unlock(&(store->shards[i].lock));
+    }
+}
+
+bool shardstore_set_ordered(ShardedStore* store) {
+    bool ordered = true;
+    for (unsigned int i = 0; i < store->numShards && ordered; i++) {
+        pthread_rwlock_wrlock(&(store->shards[i].lock));
+	ordered = stringstore_set_ordered(store->shards[i].store);
+	pthread_rwlock_unlock(&(store->shards[i].lock));
+    }
+    store->ordered = ordered;
+    return ordered;
+}
+
+/* Reads the next keys of a shard into its part of a scan, starting at from
+ * (or after it unless inclusive) */
+static void scan_read(ShardScan* scan, unsigned int s, const char* from,
+	bool inclusive) {
+    scan->numRead[s] = stringstore_scan(scan->store->shards[s].store, from, 
+	    inclusive, scan->items + s * SHARDSTORE_SCAN_CHUNK, 
+	    SHARDSTORE_SCAN_CHUNK);
+    scan->next[s] = 0;
+    scan->done[s] = scan->numRead[s] < SHARDSTORE_SCAN_CHUNK;
+}
+
+/* Frees the memory used by a scan */
+static void scan_free(ShardScan* scan) {
+    free(scan->items);
+    free(scan->numRead);
+    free(scan->next);
+    free(scan->done);
+}
+
+bool shardstore_scan_begin(ShardedStore* store, ShardScan* scan, 
+	const char* from) {
+    unsigned int numShards = store->numShards;
+    scan->store = store;
+    scan->items = malloc(
+	    numShards * SHARDSTORE_SCAN_CHUNK * sizeof(StringStoreItem));
+    scan->numRead = malloc(numShards * sizeof(size_t));
+    scan->next = malloc(numShards * sizeof(size_t));
+    scan->done = malloc(numShards * sizeof(bool));
+    if (scan->items == NULL || scan->numRead == NULL || scan->next == NULL
+	    || scan->done == NULL) {
+	scan_free(scan);
+	return false;
+    }
+    for (unsigned int s = 0; s < numShards; s++) {
+        shardstore_rdlock(&(store->shards[s]));
+    }
+
+    // The snapshot is only detached with every shard locked
+    if (store->snapshot != NULL) {
+        shardstore_scan_end(scan);
+	return false;
+    }
+    for (unsigned int s = 0; s < numShards; s++) {
+        scan_read(scan, s, from, true);
+    }
+    return true;
+}
+
+StringStoreItem* shardstore_scan_next(ShardScan* scan) {
+    // Take the smallest of the keys each shard is up to, reading the next
+    // keys of a shard once it has used up those read
+    StringStoreItem* smallest = NULL;
+    for (unsigned int s = 0; s < scan->store->numShards; s++) {
+        if (scan->next[s] == scan->numRead[s] && !scan->done[s]) {
+	    const char* last = scan->items[s * SHARDSTORE_SCAN_CHUNK 
+		    + scan->numRead[s] - 1].key;
+	    scan_read(scan, s, last, false);
+	}
+	if (scan->next[s] == scan->numRead[s]) {
+	    continue;
+	}
+	StringStoreItem* item = 
+		&(scan->items[s * SHARDSTORE_SCAN_CHUNK + scan->next[s]]);
+	if (smallest == NULL || strcmp(item->key, smallest->key) < 0) {
+	    smallest = item;
+	}
+    }
+    if (smallest != NULL) {
+        unsigned int s = (smallest - scan->items) / SHARDSTORE_SCAN_CHUNK;
+	scan->next[s]++;
+    }
+    return smallest;
+}
+
+void shardstore_scan_end(ShardScan* scan) {
+    for (unsigned int s = scan->store->numShards; s-- > 0;) {
+        pthread_rwlock_unlock(&(scan->store->shards[s].lock));
+    }
+    scan_free(scan);
+}
+
+size_t shardstore_bytes(ShardedStore* store) {
+    size_t numBytes = 0;
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        numBytes += stringstore_bytes(store->shards[i].store);
+    }
+    return numBytes;
+}
+
+unsigned long shardstore_evicted(ShardedStore* store) {
+    unsigned long numEvicted = 0;
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        numEvicted += stringstore_evicted(store->shards[i].store);
+    }
+    return numEvicted;
+}
+
+/* Adds one key of a store to the snapshot being written */
+static void write_entry(void* arg, const char* key, unsigned int hash,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    snapshot_add((SnapshotWriter*)arg, key, hash, value, valueLength, expiry);
+}
+
+bool shardstore_write_snapshot(ShardedStore* store, const char* path,
+	unsigned long long walGeneration) {
+    SnapshotWriter* writer = snapshot_create(path);
+    if (writer == NULL) {
+        return false;
+    }
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        pthread_rwlock_rdlock(&(store->shards[i].lock));
+	stringstore_for_each(store->shards[i].store, write_entry, writer);
+        pthread_rwlock_unlock(&(store->shards[i].lock));
+    }
+    return snapshot_finish(writer, walGeneration);
+}
+
+void shardstore_memory(ShardedStore* store, SlabStats* stats) {
+    for (unsigned int i = 0; i < store->numShards; i++) {
+        pthread_rwlock_rdlock(&(store->shards[i].lock));
+	stringstore_memory(store->shards[i].store, stats);
+	pthread_rwlock_unlock(&(store->shards[i].lock));
+    }
+}
+
+unsigned long long shardstore_log(ShardedStore* store, WalRecordType type,
+	const char* key, const char* value, size_t valueLength,
+	unsigned int expiry) {
+    if (store->log == NULL) {
+        return 0;
+    }
+    return wal_append(store->log, type, store->name, key, value, valueLength,
+	    expiry);
+}
+
+bool shardstore_commit(ShardedStore* store, unsigned long long record) {
+    return store->log == NULL || record == 0 
+	    || wal_commit(store->log, record);
+}
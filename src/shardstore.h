@@ -0,0 +1,448 @@
+/*
+** shardstore.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef SHARDSTORE_H
+#define SHARDSTORE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "stringstore.h"
+#include "wal.h"
+#include "snapshot.h"
+#include "timerwheel.h"
+
+/* Size of a cache line, used to keep the locks of different shards apart */
+#define CACHE_LINE_SIZE 64
+
+/* Number of expired keys removed each time a shard is locked by 
+ * shardstore_expire() */
+#define SHARDSTORE_EXPIRE_CHUNK 64
+
+/* Number of keys read from each shard at a time by a scan */
+#define SHARDSTORE_SCAN_CHUNK 32
+
+/* One partition of a store, guarded by its own reader/writer lock. While 
+ * the store has a snapshot, deleted holds the keys of the shard deleted since
+ * the snapshot was taken (NULL until there are any), along with keys that 
+ * expire and hide an older value in the snapshot. timers holds a timer for 
+ * each key added with an expiry, and is guarded by the lock too */
+typedef struct {
+    pthread_rwlock_t lock;
+    StringStore* store;
+    StringStore* deleted;
+    TimerWheel timers;
+} __attribute__((aligned(CACHE_LINE_SIZE))) StoreShard;
+
+/* A store split into numShards partitions by the hash of each key. Changes
+ * are recorded under the store's name in log, if it has one.
+ *
+ * After a restart the keys of the store are first served from snapshot, with
+ * the shards holding only the changes made since. The snapshot is detached
+ * once its entries have been copied into the shards.
+ *
+ * memoryLimit is the most memory the keys of the store may hold, 0 for no 
+ * limit, split evenly between the shards. It only takes effect once there is
+ * no snapshot, as a key evicted meanwhile would show its old value there.
+ *
+ * ordered is set once every shard keeps its keys in order, so the store can
+ * be scanned */
+typedef struct {
+    StoreShard* shards;
+    unsigned int numShards;
+    const char* name;
+    WriteAheadLog* log;
+    Snapshot* snapshot;
+    size_t memoryLimit;
+    bool ordered;
+} ShardedStore;
+
+/* A walk through the keys of every shard of a store in ascending order. The
+ * next keys of shard s are read into the SHARDSTORE_SCAN_CHUNK items starting
+ * at items + s * SHARDSTORE_SCAN_CHUNK, of which numRead[s] were read and 
+ * the first unused is next[s]. done[s] is set once the shard has no more */
+typedef struct {
+    ShardedStore* store;
+    StringStoreItem* items;
+    size_t* numRead;
+    size_t* next;
+    bool* done;
+} ShardScan;
+
+/* shardstore_init()
+* −−−−−−−−−−−−−−−
+* Creates a store made up of the given number of shards, without a log.
+*
+* name: the name the store's changes are logged under. Not NULL
+* numShards: the number of partitions to spread keys over. Greater than 0
+*
+* Returns: pointer to the ShardedStore created with malloc, NULL if the memory
+* could not be allocated
+*/
+ShardedStore* shardstore_init(const char* name, unsigned int numShards);
+
+/* shardstore_free()
+* −−−−−−−−−−−−−−−
+* Frees all memory used by a sharded store, including every shard's
+* stringstore.
+*
+* store: the store to free. Not NULL
+*/
+void shardstore_free(ShardedStore* store);
+
+/* shardstore_index()
+* −−−−−−−−−−−−−−−
+* Finds the index of the shard a key with the given hash belongs to.
+*
+* store: the sharded store to look in. Not NULL
+* hash: the hash stringstore_hash() gives the key
+*
+* Returns: the index of the key's shard in store->shards
+*/
+unsigned int shardstore_index(ShardedStore* store, unsigned int hash);
+
+/* shardstore_shard()
+* −−−−−−−−−−−−−−−
+* Finds the shard the given key belongs to.
+*
+* store: the sharded store to look in. Not NULL
+* key: the key to find the shard of. Not NULL
+*
+* Returns: the shard responsible for the key. The caller must hold the shard's
+* lock while using its stringstore
+*/
+StoreShard* shardstore_shard(ShardedStore* store, const char* key);
+
+/* shardstore_rdlock()
+* −−−−−−−−−−−−−−−
+* Locks a shard for reading. If the lock is not free straight away, the time
+* spent waiting for it is added to the calling thread's lock wait.
+*
+* shard: the shard to lock. Not NULL
+*/
+void shardstore_rdlock(StoreShard* shard);
+
+/* shardstore_wrlock()
+* −−−−−−−−−−−−−−−
+* Locks a shard for writing. If the lock is not free straight away, the time
+* spent waiting for it is added to the calling thread's lock wait.
+*
+* shard: the shard to lock. Not NULL
+*/
+void shardstore_wrlock(StoreShard* shard);
+
+/* shardstore_take_lock_wait()
+* −−−−−−−−−−−−−−−
+* Gets the time the calling thread has spent waiting for shard locks taken
+* with shardstore_rdlock() and shardstore_wrlock(), and starts it again from
+* zero.
+*
+* Returns: the time waited in nanoseconds
+*/
+unsigned long long shardstore_take_lock_wait(void);
+
+/* shardstore_retrieve_many()
+* −−−−−−−−−−−−−−−
+* Retrieves the values of many keys of one shard, as for 
+* stringstore_retrieve_many(), looking in the store's snapshot for keys not
+* changed since it was taken. The caller holds the shard's lock and must copy
+* the values before releasing it.
+*
+* store: the store the shard belongs to. Not NULL
+* shard: the shard every key belongs to. Not NULL
+* items: the keys to retrieve. Not NULL unless count is 0
+* count: the number of items
+*/
+void shardstore_retrieve_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count);
+
+/* shardstore_add_many()
+* −−−−−−−−−−−−−−−
+* Adds many key values to one shard, as for stringstore_add_many(). The 
+* caller holds the shard's lock for writing.
+*
+* store: the store the shard belongs to. Not NULL
+* shard: the shard every key belongs to. Not NULL
+* items: the keys and values to add. Not NULL unless count is 0
+* count: the number of items
+*
+* Returns: the number of items added
+*/
+size_t shardstore_add_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count);
+
+/* shardstore_delete_many()
+* −−−−−−−−−−−−−−−
+* Removes many keys from one shard, as for stringstore_delete_many(). Keys 
+* held by the store's snapshot are remembered as deleted. The caller holds 
+* the shard's lock for writing.
+*
+* store: the store the shard belongs to. Not NULL
+* shard: the shard every key belongs to. Not NULL
+* items: the keys to remove. Not NULL unless count is 0
+* count: the number of items
+*
+* Returns: the number of keys removed
+*/
+size_t shardstore_delete_many(ShardedStore* store, StoreShard* shard,
+	StringStoreItem* items, size_t count);
+
+/* shardstore_retrieve()
+* −−−−−−−−−−−−−−−
+* Retrieves the value of a single key. See shardstore_retrieve_many().
+*
+* Returns: the value, NULL if the key is not in the store
+*/
+const char* shardstore_retrieve(ShardedStore* store, StoreShard* shard,
+	const char* key, size_t* valueLength);
+
+/* shardstore_retrieve_pinned()
+* −−−−−−−−−−−−−−−
+* Retrieves the value of a single key, pinning it where the stringstore
+* allows so it can be used after the shard's lock is released. See 
+* stringstore_retrieve_pinned().
+*
+* store: the store the shard belongs to. Not NULL
+* shard: the shard the key belongs to, locked by the caller. Not NULL
+* key: the key to retrieve. Not NULL
+* valueLength: set to the length of the value found. Not NULL
+* pin: set to the entry pinned, to be passed to stringstore_unpin(), or NULL
+* if the value must be copied before the lock is released. Not NULL
+*
+* Returns: the value, NULL if the key is not in the store
+*/
+const char* shardstore_retrieve_pinned(ShardedStore* store, StoreShard* shard,
+	const char* key, size_t* valueLength, KeyValue** pin);
+
+/* shardstore_retrieve_unlocked()
+* −−−−−−−−−−−−−−−
+* Retrieves the value of a single key without taking the shard's lock. See
+* stringstore_retrieve_unlocked(). Only possible once the store's snapshot
+* is detached, as values read from it are unmapped along with it.
+*
+* store: the store the shard belongs to. Not NULL
+* shard: the shard the key belongs to, not locked by the caller. Not NULL
+* key: the key to retrieve. Not NULL
+* copy: STRINGSTORE_INLINE_SIZE bytes to copy a value held in the index to
+* value: set to the value, NULL if the key is not in the store. Not NULL
+* valueLength: set to the length of the value found. Not NULL
+* pin: set to the entry pinned, to be passed to stringstore_unpin(), or NULL
+* if the value was copied. Not NULL
+*
+* Returns: false if the snapshot is still attached, in which case nothing is
+* set and the lock must be taken to use shardstore_retrieve_pinned()
+*/
+bool shardstore_retrieve_unlocked(ShardedStore* store, StoreShard* shard,
+	const char* key, char* copy, const char** value, size_t* valueLength,
+	KeyValue** pin);
+
+/* shardstore_add()
+* −−−−−−−−−−−−−−−
+* Adds a single key value, which expires at expiry (in seconds since the 
+* Epoch) unless it is 0. See shardstore_add_many().
+*
+* Returns: 1 if the key was added, 0 otherwise
+*/
+int shardstore_add(ShardedStore* store, StoreShard* shard, const char* key,
+	const char* value, size_t valueLength, unsigned int expiry);
+
+/* shardstore_delete()
+* −−−−−−−−−−−−−−−
+* Removes a single key. See shardstore_delete_many().
+*
+* Returns: 1 if the key was removed, 0 if it was not found
+*/
+int shardstore_delete(ShardedStore* store, StoreShard* shard, 
+	const char* key);
+
+/* shardstore_expire()
+* −−−−−−−−−−−−−−−
+* Removes the keys whose timers have come due, advancing the timing wheel of
+* each shard to the given time. Each shard is locked for writing while its
+* wheel is advanced, then again for each SHARDSTORE_EXPIRE_CHUNK keys 
+* removed, so requests carry on being served meanwhile. Expired keys are
+* never retrieved, so this only frees their memory.
+*
+* Expirations are not logged. A key replayed from the log or snapshot once 
+* its expiry has passed is treated as missing.
+*
+* store: the store to expire keys from. Not NULL
+* now: the current time in seconds since the Epoch
+*
+* Returns: the number of keys removed
+*/
+size_t shardstore_expire(ShardedStore* store, unsigned int now);
+
+/* shardstore_expired()
+* −−−−−−−−−−−−−−−
+* Returns: the number of keys removed from the store because they expired,
+* whether on access or by shardstore_expire(). Takes no locks
+*/
+unsigned long shardstore_expired(ShardedStore* store);
+
+/* shardstore_warm()
+* −−−−−−−−−−−−−−−
+* Copies the entries of the store's snapshot into its shards, skipping keys
+* changed since the snapshot was taken. Each shard is only locked while one
+* entry is copied, so requests carry on being served meanwhile.
+*
+* store: the store to warm up. Not NULL
+*
+* Returns: false if a damaged snapshot entry was found, true otherwise
+*/
+bool shardstore_warm(ShardedStore* store);
+
+/* shardstore_detach_snapshot()
+* −−−−−−−−−−−−−−−
+* Stops serving keys from the store's snapshot and closes it, once 
+* shardstore_warm() has copied it. Does nothing if the store has no snapshot.
+*
+* store: the store to detach the snapshot from. Not NULL
+*/
+void shardstore_detach_snapshot(ShardedStore* store);
+
+/* shardstore_write_snapshot()
+* −−−−−−−−−−−−−−−
+* Writes every key of a store without a snapshot attached to a new snapshot
+* file. Each shard is locked for reading while its keys are written.
+*
+* store: the store to save. Not NULL
+* path: the snapshot file to write. Not NULL
+* walGeneration: the first write-ahead log generation whose changes may be
+* missing from the snapshot
+*
+* Returns: true if the snapshot was written, false otherwise
+*/
+bool shardstore_write_snapshot(ShardedStore* store, const char* path,
+	unsigned long long walGeneration);
+
+/* shardstore_set_memory_limit()
+* −−−−−−−−−−−−−−−
+* Bounds the memory held by the keys of a store, as for 
+* stringstore_set_limit(), evicting cold keys to make room for new ones. Each
+* shard is given an equal share. If the store still has a snapshot attached 
+* the limit is applied once it is detached. Every shard is locked while the
+* limit is set.
+*
+* Evictions are not logged, so keys evicted may come back after a restart,
+* once more subject to the limit.
+*
+* store: the store to bound. Not NULL
+* memoryLimit: the most memory in bytes, 0 for no limit
+*/
+void shardstore_set_memory_limit(ShardedStore* store, size_t memoryLimit);
+
+/* shardstore_set_ordered()
+* −−−−−−−−−−−−−−−
+* Keeps the keys of every shard in order, as for stringstore_set_ordered(),
+* so the store can be walked with shardstore_scan_begin(). Every shard is 
+* locked while its order is built.
+*
+* store: the store to order. Not NULL
+*
+* Returns: false if memory cannot be allocated, true otherwise
+*/
+bool shardstore_set_ordered(ShardedStore* store);
+
+/* shardstore_scan_begin()
+* −−−−−−−−−−−−−−−
+* Starts a walk through the keys of an ordered store in ascending strcmp() 
+* order, merging the keys of every shard. Every shard is locked for reading,
+* in ascending order, until shardstore_scan_end() is called, so the walk sees
+* the store as it was at one moment. Keys that have expired are skipped.
+*
+* A store still serving keys from its snapshot cannot be walked, as the keys
+* only held there are not in order.
+*
+* store: the store to walk, which must be ordered. Not NULL
+* scan: set up for shardstore_scan_next(). Not NULL
+* from: the first key to walk from, NULL to start at the first key
+*
+* Returns: false if the store still has a snapshot attached or memory cannot
+* be allocated, in which case no shard is left locked. True otherwise
+*/
+bool shardstore_scan_begin(ShardedStore* store, ShardScan* scan, 
+	const char* from);
+
+/* shardstore_scan_next()
+* −−−−−−−−−−−−−−−
+* Moves on to the next key of a walk started by shardstore_scan_begin().
+*
+* scan: the walk to continue. Not NULL
+*
+* Returns: the next key, with its hash, value, valueLength and expiry set as
+* for stringstore_scan(). Only valid until the next call. NULL once every
+* key has been walked
+*/
+StringStoreItem* shardstore_scan_next(ShardScan* scan);
+
+/* shardstore_scan_end()
+* −−−−−−−−−−−−−−−
+* Finishes a walk started by shardstore_scan_begin(), unlocking every shard.
+* Keys and values walked must be copied before this is called.
+*
+* scan: the walk to finish. Not NULL
+*/
+void shardstore_scan_end(ShardScan* scan);
+
+/* shardstore_bytes()
+* −−−−−−−−−−−−−−−
+* Returns: the memory held by the keys of every shard, as counted by 
+* stringstore_bytes(). Takes no locks
+*/
+size_t shardstore_bytes(ShardedStore* store);
+
+/* shardstore_evicted()
+* −−−−−−−−−−−−−−−
+* Returns: the number of keys evicted from the store to keep it within its
+* memory limit. Takes no locks
+*/
+unsigned long shardstore_evicted(ShardedStore* store);
+
+/* shardstore_memory()
+* −−−−−−−−−−−−−−−
+* Adds the memory used by the entries of every shard to a running total, 
+* locking each shard for reading in turn.
+*
+* store: the store to measure. Not NULL
+* stats: the total to add to. Not NULL
+*/
+void shardstore_memory(ShardedStore* store, SlabStats* stats);
+
+/* shardstore_log()
+* −−−−−−−−−−−−−−−
+* Records a change to the store in its log, if it has one. Called while the
+* shard holding the key is locked for writing, once the change has been made.
+*
+* store: the store changed. Not NULL
+* type: the type of change
+* key: the key changed. Not NULL
+* value: the valueLength bytes stored by a WAL_PUT, NULL for a WAL_DELETE
+* valueLength: the number of bytes in value
+* expiry: when a key put expires, 0 if it never does or for a WAL_DELETE
+*
+* Returns: the record number to pass to shardstore_commit(), 0 if the store 
+* has no log
+*/
+unsigned long long shardstore_log(ShardedStore* store, WalRecordType type,
+	const char* key, const char* value, size_t valueLength,
+	unsigned int expiry);
+
+/* shardstore_commit()
+* −−−−−−−−−−−−−−−
+* Waits for a record returned by shardstore_log() to be written to the log.
+* Called once the shard locks have been released.
+*
+* store: the store changed. Not NULL
+* record: the record number, 0 if there is nothing to wait for
+*
+* Returns: false if the record could not be written to the log, true 
+* otherwise
+*/
+bool shardstore_commit(ShardedStore* store, unsigned long long record);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+** skiplist.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "skiplist.h"
+
+/* Starting state of the height generator, any value but 0 */
+#define SKIPLIST_SEED 2463534242u
+
+/* Number of random bits used to decide each level a node reaches, giving
+ * a 1 in 4 chance of going up */
+#define SKIPLIST_LEVEL_BITS 2
+
+/* Returns the key stored after a node's links */
+static char* node_key(const SkipNode* node) {
+    return (char*)(node->next + node->height);
+}
+
+/* Allocates a node of the given height holding a copy of key, with its links
+ * cleared. Returns NULL if memory cannot be allocated */
+static SkipNode* node_new(const char* key, unsigned int hash,
+	unsigned int height) {
+    size_t keyLength = strlen(key);
+    SkipNode* node = malloc(sizeof(SkipNode) + height * sizeof(SkipNode*)
+	    + keyLength + 1);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->hash = hash;
+    node->height = height;
+    memset(node->next, 0, height * sizeof(SkipNode*));
+    memcpy(node_key(node), key, keyLength + 1);
+    return node;
+}
+
+/* Picks the height of a new node, using xorshift to step the generator */
+static unsigned int random_height(SkipList* list) {
+    unsigned int x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+    unsigned int height = 1;
+    while (height < SKIPLIST_MAX_LEVELS
+	    && (x & ((1u << SKIPLIST_LEVEL_BITS) - 1)) == 0) {
+        height++;
+	x >>= SKIPLIST_LEVEL_BITS;
+    }
+    return height;
+}
+
+/* Finds the last node on each level whose key is less than key, filling
+ * before with one node per level in use. Returns the node after it on the
+ * bottom level, the first whose key is not less than key */
+static SkipNode* find(SkipList* list, const char* key,
+	SkipNode* before[SKIPLIST_MAX_LEVELS]) {
+    SkipNode* node = list->head;
+    for (unsigned int level = list->levels; level-- > 0;) {
+        while (node->next[level] != NULL
+		&& strcmp(node_key(node->next[level]), key) < 0) {
+	    node = node->next[level];
+	}
+	before[level] = node;
+    }
+    return node->next[0];
+}
+
+bool skiplist_init(SkipList* list) {
+    list->head = node_new("", 0, SKIPLIST_MAX_LEVELS);
+    list->levels = 1;
+    list->seed = SKIPLIST_SEED;
+    list->numKeys = 0;
+    return list->head != NULL;
+}
+
+void skiplist_destroy(SkipList* list) {
+    SkipNode* node = list->head;
+    while (node != NULL) {
+        SkipNode* next = node->next[0];
+	free(node);
+	node = next;
+    }
+    list->head = NULL;
+    list->numKeys = 0;
+}
+
+bool skiplist_insert(SkipList* list, const char* key, unsigned int hash) {
+    SkipNode* before[SKIPLIST_MAX_LEVELS];
+    SkipNode* found = find(list, key, before);
+    if (found != NULL && strcmp(node_key(found), key) == 0) {
+        return true;
+    }
+    unsigned int height = random_height(list);
+    SkipNode* node = node_new(key, hash, height);
+    if (node == NULL) {
+        return false;
+    }
+
+    // Levels coming into use are only reached from the head
+    for (; list->levels < height; list->levels++) {
+        before[list->levels] = list->head;
+    }
+    for (unsigned int level = 0; level < height; level++) {
+        node->next[level] = before[level]->next[level];
+	before[level]->next[level] = node;
+    }
+    list->numKeys++;
+    return true;
+}
+
+void skiplist_remove(SkipList* list, const char* key) {
+    SkipNode* before[SKIPLIST_MAX_LEVELS];
+    SkipNode* node = find(list, key, before);
+    if (node == NULL || strcmp(node_key(node), key) != 0) {
+        return;
+    }
+    for (unsigned int level = 0; level < node->height; level++) {
+        before[level]->next[level] = node->next[level];
+    }
+    while (list->levels > 1 && list->head->next[list->levels - 1] == NULL) {
+        list->levels--;
+    }
+    free(node);
+    list->numKeys--;
+}
+
+SkipNode* skiplist_seek(SkipList* list, const char* key, bool inclusive) {
+    if (key == NULL) {
+        return list->head->next[0];
+    }
+    SkipNode* before[SKIPLIST_MAX_LEVELS];
+    SkipNode* node = find(list, key, before);
+    if (!inclusive && node != NULL && strcmp(node_key(node), key) == 0) {
+        node = node->next[0];
+    }
+    return node;
+}
+
+SkipNode* skiplist_next(const SkipNode* node) {
+    return node->next[0];
+}
+
+const char* skiplist_key(const SkipNode* node) {
+    return node_key(node);
+}
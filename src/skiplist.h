@@ -0,0 +1,104 @@
+/*
+** skiplist.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most levels a node can be linked into. Each node reaches the next level
+ * up with probability 1/4, so 16 levels keep searches logarithmic up to
+ * about 4^16 keys */
+#define SKIPLIST_MAX_LEVELS 16
+
+/* A key in a skip list, linked into the first height levels. The key is
+ * stored null terminated after the links, along with the hash the owner of
+ * the list gives it */
+typedef struct SkipNode {
+    unsigned int hash;
+    unsigned int height;
+    struct SkipNode* next[];
+} SkipNode;
+
+/* Keys kept in ascending strcmp() order. head holds a link for every level
+ * and no key, and levels is the number of levels in use. seed is the state
+ * of the generator choosing the height of each new node. Not thread safe,
+ * each user supplies its own locking */
+typedef struct {
+    SkipNode* head;
+    unsigned int levels;
+    unsigned int seed;
+    size_t numKeys;
+} SkipList;
+
+/* skiplist_init()
+* −−−−−−−−−−−−−−−
+* Sets up an empty skip list.
+*
+* list: the list to set up. Not NULL
+*
+* Returns: false if memory cannot be allocated, true otherwise
+*/
+bool skiplist_init(SkipList* list);
+
+/* skiplist_destroy()
+* −−−−−−−−−−−−−−−
+* Frees every node of a skip list.
+*
+* list: the list to free. Not NULL
+*/
+void skiplist_destroy(SkipList* list);
+
+/* skiplist_insert()
+* −−−−−−−−−−−−−−−
+* Adds a copy of a key to a skip list, doing nothing if it is already there.
+*
+* list: the list to add to. Not NULL
+* key: the key to add. Not NULL
+* hash: the hash stored with the key
+*
+* Returns: false if memory cannot be allocated, true otherwise
+*/
+bool skiplist_insert(SkipList* list, const char* key, unsigned int hash);
+
+/* skiplist_remove()
+* −−−−−−−−−−−−−−−
+* Removes a key from a skip list, if it is there.
+*
+* list: the list to remove from. Not NULL
+* key: the key to remove. Not NULL
+*/
+void skiplist_remove(SkipList* list, const char* key);
+
+/* skiplist_seek()
+* −−−−−−−−−−−−−−−
+* Finds where a walk through the keys in order should start.
+*
+* list: the list to search. Not NULL
+* key: the key to start at, NULL to start at the first key
+* inclusive: whether a node holding key itself is returned, or the one after
+*
+* Returns: the first node whose key is not less than key (greater than key if
+* inclusive is false), NULL if there is none
+*/
+SkipNode* skiplist_seek(SkipList* list, const char* key, bool inclusive);
+
+/* skiplist_next()
+* −−−−−−−−−−−−−−−
+* Returns: the node after the given one in key order, NULL if it is the last
+*/
+SkipNode* skiplist_next(const SkipNode* node);
+
+/* skiplist_key()
+* −−−−−−−−−−−−−−−
+* Returns: the null terminated key held by a node
+*/
+const char* skiplist_key(const SkipNode* node);
+
+#endif
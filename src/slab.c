@@ -0,0 +1,203 @@
+/*
+** slab.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "slab.h"
+
+/* Chunk sizes are multiples of this many bytes */
+#define SLAB_ALIGNMENT 8
+
+/* Each size class is about a quarter larger than the one before, so no more
+ * than a fifth of a chunk is wasted rounding up */
+#define SLAB_GROWTH_NUMERATOR 5
+#define SLAB_GROWTH_DENOMINATOR 4
+
+/* Offset of the first chunk in a page, past the page header */
+#define SLAB_PAGE_HEADER_SIZE \
+	((sizeof(SlabPage) + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT \
+	* SLAB_ALIGNMENT)
+
+/* Returns the page a chunk was carved from. Pages are aligned to their
+ * size */
+static SlabPage* page_of(void* chunk) {
+    return (SlabPage*)((uintptr_t)chunk & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+}
+
+void slab_init(Slab* slab) {
+    memset(slab, 0, sizeof(Slab));
+    unsigned int size = SLAB_MIN_CHUNK;
+    while (slab->numClasses < SLAB_MAX_CLASSES) {
+        SlabClass* class = &(slab->classes[slab->numClasses++]);
+	class->chunkSize = size;
+	class->chunksPerPage = (SLAB_PAGE_SIZE - SLAB_PAGE_HEADER_SIZE) / size;
+	if (size == SLAB_MAX_CHUNK) {
+	    break;
+	}
+	size = (size * SLAB_GROWTH_NUMERATOR / SLAB_GROWTH_DENOMINATOR
+		+ SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+	if (size > SLAB_MAX_CHUNK) {
+	    size = SLAB_MAX_CHUNK;
+	}
+    }
+}
+
+/* Frees every page on a list */
+static void free_pages(SlabPage* page) {
+    while (page != NULL) {
+        SlabPage* next = page->next;
+	free(page);
+	page = next;
+    }
+}
+
+void slab_destroy(Slab* slab) {
+    for (unsigned int i = 0; i < slab->numClasses; i++) {
+        free_pages(slab->classes[i].partial);
+	free_pages(slab->classes[i].full);
+    }
+    memset(slab, 0, sizeof(Slab));
+}
+
+/* Returns the smallest size class holding blocks of the given size, or NULL
+ * if the block is too large for any of them */
+static SlabClass* class_of(Slab* slab, size_t size) {
+    if (size > SLAB_MAX_CHUNK) {
+        return NULL;
+    }
+    unsigned int low = 0;
+    unsigned int high = slab->numClasses - 1;
+    while (low < high) {
+        unsigned int middle = (low + high) / 2;
+	if (slab->classes[middle].chunkSize < size) {
+	    low = middle + 1;
+	} else {
+	    high = middle;
+	}
+    }
+    return &(slab->classes[low]);
+}
+
+/* Removes a page from a list */
+static void unlink_page(SlabPage** list, SlabPage* page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        *list = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    }
+}
+
+/* Adds a page to the front of a list */
+static void push_page(SlabPage** list, SlabPage* page) {
+    page->prev = NULL;
+    page->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = page;
+    }
+    *list = page;
+}
+
+void* slab_alloc(Slab* slab, size_t size) {
+    SlabClass* class = class_of(slab, size);
+    if (class == NULL) {
+        void* block = malloc(size);
+	if (block != NULL) {
+	    slab->largeBytes += size;
+	    slab->requestedBytes += size;
+	    slab->numLarge++;
+	}
+	return block;
+    }
+
+    SlabPage* page = class->partial;
+    if (page == NULL) {
+        void* memory;
+	if (posix_memalign(&memory, SLAB_PAGE_SIZE, SLAB_PAGE_SIZE) != 0) {
+	    return NULL;
+	}
+	page = memory;
+	memset(page, 0, sizeof(SlabPage));
+	push_page(&(class->partial), page);
+	class->numPages++;
+    }
+
+    // Reuse a freed chunk before carving a new one
+    void* chunk = page->freeList;
+    if (chunk != NULL) {
+        memcpy(&(page->freeList), chunk, sizeof(void*));
+    } else {
+        chunk = (char*)page + SLAB_PAGE_HEADER_SIZE
+		+ (size_t)page->carved++ * class->chunkSize;
+    }
+    if (++page->used == class->chunksPerPage) {
+        unlink_page(&(class->partial), page);
+	push_page(&(class->full), page);
+    }
+    class->usedChunks++;
+    slab->requestedBytes += size;
+    return chunk;
+}
+
+void slab_free(Slab* slab, void* block, size_t size) {
+    slab->requestedBytes -= size;
+    SlabClass* class = class_of(slab, size);
+    if (class == NULL) {
+        slab->largeBytes -= size;
+	slab->numLarge--;
+	free(block);
+	return;
+    }
+
+    SlabPage* page = page_of(block);
+    if (page->used-- == class->chunksPerPage) {
+        unlink_page(&(class->full), page);
+	push_page(&(class->partial), page);
+    }
+    memcpy(block, &(page->freeList), sizeof(void*));
+    page->freeList = block;
+    class->usedChunks--;
+
+    // Hand empty pages back, keeping one so a class that empties and refills
+    // does not allocate a page every time
+    if (page->used == 0 && (class->partial != page || page->next != NULL)) {
+        unlink_page(&(class->partial), page);
+	class->numPages--;
+	free(page);
+    }
+}
+
+void* slab_realloc(Slab* slab, void* block, size_t oldSize, size_t newSize) {
+    SlabClass* oldClass = class_of(slab, oldSize);
+    if (oldClass != NULL && oldClass == class_of(slab, newSize)) {
+        slab->requestedBytes += newSize - oldSize;
+	return block;
+    }
+    void* resized = slab_alloc(slab, newSize);
+    if (resized == NULL) {
+        return NULL;
+    }
+    memcpy(resized, block, oldSize < newSize ? oldSize : newSize);
+    slab_free(slab, block, oldSize);
+    return resized;
+}
+
+void slab_stats(Slab* slab, SlabStats* stats) {
+    for (unsigned int i = 0; i < slab->numClasses; i++) {
+        SlabClass* class = &(slab->classes[i]);
+	stats->numPages += class->numPages;
+	stats->reservedBytes += class->numPages * SLAB_PAGE_SIZE;
+	stats->usedBytes += class->usedChunks * class->chunkSize;
+    }
+    stats->reservedBytes += slab->largeBytes;
+    stats->usedBytes += slab->largeBytes;
+    stats->requestedBytes += slab->requestedBytes;
+}
@@ -0,0 +1,133 @@
+/*
+** slab.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/* Size and alignment of the pages chunks are carved from */
+#define SLAB_PAGE_SIZE 16384
+
+/* Smallest and largest chunk sizes. Larger blocks come straight from
+ * malloc */
+#define SLAB_MIN_CHUNK 32
+#define SLAB_MAX_CHUNK 2048
+
+/* Upper bound on the number of size classes */
+#define SLAB_MAX_CLASSES 32
+
+/* A page of chunks of one size class. Free chunks are linked through their
+ * first bytes on freeList, and chunks past carved have never been used */
+typedef struct SlabPage {
+    struct SlabPage* prev;
+    struct SlabPage* next;
+    void* freeList;
+    unsigned int used;
+    unsigned int carved;
+} SlabPage;
+
+/* The pages of one size class. partial holds the pages with free chunks and
+ * full the rest */
+typedef struct {
+    unsigned int chunkSize;
+    unsigned int chunksPerPage;
+    SlabPage* partial;
+    SlabPage* full;
+    size_t numPages;
+    size_t usedChunks;
+} SlabClass;
+
+/* A size-classed allocator. Not thread safe, each user supplies its own
+ * locking. requestedBytes is the total size asked for by the blocks
+ * currently allocated, and largeBytes the part of it allocated with
+ * malloc */
+typedef struct {
+    SlabClass classes[SLAB_MAX_CLASSES];
+    unsigned int numClasses;
+    size_t requestedBytes;
+    size_t largeBytes;
+    size_t numLarge;
+} Slab;
+
+/* Memory use of one or more slabs. reservedBytes is the memory taken from
+ * malloc (whole pages and large blocks), usedBytes the part of it in
+ * allocated chunks and large blocks, and requestedBytes the part of that
+ * actually asked for */
+typedef struct {
+    size_t numPages;
+    size_t reservedBytes;
+    size_t usedBytes;
+    size_t requestedBytes;
+} SlabStats;
+
+/* slab_init()
+* −−−−−−−−−−−−−−−
+* Sets up an empty slab. No memory is allocated until it is first used.
+*
+* slab: the slab to set up. Not NULL
+*/
+void slab_init(Slab* slab);
+
+/* slab_destroy()
+* −−−−−−−−−−−−−−−
+* Frees every page of a slab. Large blocks must have been freed already.
+*
+* slab: the slab to destroy. Not NULL
+*/
+void slab_destroy(Slab* slab);
+
+/* slab_alloc()
+* −−−−−−−−−−−−−−−
+* Allocates a block from the smallest size class that fits it.
+*
+* slab: the slab to allocate from. Not NULL
+* size: the number of bytes needed. Greater than 0
+*
+* Returns: the block, aligned to 8 bytes, or NULL if memory cannot be
+* allocated
+*/
+void* slab_alloc(Slab* slab, size_t size);
+
+/* slab_free()
+* −−−−−−−−−−−−−−−
+* Returns a block to its size class. A page is freed once none of its chunks
+* are in use, unless it is the last page of its class with free chunks.
+*
+* slab: the slab the block was allocated from. Not NULL
+* block: the block. Not NULL
+* size: the size the block was allocated with
+*/
+void slab_free(Slab* slab, void* block, size_t size);
+
+/* slab_realloc()
+* −−−−−−−−−−−−−−−
+* Resizes a block, keeping it in place if the new size is in the same size
+* class. Otherwise the first bytes of the block, up to the smaller of the two
+* sizes, are copied to a new block and the old one is freed.
+*
+* slab: the slab the block was allocated from. Not NULL
+* block: the block. Not NULL
+* oldSize: the size the block was allocated with
+* newSize: the size needed. Greater than 0
+*
+* Returns: the resized block, NULL if memory cannot be allocated, in which
+* case the old block is left as it was
+*/
+void* slab_realloc(Slab* slab, void* block, size_t oldSize, size_t newSize);
+
+/* slab_stats()
+* −−−−−−−−−−−−−−−
+* Adds the memory use of a slab to a running total.
+*
+* slab: the slab to measure. Not NULL
+* stats: the total to add to. Not NULL
+*/
+void slab_stats(Slab* slab, SlabStats* stats);
+
+#endif
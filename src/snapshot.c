@@ -0,0 +1,363 @@
+/*
+** snapshot.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "crc32.h"
+
+/* Sections and entries start on multiples of this many bytes */
+#define SNAPSHOT_ALIGNMENT 8
+
+/* Suffix of the file a snapshot is written to before it is moved into
+ * place */
+#define SNAPSHOT_TEMP_SUFFIX ".tmp"
+
+/* Number of entries the writer makes room for when it is first needed */
+#define SNAPSHOT_INITIAL_ENTRIES 1024
+
+/* Permissions of a new snapshot file */
+#define SNAPSHOT_FILE_MODE 0600
+
+/* Rounds a length up to the next multiple of SNAPSHOT_ALIGNMENT */
+static uint64_t align(uint64_t length) {
+    return (length + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT 
+	    * SNAPSHOT_ALIGNMENT;
+}
+
+/* Returns the number of bytes an entry with the given key and value lengths
+ * takes up in the heap, including padding */
+static uint64_t entry_size(uint64_t keyLength, uint64_t valueLength) {
+    return align(sizeof(SnapshotEntry) + keyLength + 1 + valueLength + 1);
+}
+
+/* Returns the CRC-32 of a header, computed with its headerCrc zeroed */
+static uint32_t header_crc(const SnapshotHeader* header) {
+    SnapshotHeader copy = *header;
+    copy.headerCrc = 0;
+    return crc32(0, &copy, sizeof(SnapshotHeader));
+}
+
+char* snapshot_path(const char* dir, const char* name) {
+    char* path = malloc(strlen(dir) + strlen(name)
+	    + strlen(SNAPSHOT_FILE_EXTENSION) + 2);
+    if (path != NULL) {
+        sprintf(path, "%s/%s%s", dir, name, SNAPSHOT_FILE_EXTENSION);
+    }
+    return path;
+}
+
+/* Checks that the sections a header describes fit within a file of the
+ * given size */
+static bool valid_header(const SnapshotHeader* header, size_t size) {
+    uint64_t heapEnd = header->heapOffset + header->heapLength;
+    uint64_t capacity = header->indexCapacity;
+    return memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0
+	    && header->version == SNAPSHOT_VERSION
+	    && header->headerCrc == header_crc(header)
+	    && header->heapOffset == sizeof(SnapshotHeader)
+	    && heapEnd >= header->heapOffset && heapEnd <= size
+	    && header->indexOffset >= heapEnd
+	    && header->indexOffset % SNAPSHOT_ALIGNMENT == 0
+	    && header->indexOffset <= size
+	    && capacity > 0 && (capacity & (capacity - 1)) == 0
+	    && capacity <= (size - header->indexOffset) / sizeof(SnapshotSlot)
+	    && header->numEntries < capacity;
+}
+
+bool snapshot_open(const char* path, Snapshot** snapshot) {
+    *snapshot = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0
+	    || (size_t)status.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+	return false;
+    }
+
+    // Pages are only read in as lookups touch them
+    size_t size = status.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    Snapshot* opened = malloc(sizeof(Snapshot));
+    if (opened == NULL || !valid_header((const SnapshotHeader*)map, size)) {
+        free(opened);
+	munmap(map, size);
+	return false;
+    }
+    opened->map = map;
+    opened->size = size;
+    opened->header = (const SnapshotHeader*)map;
+    opened->index =
+	    (const SnapshotSlot*)(opened->map + opened->header->indexOffset);
+    *snapshot = opened;
+    return true;
+}
+
+void snapshot_close(Snapshot* snapshot) {
+    munmap((void*)snapshot->map, snapshot->size);
+    free(snapshot);
+}
+
+unsigned long long snapshot_generation(Snapshot* snapshot) {
+    return snapshot->header->walGeneration;
+}
+
+/* Returns the entry at the given offset, or NULL if the offset is outside
+ * the heap or the entry fails its checks */
+static const SnapshotEntry* entry_at(Snapshot* snapshot, uint64_t offset) {
+    uint64_t heapEnd = snapshot->header->heapOffset
+	    + snapshot->header->heapLength;
+    if (offset < snapshot->header->heapOffset
+	    || offset % SNAPSHOT_ALIGNMENT != 0
+	    || offset + sizeof(SnapshotEntry) > heapEnd) {
+        return NULL;
+    }
+    const SnapshotEntry* entry =
+	    (const SnapshotEntry*)(snapshot->map + offset);
+    if (offset + entry_size(entry->keyLength, entry->valueLength) > heapEnd) {
+        return NULL;
+    }
+    const char* key = (const char*)(entry + 1);
+    const char* value = key + entry->keyLength + 1;
+    if (key[entry->keyLength] != '\0' || value[entry->valueLength] != '\0') {
+        return NULL;
+    }
+
+    // The other fields, key and value follow the CRC without any gaps
+    size_t checked = sizeof(SnapshotEntry) - sizeof(entry->crc)
+	    + entry->keyLength + 1 + entry->valueLength + 1;
+    if (crc32(0, &(entry->keyLength), checked) != entry->crc) {
+        return NULL;
+    }
+    return entry;
+}
+
+bool snapshot_find(Snapshot* snapshot, const char* key, unsigned int hash,
+	const char** value, size_t* valueLength, unsigned int* expiry) {
+    uint64_t mask = snapshot->header->indexCapacity - 1;
+    uint64_t i = hash & mask;
+    for (uint64_t probes = 0; probes <= mask; probes++, i = (i + 1) & mask) {
+        const SnapshotSlot* slot = &(snapshot->index[i]);
+	if (slot->offset == 0) {
+	    return false;
+	}
+	if (slot->hash != hash) {
+	    continue;
+	}
+	const SnapshotEntry* entry = entry_at(snapshot, slot->offset);
+	if (entry == NULL) {
+	    continue;
+	}
+	const char* entryKey = (const char*)(entry + 1);
+	if (strcmp(entryKey, key) == 0) {
+	    *value = entryKey + entry->keyLength + 1;
+	    *valueLength = entry->valueLength;
+	    *expiry = entry->expiry;
+	    return true;
+	}
+    }
+    return false;
+}
+
+int snapshot_next(Snapshot* snapshot, size_t* offset, const char** key,
+	const char** value, size_t* valueLength, unsigned int* expiry) {
+    if (*offset == 0) {
+        *offset = snapshot->header->heapOffset;
+    }
+    if (*offset >= snapshot->header->heapOffset
+	    + snapshot->header->heapLength) {
+        return 0;
+    }
+    const SnapshotEntry* entry = entry_at(snapshot, *offset);
+    if (entry == NULL) {
+        return -1;
+    }
+    *key = (const char*)(entry + 1);
+    *value = *key + entry->keyLength + 1;
+    *valueLength = entry->valueLength;
+    *expiry = entry->expiry;
+    *offset += entry_size(entry->keyLength, entry->valueLength);
+    return 1;
+}
+
+SnapshotWriter* snapshot_create(const char* path) {
+    SnapshotWriter* writer = malloc(sizeof(SnapshotWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+    memset(writer, 0, sizeof(SnapshotWriter));
+    writer->path = strdup(path);
+    writer->tempPath = 
+	    malloc(strlen(path) + strlen(SNAPSHOT_TEMP_SUFFIX) + 1);
+    int fd = -1;
+    if (writer->path != NULL && writer->tempPath != NULL) {
+        sprintf(writer->tempPath, "%s%s", path, SNAPSHOT_TEMP_SUFFIX);
+	fd = open(writer->tempPath, O_WRONLY | O_CREAT | O_TRUNC,
+		SNAPSHOT_FILE_MODE);
+    }
+    if (fd >= 0) {
+        writer->file = fdopen(fd, "w");
+    }
+    if (writer->file == NULL) {
+        if (fd >= 0) {
+	    close(fd);
+	}
+	free(writer->path);
+	free(writer->tempPath);
+	free(writer);
+	return NULL;
+    }
+
+    // The header is filled in once the rest of the file is written
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    writer->failed =
+	    fwrite(&header, sizeof(SnapshotHeader), 1, writer->file) != 1;
+    writer->offset = sizeof(SnapshotHeader);
+    return writer;
+}
+
+void snapshot_add(SnapshotWriter* writer, const char* key, unsigned int hash,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    if (writer->failed) {
+        return;
+    }
+    if (writer->numEntries == writer->capacity) {
+        size_t capacity = writer->capacity == 0 ? SNAPSHOT_INITIAL_ENTRIES
+		: writer->capacity * 2;
+	SnapshotSlot* slots =
+		realloc(writer->slots, capacity * sizeof(SnapshotSlot));
+	if (slots == NULL) {
+	    writer->failed = true;
+	    return;
+	}
+	writer->slots = slots;
+	writer->capacity = capacity;
+    }
+
+    SnapshotEntry entry;
+    entry.keyLength = strlen(key);
+    entry.valueLength = valueLength;
+    entry.expiry = expiry;
+    entry.crc = crc32(0, &(entry.keyLength),
+	    sizeof(SnapshotEntry) - sizeof(entry.crc));
+    entry.crc = crc32(entry.crc, key, entry.keyLength + 1);
+    entry.crc = crc32(entry.crc, value, valueLength + 1);
+    static const char padding[SNAPSHOT_ALIGNMENT];
+    uint64_t size = entry_size(entry.keyLength, valueLength);
+    size_t padLength = size - (sizeof(SnapshotEntry) + entry.keyLength + 1
+	    + valueLength + 1);
+    if (fwrite(&entry, sizeof(SnapshotEntry), 1, writer->file) != 1
+	    || fwrite(key, 1, entry.keyLength + 1, writer->file)
+	    != entry.keyLength + 1
+	    || fwrite(value, 1, valueLength + 1, writer->file)
+	    != valueLength + 1
+	    || fwrite(padding, 1, padLength, writer->file) != padLength) {
+        writer->failed = true;
+	return;
+    }
+    SnapshotSlot* slot = &(writer->slots[writer->numEntries++]);
+    slot->hash = hash;
+    slot->unused = 0;
+    slot->offset = writer->offset;
+    writer->offset += size;
+}
+
+/* Writes the hash index of a snapshot, at least twice as large as the number
+ * of entries so probes stay short. Returns its capacity, 0 on failure */
+static uint64_t write_index(SnapshotWriter* writer) {
+    uint64_t capacity = 1;
+    while (capacity < (uint64_t)writer->numEntries * 2 + 1) {
+        capacity *= 2;
+    }
+    SnapshotSlot* index = calloc(capacity, sizeof(SnapshotSlot));
+    if (index == NULL) {
+        return 0;
+    }
+    uint64_t mask = capacity - 1;
+    for (size_t e = 0; e < writer->numEntries; e++) {
+        uint64_t i = writer->slots[e].hash & mask;
+	while (index[i].offset != 0) {
+	    i = (i + 1) & mask;
+	}
+	index[i] = writer->slots[e];
+    }
+    bool written = fwrite(index, sizeof(SnapshotSlot), capacity, writer->file)
+	    == capacity;
+    free(index);
+    return written ? capacity : 0;
+}
+
+/* Syncs the directory holding path, so a file renamed into it survives a
+ * crash. Returns false on error */
+static bool sync_directory(const char* path) {
+    char* dir = strdup(path);
+    if (dir == NULL) {
+        return false;
+    }
+    char* slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        *slash = '\0';
+    }
+    int fd = open(dir, O_RDONLY);
+    free(dir);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return synced;
+}
+
+bool snapshot_finish(SnapshotWriter* writer, unsigned long long walGeneration) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.walGeneration = walGeneration;
+    header.numEntries = writer->numEntries;
+    header.heapOffset = sizeof(SnapshotHeader);
+    header.heapLength = writer->offset - sizeof(SnapshotHeader);
+    header.indexOffset = writer->offset;
+    if (!writer->failed) {
+        header.indexCapacity = write_index(writer);
+    }
+    header.headerCrc = header_crc(&header);
+
+    // The header goes in last, so a snapshot is only valid once it is whole
+    bool written = !writer->failed && header.indexCapacity > 0
+	    && fflush(writer->file) == 0
+	    && fseek(writer->file, 0, SEEK_SET) == 0
+	    && fwrite(&header, sizeof(SnapshotHeader), 1, writer->file) == 1
+	    && fflush(writer->file) == 0
+	    && fsync(fileno(writer->file)) == 0;
+    written = fclose(writer->file) == 0 && written
+	    && rename(writer->tempPath, writer->path) == 0
+	    && sync_directory(writer->path);
+    if (!written) {
+        unlink(writer->tempPath);
+    }
+    free(writer->slots);
+    free(writer->path);
+    free(writer->tempPath);
+    free(writer);
+    return written;
+}
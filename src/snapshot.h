@@ -0,0 +1,197 @@
+/*
+** snapshot.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Extension of a snapshot file, which is named after its store */
+#define SNAPSHOT_FILE_EXTENSION ".snap"
+
+/* Identifies a snapshot file and the version of its format */
+#define SNAPSHOT_MAGIC "DBSNAP\0"
+#define SNAPSHOT_VERSION 2
+
+/* The first bytes of a snapshot file. A snapshot is laid out as this header,
+ * then the heap of entries, then the hash index, each section starting on an
+ * 8 byte boundary. headerCrc is the CRC-32 of the header with headerCrc
+ * itself zeroed. Changes logged in walGeneration and later generations of the
+ * write-ahead log may be missing from the snapshot. Integers are in host byte
+ * order */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerCrc;
+    uint64_t walGeneration;
+    uint64_t numEntries;
+    uint64_t heapOffset;
+    uint64_t heapLength;
+    uint64_t indexOffset;
+    uint64_t indexCapacity;
+} SnapshotHeader;
+
+/* An entry in the heap, followed by the null terminated key and value and
+ * padding to the next 8 byte boundary. expiry is when the key expires in 
+ * seconds since the Epoch, 0 if it never does. crc is the CRC-32 of the 
+ * other fields, key and value */
+typedef struct {
+    uint32_t crc;
+    uint32_t keyLength;
+    uint32_t valueLength;
+    uint32_t expiry;
+} SnapshotEntry;
+
+/* A bucket of the hash index, an open addressing table with linear probing
+ * whose capacity is a power of 2. offset is the position of the entry in the
+ * file, 0 for an empty bucket */
+typedef struct {
+    uint32_t hash;
+    uint32_t unused;
+    uint64_t offset;
+} SnapshotSlot;
+
+/* A snapshot file mapped into memory */
+typedef struct {
+    const char* map;
+    size_t size;
+    const SnapshotHeader* header;
+    const SnapshotSlot* index;
+} Snapshot;
+
+/* A snapshot being written. The index is built in memory as entries are
+ * added to the heap and written after it */
+typedef struct {
+    FILE* file;
+    char* path;
+    char* tempPath;
+    SnapshotSlot* slots;
+    size_t numEntries;
+    size_t capacity;
+    uint64_t offset;
+    bool failed;
+} SnapshotWriter;
+
+/* snapshot_path()
+* −−−−−−−−−−−−−−−
+* Returns: the path of the snapshot of the named store in a data directory,
+* allocated with malloc
+*/
+char* snapshot_path(const char* dir, const char* name);
+
+/* snapshot_open()
+* −−−−−−−−−−−−−−−
+* Maps a snapshot file into memory.
+*
+* Only the header is checked here, so opening takes the same time however
+* many entries there are. Each entry is checked against its CRC as it is read.
+*
+* path: the snapshot file. Not NULL
+* snapshot: set to the snapshot opened, or NULL if there is none. Not NULL
+*
+* Returns: true if the snapshot was opened or the file does not exist, false
+* if it cannot be read or its header is damaged
+*/
+bool snapshot_open(const char* path, Snapshot** snapshot);
+
+/* snapshot_close()
+* −−−−−−−−−−−−−−−
+* Unmaps a snapshot and frees its memory. Values found in it can no longer be
+* used.
+*
+* snapshot: the snapshot to close. Not NULL
+*/
+void snapshot_close(Snapshot* snapshot);
+
+/* snapshot_generation()
+* −−−−−−−−−−−−−−−
+* Returns: the first write-ahead log generation whose changes must be
+* replayed on top of the snapshot
+*/
+unsigned long long snapshot_generation(Snapshot* snapshot);
+
+/* snapshot_find()
+* −−−−−−−−−−−−−−−
+* Looks up a key in the hash index of a snapshot.
+*
+* snapshot: the snapshot to look in. Not NULL
+* key: the key to find. Not NULL
+* hash: the hash stringstore_hash() gives the key
+* value: set to the null terminated value found, which stays valid until the
+* snapshot is closed. Not NULL
+* valueLength: set to the number of bytes in the value. Not NULL
+* expiry: set to when the key expires, 0 if it never does. Not NULL
+*
+* Returns: true if the key was found in an undamaged entry, false otherwise
+*/
+bool snapshot_find(Snapshot* snapshot, const char* key, unsigned int hash,
+	const char** value, size_t* valueLength, unsigned int* expiry);
+
+/* snapshot_next()
+* −−−−−−−−−−−−−−−
+* Reads the next entry of a snapshot's heap.
+*
+* snapshot: the snapshot to read. Not NULL
+* offset: the position of the entry to read, starting at 0 for the first and
+* advanced past the entry read. Not NULL
+* key: set to the key of the entry. Not NULL
+* value: set to the null terminated value of the entry. Not NULL
+* valueLength: set to the number of bytes in the value. Not NULL
+* expiry: set to when the key expires, 0 if it never does. Not NULL
+*
+* Returns: 1 if an entry was read, 0 at the end of the heap, -1 if the entry
+* is damaged
+*/
+int snapshot_next(Snapshot* snapshot, size_t* offset, const char** key,
+	const char** value, size_t* valueLength, unsigned int* expiry);
+
+/* snapshot_create()
+* −−−−−−−−−−−−−−−
+* Starts writing a snapshot. Entries go to a temporary file next to path,
+* which only replaces the snapshot at path once snapshot_finish() has synced
+* it.
+*
+* path: the snapshot file to write. Not NULL
+*
+* Returns: the writer, NULL if the temporary file cannot be created
+*/
+SnapshotWriter* snapshot_create(const char* path);
+
+/* snapshot_add()
+* −−−−−−−−−−−−−−−
+* Adds an entry to a snapshot being written. Each key must only be added
+* once.
+*
+* writer: the snapshot being written. Not NULL
+* key: the key. Not NULL
+* hash: the hash stringstore_hash() gives the key
+* value: the null terminated value. Not NULL
+* valueLength: the number of bytes in value
+* expiry: when the key expires in seconds since the Epoch, 0 if it never does
+*/
+void snapshot_add(SnapshotWriter* writer, const char* key, unsigned int hash,
+	const char* value, size_t valueLength, unsigned int expiry);
+
+/* snapshot_finish()
+* −−−−−−−−−−−−−−−
+* Writes the index and header of a snapshot, syncs it and moves it into
+* place. The writer is freed.
+*
+* writer: the snapshot being written. Not NULL
+* walGeneration: the first write-ahead log generation whose changes may be
+* missing from the snapshot
+*
+* Returns: true if the snapshot was written, false if it was abandoned, in
+* which case any earlier snapshot at the path is left as it was
+*/
+bool snapshot_finish(SnapshotWriter* writer, unsigned long long walGeneration);
+
+#endif
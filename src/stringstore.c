@@ -9,106 +9,1041 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
 #include "stringstore.h"
+#include "epoch.h"
 
-/* Increase key value buffer size by 100 when full */
-#define KEY_VALUE_BUFFER_SIZE 100
+/* Number of buckets in a new store. Must be a power of 2 */
+#define STRINGSTORE_INITIAL_CAPACITY 128
+
+/* Start a resize once 3/4 of the buckets are live or tombstones */
+#define STRINGSTORE_MAX_LOAD_NUMERATOR 3
+#define STRINGSTORE_MAX_LOAD_DENOMINATOR 4
+
+/* Number of old buckets moved into the new table on each add or delete */
+#define STRINGSTORE_MIGRATE_STEP 16
+
+/* Number of blocks retired between passes to free them */
+#define STRINGSTORE_RECLAIM_MIN 32
+
+/* Number of times a reader retries before yielding to the writer it keeps
+ * racing with */
+#define STRINGSTORE_SPIN_LIMIT 64
+
+/* FNV-1a 32 bit offset basis and prime */
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* A bucket seen as words, so readers that take no lock copy it with atomic
+ * loads and writers publish it with atomic stores */
+typedef unsigned long long __attribute__((__may_alias__)) SlotWord;
+
+/* Number of words in a bucket */
+#define SLOT_WORDS (sizeof(StringStoreSlot) / sizeof(SlotWord))
+
+/* Writes a bucket for readers that take no lock. Each word is released, so a
+ * reader seeing any of it also sees the odd sequence set before it */
+static void slot_publish(StringStoreSlot* slot, const StringStoreSlot* value) {
+    SlotWord* to = (SlotWord*)slot;
+    const SlotWord* from = (const SlotWord*)value;
+    for (size_t i = 0; i < SLOT_WORDS; i++) {
+        __atomic_store_n(&(to[i]), from[i], __ATOMIC_RELEASE);
+    }
+}
+
+/* Changes the state of a bucket, which shares the first word with the
+ * hash and lengths */
+static void slot_set_state(StringStoreSlot* slot, unsigned char state) {
+    StringStoreSlot updated;
+    ((SlotWord*)&updated)[0] = ((SlotWord*)slot)[0];
+    updated.state = state;
+    __atomic_store_n((SlotWord*)slot, ((SlotWord*)&updated)[0],
+	    __ATOMIC_RELEASE);
+}
+
+/* Copies a bucket that may be changing. The copy is only consistent if the
+ * store's sequence is unchanged afterwards */
+static void slot_copy(StringStoreSlot* copy, StringStoreSlot* slot) {
+    SlotWord* to = (SlotWord*)copy;
+    SlotWord* from = (SlotWord*)slot;
+    for (size_t i = 0; i < SLOT_WORDS; i++) {
+        to[i] = __atomic_load_n(&(from[i]), __ATOMIC_ACQUIRE);
+    }
+}
+
+/* Starts a change to a store, making its sequence odd so readers that take
+ * no lock retry anything they read meanwhile */
+static void write_begin(StringStore* store) {
+    __atomic_store_n(&(store->sequence), store->sequence + 1,
+	    __ATOMIC_RELAXED);
+}
+
+/* Finishes a change started by write_begin() */
+static void write_end(StringStore* store) {
+    __atomic_store_n(&(store->sequence), store->sequence + 1,
+	    __ATOMIC_RELEASE);
+}
+
+/* Checks if a bucket holds an entry */
+static int slot_live(const StringStoreSlot* slot) {
+    return slot->state == SLOT_INLINE || slot->state == SLOT_HEAP;
+}
+
+/* Returns the key held by a live bucket */
+static const char* slot_key(StringStoreSlot* slot) {
+    return slot->state == SLOT_INLINE ? slot->contents.data
+	    : slot->contents.entry->data;
+}
+
+/* Returns the length of the key held by a live bucket */
+static size_t slot_key_length(StringStoreSlot* slot) {
+    return slot->state == SLOT_INLINE ? slot->keyLength
+	    : slot->contents.entry->keyLength;
+}
+
+/* Returns the value held by a live bucket */
+static const char* slot_value(StringStoreSlot* slot) {
+    return slot_key(slot) + slot_key_length(slot) + 1;
+}
+
+/* Returns the length of the value held by a live bucket */
+static size_t slot_value_length(StringStoreSlot* slot) {
+    return slot->state == SLOT_INLINE ? slot->valueLength
+	    : slot->contents.entry->valueLength;
+}
+
+/* Checks if a key and value of the given lengths fit in a bucket. Keys that
+ * expire are never stored inline */
+static int fits_inline(size_t keyLength, size_t valueLength,
+	unsigned int expiry) {
+    return expiry == 0 
+	    && keyLength + 1 + valueLength + 1 <= STRINGSTORE_INLINE_SIZE;
+}
+
+/* Checks if an entry has expired by the given time */
+static int entry_expired(const KeyValue* entry, unsigned int now) {
+    return entry->expiry != 0 && now >= entry->expiry;
+}
+
+/* Checks if a live bucket holds a key that has expired. The clock is only
+ * read for keys that expire */
+static int slot_expired(const StringStoreSlot* slot) {
+    return slot->state == SLOT_HEAP && slot->contents.entry->expiry != 0
+	    && entry_expired(slot->contents.entry, (unsigned int)time(NULL));
+}
+
+/* Returns when the key held by a live bucket expires, 0 if it never does */
+static unsigned int slot_expiry(const StringStoreSlot* slot) {
+    return slot->state == SLOT_HEAP ? slot->contents.entry->expiry : 0;
+}
+
+/* Counts a key removed because it expired */
+static void count_expired(StringStore* store) {
+    __atomic_add_fetch(&(store->numExpired), 1, __ATOMIC_RELAXED);
+}
+
+/* Marks a bucket as referenced for the eviction clock. The bit is only 
+ * written when it is clear, so hot keys do not keep dirtying their bucket */
+static void slot_touch(StringStoreSlot* slot) {
+    if (!__atomic_load_n(&(slot->referenced), __ATOMIC_RELAXED)) {
+        __atomic_store_n(&(slot->referenced), 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Adds to the memory counted for a store's keys. Only the writer changes it,
+ * but it is read without the lock */
+static void add_bytes(StringStore* store, long delta) {
+    __atomic_store_n(&(store->numBytes), store->numBytes + delta,
+	    __ATOMIC_RELAXED);
+}
+
+/* Returns the FNV-1a hash of the given key */
+unsigned int stringstore_hash(const char* key) {
+    unsigned int hash = FNV_OFFSET_BASIS;
+    for (; *key != '\0'; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Allocates the buckets of a table with the given capacity, each on its own
+ * cache line. Returns 0 if the allocation fails */
+static int table_init(StringStoreTable* table, unsigned int capacity) {
+    void* slots;
+    if (posix_memalign(&slots, STRINGSTORE_SLOT_SIZE,
+	    (size_t)capacity * sizeof(StringStoreSlot)) != 0) {
+        return 0;
+    }
+    memset(slots, 0, (size_t)capacity * sizeof(StringStoreSlot));
+    table->slots = slots;
+    table->capacity = capacity;
+    table->used = 0;
+    table->tombstones = 0;
+    return 1;
+}
+
+/* Returns the index of the bucket holding key, or -1 if it is not in the
+ * table. If insertAt is not NULL it is set to the bucket a new entry for the
+ * key should be placed in (the first tombstone or empty bucket probed) */
+static long table_find(StringStoreTable* table, const char* key,
+	unsigned int hash, long* insertAt) {
+    if (insertAt != NULL) {
+        *insertAt = -1;
+    }
+    if (table->slots == NULL) {
+        return -1;
+    }
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = hash & mask;
+    for (unsigned int probes = 0; probes < table->capacity;
+	    probes++, i = (i + 1) & mask) {
+        StringStoreSlot* slot = &(table->slots[i]);
+	if (slot->state == SLOT_EMPTY) {
+	    if (insertAt != NULL && *insertAt == -1) {
+	        *insertAt = i;
+	    }
+	    return -1;
+	}
+	if (slot->state == SLOT_TOMBSTONE) {
+	    if (insertAt != NULL && *insertAt == -1) {
+	        *insertAt = i;
+	    }
+	    continue;
+	}
+	if (slot->hash == hash && strcmp(slot_key(slot), key) == 0) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+/* Points a table at a set of buckets. Readers that take no lock load the
+ * buckets and capacity, so they are stored atomically */
+static void table_publish(StringStoreTable* table,
+	const StringStoreTable* value) {
+    __atomic_store_n(&(table->slots), value->slots, __ATOMIC_RELEASE);
+    __atomic_store_n(&(table->capacity), value->capacity, __ATOMIC_RELEASE);
+    table->used = value->used;
+    table->tombstones = value->tombstones;
+}
+
+/* Copies a live bucket whose key is known not to be in the table into the
+ * given bucket */
+static void table_place(StringStoreTable* table, long index,
+	const StringStoreSlot* source) {
+    StringStoreSlot* slot = &(table->slots[index]);
+    if (slot->state == SLOT_TOMBSTONE) {
+        table->tombstones--;
+    } else {
+        table->used++;
+    }
+    slot_publish(slot, source);
+}
+
+/* Inserts a live bucket whose key is known not to be in the table */
+static void table_insert(StringStoreTable* table,
+	const StringStoreSlot* source) {
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = source->hash & mask;
+    while (slot_live(&(table->slots[i]))) {
+        i = (i + 1) & mask;
+    }
+    table_place(table, i, source);
+}
+
+/* Removes the entry in the given bucket. A tombstone is only left behind when
+ * the following bucket is in use, otherwise the run of tombstones ending at
+ * this bucket can no longer be part of any probe and is emptied */
+static void table_remove(StringStoreTable* table, long index) {
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = index;
+    if (table->slots[(i + 1) & mask].state != SLOT_EMPTY) {
+        slot_set_state(&(table->slots[i]), SLOT_TOMBSTONE);
+	table->tombstones++;
+	return;
+    }
+    slot_set_state(&(table->slots[i]), SLOT_EMPTY);
+    table->used--;
+    for (i = (i - 1) & mask; table->slots[i].state == SLOT_TOMBSTONE;
+	    i = (i - 1) & mask) {
+        slot_set_state(&(table->slots[i]), SLOT_EMPTY);
+	table->used--;
+	table->tombstones--;
+    }
+}
+
+/* Queues an entry or a table's buckets, already unlinked from the index, to
+ * be freed by reclaim() once no reader can still hold them */
+static void retire(StringStore* store, KeyValue* entry,
+	StringStoreSlot* slots) {
+    if (store->numRetired == store->retiredCapacity) {
+        size_t capacity = store->retiredCapacity == 0 ? 16
+		: store->retiredCapacity * 2;
+	StringStoreRetired* retired = 
+		realloc(store->retired, capacity * sizeof(StringStoreRetired));
+	if (retired == NULL) {
+	    // Leak the block rather than free it under its reader
+	    return;
+	}
+	store->retired = retired;
+	store->retiredCapacity = capacity;
+    }
+
+    // The unlink must be visible before the epoch is noted
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    StringStoreRetired* retired = &(store->retired[store->numRetired++]);
+    retired->entry = entry;
+    retired->slots = slots;
+    retired->epoch = epoch_current();
+}
+
+/* Moves up to maxBuckets buckets of the old table into the current table.
+ * Moved buckets become tombstones so probes for the entries still waiting to
+ * be moved are not cut short. The old table is retired once all of its
+ * buckets have been moved */
+static void migrate(StringStore* store, unsigned int maxBuckets) {
+    StringStoreTable* old = &(store->oldTable);
+    if (old->slots == NULL) {
+        return;
+    }
+    for (; maxBuckets > 0 && store->migrateIndex < old->capacity;
+	    maxBuckets--, store->migrateIndex++) {
+        StringStoreSlot* slot = &(old->slots[store->migrateIndex]);
+	if (slot_live(slot)) {
+	    table_insert(&(store->table), slot);
+	    slot_set_state(slot, SLOT_TOMBSTONE);
+	}
+    }
+    if (store->migrateIndex == old->capacity) {
+        StringStoreTable empty = {NULL, 0, 0, 0};
+	StringStoreSlot* slots = old->slots;
+	table_publish(old, &empty);
+	retire(store, NULL, slots);
+	store->migrateIndex = 0;
+    }
+}
+
+/* Starts moving entries into a fresh table if adding another entry would
+ * overload the current one. The new table is doubled in size only when the
+ * live entries need it, so a table full of tombstones is compacted in place.
+ * Returns 0 if the new table cannot be allocated */
+static int maybe_resize(StringStore* store) {
+    StringStoreTable* table = &(store->table);
+    if ((table->used + 1) * STRINGSTORE_MAX_LOAD_DENOMINATOR
+	    < table->capacity * STRINGSTORE_MAX_LOAD_NUMERATOR) {
+        return 1;
+    }
+
+    // Only one resize can be in progress at a time
+    migrate(store, store->oldTable.capacity);
+
+    unsigned int capacity = table->capacity;
+    while ((store->numWords + 1) * 2 > capacity) {
+        capacity *= 2;
+    }
+    StringStoreTable newTable;
+    if (!table_init(&newTable, capacity)) {
+        return 0;
+    }
+    table_publish(&(store->oldTable), table);
+    table_publish(table, &newTable);
+    store->migrateIndex = 0;
+    return 1;
+}
+
+/* Returns the size of the block holding an entry with the given key and 
+ * value lengths */
+static size_t entry_size(size_t keyLength, size_t valueLength) {
+    return sizeof(KeyValue) + keyLength + 1 + valueLength + 1;
+}
+
+/* Returns the value held by an entry */
+static char* entry_value(KeyValue* entry) {
+    return entry->data + entry->keyLength + 1;
+}
+
+/* Returns the memory counted for a key of the given lengths */
+static size_t key_bytes(size_t keyLength, size_t valueLength,
+	unsigned int expiry) {
+    return STRINGSTORE_SLOT_SIZE + (fits_inline(keyLength, valueLength, 
+	    expiry) ? 0 : entry_size(keyLength, valueLength));
+}
+
+/* Returns the memory counted for the key held by a live bucket */
+static size_t slot_bytes(StringStoreSlot* slot) {
+    return key_bytes(slot_key_length(slot), slot_value_length(slot),
+	    slot_expiry(slot));
+}
+
+/* Returns an entry's block to the slab */
+static void free_entry(StringStore* store, KeyValue* entry) {
+    slab_free(&(store->slab), entry, 
+	    entry_size(entry->keyLength, entry->valueLength));
+}
+
+/* Allocates an entry holding copies of a key and value. Returns NULL if 
+ * memory cannot be allocated */
+static KeyValue* new_entry(StringStore* store, const char* key, 
+	const char* value, size_t valueLength, unsigned int expiry) {
+    size_t keyLength = strlen(key);
+    KeyValue* entry = 
+	    slab_alloc(&(store->slab), entry_size(keyLength, valueLength));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->keyLength = keyLength;
+    entry->valueLength = valueLength;
+    entry->refs = 1;
+    entry->expiry = expiry;
+    memcpy(entry->data, key, keyLength + 1);
+    memcpy(entry_value(entry), value, valueLength);
+    entry_value(entry)[valueLength] = '\0';
+    return entry;
+}
+
+/* Drops the store's ref to an entry removed from the index and retires it.
+ * Readers that take no lock may be using it without a ref, so even an
+ * unpinned entry waits for their epochs to pass */
+static void release_entry(StringStore* store, KeyValue* entry) {
+    __atomic_sub_fetch(&(entry->refs), 1, __ATOMIC_RELEASE);
+    retire(store, entry, NULL);
+}
+
+/* Frees the retired blocks that no reader can still be using and that are no
+ * longer pinned, once enough have built up to be worth a pass */
+static void reclaim(StringStore* store) {
+    if (store->numRetired < store->reclaimAt) {
+        return;
+    }
+    epoch_advance();
+
+    // Blocks are retired in epoch order, so only the start of the list can
+    // be freed. Entries there that are still pinned are kept at the front
+    size_t kept = 0;
+    size_t i = 0;
+    for (; i < store->numRetired 
+	    && epoch_reclaimable(store->retired[i].epoch); i++) {
+        StringStoreRetired* retired = &(store->retired[i]);
+	if (retired->entry != NULL && __atomic_load_n(
+		&(retired->entry->refs), __ATOMIC_ACQUIRE) != 0) {
+	    store->retired[kept++] = *retired;
+	} else if (retired->entry != NULL) {
+	    free_entry(store, retired->entry);
+	} else {
+	    free(retired->slots);
+	}
+    }
+    memmove(&(store->retired[kept]), &(store->retired[i]),
+	    (store->numRetired - i) * sizeof(StringStoreRetired));
+    store->numRetired -= i - kept;
+    store->reclaimAt = store->numRetired + STRINGSTORE_RECLAIM_MIN;
+}
+
+/* Stores a key and value in a bucket, inline if they fit and in a new 
+ * entry otherwise. Returns 0 if memory cannot be allocated */
+static int fill_slot(StringStore* store, StringStoreSlot* slot, 
+	unsigned int hash, const char* key, const char* value, 
+	size_t valueLength, unsigned int expiry) {
+    size_t keyLength = strlen(key);
+    slot->hash = hash;
+    slot->referenced = 1;
+    if (!fits_inline(keyLength, valueLength, expiry)) {
+        slot->contents.entry = 
+		new_entry(store, key, value, valueLength, expiry);
+	slot->state = SLOT_HEAP;
+	return slot->contents.entry != NULL;
+    }
+    slot->state = SLOT_INLINE;
+    slot->keyLength = keyLength;
+    slot->valueLength = valueLength;
+    memcpy(slot->contents.data, key, keyLength + 1);
+    memcpy(slot->contents.data + keyLength + 1, value, valueLength);
+    slot->contents.data[keyLength + 1 + valueLength] = '\0';
+    return 1;
+}
+
+/* Replaces the value held by a live bucket, moving the key and value 
+ * between the bucket and an entry as the new size requires. Entries are
+ * never changed in place, as readers may be using them without the lock, so
+ * a new value always gets a new entry. Returns 0 if memory cannot be
+ * allocated, leaving the bucket as it was */
+static int replace_value(StringStore* store, StringStoreSlot* slot,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    // The key is copied out first as the bucket may be holding it
+    StringStoreSlot replacement;
+    char key[STRINGSTORE_INLINE_SIZE];
+    KeyValue* entry = slot->state == SLOT_HEAP ? slot->contents.entry : NULL;
+    const char* oldKey = slot_key(slot);
+    if (slot->state == SLOT_INLINE) {
+        memcpy(key, oldKey, slot->keyLength + 1);
+	oldKey = key;
+    }
+    if (!fill_slot(store, &replacement, slot->hash, oldKey, value,
+	    valueLength, expiry)) {
+	return 0;
+    }
+
+    // Giving an expired key a new value removes the old one for good
+    if (slot_expired(slot)) {
+        count_expired(store);
+    }
+    add_bytes(store, (long)slot_bytes(&replacement) - (long)slot_bytes(slot));
+    slot_publish(slot, &replacement);
+    if (entry != NULL) {
+        release_entry(store, entry);
+    }
+    return 1;
+}
+
+/* Releases the entry held by a bucket, if any */
+static void free_slot(StringStore* store, StringStoreSlot* slot) {
+    if (slot->state == SLOT_HEAP) {
+        release_entry(store, slot->contents.entry);
+    }
+}
+
+/* Adds a new key to the store's ordered index, if it keeps one. Returns 0
+ * if memory cannot be allocated */
+static int index_key(StringStore* store, const char* key, unsigned int hash) {
+    return store->ordered == NULL || skiplist_insert(store->ordered, key, hash);
+}
+
+/* Removes a key from the store's ordered index, if it keeps one */
+static void unindex_key(StringStore* store, const char* key) {
+    if (store->ordered != NULL) {
+        skiplist_remove(store->ordered, key);
+    }
+}
+
+/* Removes the key held by a live bucket of one of the store's tables */
+static void remove_key(StringStore* store, StringStoreTable* table,
+	long index) {
+    StringStoreSlot removed = table->slots[index];
+    add_bytes(store, -(long)slot_bytes(&removed));
+    unindex_key(store, slot_key(&removed));
+    table_remove(table, index);
+    free_slot(store, &removed);
+    store->numWords--;
+}
+
+/* Evicts keys until there is room for needed more bytes within the store's
+ * limit. The clock hand sweeps the current table, giving keys referenced 
+ * since it last passed a second chance and evicting the rest. Expired keys 
+ * are removed first whatever their bit. Gives up after two sweeps, by when
+ * every bit has been cleared, in case the store cannot shrink enough */
+static void evict(StringStore* store, size_t needed) {
+    if (store->maxBytes == 0 || store->numBytes + needed <= store->maxBytes) {
+        return;
+    }
+
+    // Finish any resize first so every key is in the table swept
+    migrate(store, store->oldTable.capacity);
+    StringStoreTable* table = &(store->table);
+    unsigned int mask = table->capacity - 1;
+    for (size_t steps = 0; steps < 2 * (size_t)table->capacity
+	    && store->numBytes + needed > store->maxBytes; steps++) {
+	long index = store->clockHand & mask;
+	StringStoreSlot* slot = &(table->slots[index]);
+	store->clockHand = (index + 1) & mask;
+	if (!slot_live(slot)) {
+	    continue;
+	}
+	if (slot_expired(slot)) {
+	    count_expired(store);
+	} else if (__atomic_load_n(&(slot->referenced), __ATOMIC_RELAXED)) {
+	    __atomic_store_n(&(slot->referenced), 0, __ATOMIC_RELAXED);
+	    continue;
+	} else {
+	    __atomic_add_fetch(&(store->numEvicted), 1, __ATOMIC_RELAXED);
+	}
+	remove_key(store, table, index);
+    }
+}
 
 StringStore* stringstore_init(void) {
     StringStore* stringStore = malloc(sizeof(StringStore));
-    memset(stringStore, 0, sizeof(StringStore)); 
+    memset(stringStore, 0, sizeof(StringStore));
+    slab_init(&(stringStore->slab));
+    stringStore->reclaimAt = STRINGSTORE_RECLAIM_MIN;
 
-    KeyValue** words = 
-	    (KeyValue**)malloc(KEY_VALUE_BUFFER_SIZE * sizeof(KeyValue*));
-    stringStore->words = words;
-    stringStore->bufferSize = KEY_VALUE_BUFFER_SIZE;
+    if (!table_init(&(stringStore->table), STRINGSTORE_INITIAL_CAPACITY)) {
+        free(stringStore);
+	return NULL;
+    }
     return stringStore;
 }
 
 StringStore* stringstore_free(StringStore* store) {
-    // Free inner words
-    for (int i = 0; i < store->numWords; i++) {
-	free(store->words[i]->key);
-	free(store->words[i]->value);
-	free(store->words[i]);
+    // Free the entries of both tables
+    StringStoreTable* tables[] = {&(store->table), &(store->oldTable)};
+    for (int t = 0; t < 2; t++) {
+        for (unsigned int i = 0; i < tables[t]->capacity; i++) {
+	    if (slot_live(&(tables[t]->slots[i]))) {
+	        free_slot(store, &(tables[t]->slots[i]));
+	    }
+	}
+	free(tables[t]->slots);
+    }
+    for (size_t i = 0; i < store->numRetired; i++) {
+        if (store->retired[i].entry != NULL) {
+	    free_entry(store, store->retired[i].entry);
+	} else {
+	    free(store->retired[i].slots);
+	}
+    }
+    free(store->retired);
+    slab_destroy(&(store->slab));
+    if (store->ordered != NULL) {
+        skiplist_destroy(store->ordered);
+	free(store->ordered);
     }
-
-    // Free the outter dimension of list
-    free(store->words);
 
     // Free whole stringstore
     free(store);
     return NULL;
 }
 
-int stringstore_add(StringStore* store, const char* key, const char* value) {
-    char* keyCopy = strdup(key);
-    char* valueCopy = strdup(value);
-    if (keyCopy == NULL || valueCopy == NULL) {
+/* Grows the table ahead of adding up to count entries, moving every entry
+ * across at once, so a batch does not start a resize part way through */
+static void reserve(StringStore* store, size_t count) {
+    migrate(store, store->oldTable.capacity);
+    StringStoreTable* table = &(store->table);
+    if ((table->used + count) * STRINGSTORE_MAX_LOAD_DENOMINATOR
+	    < table->capacity * STRINGSTORE_MAX_LOAD_NUMERATOR) {
+        return;
+    }
+    unsigned int capacity = table->capacity;
+    while ((store->numWords + count) * STRINGSTORE_MAX_LOAD_DENOMINATOR
+	    >= capacity * STRINGSTORE_MAX_LOAD_NUMERATOR) {
+        capacity *= 2;
+    }
+    StringStoreTable newTable;
+    if (!table_init(&newTable, capacity)) {
+        return;
+    }
+    table_publish(&(store->oldTable), table);
+    table_publish(table, &newTable);
+    store->migrateIndex = 0;
+    migrate(store, store->oldTable.capacity);
+}
+
+/* Returns the bucket of a key whose hash is already known in either table,
+ * expired or not, or NULL if it is missing */
+static StringStoreSlot* find_any_slot(StringStore* store, const char* key,
+	unsigned int hash) {
+    long index = table_find(&(store->table), key, hash, NULL);
+    if (index >= 0) {
+        return &(store->table.slots[index]);
+    }
+    index = table_find(&(store->oldTable), key, hash, NULL);
+    return index >= 0 ? &(store->oldTable.slots[index]) : NULL;
+}
+
+/* Adds a key whose hash is already known. See stringstore_add_expiring() */
+static int add_hashed(StringStore* store, const char* key, unsigned int hash,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    size_t needed = key_bytes(strlen(key), valueLength, expiry);
+    if (valueLength >= UINT_MAX 
+	    || (store->maxBytes != 0 && needed > store->maxBytes)) {
+	return 0;
+    }
+    reclaim(store);
+    migrate(store, STRINGSTORE_MIGRATE_STEP);
+
+    // Overwriting a key only needs room for what its entry grows by. It is
+    // marked as used so the clock passes over it
+    StringStoreSlot* existing = find_any_slot(store, key, hash);
+    size_t replaced = 0;
+    if (existing != NULL) {
+        replaced = slot_bytes(existing);
+	slot_touch(existing);
+    }
+    evict(store, needed > replaced ? needed - replaced : 0);
+
+    // If the key exists in the store its entry is given the new value
+    long index = table_find(&(store->table), key, hash, NULL);
+    if (index >= 0) {
+	return replace_value(store, &(store->table.slots[index]), value,
+		valueLength, expiry);
+    }
+
+    // A key still in the old table is moved across with its new value
+    StringStoreSlot slot;
+    index = table_find(&(store->oldTable), key, hash, NULL);
+    if (index >= 0) {
+	if (!replace_value(store, &(store->oldTable.slots[index]), value,
+		valueLength, expiry)) {
+	    return 0;
+	}
+        slot = store->oldTable.slots[index];
+	table_remove(&(store->oldTable), index);
+	store->numWords--;
+	add_bytes(store, -(long)slot_bytes(&slot));
+    } else if (!index_key(store, key, hash)) {
         return 0;
+    } else if (!fill_slot(store, &slot, hash, key, value, valueLength,
+	    expiry)) {
+	unindex_key(store, key);
+	return 0;
     }
-    
-    // If the key exists in the store free the current value and replace it 
-    // with the new one
-    for (int i = 0; i < store->numWords; i++) {
-        if (store->words[i]->key != NULL 
-		&& strcmp(store->words[i]->key, key) == 0) {
-	    // replace value with new value
-	    free(store->words[i]->value);
-	    store->words[i]->value = valueCopy;
-            return 1;
-        }
-    }
-    
-    // If there is a free spot that previously contained a deleted key 
-    // (key = NULL), put in the new key and value
-    for (int i = 0; i < store->numWords; i++) {
-        if (store->words[i]->key == NULL) {
-            store->words[i]->key = keyCopy;
-            store->words[i]->value = valueCopy;
-	    return 1;
-	}
-    }
-
-    // Add more rows to the words list if the number of words equals the buffer
-    // size
-    if (store->numWords == store->bufferSize) {
-        store->bufferSize = store->bufferSize + KEY_VALUE_BUFFER_SIZE;
-        store->words = (KeyValue**)realloc(store->words, 
-		sizeof(KeyValue*) * (store->bufferSize));
-    }
-
-    // Put the key and value in the words array at last index
-    store->words[store->numWords] = (KeyValue*)malloc(sizeof(KeyValue));
-    store->words[store->numWords]->key = keyCopy;
-    store->words[store->numWords]->value = valueCopy;
+
+    // If the table cannot grow keep using it until it is completely full
+    maybe_resize(store);
+    long insertAt;
+    table_find(&(store->table), key, hash, &insertAt);
+    if (insertAt < 0) {
+        unindex_key(store, key);
+	free_slot(store, &slot);
+	return 0;
+    }
+    table_place(&(store->table), insertAt, &slot);
     store->numWords++;
+    add_bytes(store, slot_bytes(&slot));
     return 1;
 }
 
+/* Returns the bucket of a key whose hash is already known, or NULL if it is
+ * missing or has expired */
+static StringStoreSlot* find_slot(StringStore* store, const char* key,
+	unsigned int hash) {
+    StringStoreSlot* slot = find_any_slot(store, key, hash);
+    if (slot == NULL || slot_expired(slot)) {
+        return NULL;
+    }
+    return slot;
+}
+
+/* Finds the bucket of a key as for find_slot(), marking it as used */
+static StringStoreSlot* retrieve_hashed(StringStore* store, const char* key,
+	unsigned int hash) {
+    StringStoreSlot* slot = find_slot(store, key, hash);
+    if (slot != NULL) {
+        slot_touch(slot);
+    }
+    return slot;
+}
+
+/* Deletes a key whose hash is already known, if it has expired by now when
+ * onlyExpired is set. A key found to have expired is removed either way, 
+ * but is treated as missing. Returns 1 if a key was deleted */
+static int delete_hashed(StringStore* store, const char* key,
+	unsigned int hash, int onlyExpired, unsigned int now) {
+    reclaim(store);
+    migrate(store, STRINGSTORE_MIGRATE_STEP);
+
+    StringStoreTable* tables[] = {&(store->table), &(store->oldTable)};
+    for (int t = 0; t < 2; t++) {
+        long index = table_find(tables[t], key, hash, NULL);
+	if (index < 0) {
+	    continue;
+	}
+	StringStoreSlot* slot = &(tables[t]->slots[index]);
+	int expired = onlyExpired ? slot->state == SLOT_HEAP 
+		&& entry_expired(slot->contents.entry, now)
+		: slot_expired(slot);
+	if (onlyExpired && !expired) {
+	    return 0;
+	}
+	remove_key(store, tables[t], index);
+	if (expired) {
+	    count_expired(store);
+	}
+	return onlyExpired || !expired;
+    }
+    return 0;
+}
+
+int stringstore_add(StringStore* store, const char* key, const char* value) {
+    return stringstore_add_sized(store, key, value, strlen(value));
+}
+
+int stringstore_add_sized(StringStore* store, const char* key, 
+	const char* value, size_t valueLength) {
+    return stringstore_add_expiring(store, key, value, valueLength, 0);
+}
+
+int stringstore_add_expiring(StringStore* store, const char* key, 
+	const char* value, size_t valueLength, unsigned int expiry) {
+    write_begin(store);
+    int added = add_hashed(store, key, stringstore_hash(key), value, 
+	    valueLength, expiry);
+    write_end(store);
+    return added;
+}
+
 const char* stringstore_retrieve(StringStore* store, const char* key) {
-    for (int i = 0; i < store->numWords; i++) {
-        if (store->words[i]->key != NULL 
-		&& strcmp(store->words[i]->key, key) == 0) {
-	    return (const char*)store->words[i]->value;
+    StringStoreSlot* slot = retrieve_hashed(store, key, stringstore_hash(key));
+    return slot != NULL ? slot_value(slot) : NULL;
+}
+
+const char* stringstore_retrieve_pinned(StringStore* store, const char* key,
+	size_t* valueLength, KeyValue** pin) {
+    StringStoreSlot* slot = retrieve_hashed(store, key, stringstore_hash(key));
+    *pin = NULL;
+    if (slot == NULL) {
+        return NULL;
+    }
+    if (slot->state == SLOT_HEAP) {
+        *pin = slot->contents.entry;
+	__atomic_add_fetch(&((*pin)->refs), 1, __ATOMIC_RELAXED);
+    }
+    *valueLength = slot_value_length(slot);
+    return slot_value(slot);
+}
+
+/* Looks for a key without the lock, copying each bucket read into *found and
+ * setting *at to the bucket itself. Returns 1 if the key is found, 0 if it 
+ * is missing and -1 if the store has changed since sequence was read. A 
+ * missing key is only certain once the sequence is checked again */
+static int find_unlocked(StringStore* store, const char* key,
+	size_t keyLength, unsigned int hash, unsigned int sequence,
+	StringStoreSlot* found, StringStoreSlot** at) {
+    StringStoreTable* tables[] = {&(store->table), &(store->oldTable)};
+    for (int t = 0; t < 2; t++) {
+        StringStoreSlot* slots = 
+		__atomic_load_n(&(tables[t]->slots), __ATOMIC_ACQUIRE);
+	unsigned int capacity = 
+		__atomic_load_n(&(tables[t]->capacity), __ATOMIC_ACQUIRE);
+
+	// The buckets and capacity only belong together if nothing changed
+	if (__atomic_load_n(&(store->sequence), __ATOMIC_ACQUIRE) 
+		!= sequence) {
+	    return -1;
+	}
+	if (slots == NULL) {
+	    continue;
+	}
+	unsigned int mask = capacity - 1;
+	unsigned int i = hash & mask;
+	for (unsigned int probes = 0; probes < capacity;
+		probes++, i = (i + 1) & mask) {
+	    *at = &(slots[i]);
+	    slot_copy(found, *at);
+	    if (found->state == SLOT_EMPTY) {
+	        break;
+	    }
+	    if (!slot_live(found) || found->hash != hash) {
+	        continue;
+	    }
+
+	    // A torn copy could hold any pointer, so check before following it
+	    if (__atomic_load_n(&(store->sequence), __ATOMIC_ACQUIRE) 
+		    != sequence) {
+	        return -1;
+	    }
+	    if (slot_key_length(found) == keyLength 
+		    && memcmp(slot_key(found), key, keyLength) == 0) {
+	        return 1;
+	    }
 	}
     }
-    return NULL;
+    return 0;
+}
+
+const char* stringstore_retrieve_unlocked(StringStore* store, 
+	const char* key, char* copy, size_t* valueLength, KeyValue** pin) {
+    unsigned int hash = stringstore_hash(key);
+    size_t keyLength = strlen(key);
+    StringStoreSlot found;
+    StringStoreSlot* at;
+    int result;
+    for (unsigned int attempts = 1;; attempts++) {
+        epoch_enter();
+        unsigned int sequence = 
+		__atomic_load_n(&(store->sequence), __ATOMIC_ACQUIRE);
+	if ((sequence & 1) == 0) {
+	    result = find_unlocked(store, key, keyLength, hash, sequence,
+		    &found, &at);
+	    if (result >= 0 && __atomic_load_n(&(store->sequence),
+		    __ATOMIC_ACQUIRE) == sequence) {
+	        break;
+	    }
+	}
+
+	// Waiting outside the epoch keeps a reader racing with writers from
+	// holding up what they retire
+	epoch_exit();
+	if (attempts % STRINGSTORE_SPIN_LIMIT == 0) {
+	    sched_yield();
+	}
+    }
+
+    // An entry is never changed once published, so its expiry can be read
+    // now the bucket is known to be consistent
+    const char* value = NULL;
+    *pin = NULL;
+    if (result == 1 && found.state == SLOT_HEAP 
+	    && slot_expired(&found)) {
+	result = 0;
+    }
+
+    // The buckets are only retired after this epoch, so the bit can still be
+    // set even if the key has since moved
+    if (result == 1) {
+        slot_touch(at);
+    }
+    if (result == 1 && found.state == SLOT_INLINE) {
+        *valueLength = found.valueLength;
+	memcpy(copy, slot_value(&found), found.valueLength + 1);
+	value = copy;
+    } else if (result == 1) {
+        // The ref is taken inside the epoch, so the entry cannot be freed
+	// before reclaim() sees it
+        *pin = found.contents.entry;
+	__atomic_add_fetch(&((*pin)->refs), 1, __ATOMIC_RELAXED);
+	*valueLength = (*pin)->valueLength;
+	value = entry_value(*pin);
+    }
+    epoch_exit();
+    return value;
+}
+
+void stringstore_unpin(KeyValue* pin) {
+    __atomic_sub_fetch(&(pin->refs), 1, __ATOMIC_RELEASE);
 }
 
 int stringstore_delete(StringStore* store, const char* key) {
-    for (int i = 0; i < store->numWords; i++) {
-	if (store->words[i]->key == NULL) {
+    write_begin(store);
+    int deleted = delete_hashed(store, key, stringstore_hash(key), 0, 0);
+    write_end(store);
+    return deleted;
+}
+
+int stringstore_expire(StringStore* store, const char* key, unsigned int hash,
+	unsigned int now) {
+    write_begin(store);
+    int expired = delete_hashed(store, key, hash, 1, now);
+    write_end(store);
+    return expired;
+}
+
+unsigned long stringstore_expired(StringStore* store) {
+    return __atomic_load_n(&(store->numExpired), __ATOMIC_RELAXED);
+}
+
+void stringstore_set_limit(StringStore* store, size_t maxBytes) {
+    write_begin(store);
+    store->maxBytes = maxBytes;
+    evict(store, 0);
+    write_end(store);
+}
+
+size_t stringstore_bytes(StringStore* store) {
+    return __atomic_load_n(&(store->numBytes), __ATOMIC_RELAXED);
+}
+
+unsigned long stringstore_evicted(StringStore* store) {
+    return __atomic_load_n(&(store->numEvicted), __ATOMIC_RELAXED);
+}
+
+int stringstore_set_ordered(StringStore* store) {
+    if (store->ordered != NULL) {
+        return 1;
+    }
+    SkipList* ordered = malloc(sizeof(SkipList));
+    if (ordered == NULL || !skiplist_init(ordered)) {
+        free(ordered);
+	return 0;
+    }
+
+    // Keys that have expired are indexed too, they are unindexed along with
+    // the rest once removed
+    StringStoreTable* tables[] = {&(store->table), &(store->oldTable)};
+    for (int t = 0; t < 2; t++) {
+        for (unsigned int i = 0; i < tables[t]->capacity; i++) {
+	    StringStoreSlot* slot = &(tables[t]->slots[i]);
+	    if (slot_live(slot) 
+		    && !skiplist_insert(ordered, slot_key(slot), slot->hash)) {
+		skiplist_destroy(ordered);
+		free(ordered);
+		return 0;
+	    }
+	}
+    }
+    store->ordered = ordered;
+    return 1;
+}
+
+size_t stringstore_scan(StringStore* store, const char* from, int inclusive,
+	StringStoreItem* items, size_t count) {
+    if (store->ordered == NULL) {
+        return 0;
+    }
+    size_t found = 0;
+    for (SkipNode* node = skiplist_seek(store->ordered, from, inclusive);
+	    node != NULL && found < count; node = skiplist_next(node)) {
+	const char* key = skiplist_key(node);
+	StringStoreSlot* slot = find_slot(store, key, node->hash);
+	if (slot == NULL) {
 	    continue;
 	}
-        if (strcmp(store->words[i]->key, key) == 0) {
-            free(store->words[i]->key);
-            free(store->words[i]->value);
-            store->words[i]->key = NULL;
-            store->words[i]->value = NULL;
-	    return 1;
+	StringStoreItem* item = &(items[found++]);
+	item->key = key;
+	item->hash = node->hash;
+	item->value = slot_value(slot);
+	item->valueLength = slot_value_length(slot);
+	item->expiry = slot_expiry(slot);
+	item->result = 1;
+    }
+    return found;
+}
+
+void stringstore_retrieve_many(StringStore* store, StringStoreItem* items,
+	size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        StringStoreSlot* slot = 
+		retrieve_hashed(store, items[i].key, items[i].hash);
+	items[i].value = slot != NULL ? slot_value(slot) : NULL;
+	items[i].valueLength = slot != NULL ? slot_value_length(slot) : 0;
+	items[i].expiry = slot != NULL ? slot_expiry(slot) : 0;
+	items[i].result = slot != NULL;
+    }
+}
+
+size_t stringstore_add_many(StringStore* store, StringStoreItem* items,
+	size_t count) {
+    size_t added = 0;
+    write_begin(store);
+    reserve(store, count);
+    for (size_t i = 0; i < count; i++) {
+	items[i].result = add_hashed(store, items[i].key, items[i].hash,
+		items[i].value, items[i].valueLength, items[i].expiry);
+	added += items[i].result;
+    }
+    write_end(store);
+    return added;
+}
+
+size_t stringstore_delete_many(StringStore* store, StringStoreItem* items,
+	size_t count) {
+    size_t deleted = 0;
+    write_begin(store);
+    for (size_t i = 0; i < count; i++) {
+	items[i].result = 
+		delete_hashed(store, items[i].key, items[i].hash, 0, 0);
+	deleted += items[i].result;
+    }
+    write_end(store);
+    return deleted;
+}
+
+void stringstore_for_each(StringStore* store, StringStoreVisitor visit,
+	void* arg) {
+    StringStoreTable* tables[] = {&(store->table), &(store->oldTable)};
+    for (int t = 0; t < 2; t++) {
+        for (unsigned int i = 0; i < tables[t]->capacity; i++) {
+	    StringStoreSlot* slot = &(tables[t]->slots[i]);
+	    if (slot_live(slot) && !slot_expired(slot)) {
+	        visit(arg, slot_key(slot), slot->hash, slot_value(slot),
+			slot_value_length(slot), slot_expiry(slot));
+	    }
 	}
     }
-    return 0;
 }
 
+void stringstore_memory(StringStore* store, SlabStats* stats) {
+    slab_stats(&(store->slab), stats);
+}
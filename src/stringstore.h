@@ -2,24 +2,135 @@
 #define STRINGSTORE_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include "slab.h"
+#include "skiplist.h"
 
 //////////
 // STRUCTS
 //////////
 
-/* Storage of keys and values */
+/* Storage of keys and values. The key and value are stored inline after 
+ * the lengths, each followed by a null terminator, in one block allocated 
+ * from the store's slab. An entry is never changed once it is in the index,
+ * a new value gets a new entry. refs are only updated atomically. expiry is
+ * the time the key expires in seconds since the Epoch, 0 if it never does */
 typedef struct {
-    char* key;
-    char* value;
+    unsigned int keyLength;
+    unsigned int valueLength;
+    unsigned int refs;
+    unsigned int expiry;
+    char data[];
 } KeyValue;
 
-/* Stringstore holding list of keyvalues and the number of words */
+/* Size of a bucket in the hash index, one cache line */
+#define STRINGSTORE_SLOT_SIZE 64
+
+/* Number of bytes in a bucket for a key and value stored inline, including
+ * their null terminators */
+#define STRINGSTORE_INLINE_SIZE 56
+
+/* What a bucket in the hash index holds */
+typedef enum {
+    SLOT_EMPTY = 0,
+    SLOT_TOMBSTONE,     // a deleted entry, probes continue past it
+    SLOT_INLINE,        // a key and value stored in the bucket itself
+    SLOT_HEAP           // a KeyValue too large to fit in the bucket
+} StringStoreSlotState;
+
+/* A bucket in the hash index, one cache line long. The full hash of the key
+ * is stored so probes only compare keys when the hashes match. A key and 
+ * value that fit in STRINGSTORE_INLINE_SIZE bytes are stored one after the
+ * other in contents.data, with their lengths in keyLength and valueLength,
+ * so finding them touches no other memory. Larger ones, and keys that
+ * expire, are held in contents.entry. referenced is set whenever the key is
+ * retrieved and cleared as the eviction clock passes it. Readers set it 
+ * atomically without the lock, so it may occasionally be lost */
+typedef struct {
+    unsigned int hash;
+    unsigned char state;
+    unsigned char keyLength;
+    unsigned char valueLength;
+    unsigned char referenced;
+    union {
+        KeyValue* entry;
+	char data[STRINGSTORE_INLINE_SIZE];
+    } contents;
+} __attribute__((aligned(STRINGSTORE_SLOT_SIZE))) StringStoreSlot;
+
+/* Open addressing hash table with linear probing. capacity is a power of 2 */
+typedef struct {
+    StringStoreSlot* slots;
+    unsigned int capacity;
+    unsigned int used;
+    unsigned int tombstones;
+} StringStoreTable;
+
+/* An entry or a table's buckets removed from the index, along with the epoch
+ * it was removed in. Exactly one of entry and slots is set */
+typedef struct {
+    KeyValue* entry;
+    StringStoreSlot* slots;
+    unsigned long long epoch;
+} StringStoreRetired;
+
+/* Stringstore holding a hash index of keyvalues and the number of words.
+ * While resizing the entries of oldTable are moved into table a few buckets
+ * at a time, starting at migrateIndex. The entries are allocated from 
+ * slab. sequence is odd while the store is being changed, so readers that 
+ * take no lock can tell what they read was consistent. Entries and buckets 
+ * removed from the index are kept in retired until no reader can hold them,
+ * and are next looked at once there are reclaimAt of them. numExpired counts
+ * the keys removed because they expired.
+ *
+ * numBytes is the memory held by the keys of the store, counting a bucket
+ * for each key plus the block of any entry. Once maxBytes is set, keys are 
+ * evicted to keep numBytes within it, choosing with the CLOCK algorithm: 
+ * clockHand sweeps the buckets of the table, evicting keys not referenced 
+ * since it last passed and clearing the bit of those that were. numEvicted
+* counts them. numExpired, numBytes and numEvicted are only updated 
+ * atomically.
+ *
+ * ordered holds every key of the store in order as well, NULL unless the
+ * store has been asked to keep one. Its memory is not counted in numBytes */
 typedef struct {
-    KeyValue** words;
+    StringStoreTable table;
+    StringStoreTable oldTable;
+    unsigned int migrateIndex;
     int numWords;
-    int bufferSize;
+    unsigned int sequence;
+    Slab slab;
+    StringStoreRetired* retired;
+    size_t numRetired;
+    size_t retiredCapacity;
+    size_t reclaimAt;
+    unsigned long numExpired;
+    size_t numBytes;
+    size_t maxBytes;
+    unsigned int clockHand;
+    unsigned long numEvicted;
+    SkipList* ordered;
 } StringStore;
 
+/* A key in a batch operation, along with the hash stringstore_hash() gives
+ * it. The value is valueLength bytes long and need not be null terminated. 
+ * expiry is when an added key expires, 0 if it never does, and is set to 
+ * that of a key retrieved. result is set by the batch functions */
+typedef struct {
+    const char* key;
+    unsigned int hash;
+    const char* value;
+    size_t valueLength;
+    unsigned int expiry;
+    int result;
+} StringStoreItem;
+
+/* Called with each key and value by stringstore_for_each(), along with when
+ * the key expires (0 if it never does) */
+typedef void (*StringStoreVisitor)(void* arg, const char* key, 
+	unsigned int hash, const char* value, size_t valueLength,
+	unsigned int expiry);
+
 ////////////
 // FUNCTIONS
 ////////////
@@ -39,13 +150,155 @@ StringStore* stringstore_free(StringStore* store);
 int stringstore_add(StringStore* store, const char* key, const char* value);
 
 /**
- * Retreives a value from a stringstore.
+ * Adds a key value to a stringstore, where the value is the first valueLength
+ * bytes of value and need not be null terminated.
+*/
+int stringstore_add_sized(StringStore* store, const char* key, 
+	const char* value, size_t valueLength);
+
+/**
+ * Adds a key value to a stringstore as for stringstore_add_sized(), which 
+ * expires at the given time in seconds since the Epoch. An expiry of 0 means
+ * the key never expires.
+*/
+int stringstore_add_expiring(StringStore* store, const char* key, 
+	const char* value, size_t valueLength, unsigned int expiry);
+
+/**
+ * Retreives a value from a stringstore. Short values are stored in the 
+ * store's index, so the value is only valid until the store is next changed.
 */
 const char* stringstore_retrieve(StringStore* store, const char* key);
 
+/**
+ * Retrieves a value from a stringstore, pinning it if it is held in an entry
+ * of its own. *pin is set to the entry pinned, whose value stays valid and
+ * unchanged until it is passed to stringstore_unpin(), even if the key is 
+ * changed or deleted meanwhile. *pin is set to NULL if the value is stored 
+ * in the index, in which case it must be copied before the store is next 
+ * changed. Sets *valueLength to the length of the value.
+*/
+const char* stringstore_retrieve_pinned(StringStore* store, const char* key,
+	size_t* valueLength, KeyValue** pin);
+
+/**
+ * Retrieves a value from a stringstore without any lock, while other threads
+ * may be changing it, provided they are kept from changing it at the same 
+ * time as each other. Never blocks writers. A value stored in the index is 
+ * copied to copy, which must hold STRINGSTORE_INLINE_SIZE bytes, and *pin is
+ * set to NULL. Otherwise the value's entry is pinned as by 
+ * stringstore_retrieve_pinned(). Sets *valueLength to the length of the 
+ * value.
+*/
+const char* stringstore_retrieve_unlocked(StringStore* store, 
+	const char* key, char* copy, size_t* valueLength, KeyValue** pin);
+
+/**
+ * Releases a value pinned by stringstore_retrieve_pinned() or 
+ * stringstore_retrieve_unlocked(). Needs no lock, the store frees a replaced
+ * entry on a later change once it is unpinned.
+*/
+void stringstore_unpin(KeyValue* pin);
+
 /**
  * Removes a key:value from a stringstore.
 */
 int stringstore_delete(StringStore* store, const char* key);
 
-#endif
\ No newline at end of file
+/**
+ * Removes a key whose hash is already known if it has expired by now, in 
+ * seconds since the Epoch. Keys that have expired are never retrieved, and 
+ * are removed once they are next changed or passed here. Returns 1 if the 
+ * key was removed.
+*/
+int stringstore_expire(StringStore* store, const char* key, unsigned int hash,
+	unsigned int now);
+
+/**
+ * Returns the number of keys removed from a stringstore because they 
+ * expired. Needs no lock.
+*/
+unsigned long stringstore_expired(StringStore* store);
+
+/**
+ * Sets the most memory the keys of a stringstore may hold, as counted by
+ * stringstore_bytes(), evicting the least recently used keys as needed to
+ * stay within it. Adding a key that could never fit fails. 0 means no limit.
+*/
+void stringstore_set_limit(StringStore* store, size_t maxBytes);
+
+/**
+ * Returns the memory held by the keys of a stringstore, a bucket for each key
+ * plus the size of any entry allocated for it. Needs no lock.
+*/
+size_t stringstore_bytes(StringStore* store);
+
+/**
+ * Returns the number of keys evicted from a stringstore to keep it within 
+ * its limit. Needs no lock.
+*/
+unsigned long stringstore_evicted(StringStore* store);
+
+/**
+ * Keeps the keys of a stringstore in order as well as hashed, so they can be 
+ * walked with stringstore_scan(). Returns 0 if memory cannot be allocated.
+*/
+int stringstore_set_ordered(StringStore* store);
+
+/**
+ * Retrieves up to count keys of an ordered stringstore in ascending strcmp()
+ * order, starting at the first key not less than from, or greater than from
+ * if inclusive is 0. A NULL from starts at the first key. Keys that have
+ * expired are skipped, and keys scanned are not marked as used for eviction.
+ * Each item's key, hash, value, valueLength and expiry are set, and are only
+ * valid until the store is next changed. Returns the number of items set, 0
+ * if the store keeps no order.
+*/
+size_t stringstore_scan(StringStore* store, const char* from, int inclusive,
+	StringStoreItem* items, size_t count);
+
+/**
+ * Returns the hash a stringstore uses to index the given key. The bucket is
+ * taken from the low bits, so callers partitioning keys between several
+ * stores should use the high bits.
+*/
+unsigned int stringstore_hash(const char* key);
+
+/**
+ * Retrieves the values of many keys. Each item's value is set to the value 
+ * stored (NULL if the key is missing) along with its length, and result is 
+ * set to 1 if the key was found and 0 otherwise.
+*/
+void stringstore_retrieve_many(StringStore* store, StringStoreItem* items,
+	size_t count);
+
+/**
+ * Adds many key values to a stringstore, growing it once up front. Each 
+ * item's result is set to 1 if it was added and 0 otherwise. Returns the 
+ * number of items added.
+*/
+size_t stringstore_add_many(StringStore* store, StringStoreItem* items,
+	size_t count);
+
+/**
+ * Removes many keys from a stringstore. Each item's result is set to 1 if the
+ * key was removed and 0 if it was not found. Returns the number of keys 
+ * removed.
+*/
+size_t stringstore_delete_many(StringStore* store, StringStoreItem* items,
+	size_t count);
+
+/**
+ * Calls visit with every key and value in a stringstore that has not 
+ * expired, in no particular order. The store must not be changed until it
+ * returns.
+*/
+void stringstore_for_each(StringStore* store, StringStoreVisitor visit,
+	void* arg);
+
+/**
+ * Adds the memory used by the entries of a stringstore to a running total.
+*/
+void stringstore_memory(StringStore* store, SlabStats* stats);
+
+#endif
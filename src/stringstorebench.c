@@ -0,0 +1,298 @@
+/*
+** stringstorebench.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+**
+** Usage:
+**      stringstorebench [--max-keys n] [--value-size bytes]
+** Measures the operations of a StringStore on their own, linked against
+** libstringstore.so, with no network or server in the way.
+** Stores of 1000 keys and every power of ten up to --max-keys (1000000 by
+** default, at most 100000000) are measured in turn. For each, the time,
+** memory allocations and cache misses of every insert, overwrite, lookup of a
+** key present (hit) and absent (miss), delete, and insert into a deleted
+** bucket (reuse) are printed per operation. Values are --value-size bytes
+** (8 by default), so the default keys and values are held in the buckets of
+** the store.
+** Allocations are counted by replacing malloc() and the functions like it
+** with versions that count their calls before handing them to the C library.
+** Cache misses are read from perf_event_open(), and are shown as "-" where
+** the kernel does not allow it.
+*/
+
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "stringstorebench.h"
+
+/* Error messages */
+#define USAGE_ERROR_MSG "Usage: stringstorebench [--max-keys n] " \
+	"[--value-size bytes]\n"
+#define STORE_FAILED_ERROR "stringstorebench: %s of %lu keys gave an " \
+	"unexpected result\n"
+
+/* Base 10 used for calls to strtol */
+#define BASE_10 10
+
+/* Smallest store measured, and the default and largest sizes allowed */
+#define MIN_KEYS 1000
+#define DEFAULT_MAX_KEYS 1000000
+#define MAX_KEYS 100000000
+
+/* Default and maximum value sizes */
+#define DEFAULT_VALUE_SIZE 8
+#define MAX_VALUE_SIZE (1024 * 1024)
+
+/* Factor between the store sizes measured */
+#define SIZE_STEP 10
+
+/* Byte every value is filled with */
+#define VALUE_FILL 'v'
+
+/* First character of every key, followed by its number in hexadecimal */
+#define KEY_PREFIX 'k'
+#define KEY_BUFFER_SIZE 24
+
+/* Number of nanoseconds in a second */
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+/* Results table */
+#define TABLE_HEADER "%-10s %-10s %10s %10s %10s\n"
+#define TABLE_ROW "%-10lu %-10s %10.1f %10.3f "
+#define TABLE_MISSES "%10.2f\n"
+#define TABLE_NO_MISSES "%10s\n"
+
+/* The options stringstorebench accepts, as returned by getopt_long() */
+enum {
+    OPTION_MAX_KEYS = 1,
+    OPTION_VALUE_SIZE
+};
+
+/* Options accepted */
+static const struct option longOptions[] = {
+    {"max-keys", required_argument, NULL, OPTION_MAX_KEYS},
+    {"value-size", required_argument, NULL, OPTION_VALUE_SIZE},
+    {NULL, 0, NULL, 0}
+};
+
+/* Names the operations are given in the table, indexed by StoreOperation */
+static const char* const operationNames[] = {"insert", "overwrite", "hit",
+	"miss", "delete", "reuse"};
+
+/* The allocation functions of the C library, which the replacements below
+ * hand every call on to */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* block, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+/* Number of memory allocations made by the program so far. The benchmark
+ * has a single thread, so it needs no synchronisation */
+static unsigned long numAllocations = 0;
+
+void* malloc(size_t size) {
+    numAllocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    numAllocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* block, size_t size) {
+    numAllocations++;
+    return __libc_realloc(block, size);
+}
+
+int posix_memalign(void** block, size_t alignment, size_t size) {
+    numAllocations++;
+    void* memory = __libc_memalign(alignment, size);
+    if (memory == NULL) {
+        return ENOMEM;
+    }
+    *block = memory;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    StoreBenchArguments benchArgs = process_command_line(argc, argv);
+
+    char* value = malloc(benchArgs.valueSize + 1);
+    memset(value, VALUE_FILL, benchArgs.valueSize);
+    value[benchArgs.valueSize] = '\0';
+    int cacheCounter = open_cache_counter();
+
+    // Every size gets a new store, so each starts from an empty table
+    printf(TABLE_HEADER, "Keys", "Operation", "ns/op", "allocs/op",
+	    "misses/op");
+    for (unsigned long numKeys = MIN_KEYS; numKeys <= benchArgs.maxKeys;
+	    numKeys *= SIZE_STEP) {
+        StringStore* store = stringstore_init();
+	for (int op = 0; op < STORE_OPERATIONS; op++) {
+	    StoreBenchResult result;
+	    if (!run_operation(store, op, numKeys, value, cacheCounter,
+		    &result)) {
+	        fprintf(stderr, STORE_FAILED_ERROR, operationNames[op],
+			numKeys);
+		exit(STORE_ERROR);
+	    }
+	    print_result(numKeys, op, &result);
+	}
+	stringstore_free(store);
+	fflush(stdout);
+    }
+
+    if (cacheCounter >= 0) {
+        close(cacheCounter);
+    }
+    free(value);
+    return OK;
+}
+
+/* Parses an integer option value between min and max inclusive. Exits with
+ * a usage error if the value is invalid */
+static long parse_option_count(const char* value, long min, long max) {
+    char* endOfInt;
+    long count = strtol(value, &endOfInt, BASE_10);
+    if (*value == '\0' || *endOfInt != '\0' || count < min || count > max) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    return count;
+}
+
+StoreBenchArguments process_command_line(int argc, char** argv) {
+    StoreBenchArguments benchArgs;
+    benchArgs.maxKeys = DEFAULT_MAX_KEYS;
+    benchArgs.valueSize = DEFAULT_VALUE_SIZE;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (option) {
+	    case OPTION_MAX_KEYS:
+	        benchArgs.maxKeys =
+			parse_option_count(optarg, MIN_KEYS, MAX_KEYS);
+		break;
+	    case OPTION_VALUE_SIZE:
+	        benchArgs.valueSize =
+			parse_option_count(optarg, 0, MAX_VALUE_SIZE);
+		break;
+	    default:
+	        fprintf(stderr, USAGE_ERROR_MSG);
+		exit(USAGE_ERROR);
+	}
+    }
+    if (optind != argc) {
+	fprintf(stderr, USAGE_ERROR_MSG);
+        exit(USAGE_ERROR);
+    }
+    return benchArgs;
+}
+
+int open_cache_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Reads the monotonic clock in nanoseconds */
+static unsigned long long now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (unsigned long long)time.tv_sec * NANOSECONDS_PER_SECOND
+	    + time.tv_nsec;
+}
+
+/* Writes the key numbered number into buffer, which must hold
+ * KEY_BUFFER_SIZE bytes. Much cheaper than sprintf(), so it adds little to
+ * the time measured */
+static void format_key(char* buffer, unsigned long number) {
+    static const char digits[] = "0123456789abcdef";
+    char reversed[KEY_BUFFER_SIZE];
+    int length = 0;
+    do {
+        reversed[length++] = digits[number & 0xf];
+	number >>= 4;
+    } while (number != 0);
+    *buffer++ = KEY_PREFIX;
+    while (length > 0) {
+        *buffer++ = reversed[--length];
+    }
+    *buffer = '\0';
+}
+
+bool run_operation(StringStore* store, StoreOperation op,
+	unsigned long numKeys, const char* value, int cacheCounter,
+	StoreBenchResult* result) {
+    // Hits, overwrites and deletes use the keys inserted, misses the ones
+    // after them and reuse the ones after those
+    unsigned long first = op == STORE_MISS ? numKeys
+	    : op == STORE_REUSE ? 2 * numKeys : 0;
+    char key[KEY_BUFFER_SIZE];
+    unsigned long failures = 0;
+
+    if (cacheCounter >= 0) {
+        ioctl(cacheCounter, PERF_EVENT_IOC_RESET, 0);
+	ioctl(cacheCounter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    unsigned long allocationsBefore = numAllocations;
+    unsigned long long start = now();
+    for (unsigned long i = first; i < first + numKeys; i++) {
+        format_key(key, i);
+	switch (op) {
+	    case STORE_INSERT:
+	    case STORE_OVERWRITE:
+	    case STORE_REUSE:
+	        failures += stringstore_add(store, key, value) != 1;
+		break;
+	    case STORE_HIT:
+	        failures += stringstore_retrieve(store, key) == NULL;
+		break;
+	    case STORE_MISS:
+	        failures += stringstore_retrieve(store, key) != NULL;
+		break;
+	    default:
+	        failures += stringstore_delete(store, key) != 1;
+		break;
+	}
+    }
+    unsigned long long elapsed = now() - start;
+    unsigned long allocations = numAllocations - allocationsBefore;
+    uint64_t misses = 0;
+    bool counted = false;
+    if (cacheCounter >= 0) {
+        ioctl(cacheCounter, PERF_EVENT_IOC_DISABLE, 0);
+	counted = read(cacheCounter, &misses, sizeof(misses))
+		== sizeof(misses);
+    }
+
+    result->nsPerOp = (double)elapsed / numKeys;
+    result->allocationsPerOp = (double)allocations / numKeys;
+    result->missesPerOp = counted ? (double)misses / numKeys : -1;
+    return failures == 0;
+}
+
+void print_result(unsigned long numKeys, StoreOperation op,
+	StoreBenchResult* result) {
+    printf(TABLE_ROW, numKeys, operationNames[op], result->nsPerOp,
+	    result->allocationsPerOp);
+    if (result->missesPerOp >= 0) {
+        printf(TABLE_MISSES, result->missesPerOp);
+    } else {
+        printf(TABLE_NO_MISSES, "-");
+    }
+}
@@ -0,0 +1,113 @@
+/*
+** stringstorebench.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef STRINGSTOREBENCH_H
+#define STRINGSTOREBENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "stringstore.h"
+
+/* The operations measured at each store size, in the order they are run */
+typedef enum {
+    STORE_INSERT = 0,       // add keys not in the store
+    STORE_OVERWRITE = 1,    // add keys already in the store
+    STORE_HIT = 2,          // retrieve keys in the store
+    STORE_MISS = 3,         // retrieve keys not in the store
+    STORE_DELETE = 4,       // delete every key
+    STORE_REUSE = 5,        // add new keys into the buckets just deleted
+    STORE_OPERATIONS = 6
+} StoreOperation;
+
+/* Arguments passed into stringstorebench. Stores of 1000 keys and every
+ * power of ten up to maxKeys are measured */
+typedef struct {
+    unsigned long maxKeys;
+    unsigned int valueSize;
+} StoreBenchArguments;
+
+/* The cost of one operation at one store size. missesPerOp is negative if
+ * cache misses could not be counted */
+typedef struct {
+    double nsPerOp;
+    double allocationsPerOp;
+    double missesPerOp;
+} StoreBenchResult;
+
+/* Different types of exit statuses */
+typedef enum {
+    OK = 0,
+    USAGE_ERROR = 1,
+    STORE_ERROR = 2
+} ErrorType;
+
+/* process_command_line()
+* −−−−−−−−−−−−−−−
+* Validates the command line arguments given to stringstorebench.
+*
+* The expected structure of the command line arguments is:
+*
+*     ./stringstorebench [--max-keys n] [--value-size bytes]
+*
+* argc: the number of command line arguments given.
+* argv: array containing the command line arguments.
+*
+* Returns: StoreBenchArguments struct containing the values extracted from
+* the command line arguments, with defaults for the options not given.
+* Errors: if an option is invalid or --max-keys is below 1000
+* USAGE_ERROR_MSG is printed and the program exits with status 1.
+*/
+StoreBenchArguments process_command_line(int argc, char** argv);
+
+/* open_cache_counter()
+* −−−−−−−−−−−−−−−
+* Opens a hardware counter of the cache misses of this thread in user space
+* with perf_event_open(). The counter starts disabled.
+*
+* Returns: the file descriptor of the counter, or -1 if the kernel or the
+* processor does not provide one, or perf events are not permitted
+*/
+int open_cache_counter(void);
+
+/* run_operation()
+* −−−−−−−−−−−−−−−
+* Runs one operation on numKeys keys of a store, timing it and counting the
+* memory allocations and cache misses it causes.
+*
+* The keys inserted are numbered from 0 to numKeys - 1. Misses look up the
+* next numKeys keys, which are never added, and reuse adds those after
+* them.
+*
+* store: the store to run the operation on. Not NULL
+* op: the operation to run
+* numKeys: the number of keys in the store
+* value: the null terminated value added by the operations that add keys.
+* Not NULL
+* cacheCounter: the counter from open_cache_counter(), or -1 if there is none
+* result: set to the cost of each operation. Not NULL
+*
+* Returns: true if every operation had the expected result, false otherwise
+*/
+bool run_operation(StringStore* store, StoreOperation op,
+	unsigned long numKeys, const char* value, int cacheCounter,
+	StoreBenchResult* result);
+
+/* print_result()
+* −−−−−−−−−−−−−−−
+* Prints a row of the results table.
+*
+* numKeys: the number of keys in the store
+* op: the operation measured
+* result: the cost of each operation. Not NULL
+*/
+void print_result(unsigned long numKeys, StoreOperation op,
+	StoreBenchResult* result);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+** threadpool.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "threadpool.h"
+
+/* Adds a task to the back of a worker's queue, counting it as pending before
+ * any worker can take it. Returns false if the queue is full */
+static bool push_task(ThreadPoolWorker* worker, void* task) {
+    ThreadPool* pool = worker->pool;
+    pthread_mutex_lock(&(worker->lock));
+    bool pushed = worker->count < pool->capacity;
+    if (pushed) {
+        worker->tasks[(worker->head + worker->count) % pool->capacity] = task;
+	worker->count++;
+	__atomic_fetch_add(&(pool->pending), 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&(worker->lock));
+    return pushed;
+}
+
+/* Takes a task from the front of a worker's queue, or from the back if
+ * another worker is stealing it. Returns NULL if the queue is empty */
+static void* take_task(ThreadPoolWorker* worker, bool steal) {
+    ThreadPool* pool = worker->pool;
+    void* task = NULL;
+    pthread_mutex_lock(&(worker->lock));
+    if (worker->count > 0) {
+        worker->count--;
+	if (steal) {
+	    task = worker->tasks[(worker->head + worker->count)
+		    % pool->capacity];
+	} else {
+	    task = worker->tasks[worker->head];
+	    worker->head = (worker->head + 1) % pool->capacity;
+	}
+	__atomic_fetch_sub(&(pool->pending), 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&(worker->lock));
+
+    // The room made is counted before looking for a submitter waiting for
+    // it, so one about to wait sees it and carries on instead
+    if (task != NULL
+	    && __atomic_load_n(&(pool->numBlocked), __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&(pool->roomLock));
+	pthread_cond_signal(&(pool->roomFreed));
+	pthread_mutex_unlock(&(pool->roomLock));
+    }
+    return task;
+}
+
+/* Takes the next task for a worker to run, from its own queue if it has any
+ * and otherwise from the others in turn. Returns NULL if none were found */
+static void* next_task(ThreadPoolWorker* worker) {
+    ThreadPool* pool = worker->pool;
+    void* task = take_task(worker, false);
+    for (unsigned int i = 1; task == NULL && i < pool->numWorkers; i++) {
+        task = take_task(&(pool->workers[(worker->index + i)
+		% pool->numWorkers]), true);
+	if (task != NULL) {
+	    __atomic_fetch_add(&(worker->stolen), 1, __ATOMIC_RELAXED);
+	}
+    }
+    return task;
+}
+
+/* Wakes a waiting worker to run a task queued on target, target itself if it
+ * is waiting and otherwise the first waiting worker after it */
+static void wake_worker(ThreadPool* pool, ThreadPoolWorker* target) {
+    pthread_mutex_lock(&(pool->sleepLock));
+    ThreadPoolWorker* sleeper = NULL;
+    for (unsigned int i = 0; i < pool->numWorkers && pool->numSleeping > 0;
+	    i++) {
+	ThreadPoolWorker* worker =
+		&(pool->workers[(target->index + i) % pool->numWorkers]);
+	if (worker->sleeping) {
+	    sleeper = worker;
+	    break;
+	}
+    }
+
+    // The flag is cleared here rather than by the worker, so a second task
+    // submitted before it runs wakes someone else
+    if (sleeper != NULL) {
+        sleeper->sleeping = false;
+	pool->numSleeping--;
+	pthread_cond_signal(&(sleeper->wake));
+    }
+    pthread_mutex_unlock(&(pool->sleepLock));
+}
+
+/* Waits until a worker takes a task, making room in a pool whose queues
+ * were all found full */
+static void wait_for_room(ThreadPool* pool) {
+    size_t total = pool->numWorkers * pool->capacity;
+    pthread_mutex_lock(&(pool->roomLock));
+    __atomic_fetch_add(&(pool->numBlocked), 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&(pool->pending), __ATOMIC_SEQ_CST) >= total) {
+        pthread_cond_wait(&(pool->roomFreed), &(pool->roomLock));
+    }
+    __atomic_fetch_sub(&(pool->numBlocked), 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&(pool->roomLock));
+}
+
+ThreadPool* threadpool_create(unsigned int numWorkers, size_t capacity,
+	ThreadPoolTask run, void* arg) {
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    void* workers;
+    if (posix_memalign(&workers, THREADPOOL_CACHE_LINE_SIZE,
+	    numWorkers * sizeof(ThreadPoolWorker)) != 0) {
+        free(pool);
+	return NULL;
+    }
+    pool->workers = workers;
+    pool->numWorkers = numWorkers;
+    pool->capacity = capacity;
+    pool->run = run;
+    pool->arg = arg;
+    pthread_mutex_init(&(pool->sleepLock), NULL);
+    pthread_mutex_init(&(pool->roomLock), NULL);
+    pthread_cond_init(&(pool->roomFreed), NULL);
+
+    // Every queue is allocated before any worker starts looking at them
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        ThreadPoolWorker* worker = &(pool->workers[i]);
+	memset(worker, 0, sizeof(ThreadPoolWorker));
+	worker->tasks = malloc(capacity * sizeof(void*));
+	if (worker->tasks == NULL) {
+	    while (i-- > 0) {
+	        free(pool->workers[i].tasks);
+	    }
+	    free(pool->workers);
+	    free(pool);
+	    return NULL;
+	}
+	pthread_mutex_init(&(worker->lock), NULL);
+	pthread_cond_init(&(worker->wake), NULL);
+	worker->pool = pool;
+	worker->index = i;
+    }
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        pthread_t threadId;
+	pthread_create(&threadId, NULL, threadpool_worker,
+		&(pool->workers[i]));
+	pthread_detach(threadId);
+    }
+    return pool;
+}
+
+void threadpool_submit(ThreadPool* pool, void* task, unsigned int worker) {
+    ThreadPoolWorker* target = NULL;
+    bool waited = false;
+    while (target == NULL) {
+        for (unsigned int i = 0; i < pool->numWorkers; i++) {
+	    ThreadPoolWorker* next =
+		    &(pool->workers[(worker + i) % pool->numWorkers]);
+	    if (push_task(next, task)) {
+	        target = next;
+		break;
+	    }
+	}
+	if (target == NULL) {
+	    if (!waited) {
+	        __atomic_fetch_add(&(pool->numFull), 1, __ATOMIC_RELAXED);
+		waited = true;
+	    }
+	    wait_for_room(pool);
+	}
+    }
+    __atomic_fetch_add(&(pool->submitted), 1, __ATOMIC_RELAXED);
+
+    // The task was counted before looking for a worker to wake, so a worker
+    // about to wait sees it and carries on instead
+    wake_worker(pool, target);
+}
+
+void threadpool_stats(ThreadPool* pool, ThreadPoolStats* stats) {
+    memset(stats, 0, sizeof(ThreadPoolStats));
+    stats->workers = pool->numWorkers;
+    stats->queued = __atomic_load_n(&(pool->pending), __ATOMIC_RELAXED);
+    stats->submitted = __atomic_load_n(&(pool->submitted), __ATOMIC_RELAXED);
+    stats->full = __atomic_load_n(&(pool->numFull), __ATOMIC_RELAXED);
+    for (unsigned int i = 0; i < pool->numWorkers; i++) {
+        ThreadPoolWorker* worker = &(pool->workers[i]);
+	stats->executed += __atomic_load_n(&(worker->executed),
+		__ATOMIC_RELAXED);
+	stats->stolen += __atomic_load_n(&(worker->stolen), __ATOMIC_RELAXED);
+    }
+}
+
+void* threadpool_worker(void* arg) {
+    ThreadPoolWorker* worker = (ThreadPoolWorker*)arg;
+    ThreadPool* pool = worker->pool;
+
+    while (true) {
+        void* task = next_task(worker);
+	if (task != NULL) {
+	    pool->run(pool->arg, worker->index, task);
+	    __atomic_fetch_add(&(worker->executed), 1, __ATOMIC_RELAXED);
+	    continue;
+	}
+
+	// Wait until a task is submitted. Tasks counted as pending but taken
+	// by another worker first leave this one looking again
+	pthread_mutex_lock(&(pool->sleepLock));
+	while (__atomic_load_n(&(pool->pending), __ATOMIC_SEQ_CST) == 0) {
+	    worker->sleeping = true;
+	    pool->numSleeping++;
+	    while (worker->sleeping) {
+	        pthread_cond_wait(&(worker->wake), &(pool->sleepLock));
+	    }
+	}
+	pthread_mutex_unlock(&(pool->sleepLock));
+    }
+    return NULL;
+}
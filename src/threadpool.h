@@ -0,0 +1,129 @@
+/*
+** threadpool.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of a cache line, so each worker's queue sits on its own */
+#define THREADPOOL_CACHE_LINE_SIZE 64
+
+/* Called by a worker to carry out a task. arg is the argument the pool was
+ * created with and worker the index of the worker running the task */
+typedef void (*ThreadPoolTask)(void* arg, unsigned int worker, void* task);
+
+struct ThreadPool;
+
+/* One worker of a pool and its queue of tasks, a bounded double ended queue
+ * guarded by lock. The tasks waiting are tasks[(head + i) % capacity] for i
+ * less than count. The worker takes tasks from the front in the order they
+ * were submitted, and idle workers steal from the back, so the two only
+ * contend when a single task is left. executed and stolen count the tasks
+ * the worker has run and the ones it took from other workers. sleeping is
+ * set while the worker waits on wake for more tasks, and is guarded by the
+ * pool's sleepLock */
+typedef struct {
+    pthread_mutex_t lock;
+    void** tasks;
+    size_t head;
+    size_t count;
+    unsigned long executed;
+    unsigned long stolen;
+    struct ThreadPool* pool;
+    unsigned int index;
+    pthread_cond_t wake;
+    bool sleeping;
+} __attribute__((aligned(THREADPOOL_CACHE_LINE_SIZE))) ThreadPoolWorker;
+
+/* A fixed set of worker threads running tasks, each with a queue holding up
+ * to capacity tasks. pending is the number of tasks queued across every
+ * worker. submitted and numFull count the tasks submitted and the times a
+ * task had to wait for room in every queue. numSleeping is the number of
+ * workers waiting for tasks, guarded by sleepLock. numBlocked is the number
+ * of submitters waiting on roomFreed, with roomLock held around the wait,
+ * for a worker to take a task out of a full pool. The pool runs until the
+ * process exits */
+typedef struct ThreadPool {
+    ThreadPoolWorker* workers;
+    unsigned int numWorkers;
+    size_t capacity;
+    ThreadPoolTask run;
+    void* arg;
+    size_t pending;
+    unsigned long submitted;
+    unsigned long numFull;
+    pthread_mutex_t sleepLock;
+    unsigned int numSleeping;
+    pthread_mutex_t roomLock;
+    pthread_cond_t roomFreed;
+    unsigned int numBlocked;
+} ThreadPool;
+
+/* Counters of a pool summed over its workers */
+typedef struct {
+    unsigned int workers;
+    size_t queued;
+    unsigned long submitted;
+    unsigned long executed;
+    unsigned long stolen;
+    unsigned long full;
+} ThreadPoolStats;
+
+/* threadpool_create()
+* −−−−−−−−−−−−−−−
+* Starts a pool of worker threads, each with a queue of its own.
+*
+* numWorkers: the number of worker threads. Greater than 0
+* capacity: the most tasks each worker's queue holds. Greater than 0
+* run: called by a worker with each task it takes. Not NULL
+* arg: passed to every call of run
+*
+* Returns: the pool created with malloc, NULL if it could not be started
+*/
+ThreadPool* threadpool_create(unsigned int numWorkers, size_t capacity,
+	ThreadPoolTask run, void* arg);
+
+/* threadpool_submit()
+* −−−−−−−−−−−−−−−
+* Queues a task on the given worker, which is woken if it is waiting. If its
+* queue is full the next worker with room is used instead. If every queue is
+* full the caller blocks until a worker takes a task, so callers are held
+* back to the rate the pool can keep up with. A waiting worker is woken to
+* steal the task if the worker it is queued on is busy.
+*
+* pool: the pool to run the task. Not NULL
+* task: passed to the pool's run function
+* worker: the worker the task is best run on, for example the one that last
+* ran related tasks. Taken modulo the number of workers
+*/
+void threadpool_submit(ThreadPool* pool, void* task, unsigned int worker);
+
+/* threadpool_stats()
+* −−−−−−−−−−−−−−−
+* Reads the counters of a pool without stopping it, so they may be slightly
+* out of step with each other.
+*
+* pool: the pool to read. Not NULL
+* stats: set to the counters. Not NULL
+*/
+void threadpool_stats(ThreadPool* pool, ThreadPoolStats* stats);
+
+/* threadpool_worker()
+* −−−−−−−−−−−−−−−
+* Thread function of a worker. Runs the tasks of its own queue, steals from
+* the other workers when it has none, and waits once there are none left
+* anywhere.
+*
+* arg: ThreadPoolWorker struct of the worker cast to a void*. Not NULL
+*/
+void* threadpool_worker(void* arg);
+
+#endif
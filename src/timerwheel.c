@@ -0,0 +1,270 @@
+/*
+** timerwheel.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "timerwheel.h"
+
+/* Number of seconds the whole wheel spans */
+#define TIMERWHEEL_SPAN (1u << (TIMERWHEEL_SLOT_BITS * TIMERWHEEL_LEVELS))
+
+/* Number of entries in the index of the timers once it is first needed */
+#define INDEX_INITIAL_CAPACITY 16
+
+/* FNV-1a constants used to hash keys */
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* Hashes a key */
+static unsigned int hash_key(const char* key) {
+    unsigned int hash = FNV_OFFSET_BASIS;
+    for (; *key != '\0'; key++) {
+        hash ^= (unsigned char)*key;
+	hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Returns the position in the index of the timer of a key, or of the free
+ * entry it would go in. The index must have been allocated */
+static size_t index_position(TimerWheel* wheel, const char* key,
+	unsigned int hash) {
+    size_t mask = wheel->indexCapacity - 1;
+    size_t i = hash & mask;
+    while (wheel->index[i] != NULL && (wheel->index[i]->hash != hash
+	    || strcmp(wheel->index[i]->key, key) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Doubles the size of the index. Returns false if memory cannot be
+ * allocated */
+static bool index_grow(TimerWheel* wheel) {
+    size_t capacity = wheel->indexCapacity == 0 ? INDEX_INITIAL_CAPACITY
+	    : 2 * wheel->indexCapacity;
+    Timer** index = calloc(capacity, sizeof(Timer*));
+    if (index == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < wheel->indexCapacity; i++) {
+        Timer* timer = wheel->index[i];
+	if (timer == NULL) {
+	    continue;
+	}
+	size_t j = timer->hash & (capacity - 1);
+	while (index[j] != NULL) {
+	    j = (j + 1) & (capacity - 1);
+	}
+	index[j] = timer;
+    }
+    free(wheel->index);
+    wheel->index = index;
+    wheel->indexCapacity = capacity;
+    return true;
+}
+
+/* Takes a timer out of the index. Later entries of the same run are moved
+ * back to fill the gap, unless that would put them before their home entry,
+ * so lookups never stop short of them */
+static void index_remove(TimerWheel* wheel, Timer* timer) {
+    size_t mask = wheel->indexCapacity - 1;
+    size_t gap = index_position(wheel, timer->key, timer->hash);
+    wheel->index[gap] = NULL;
+    for (size_t i = (gap + 1) & mask; wheel->index[i] != NULL;
+	    i = (i + 1) & mask) {
+        size_t home = wheel->index[i]->hash & mask;
+	if (((i - home) & mask) >= ((i - gap) & mask)) {
+	    wheel->index[gap] = wheel->index[i];
+	    wheel->index[i] = NULL;
+	    gap = i;
+	}
+    }
+}
+
+/* Takes a timer out of the slot it is in */
+static void unlink_timer(Timer* timer) {
+    *(timer->link) = timer->next;
+    if (timer->next != NULL) {
+        timer->next->link = timer->link;
+    }
+}
+
+/* Returns the slot index of a time at the given level */
+static unsigned int slot_index(unsigned int time, unsigned int level) {
+    return (time >> (TIMERWHEEL_SLOT_BITS * level)) & (TIMERWHEEL_SLOTS - 1);
+}
+
+/* Puts a timer in the slot covering the time it is due. A timer is placed
+ * in the lowest level whose span reaches its time, so the slot is only
+ * reached again by the time it is due. Times already passed are placed at
+ * the current second */
+static void place(TimerWheel* wheel, Timer* timer, unsigned int due) {
+    if ((int)(due - wheel->now) < 0) {
+        due = wheel->now;
+    }
+    unsigned int delta = due - wheel->now;
+    if (delta >= TIMERWHEEL_SPAN) {
+        due = wheel->now + TIMERWHEEL_SPAN - 1;
+	delta = TIMERWHEEL_SPAN - 1;
+    }
+    unsigned int level = 0;
+    while ((delta >> (TIMERWHEEL_SLOT_BITS * (level + 1))) != 0) {
+        level++;
+    }
+    Timer** slot = &(wheel->slots[level][slot_index(due, level)]);
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->link = &(timer->next);
+    }
+    timer->link = slot;
+    *slot = timer;
+}
+
+/* Places a timer for its expiry. The slot for the current second has
+ * already been emptied, so a timer already due goes in the next one */
+static void schedule(TimerWheel* wheel, Timer* timer) {
+    unsigned int due = timer->expiry;
+    if ((int)(due - wheel->now) <= 0) {
+        due = wheel->now + 1;
+    }
+    place(wheel, timer, due);
+}
+
+/* Moves every timer of a list onto the front of another. The links of the
+ * timers moved are left for place() to set again */
+static void take_all(Timer** list, Timer** into) {
+    while (*list != NULL) {
+        Timer* timer = *list;
+	*list = timer->next;
+	timer->next = *into;
+	*into = timer;
+    }
+}
+
+void timerwheel_init(TimerWheel* wheel, unsigned int now) {
+    memset(wheel, 0, sizeof(TimerWheel));
+    wheel->now = now;
+}
+
+void timerwheel_destroy(TimerWheel* wheel) {
+    for (unsigned int level = 0; level < TIMERWHEEL_LEVELS; level++) {
+        for (unsigned int i = 0; i < TIMERWHEEL_SLOTS; i++) {
+	    while (wheel->slots[level][i] != NULL) {
+	        Timer* timer = wheel->slots[level][i];
+		wheel->slots[level][i] = timer->next;
+		free(timer);
+	    }
+	}
+    }
+    wheel->numTimers = 0;
+    free(wheel->index);
+    wheel->index = NULL;
+    wheel->indexCapacity = 0;
+}
+
+bool timerwheel_add(TimerWheel* wheel, const char* key, unsigned int expiry) {
+    // A key given a new expiry keeps its timer, moved to the new time
+    unsigned int hash = hash_key(key);
+    Timer* timer = wheel->index == NULL ? NULL
+	    : wheel->index[index_position(wheel, key, hash)];
+    if (timer != NULL) {
+        unlink_timer(timer);
+	timer->expiry = expiry;
+	schedule(wheel, timer);
+	return true;
+    }
+
+    size_t keyLength = strlen(key);
+    if ((2 * (wheel->numTimers + 1) > wheel->indexCapacity
+	    && !index_grow(wheel))
+	    || (timer = malloc(sizeof(Timer) + keyLength + 1)) == NULL) {
+        return false;
+    }
+    timer->expiry = expiry;
+    timer->hash = hash;
+    memcpy(timer->key, key, keyLength + 1);
+    wheel->index[index_position(wheel, key, hash)] = timer;
+    schedule(wheel, timer);
+    wheel->numTimers++;
+    return true;
+}
+
+void timerwheel_cancel(TimerWheel* wheel, const char* key) {
+    if (wheel->numTimers == 0) {
+        return;
+    }
+    Timer* timer = wheel->index[index_position(wheel, key, hash_key(key))];
+    if (timer != NULL) {
+        unlink_timer(timer);
+	index_remove(wheel, timer);
+	free(timer);
+	wheel->numTimers--;
+    }
+}
+
+/* Moves a wheel straight to a time beyond its span, as after the clock is
+ * set forward, rather than stepping through every second between. Every
+ * timer is placed again, adding those now due to the due list */
+static void jump(TimerWheel* wheel, unsigned int now, Timer** due) {
+    Timer* all = NULL;
+    for (unsigned int level = 0; level < TIMERWHEEL_LEVELS; level++) {
+        for (unsigned int i = 0; i < TIMERWHEEL_SLOTS; i++) {
+	    take_all(&(wheel->slots[level][i]), &all);
+	}
+    }
+    wheel->now = now;
+    while (all != NULL) {
+        Timer* timer = all;
+	all = timer->next;
+	if ((int)(timer->expiry - now) <= 0) {
+	    index_remove(wheel, timer);
+	    timer->next = *due;
+	    *due = timer;
+	    wheel->numTimers--;
+	} else {
+	    place(wheel, timer, timer->expiry);
+	}
+    }
+}
+
+Timer* timerwheel_advance(TimerWheel* wheel, unsigned int now) {
+    Timer* due = NULL;
+    if ((int)(now - wheel->now) > 0 && now - wheel->now >= TIMERWHEEL_SPAN) {
+        jump(wheel, now, &due);
+	return due;
+    }
+    while ((int)(now - wheel->now) > 0) {
+        wheel->now++;
+
+	// Each time a level wraps round, the timers in the next slot of the
+	// level above come within its range and are moved down
+	for (unsigned int level = 1; level < TIMERWHEEL_LEVELS
+		&& slot_index(wheel->now, level - 1) == 0; level++) {
+	    Timer* cascade = NULL;
+	    take_all(&(wheel->slots[level][slot_index(wheel->now, level)]),
+		    &cascade);
+	    while (cascade != NULL) {
+	        Timer* timer = cascade;
+		cascade = timer->next;
+		place(wheel, timer, timer->expiry);
+	    }
+	}
+
+	Timer** slot = &(wheel->slots[0][slot_index(wheel->now, 0)]);
+	while (*slot != NULL) {
+	    Timer* timer = *slot;
+	    *slot = timer->next;
+	    index_remove(wheel, timer);
+	    timer->next = due;
+	    due = timer;
+	    wheel->numTimers--;
+	}
+    }
+    return due;
+}
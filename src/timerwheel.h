@@ -0,0 +1,103 @@
+/*
+** timerwheel.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of levels in a wheel and the number of bits of time each covers.
+ * Level l holds timers due between 64^l and 64^(l + 1) seconds away, so
+ * four levels reach about 194 days. Timers due later wait in the last
+ * level and are moved back up until they are in range */
+#define TIMERWHEEL_LEVELS 4
+#define TIMERWHEEL_SLOT_BITS 6
+#define TIMERWHEEL_SLOTS (1u << TIMERWHEEL_SLOT_BITS)
+
+/* A key to look at once it is due to expire. expiry is in seconds since the
+ * Epoch. link points at whatever points at the timer in its slot, so it can
+ * be taken out without walking the list, and hash is that of the key */
+typedef struct Timer {
+    struct Timer* next;
+    struct Timer** link;
+    unsigned int expiry;
+    unsigned int hash;
+    char key[];
+} Timer;
+
+/* A hierarchical timing wheel with a resolution of one second. Each slot
+ * holds a list of the timers due in the interval it covers, and now is the
+ * last second the wheel has been advanced to. Adding a timer takes constant
+ * time, and each one is moved down a level at most once per level before
+ * it is due. index is an open addressing table of indexCapacity entries, at
+ * most half full, finding the timer of each key, so a key has at most one
+ * timer however many times it is given an expiry. Not thread safe, each
+ * user supplies its own locking */
+typedef struct {
+    Timer* slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+    unsigned int now;
+    size_t numTimers;
+    Timer** index;
+    size_t indexCapacity;
+} TimerWheel;
+
+/* timerwheel_init()
+* −−−−−−−−−−−−−−−
+* Sets up an empty wheel.
+*
+* wheel: the wheel to set up. Not NULL
+* now: the current time in seconds since the Epoch
+*/
+void timerwheel_init(TimerWheel* wheel, unsigned int now);
+
+/* timerwheel_destroy()
+* −−−−−−−−−−−−−−−
+* Frees every timer left in a wheel.
+*
+* wheel: the wheel to destroy. Not NULL
+*/
+void timerwheel_destroy(TimerWheel* wheel);
+
+/* timerwheel_add()
+* −−−−−−−−−−−−−−−
+* Sets the timer of a key, moving the one it already has if there is one. A
+* timer already due fires on the next advance.
+*
+* wheel: the wheel to add to. Not NULL
+* key: the key, copied into the timer. Not NULL
+* expiry: when the timer is due, in seconds since the Epoch
+*
+* Returns: false if memory cannot be allocated
+*/
+bool timerwheel_add(TimerWheel* wheel, const char* key, unsigned int expiry);
+
+/* timerwheel_cancel()
+* −−−−−−−−−−−−−−−
+* Removes the timer of a key, if it has one.
+*
+* wheel: the wheel to remove from. Not NULL
+* key: the key. Not NULL
+*/
+void timerwheel_cancel(TimerWheel* wheel, const char* key);
+
+/* timerwheel_advance()
+* −−−−−−−−−−−−−−−
+* Moves a wheel on to the given time, taking out every timer that has come
+* due.
+*
+* wheel: the wheel to advance. Not NULL
+* now: the current time in seconds since the Epoch. Earlier times are
+* ignored
+*
+* Returns: the list of timers due, linked through next, to be freed by the
+* caller. NULL if there are none
+*/
+Timer* timerwheel_advance(TimerWheel* wheel, unsigned int now);
+
+#endif
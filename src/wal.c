@@ -0,0 +1,440 @@
+/*
+** wal.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "wal.h"
+#include "crc32.h"
+
+/* Each record is a header followed by the store name, key and value bytes.
+ * The header holds a CRC-32 of everything after it, the record type, and the
+ * lengths of the store name, key and value. A WAL_PUT_EXPIRING record has the
+ * expiry between the header and the name. Integers are in host byte order */
+#define RECORD_CRC_SIZE 4
+#define RECORD_HEADER_SIZE (RECORD_CRC_SIZE + 1 + 1 + 4 + 4)
+#define RECORD_EXPIRY_SIZE 4
+
+/* Largest record replay will accept, anything larger must be damage */
+#define WAL_MAX_RECORD_SIZE (256u * 1024 * 1024)
+
+/* Size of the record buffer when it is first needed */
+#define WAL_INITIAL_CAPACITY (64 * 1024)
+
+/* Permissions of a new log file */
+#define WAL_FILE_MODE 0600
+
+/* Microseconds and nanoseconds per second */
+#define USEC_PER_SEC 1000000
+#define NSEC_PER_USEC 1000
+
+/* Writes all length bytes of data to fd. Returns false on error */
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t numWritten = write(fd, data, length);
+	if (numWritten < 0) {
+	    if (errno == EINTR) {
+	        continue;
+	    }
+	    return false;
+	}
+	data += numWritten;
+	length -= numWritten;
+    }
+    return true;
+}
+
+/* Reads exactly length bytes from a stream. Returns false at end of file */
+static bool read_exactly(FILE* file, char* data, size_t length) {
+    return fread(data, 1, length, file) == length;
+}
+
+/* Returns a path to the log file of the given generation, allocated with 
+ * malloc */
+static char* generation_path(const char* dir, unsigned long long generation) {
+    char* path = malloc(strlen(dir) + strlen(WAL_FILE_PREFIX) 
+	    + WAL_MAX_GENERATION_DIGITS + 2);
+    if (path != NULL) {
+        sprintf(path, "%s/%s%llu", dir, WAL_FILE_PREFIX, generation);
+    }
+    return path;
+}
+
+/* Sets *generations to the generations of the log files in dir in ascending
+ * order, allocated with malloc. Returns how many there are, or -1 if the 
+ * directory cannot be read */
+static long list_generations(const char* dir, 
+	unsigned long long** generations) {
+    DIR* directory = opendir(dir);
+    if (directory == NULL) {
+        return -1;
+    }
+    *generations = NULL;
+    long count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        const char* suffix = entry->d_name + strlen(WAL_FILE_PREFIX);
+	char* end;
+	if (strncmp(entry->d_name, WAL_FILE_PREFIX, strlen(WAL_FILE_PREFIX))
+		!= 0 || *suffix < '0' || *suffix > '9') {
+	    continue;
+	}
+	unsigned long long generation = strtoull(suffix, &end, 10);
+	unsigned long long* grown = realloc(*generations, 
+		(count + 1) * sizeof(unsigned long long));
+	if (*end != '\0' || grown == NULL) {
+	    continue;
+	}
+	*generations = grown;
+
+	// Insert in order, there are only ever a few
+	long i = count++;
+	for (; i > 0 && (*generations)[i - 1] > generation; i--) {
+	    (*generations)[i] = (*generations)[i - 1];
+	}
+	(*generations)[i] = generation;
+    }
+    closedir(directory);
+    return count;
+}
+
+/* Replays the records of one log file, newest if it is the last generation.
+ * See wal_replay() */
+static long replay_file(const char* path, unsigned long long generation,
+	bool newest, WalReplayFunction apply, void* arg) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    char header[RECORD_HEADER_SIZE];
+    char* record = NULL;
+    long numRecords = 0;
+    long validLength = 0;
+    bool damaged = false;
+    bool failed = false;
+    while (read_exactly(file, header, RECORD_HEADER_SIZE)) {
+        uint32_t crc;
+	uint32_t keyLength;
+	uint32_t valueLength;
+	unsigned char type = header[RECORD_CRC_SIZE];
+	unsigned char nameLength = header[RECORD_CRC_SIZE + 1];
+	memcpy(&crc, header, sizeof(crc));
+	memcpy(&keyLength, header + RECORD_CRC_SIZE + 2, sizeof(keyLength));
+	memcpy(&valueLength, header + RECORD_CRC_SIZE + 6,
+		sizeof(valueLength));
+	size_t extraLength = type == WAL_PUT_EXPIRING ? RECORD_EXPIRY_SIZE : 0;
+	size_t size = RECORD_HEADER_SIZE + extraLength + nameLength 
+		+ (size_t)keyLength + valueLength;
+	if ((type != WAL_PUT && type != WAL_DELETE && type != WAL_PUT_EXPIRING)
+		|| size > WAL_MAX_RECORD_SIZE) {
+	    break;
+	}
+
+	// Running short of memory says nothing about the file
+	char* grown = realloc(record, size);
+	if (grown == NULL) {
+	    failed = true;
+	    break;
+	}
+	record = grown;
+	memcpy(record, header, RECORD_HEADER_SIZE);
+	if (!read_exactly(file, record + RECORD_HEADER_SIZE,
+		size - RECORD_HEADER_SIZE) || crc32(0, record + RECORD_CRC_SIZE,
+		size - RECORD_CRC_SIZE) != crc) {
+	    break;
+	}
+
+	uint32_t expiry = 0;
+	if (type == WAL_PUT_EXPIRING) {
+	    memcpy(&expiry, record + RECORD_HEADER_SIZE, sizeof(expiry));
+	    type = WAL_PUT;
+	}
+
+	// Move the name and key back over the header to make room for their
+	// terminators, the value stays where it is
+	char* start = record + RECORD_HEADER_SIZE + extraLength;
+	char* value = start + nameLength + keyLength;
+	char* name = record;
+	memmove(name, start, nameLength);
+	name[nameLength] = '\0';
+	char* key = name + nameLength + 1;
+	memmove(key, start + nameLength, keyLength);
+	key[keyLength] = '\0';
+	apply(arg, generation, type, name, key, value, valueLength, expiry);
+	numRecords++;
+	validLength += size;
+    }
+    // A read error is not damage, anything read past the last whole record is
+    if (ferror(file)) {
+        failed = true;
+    } else if (ftell(file) != validLength) {
+        damaged = true;
+    }
+    free(record);
+    fclose(file);
+
+    // Only the newest generation can be left with a partly written last
+    // record, older ones were synced in full before the log moved on. Damage
+    // anywhere else would lose the records after it while later generations
+    // are replayed on top, so nothing is cut off
+    if (failed || (damaged && !newest)) {
+        return -1;
+    }
+    if (damaged && truncate(path, validLength) != 0) {
+        return -1;
+    }
+    return numRecords;
+}
+
+long wal_replay(const char* dir, WalReplayFunction apply, void* arg) {
+    unsigned long long* generations;
+    long numGenerations = list_generations(dir, &generations);
+    if (numGenerations < 0) {
+        return -1;
+    }
+    long numRecords = 0;
+    for (long i = 0; i < numGenerations && numRecords >= 0; i++) {
+        char* path = generation_path(dir, generations[i]);
+	long replayed = path == NULL ? -1 
+		: replay_file(path, generations[i], i == numGenerations - 1,
+		apply, arg);
+	numRecords = replayed < 0 ? -1 : numRecords + replayed;
+	free(path);
+    }
+    free(generations);
+    return numRecords;
+}
+
+/* Opens the log file of the given generation for appending, syncing the 
+ * directory so a new file survives a crash. Returns the file descriptor or
+ * -1 */
+static int open_generation(const char* dir, unsigned long long generation) {
+    char* path = generation_path(dir, generation);
+    if (path == NULL) {
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, WAL_FILE_MODE);
+    free(path);
+    int fdDir = open(dir, O_RDONLY);
+    if (fdDir < 0 || fsync(fdDir) != 0) {
+        if (fd >= 0) {
+	    close(fd);
+	}
+	fd = -1;
+    }
+    if (fdDir >= 0) {
+        close(fdDir);
+    }
+    return fd;
+}
+
+WriteAheadLog* wal_open(const char* dir, WalSyncMode syncMode,
+	unsigned int syncInterval) {
+    // Carry on appending to the newest generation
+    unsigned long long* generations;
+    long numGenerations = list_generations(dir, &generations);
+    if (numGenerations < 0) {
+        return NULL;
+    }
+    unsigned long long generation = 
+	    numGenerations > 0 ? generations[numGenerations - 1] : 1;
+    free(generations);
+
+    WriteAheadLog* log = malloc(sizeof(WriteAheadLog));
+    char* dirCopy = strdup(dir);
+    int fd = open_generation(dir, generation);
+    if (log == NULL || dirCopy == NULL || fd < 0) {
+        free(log);
+	free(dirCopy);
+	if (fd >= 0) {
+	    close(fd);
+	}
+	return NULL;
+    }
+    memset(log, 0, sizeof(WriteAheadLog));
+    log->dir = dirCopy;
+    log->generation = generation;
+    log->fd = fd;
+    log->syncMode = syncMode;
+    log->syncInterval = syncInterval;
+    pthread_mutex_init(&(log->lock), NULL);
+    pthread_cond_init(&(log->flushed), NULL);
+    return log;
+}
+
+/* Makes room for length more bytes in the record buffer. Returns false if
+ * memory cannot be allocated */
+static bool reserve(WriteAheadLog* log, size_t length) {
+    if (log->length + length <= log->capacity) {
+        return true;
+    }
+    size_t capacity = log->capacity == 0 ? WAL_INITIAL_CAPACITY
+	    : log->capacity;
+    while (capacity < log->length + length) {
+        capacity *= 2;
+    }
+    char* buffer = realloc(log->buffer, capacity);
+    if (buffer == NULL) {
+        return false;
+    }
+    log->buffer = buffer;
+    log->capacity = capacity;
+    return true;
+}
+
+/* Writes out every buffered record, syncing unless the mode is
+ * WAL_SYNC_NONE. Called with the lock held by a thread that is not already
+ * flushing. The lock is released during the write, with the spare buffer
+ * taking new records meanwhile */
+static void flush(WriteAheadLog* log) {
+    log->flushing = true;
+    if (log->syncMode == WAL_SYNC_BATCH && log->syncInterval > 0) {
+        // Give other writers a chance to join this write
+        struct timespec delay = {log->syncInterval / USEC_PER_SEC,
+		(log->syncInterval % USEC_PER_SEC) * NSEC_PER_USEC};
+	pthread_mutex_unlock(&(log->lock));
+	nanosleep(&delay, NULL);
+	pthread_mutex_lock(&(log->lock));
+    }
+    char* buffer = log->buffer;
+    size_t length = log->length;
+    size_t capacity = log->capacity;
+    unsigned long long last = log->appended;
+    log->buffer = log->spare;
+    log->capacity = log->spareCapacity;
+    log->length = 0;
+    log->spare = NULL;
+    log->spareCapacity = 0;
+
+    pthread_mutex_unlock(&(log->lock));
+    bool written = write_all(log->fd, buffer, length)
+	    && (log->syncMode == WAL_SYNC_NONE || fdatasync(log->fd) == 0);
+    pthread_mutex_lock(&(log->lock));
+
+    free(log->spare);
+    log->spare = buffer;
+    log->spareCapacity = capacity;
+    if (written) {
+        log->written = last;
+    } else {
+        log->failed = true;
+    }
+    log->flushing = false;
+    pthread_cond_broadcast(&(log->flushed));
+}
+
+unsigned long long wal_append(WriteAheadLog* log, WalRecordType type,
+	const char* store, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry) {
+    uint32_t keyLength = strlen(key);
+    uint32_t valueLength32 = valueLength;
+    uint32_t expiry32 = expiry;
+    unsigned char nameLength = strlen(store);
+    if (type == WAL_PUT && expiry != 0) {
+        type = WAL_PUT_EXPIRING;
+    }
+    size_t extraLength = type == WAL_PUT_EXPIRING ? RECORD_EXPIRY_SIZE : 0;
+    size_t size = RECORD_HEADER_SIZE + extraLength + nameLength + keyLength 
+	    + valueLength;
+
+    pthread_mutex_lock(&(log->lock));
+    unsigned long long record = ++log->appended;
+    if (!reserve(log, size)) {
+        log->failed = true;
+	pthread_mutex_unlock(&(log->lock));
+	return record;
+    }
+    char* out = log->buffer + log->length;
+    out[RECORD_CRC_SIZE] = type;
+    out[RECORD_CRC_SIZE + 1] = nameLength;
+    memcpy(out + RECORD_CRC_SIZE + 2, &keyLength, sizeof(keyLength));
+    memcpy(out + RECORD_CRC_SIZE + 6, &valueLength32, sizeof(valueLength32));
+    char* data = out + RECORD_HEADER_SIZE;
+    if (extraLength > 0) {
+        memcpy(data, &expiry32, sizeof(expiry32));
+	data += extraLength;
+    }
+    memcpy(data, store, nameLength);
+    memcpy(data + nameLength, key, keyLength);
+    if (valueLength > 0) {
+        memcpy(data + nameLength + keyLength, value, valueLength);
+    }
+    uint32_t crc = crc32(0, out + RECORD_CRC_SIZE, size - RECORD_CRC_SIZE);
+    memcpy(out, &crc, sizeof(crc));
+    log->length += size;
+    pthread_mutex_unlock(&(log->lock));
+    return record;
+}
+
+bool wal_commit(WriteAheadLog* log, unsigned long long record) {
+    pthread_mutex_lock(&(log->lock));
+    while (log->written < record && !log->failed) {
+        // Lead the next write unless one is already under way
+        if (log->flushing) {
+	    pthread_cond_wait(&(log->flushed), &(log->lock));
+	} else {
+	    flush(log);
+	}
+    }
+    bool written = log->written >= record;
+    pthread_mutex_unlock(&(log->lock));
+    return written;
+}
+
+unsigned long long wal_rotate(WriteAheadLog* log) {
+    pthread_mutex_lock(&(log->lock));
+    while (log->flushing) {
+        pthread_cond_wait(&(log->flushed), &(log->lock));
+    }
+
+    // Everything buffered so far belongs to the old generation. Appends wait
+    // for the lock until the new file is in place
+    unsigned long long generation = 0;
+    int fd = -1;
+    if (!log->failed && write_all(log->fd, log->buffer, log->length) 
+	    && fdatasync(log->fd) == 0
+	    && (fd = open_generation(log->dir, log->generation + 1)) >= 0) {
+        close(log->fd);
+	log->fd = fd;
+	log->length = 0;
+	log->written = log->appended;
+	generation = ++log->generation;
+	pthread_cond_broadcast(&(log->flushed));
+    }
+    pthread_mutex_unlock(&(log->lock));
+    return generation;
+}
+
+void wal_remove_before(WriteAheadLog* log, unsigned long long generation) {
+    unsigned long long* generations;
+    long numGenerations = list_generations(log->dir, &generations);
+    for (long i = 0; i < numGenerations && generations[i] < generation; i++) {
+        char* path = generation_path(log->dir, generations[i]);
+	if (path != NULL) {
+	    unlink(path);
+	}
+	free(path);
+    }
+    if (numGenerations >= 0) {
+        free(generations);
+    }
+}
+
+unsigned long long wal_appended(WriteAheadLog* log) {
+    pthread_mutex_lock(&(log->lock));
+    unsigned long long appended = log->appended;
+    pthread_mutex_unlock(&(log->lock));
+    return appended;
+}
@@ -0,0 +1,185 @@
+/*
+** wal.h
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+*/
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* Names of the log files within the data directory, followed by their
+ * generation number */
+#define WAL_FILE_PREFIX "wal."
+
+/* Number of bytes needed to write the largest generation number in decimal */
+#define WAL_MAX_GENERATION_DIGITS 20
+
+/* How far a change must reach before the request making it is answered */
+typedef enum {
+    WAL_SYNC_NONE,  // written to the file, not synced
+    WAL_SYNC_BATCH, // synced together with the changes made alongside it
+    WAL_SYNC_OP     // synced at once, without waiting for others to join
+} WalSyncMode;
+
+/* Types of change recorded in the log. A WAL_PUT of a key that expires is
+ * written as WAL_PUT_EXPIRING, so records of keys that never expire are no
+ * larger, but is appended and replayed as a WAL_PUT */
+typedef enum {
+    WAL_PUT = 1,
+    WAL_DELETE = 2,
+    WAL_PUT_EXPIRING = 3
+} WalRecordType;
+
+/* An append-only log of changes to the stores.
+ *
+ * Records are appended to buffer in the order the changes were made. The
+ * first thread waiting for its records to be written becomes the leader,
+ * writing and syncing everything buffered so far in one go while the threads
+ * that arrive meanwhile wait on flushed. Each record is numbered, appended is
+ * the number of the last record buffered and written the number of the last
+ * record written out (and synced, unless the mode is WAL_SYNC_NONE).
+ *
+ * The log is split into numbered generations, one file each, in the 
+ * directory dir. Records are appended to the file of the current generation,
+ * and wal_rotate() moves on to a new one so older files can be removed once
+ * their changes have been saved elsewhere */
+typedef struct {
+    int fd;
+    char* dir;
+    unsigned long long generation;
+    WalSyncMode syncMode;
+    unsigned int syncInterval;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+    char* buffer;
+    size_t length;
+    size_t capacity;
+    char* spare;
+    size_t spareCapacity;
+    unsigned long long appended;
+    unsigned long long written;
+    bool flushing;
+    bool failed;
+} WriteAheadLog;
+
+/* Called for each record when a log is replayed. expiry is when a key put
+ * expires in seconds since the Epoch, 0 if it never does */
+typedef void (*WalReplayFunction)(void* arg, unsigned long long generation,
+	WalRecordType type,
+	const char* store, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry);
+
+/* wal_replay()
+* −−−−−−−−−−−−−−−
+* Replays every record of a log in the order it was written, oldest 
+* generation first.
+*
+* Replay of the newest generation stops at the first record that is
+* incomplete or fails its checksum, as left by a crash part way through a
+* write, and the file is truncated there so later records are not appended
+* after the damage. Older generations were synced in full before the log
+* moved on, so damage in one of them fails the replay and leaves the file as
+* it is.
+*
+* dir: the directory holding the log files. Not NULL
+* apply: called with each record and the generation of the file it is in. The
+* strings passed are only valid for the duration of the call. Not NULL
+* arg: passed to apply
+*
+* Returns: the number of records replayed, -1 if a file cannot be read or
+* truncated, memory cannot be allocated, or a generation other than the
+* newest is damaged
+*/
+long wal_replay(const char* dir, WalReplayFunction apply, void* arg);
+
+/* wal_open()
+* −−−−−−−−−−−−−−−
+* Opens a log to append records to, continuing its newest generation or 
+* creating generation 1 if the directory holds none.
+*
+* dir: the directory holding the log files. Not NULL
+* syncMode: how far records must reach before wal_commit() returns
+* syncInterval: for WAL_SYNC_BATCH, the number of microseconds a leader waits
+* for more records to join its write before syncing. 0 to write at once
+*
+* Returns: the log, NULL if the file cannot be opened
+*/
+WriteAheadLog* wal_open(const char* dir, WalSyncMode syncMode,
+	unsigned int syncInterval);
+
+/* wal_append()
+* −−−−−−−−−−−−−−−
+* Adds a record of a change to the log.
+*
+* This is called while the change is being made under the store's lock, so
+* the records of each key are in the same order as its changes. Records are
+* only buffered here, in every sync mode, so nothing is written or synced
+* while the lock is held. wal_commit() waits for them to be written.
+*
+* log: the log to add to. Not NULL
+* type: the type of change
+* store: the name of the store changed. Not NULL
+* key: the key changed. Not NULL
+* value: the valueLength bytes stored by a WAL_PUT, NULL for a WAL_DELETE
+* valueLength: the number of bytes in value
+* expiry: when a key put expires in seconds since the Epoch, 0 if it never
+* does or for a WAL_DELETE
+*
+* Returns: the number of the record, passed to wal_commit()
+*/
+unsigned long long wal_append(WriteAheadLog* log, WalRecordType type,
+	const char* store, const char* key, const char* value,
+	size_t valueLength, unsigned int expiry);
+
+/* wal_commit()
+* −−−−−−−−−−−−−−−
+* Waits until a record and every record before it have been written to the
+* log, as far as its sync mode requires.
+*
+* The caller must not hold any store locks, so other changes can be appended
+* while it waits and be written along with its record.
+*
+* log: the log the record was added to. Not NULL
+* record: the number wal_append() returned for the record
+*
+* Returns: true if the record was written, false if writing the log has
+* failed
+*/
+bool wal_commit(WriteAheadLog* log, unsigned long long record);
+
+/* wal_rotate()
+* −−−−−−−−−−−−−−−
+* Starts a new generation of the log.
+*
+* Every record appended before the call is written and synced to the file of
+* the old generation, and every record appended after it goes to the new one.
+*
+* log: the log to rotate. Not NULL
+*
+* Returns: the new generation, 0 if the log could not be rotated
+*/
+unsigned long long wal_rotate(WriteAheadLog* log);
+
+/* wal_remove_before()
+* −−−−−−−−−−−−−−−
+* Deletes the files of every generation older than the one given.
+*
+* log: the log to trim. Not NULL
+* generation: the oldest generation to keep
+*/
+void wal_remove_before(WriteAheadLog* log, unsigned long long generation);
+
+/* wal_appended()
+* −−−−−−−−−−−−−−−
+* Returns: the number of the last record appended to a log, 0 if there are
+* none
+*/
+unsigned long long wal_appended(WriteAheadLog* log);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+** stresstest.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+**
+** Usage:
+**      stresstest
+** Runs threads that PUT and DELETE keys of a StringStore, serialised by a
+** lock as the server's writers are, against threads that GET the same keys
+** with stringstore_retrieve_unlocked() and no lock at all. Built with
+** ThreadSanitizer by "make stress", which then reports any data race. Every
+** value read is checked to be one a writer stored for its key. Exits with
+** status 1 if any was not.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "stringstore.h"
+
+/* Number of threads of each kind and operations each performs */
+#define NUM_WRITERS 2
+#define NUM_READERS 4
+#define WRITER_OPS 200000
+#define READER_OPS 400000
+
+/* Few enough keys that readers and writers keep meeting, and enough that
+ * the table resizes while they do */
+#define NUM_KEYS 512
+
+/* Longest key and value made, including the null terminator. Values are
+ * stored inline up to STRINGSTORE_INLINE_SIZE and in entries beyond it */
+#define KEY_SIZE 16
+#define VALUE_SIZE 160
+
+/* Shared by every thread. writeLock serialises the writers */
+typedef struct {
+    StringStore* store;
+    pthread_mutex_t writeLock;
+    int numBad;
+} Stress;
+
+/* Per-thread arguments */
+typedef struct {
+    Stress* stress;
+    unsigned int seed;
+} StressThread;
+
+/* The character every value stored for key number i is made of */
+static char value_char(int i) {
+    return 'a' + i % 26;
+}
+
+/* Writes a value for key number i of the given length into value */
+static void make_value(char* value, int i, size_t length) {
+    memset(value, value_char(i), length);
+    value[length] = '\0';
+}
+
+/* Returns whether a value read for key number i is one a writer stored */
+static bool value_valid(const char* value, size_t length, int i) {
+    if (length == 0 || length >= VALUE_SIZE || value[length] != '\0') {
+        return false;
+    }
+    for (size_t j = 0; j < length; j++) {
+        if (value[j] != value_char(i)) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+/* Puts and deletes random keys under the write lock */
+static void* writer_thread(void* arg) {
+    StressThread* thread = arg;
+    Stress* stress = thread->stress;
+    char key[KEY_SIZE];
+    char value[VALUE_SIZE];
+    for (int op = 0; op < WRITER_OPS; op++) {
+        int i = rand_r(&(thread->seed)) % NUM_KEYS;
+	sprintf(key, "key%d", i);
+	pthread_mutex_lock(&(stress->writeLock));
+	if (rand_r(&(thread->seed)) % 4 == 0) {
+	    stringstore_delete(stress->store, key);
+	} else {
+	    size_t length = 1 + rand_r(&(thread->seed)) % (VALUE_SIZE - 1);
+	    make_value(value, i, length);
+	    stringstore_add(stress->store, key, value);
+	}
+	pthread_mutex_unlock(&(stress->writeLock));
+    }
+    return NULL;
+}
+
+/* Gets random keys without any lock, checking each value found */
+static void* reader_thread(void* arg) {
+    StressThread* thread = arg;
+    Stress* stress = thread->stress;
+    char key[KEY_SIZE];
+    char copy[STRINGSTORE_INLINE_SIZE];
+    int numBad = 0;
+    for (int op = 0; op < READER_OPS; op++) {
+        int i = rand_r(&(thread->seed)) % NUM_KEYS;
+	sprintf(key, "key%d", i);
+	size_t length;
+	KeyValue* pin;
+	const char* value = stringstore_retrieve_unlocked(stress->store, key,
+		copy, &length, &pin);
+	if (value != NULL && !value_valid(value, length, i)) {
+	    numBad++;
+	}
+	if (pin != NULL) {
+	    stringstore_unpin(pin);
+	}
+    }
+    __atomic_add_fetch(&(stress->numBad), numBad, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+int main(void) {
+    Stress stress = {.store = stringstore_init(), .numBad = 0};
+    pthread_mutex_init(&(stress.writeLock), NULL);
+    pthread_t threads[NUM_WRITERS + NUM_READERS];
+    StressThread args[NUM_WRITERS + NUM_READERS];
+    for (int t = 0; t < NUM_WRITERS + NUM_READERS; t++) {
+        args[t].stress = &stress;
+	args[t].seed = t + 1;
+	pthread_create(&threads[t], NULL,
+		t < NUM_WRITERS ? writer_thread : reader_thread, &args[t]);
+    }
+    for (int t = 0; t < NUM_WRITERS + NUM_READERS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Once the threads are done every key must still read back whole
+    char key[KEY_SIZE];
+    for (int i = 0; i < NUM_KEYS; i++) {
+        sprintf(key, "key%d", i);
+	const char* value = stringstore_retrieve(stress.store, key);
+	if (value != NULL && !value_valid(value, strlen(value), i)) {
+	    stress.numBad++;
+	}
+    }
+    printf("%s: %d values read were not stored for their key\n",
+	    stress.numBad == 0 ? "PASS" : "FAIL", stress.numBad);
+    stringstore_free(stress.store);
+    return stress.numBad == 0 ? 0 : 1;
+}
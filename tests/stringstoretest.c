@@ -0,0 +1,143 @@
+/*
+** stringstoretest.c
+**      CSSE2310/7231 - Assignment Four - 2022 - Semester One
+**
+**      Written by Jamie Katsamatsas, j.katsamatsas@uq.net.au
+**      s4674720
+**
+** Usage:
+**      stringstoretest
+** Checks the memory a StringStore counts for its keys when keys are
+** overwritten while the table is being resized, and that overwriting a key
+** in a store at its memory limit evicts nothing. Prints each check and exits
+** with status 1 if any failed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "stringstore.h"
+
+/* Number of keys added before the table resizes, and the most overwritten
+ * while it does */
+#define MAX_KEYS 1000
+#define NUM_OVERWRITES 4
+
+/* Longest key made by the tests, including its null terminator */
+#define KEY_SIZE 16
+
+/* Value too long to be stored inline in a bucket */
+#define LONG_VALUE "a value far too long to be stored inline in a bucket " \
+	"of the hash index"
+
+/* Number of checks that failed */
+static int numFailed = 0;
+
+/* Reports a check, counting it if it failed */
+static void check(bool passed, const char* what) {
+    printf("%s: %s\n", passed ? "PASS" : "FAIL", what);
+    numFailed += !passed;
+}
+
+/* Adds each key visited to the store given as arg */
+static void copy_key(void* arg, const char* key, unsigned int hash,
+	const char* value, size_t valueLength, unsigned int expiry) {
+    stringstore_add_expiring((StringStore*)arg, key, value, valueLength,
+	    expiry);
+}
+
+/* Returns the memory a new store holding the same keys counts for them */
+static size_t rebuilt_bytes(StringStore* store) {
+    StringStore* copy = stringstore_init();
+    stringstore_for_each(store, copy_key, copy);
+    size_t bytes = stringstore_bytes(copy);
+    stringstore_free(copy);
+    return bytes;
+}
+
+/* Adds keys until the store starts a resize. Returns the number added */
+static int fill_until_resizing(StringStore* store) {
+    char key[KEY_SIZE];
+    int numKeys = 0;
+    while (store->oldTable.slots == NULL && numKeys < MAX_KEYS) {
+        sprintf(key, "k%d", numKeys++);
+	stringstore_add(store, key, "v");
+    }
+    return numKeys;
+}
+
+/* Copies up to max keys still waiting in the old table of a resizing store
+ * into keys, taking them from the end that is moved across last. Returns the
+ * number copied */
+static int keys_in_old_table(StringStore* store, char keys[][KEY_SIZE],
+	int max) {
+    int count = 0;
+    for (unsigned int i = store->oldTable.capacity; i-- > 0 && count < max;) {
+        StringStoreSlot* slot = &(store->oldTable.slots[i]);
+	if (slot->state == SLOT_INLINE) {
+	    strcpy(keys[count++], slot->contents.data);
+	} else if (slot->state == SLOT_HEAP) {
+	    strcpy(keys[count++], slot->contents.entry->data);
+	}
+    }
+    return count;
+}
+
+/* Overwrites keys not yet moved out of the old table during a resize, first
+ * with values of the same size and then with longer ones, checking the
+ * memory counted against a store built from scratch */
+static void test_overwrite_during_resize(void) {
+    StringStore* store = stringstore_init();
+    fill_until_resizing(store);
+    size_t before = stringstore_bytes(store);
+    char keys[NUM_OVERWRITES][KEY_SIZE];
+    int count = keys_in_old_table(store, keys, NUM_OVERWRITES);
+    check(count == NUM_OVERWRITES, "keys wait in the old table");
+
+    for (int i = 0; i < count; i++) {
+        stringstore_add(store, keys[i], "w");
+    }
+    check(stringstore_bytes(store) == before,
+	    "same size overwrites during a resize leave the bytes alone");
+    check(stringstore_bytes(store) == rebuilt_bytes(store),
+	    "bytes match a rebuilt store after same size overwrites");
+
+    // Resize again so the longer values go to keys in the old table
+    fill_until_resizing(store);
+    count = keys_in_old_table(store, keys, NUM_OVERWRITES);
+    for (int i = 0; i < count; i++) {
+        stringstore_add(store, keys[i], LONG_VALUE);
+    }
+    check(stringstore_bytes(store) == rebuilt_bytes(store),
+	    "bytes match a rebuilt store after longer overwrites");
+    stringstore_free(store);
+}
+
+/* Overwrites keys of a store filled to its limit with values of the same
+ * size, which need no more room */
+static void test_overwrite_at_limit(void) {
+    StringStore* store = stringstore_init();
+    int numKeys = fill_until_resizing(store);
+    stringstore_set_limit(store, stringstore_bytes(store));
+    char key[KEY_SIZE];
+    for (int i = 0; i < numKeys; i++) {
+        sprintf(key, "k%d", i);
+	stringstore_add(store, key, "x");
+    }
+    check(stringstore_evicted(store) == 0,
+	    "overwrites at the limit evict nothing");
+    bool allPresent = true;
+    for (int i = 0; i < numKeys; i++) {
+        sprintf(key, "k%d", i);
+	allPresent = allPresent && stringstore_retrieve(store, key) != NULL;
+    }
+    check(allPresent, "every key overwritten at the limit is kept");
+    stringstore_free(store);
+}
+
+int main(void) {
+    test_overwrite_during_resize();
+    test_overwrite_at_limit();
+    return numFailed == 0 ? 0 : 1;
+}